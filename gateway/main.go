@@ -3,7 +3,10 @@ package main
 import (
 	"context"
 	"flag"
+	"fmt"
 	"net/http"
+	"strings"
+	"time"
 
 	"github.com/golang/glog"
 	"google.golang.org/grpc"
@@ -14,11 +17,27 @@ import (
 
 var (
 	// command-line options:
-	// gRPC server endpoint
-	grpcServerEndpoint = flag.String("grpc-server", "127.0.0.1:8888", "gRPC server endpoint")
+	// gRPC server endpoints
+	grpcServerEndpoint = flag.String("grpc-server", "127.0.0.1:8888", "gRPC server endpoints of the replicas, comma separated list")
 	httpServerEndpoint = flag.String("http-server", "0.0.0.0:8080", "HTTP server endpoint")
+
+	// prefix cache aware routing
+	summaryServerEndpoint = flag.String("summary-server", "", "HTTP server endpoints of the replicas serving the prefix cache summary, comma separated list in the same order as -grpc-server, empty to route round-robin")
+	summaryInterval       = flag.Duration("summary-interval", time.Second, "interval to refresh the prefix cache summaries")
+	summaryChunkSize      = flag.Int("summary-chunk-size", 64, "size of the text chunks in the prefix cache summaries")
+	maxImbalance          = flag.Int64("max-imbalance", 16, "maximum number of requests in flight on a replica over the least loaded one, 0 for no limit")
 )
 
+func splitEndpoints(endpoints string) []string {
+	var result []string
+	for _, endpoint := range strings.Split(endpoints, ",") {
+		if endpoint = strings.TrimSpace(endpoint); endpoint != "" {
+			result = append(result, endpoint)
+		}
+	}
+	return result
+}
+
 func run() error {
 	ctx := context.Background()
 	ctx, cancel := context.WithCancel(ctx)
@@ -29,21 +48,41 @@ func run() error {
 	handler := NewHttpHandler(&gw.JSONPb{})
 	// TODO: add TLS credentials
 	opts := []grpc.DialOption{grpc.WithTransportCredentials(insecure.NewCredentials())}
+	endpoints := splitEndpoints(*grpcServerEndpoint)
+	if len(endpoints) == 0 {
+		return fmt.Errorf("no grpc server endpoint")
+	}
+	var summaryURLs []string
+	for _, endpoint := range splitEndpoints(*summaryServerEndpoint) {
+		summaryURLs = append(summaryURLs, "http://"+endpoint+"/prefix_cache/summary")
+	}
+	if len(summaryURLs) > 0 && len(summaryURLs) != len(endpoints) {
+		return fmt.Errorf("expected %d summary server endpoints, got %d", len(endpoints), len(summaryURLs))
+	}
+	replicas, err := DialReplicas(ctx, endpoints, summaryURLs, opts)
+	if err != nil {
+		glog.Error("Failed to connect to grpc servers ", err)
+		return err
+	}
+	router := NewRouter(replicas, *summaryChunkSize, *maxImbalance)
+	if len(summaryURLs) > 0 {
+		go router.Run(ctx, *summaryInterval)
+	}
 	// register completion handler
-	err := RegisterCompletionHandlerFromEndpoint(ctx, handler, *grpcServerEndpoint, opts)
+	err = RegisterCompletionHandlerClient(ctx, handler, router.CompletionClient())
 	if err != nil {
-		glog.Error("Failed to register completion handler from endpoint ", err)
+		glog.Error("Failed to register completion handler ", err)
 		return err
 	}
-	glog.Info("Register grpc server at ", *grpcServerEndpoint)
+	glog.Info("Register grpc servers at ", endpoints)
 	// register chat handler
-	err = RegisterChatHandlerFromEndpoint(ctx, handler, *grpcServerEndpoint, opts)
+	err = RegisterChatHandlerClient(ctx, handler, router.ChatClient())
 	if err != nil {
-		glog.Error("Failed to register chat handler from endpoint ", err)
+		glog.Error("Failed to register chat handler ", err)
 		return err
 	}
-	// register models handler
-	err = RegisterModelsHandlerFromEndpoint(ctx, handler, *grpcServerEndpoint, opts)
+	// register models handler, the replicas serve the same models
+	err = RegisterModelsHandlerFromEndpoint(ctx, handler, endpoints[0], opts)
 	if err != nil {
 		glog.Error("Failed to register models handler from endpoint ", err)
 		return err
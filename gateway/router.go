@@ -0,0 +1,412 @@
+package main
+
+import (
+	"context"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"io"
+	"net/http"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/golang/glog"
+	"google.golang.org/grpc"
+
+	// importing generated stubs
+	scalellm "gateway/proto"
+)
+
+const (
+	fnvOffsetBasis uint64 = 14695981039346656037
+	fnvPrime       uint64 = 1099511628211
+
+	// the version of the prefix cache summary
+	prefixSummaryVersion = 1
+
+	// the maximum number of chunk hashes routed to a replica between two
+	// refreshes of its summary
+	maxRoutedChunks = 1 << 16
+)
+
+func fnv1a(hash uint64, data string) uint64 {
+	for i := 0; i < len(data); i++ {
+		hash ^= uint64(data[i])
+		hash *= fnvPrime
+	}
+	return hash
+}
+
+// ChunkHashes returns the hash chain of the full text chunks, which matches
+// PrefixCacheSummary::chunk_hashes in the engine.
+func ChunkHashes(key string, text string, chunkSize int) []uint64 {
+	hash := fnv1a(fnv1a(fnvOffsetBasis, key), "\x00")
+	hashes := make([]uint64, 0, len(text)/chunkSize)
+	for i := 0; i+chunkSize <= len(text); i += chunkSize {
+		hash = fnv1a(hash, text[i:i+chunkSize])
+		hashes = append(hashes, hash)
+	}
+	return hashes
+}
+
+// ChatRoutingText returns the text of the conversation to route requests on,
+// the role and content of each message ended by newlines, as in the engine.
+func ChatRoutingText(messages []*scalellm.ChatMessage) string {
+	var b strings.Builder
+	for _, message := range messages {
+		b.WriteString(message.GetRole())
+		b.WriteByte('\n')
+		b.WriteString(message.GetContent())
+		b.WriteByte('\n')
+	}
+	return b.String()
+}
+
+// PrefixSummary is a bloom filter of the text chunks resident in the prefix
+// cache of a replica, published at /prefix_cache/summary.
+type PrefixSummary struct {
+	Version      int      `json:"version"`
+	ChunkSize    int      `json:"chunk_size"`
+	NumHashes    uint32   `json:"num_hashes"`
+	NumBits      uint64   `json:"num_bits"`
+	Bits         string   `json:"bits"`
+	LoraAdapters []string `json:"lora_adapters"`
+
+	bits []byte
+}
+
+// ParsePrefixSummary decodes and validates the summary published by a replica.
+func ParsePrefixSummary(data []byte) (*PrefixSummary, error) {
+	var summary PrefixSummary
+	if err := json.Unmarshal(data, &summary); err != nil {
+		return nil, err
+	}
+	if summary.Version != prefixSummaryVersion {
+		return nil, fmt.Errorf("unsupported prefix summary version %d", summary.Version)
+	}
+	if summary.ChunkSize <= 0 || summary.NumHashes == 0 || summary.NumBits == 0 {
+		return nil, fmt.Errorf("invalid prefix summary")
+	}
+	bits, err := hex.DecodeString(summary.Bits)
+	if err != nil {
+		return nil, err
+	}
+	if uint64(len(bits))*8 != summary.NumBits {
+		return nil, fmt.Errorf("prefix summary has %d bits, expected %d", len(bits)*8, summary.NumBits)
+	}
+	summary.bits = bits
+	return &summary, nil
+}
+
+// Contains returns whether the chunk hash may be resident on the replica.
+func (s *PrefixSummary) Contains(hash uint64) bool {
+	step := (hash >> 32) | 1
+	for i := uint32(0); i < s.NumHashes; i++ {
+		bit := (hash + uint64(i)*step) % s.NumBits
+		if s.bits[bit/8]&(1<<(bit%8)) == 0 {
+			return false
+		}
+	}
+	return true
+}
+
+// Replica is a serving engine behind the gateway.
+type Replica struct {
+	endpoint   string
+	summaryURL string
+	completion scalellm.CompletionClient
+	chat       scalellm.ChatClient
+
+	// the number of requests in flight
+	inflight int64
+
+	mu      sync.Mutex
+	summary *PrefixSummary
+
+	// the chunks routed to the replica since the last two refreshes, which
+	// may not be in the summary yet
+	routed     map[uint64]struct{}
+	prevRouted map[uint64]struct{}
+}
+
+func NewReplica(endpoint string, summaryURL string, completion scalellm.CompletionClient, chat scalellm.ChatClient) *Replica {
+	return &Replica{
+		endpoint:   endpoint,
+		summaryURL: summaryURL,
+		completion: completion,
+		chat:       chat,
+		routed:     make(map[uint64]struct{}),
+		prevRouted: make(map[uint64]struct{}),
+	}
+}
+
+// matchLength returns the number of leading chunks predicted to be resident.
+func (r *Replica) matchLength(hashes []uint64) int {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	for i, hash := range hashes {
+		if r.summary != nil && r.summary.Contains(hash) {
+			continue
+		}
+		if _, ok := r.routed[hash]; ok {
+			continue
+		}
+		if _, ok := r.prevRouted[hash]; ok {
+			continue
+		}
+		return i
+	}
+	return len(hashes)
+}
+
+func (r *Replica) addRouted(hashes []uint64) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	if len(r.routed)+len(hashes) > maxRoutedChunks {
+		r.prevRouted = r.routed
+		r.routed = make(map[uint64]struct{})
+	}
+	for _, hash := range hashes {
+		r.routed[hash] = struct{}{}
+	}
+}
+
+func (r *Replica) setSummary(summary *PrefixSummary) {
+	r.mu.Lock()
+	defer r.mu.Unlock()
+	r.summary = summary
+	r.prevRouted = r.routed
+	r.routed = make(map[uint64]struct{})
+}
+
+func (r *Replica) acquire() {
+	atomic.AddInt64(&r.inflight, 1)
+}
+
+func (r *Replica) release() {
+	atomic.AddInt64(&r.inflight, -1)
+}
+
+func (r *Replica) numInflight() int64 {
+	return atomic.LoadInt64(&r.inflight)
+}
+
+// Router picks the replica to serve a request. It routes the request to the
+// replica with the longest predicted prefix cache match, breaking ties by the
+// number of requests in flight and then round-robin. A replica with more than
+// maxImbalance requests in flight over the least loaded one is skipped.
+type Router struct {
+	replicas     []*Replica
+	chunkSize    int
+	maxImbalance int64
+
+	// the next replica to start with, for round-robin
+	next uint64
+
+	mu           sync.RWMutex
+	loraAdapters map[string]bool
+}
+
+func NewRouter(replicas []*Replica, chunkSize int, maxImbalance int64) *Router {
+	return &Router{
+		replicas:     replicas,
+		chunkSize:    chunkSize,
+		maxImbalance: maxImbalance,
+		loraAdapters: make(map[string]bool),
+	}
+}
+
+// the key of the hash chains, the lora adapter or empty for the base model
+func (r *Router) key(model string) string {
+	r.mu.RLock()
+	defer r.mu.RUnlock()
+	if r.loraAdapters[model] {
+		return model
+	}
+	return ""
+}
+
+// Pick returns the replica to serve the request, which must be released once
+// the request is done.
+func (r *Router) Pick(model string, text string) *Replica {
+	hashes := ChunkHashes(r.key(model), text, r.chunkSize)
+	minInflight := r.replicas[0].numInflight()
+	for _, replica := range r.replicas[1:] {
+		if n := replica.numInflight(); n < minInflight {
+			minInflight = n
+		}
+	}
+
+	start := atomic.AddUint64(&r.next, 1) - 1
+	var best *Replica
+	bestMatch := -1
+	for i := range r.replicas {
+		replica := r.replicas[(start+uint64(i))%uint64(len(r.replicas))]
+		inflight := replica.numInflight()
+		if r.maxImbalance > 0 && inflight > minInflight+r.maxImbalance {
+			continue
+		}
+		match := 0
+		if len(hashes) > 0 {
+			match = replica.matchLength(hashes)
+		}
+		if match > bestMatch || (match == bestMatch && inflight < best.numInflight()) {
+			best = replica
+			bestMatch = match
+		}
+	}
+	if best == nil {
+		// the loads changed while picking
+		best = r.replicas[start%uint64(len(r.replicas))]
+	}
+	if len(hashes) > 0 {
+		best.addRouted(hashes)
+	}
+	best.acquire()
+	return best
+}
+
+// Refresh fetches the summaries of the replicas.
+func (r *Router) Refresh(ctx context.Context, client *http.Client) {
+	for _, replica := range r.replicas {
+		if replica.summaryURL == "" {
+			continue
+		}
+		summary, err := fetchPrefixSummary(ctx, client, replica.summaryURL)
+		if err != nil {
+			glog.Warningf("Failed to fetch prefix summary from %s: %v", replica.summaryURL, err)
+			continue
+		}
+		if summary.ChunkSize != r.chunkSize {
+			glog.Warningf("Prefix summary from %s has chunk size %d, expected %d", replica.summaryURL, summary.ChunkSize, r.chunkSize)
+			continue
+		}
+		r.mu.Lock()
+		for _, adapter := range summary.LoraAdapters {
+			r.loraAdapters[adapter] = true
+		}
+		r.mu.Unlock()
+		replica.setSummary(summary)
+	}
+}
+
+// Run refreshes the summaries periodically until the context is done.
+func (r *Router) Run(ctx context.Context, interval time.Duration) {
+	client := &http.Client{Timeout: interval}
+	ticker := time.NewTicker(interval)
+	defer ticker.Stop()
+	for {
+		r.Refresh(ctx, client)
+		select {
+		case <-ctx.Done():
+			return
+		case <-ticker.C:
+		}
+	}
+}
+
+func fetchPrefixSummary(ctx context.Context, client *http.Client, url string) (*PrefixSummary, error) {
+	req, err := http.NewRequestWithContext(ctx, "GET", url, nil)
+	if err != nil {
+		return nil, err
+	}
+	resp, err := client.Do(req)
+	if err != nil {
+		return nil, err
+	}
+	defer resp.Body.Close()
+	if resp.StatusCode != http.StatusOK {
+		return nil, fmt.Errorf("unexpected status %s", resp.Status)
+	}
+	data, err := io.ReadAll(resp.Body)
+	if err != nil {
+		return nil, err
+	}
+	return ParsePrefixSummary(data)
+}
+
+// release the replica once the request context is done
+func releaseOnDone(ctx context.Context, replica *Replica) {
+	go func() {
+		<-ctx.Done()
+		replica.release()
+	}()
+}
+
+// routedCompletionClient sends each completion request to the replica picked
+// by the router. The request context must be cancelled once the request is
+// done.
+type routedCompletionClient struct {
+	router *Router
+}
+
+func (c *routedCompletionClient) Complete(ctx context.Context, in *scalellm.CompletionRequest, opts ...grpc.CallOption) (scalellm.Completion_CompleteClient, error) {
+	replica := c.router.Pick(in.GetModel(), in.GetPrompt())
+	stream, err := replica.completion.Complete(ctx, in, opts...)
+	if err != nil {
+		replica.release()
+		return nil, err
+	}
+	releaseOnDone(ctx, replica)
+	return stream, nil
+}
+
+// routedChatClient sends each chat request to the replica picked by the
+// router. The request context must be cancelled once the request is done.
+type routedChatClient struct {
+	router *Router
+}
+
+func (c *routedChatClient) Complete(ctx context.Context, in *scalellm.ChatRequest, opts ...grpc.CallOption) (scalellm.Chat_CompleteClient, error) {
+	replica := c.router.Pick(in.GetModel(), ChatRoutingText(in.GetMessages()))
+	stream, err := replica.chat.Complete(ctx, in, opts...)
+	if err != nil {
+		replica.release()
+		return nil, err
+	}
+	releaseOnDone(ctx, replica)
+	return stream, nil
+}
+
+func (r *Router) CompletionClient() scalellm.CompletionClient {
+	return &routedCompletionClient{router: r}
+}
+
+func (r *Router) ChatClient() scalellm.ChatClient {
+	return &routedChatClient{router: r}
+}
+
+// DialReplicas connects to the replicas, the connections are closed once the
+// context is done. summaryURLs are in the same order as the endpoints, or
+// empty to route round-robin.
+func DialReplicas(ctx context.Context, endpoints []string, summaryURLs []string, opts []grpc.DialOption) ([]*Replica, error) {
+	var conns []*grpc.ClientConn
+	closeAll := func() {
+		for i, conn := range conns {
+			if cerr := conn.Close(); cerr != nil {
+				glog.Errorf("Failed to close conn to %s: %v", endpoints[i], cerr)
+			}
+		}
+	}
+	replicas := make([]*Replica, 0, len(endpoints))
+	for i, endpoint := range endpoints {
+		conn, err := grpc.DialContext(ctx, endpoint, opts...)
+		if err != nil {
+			closeAll()
+			return nil, err
+		}
+		conns = append(conns, conn)
+		summaryURL := ""
+		if i < len(summaryURLs) {
+			summaryURL = summaryURLs[i]
+		}
+		replicas = append(replicas, NewReplica(endpoint, summaryURL, scalellm.NewCompletionClient(conn), scalellm.NewChatClient(conn)))
+	}
+	go func() {
+		<-ctx.Done()
+		closeAll()
+	}()
+	return replicas, nil
+}
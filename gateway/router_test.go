@@ -0,0 +1,273 @@
+package main
+
+import (
+	"container/list"
+	"context"
+	"encoding/hex"
+	"encoding/json"
+	"fmt"
+	"math/rand"
+	"net/http"
+	"net/http/httptest"
+	"strings"
+	"sync"
+	"testing"
+)
+
+const testChunkSize = 64
+
+// stubEngine mimics the prefix cache of a replica on text chunks with a LRU
+// policy, and publishes its summary in the format of the engine.
+type stubEngine struct {
+	capacity int
+
+	mu    sync.Mutex
+	lru   *list.List
+	index map[uint64]*list.Element
+
+	hitChunks   int
+	totalChunks int
+}
+
+func newStubEngine(capacity int) *stubEngine {
+	return &stubEngine{
+		capacity: capacity,
+		lru:      list.New(),
+		index:    make(map[uint64]*list.Element),
+	}
+}
+
+// serve the prompt and count the chunks hit in the cache
+func (e *stubEngine) serve(text string) {
+	e.mu.Lock()
+	defer e.mu.Unlock()
+	hashes := ChunkHashes("", text, testChunkSize)
+	matched := true
+	for _, hash := range hashes {
+		if elem, ok := e.index[hash]; ok {
+			if matched {
+				e.hitChunks++
+			}
+			e.lru.MoveToFront(elem)
+			continue
+		}
+		matched = false
+		e.index[hash] = e.lru.PushFront(hash)
+	}
+	e.totalChunks += len(hashes)
+	for e.lru.Len() > e.capacity {
+		elem := e.lru.Back()
+		delete(e.index, elem.Value.(uint64))
+		e.lru.Remove(elem)
+	}
+}
+
+func (e *stubEngine) ServeHTTP(w http.ResponseWriter, r *http.Request) {
+	e.mu.Lock()
+	hashes := make([]uint64, 0, len(e.index))
+	for hash := range e.index {
+		hashes = append(hashes, hash)
+	}
+	e.mu.Unlock()
+	w.Header().Set("Content-Type", "application/json")
+	w.Write(newPrefixSummaryJSON(hashes, testChunkSize))
+}
+
+// build the summary as PrefixCacheSummary::refresh does
+func newPrefixSummaryJSON(hashes []uint64, chunkSize int) []byte {
+	const numHashes = 7
+	numBits := uint64(64)
+	for numBits < uint64(len(hashes))*10 {
+		numBits <<= 1
+	}
+	bits := make([]byte, numBits/8)
+	for _, hash := range hashes {
+		step := (hash >> 32) | 1
+		for i := uint64(0); i < numHashes; i++ {
+			bit := (hash + i*step) % numBits
+			bits[bit/8] |= 1 << (bit % 8)
+		}
+	}
+	data, _ := json.Marshal(map[string]interface{}{
+		"version":       prefixSummaryVersion,
+		"chunk_size":    chunkSize,
+		"num_hashes":    numHashes,
+		"num_bits":      numBits,
+		"bits":          hex.EncodeToString(bits),
+		"num_chunks":    len(hashes),
+		"lora_adapters": []string{},
+	})
+	return data
+}
+
+func TestChunkHashes(t *testing.T) {
+	// golden values shared with the engine
+	expected := []uint64{0x7b495389bdbdd4a8, 0x049a755b29a3dcb5, 0xc77bf3872ce5f174}
+	if hashes := ChunkHashes("", "hello world!", 4); fmt.Sprint(hashes) != fmt.Sprint(expected) {
+		t.Errorf("ChunkHashes() = %x, want %x", hashes, expected)
+	}
+	expected = []uint64{0x898e6e7d049f1a7e, 0x5a94a16df34b703f, 0xa553a5b1c873a91a}
+	if hashes := ChunkHashes("sql", "hello world!", 4); fmt.Sprint(hashes) != fmt.Sprint(expected) {
+		t.Errorf("ChunkHashes() = %x, want %x", hashes, expected)
+	}
+	if hashes := ChunkHashes("", "hel", 4); len(hashes) != 0 {
+		t.Errorf("ChunkHashes() = %x, want no hashes", hashes)
+	}
+}
+
+func TestPrefixSummary(t *testing.T) {
+	hashes := ChunkHashes("", "hello world!", 4)
+	summary, err := ParsePrefixSummary(newPrefixSummaryJSON(hashes[:2], 4))
+	if err != nil {
+		t.Fatal(err)
+	}
+	if !summary.Contains(hashes[0]) || !summary.Contains(hashes[1]) {
+		t.Errorf("summary misses resident chunks")
+	}
+	for _, hash := range ChunkHashes("", "see you later", 4) {
+		if summary.Contains(hash) {
+			t.Errorf("summary contains %x", hash)
+		}
+	}
+
+	if _, err := ParsePrefixSummary([]byte(`{"version": 2}`)); err == nil {
+		t.Errorf("expected an error for unsupported version")
+	}
+	if _, err := ParsePrefixSummary([]byte(`{"version": 1, "chunk_size": 4, "num_hashes": 7, "num_bits": 64, "bits": "00"}`)); err == nil {
+		t.Errorf("expected an error for truncated bits")
+	}
+}
+
+func TestPickLongestMatch(t *testing.T) {
+	replicas := []*Replica{NewReplica("a", "", nil, nil), NewReplica("b", "", nil, nil)}
+	router := NewRouter(replicas, 4, 0)
+	text := "hello world!"
+	hashes := ChunkHashes("", text, 4)
+	summary, err := ParsePrefixSummary(newPrefixSummaryJSON(hashes[:2], 4))
+	if err != nil {
+		t.Fatal(err)
+	}
+	replicas[1].setSummary(summary)
+
+	for i := 0; i < 4; i++ {
+		replica := router.Pick("model", text)
+		if replica != replicas[1] {
+			t.Errorf("picked replica %s, want b", replica.endpoint)
+		}
+		replica.release()
+	}
+	// requests without a match are spread round-robin
+	picked := map[string]int{}
+	for i := 0; i < 4; i++ {
+		replica := router.Pick("model", fmt.Sprintf("%d prompt", i))
+		picked[replica.endpoint]++
+		replica.release()
+	}
+	if picked["a"] != 2 || picked["b"] != 2 {
+		t.Errorf("picked %v, want 2 requests on each replica", picked)
+	}
+	// requests routed since the last refresh are predicted to be resident
+	replica := router.Pick("model", "good night all")
+	replica.release()
+	for i := 0; i < 4; i++ {
+		if r := router.Pick("model", "good night all"); r != replica {
+			t.Errorf("picked replica %s, want %s", r.endpoint, replica.endpoint)
+		}
+	}
+}
+
+func TestPickMaxImbalance(t *testing.T) {
+	replicas := []*Replica{NewReplica("a", "", nil, nil), NewReplica("b", "", nil, nil)}
+	router := NewRouter(replicas, 4, 2)
+	// the replica with the match takes requests until it is overloaded
+	for i := 0; i < 3; i++ {
+		if replica := router.Pick("model", "hello world!"); replica != replicas[0] {
+			t.Fatalf("picked replica %s, want a", replica.endpoint)
+		}
+	}
+	if replica := router.Pick("model", "hello world!"); replica != replicas[1] {
+		t.Errorf("picked replica %s, want b", replica.endpoint)
+	}
+}
+
+// route a RAG like workload onto replicas with small prefix caches: the
+// prompts share one of the long documents with a unique question.
+func simulateHitRate(prefixAware bool) float64 {
+	const (
+		numReplicas  = 4
+		numDocuments = 32
+		numRequests  = 2000
+
+		// 16 chunks per document, 4 per question
+		documentSize = 16 * testChunkSize
+		questionSize = 4 * testChunkSize
+
+		// each replica caches about 10 documents
+		capacity = 200
+
+		// refresh the summaries every few requests
+		refreshEvery = 10
+	)
+	rng := rand.New(rand.NewSource(0))
+	documents := make([]string, numDocuments)
+	for i := range documents {
+		documents[i] = strings.Repeat(fmt.Sprintf("document %03d. ", i), documentSize/14+1)[:documentSize]
+	}
+
+	engines := make([]*stubEngine, numReplicas)
+	replicas := make([]*Replica, numReplicas)
+	for i := range engines {
+		engines[i] = newStubEngine(capacity)
+		server := httptest.NewServer(engines[i])
+		defer server.Close()
+		summaryURL := ""
+		if prefixAware {
+			summaryURL = server.URL + "/prefix_cache/summary"
+		}
+		replicas[i] = NewReplica(fmt.Sprintf("replica-%d", i), summaryURL, nil, nil)
+	}
+	router := NewRouter(replicas, testChunkSize, 0)
+
+	next := 0
+	for i := 0; i < numRequests; i++ {
+		question := strings.Repeat(fmt.Sprintf("question %06d? ", i), questionSize/17+1)[:questionSize]
+		prompt := documents[rng.Intn(numDocuments)] + question
+		var replica *Replica
+		if prefixAware {
+			if i%refreshEvery == 0 {
+				router.Refresh(context.Background(), http.DefaultClient)
+			}
+			replica = router.Pick("model", prompt)
+		} else {
+			replica = replicas[next%numReplicas]
+			replica.acquire()
+			next++
+		}
+		for j, r := range replicas {
+			if r == replica {
+				engines[j].serve(prompt)
+			}
+		}
+		replica.release()
+	}
+
+	hitChunks, totalChunks := 0, 0
+	for _, engine := range engines {
+		hitChunks += engine.hitChunks
+		totalChunks += engine.totalChunks
+	}
+	return float64(hitChunks) / float64(totalChunks)
+}
+
+func TestPrefixAwareRoutingHitRate(t *testing.T) {
+	roundRobin := simulateHitRate(false)
+	prefixAware := simulateHitRate(true)
+	t.Logf("hit rate: round-robin %.3f, prefix aware %.3f", roundRobin, prefixAware)
+	// at most 16 of 20 chunks per prompt can hit
+	if prefixAware < 0.6 {
+		t.Errorf("prefix aware hit rate %.3f, want at least 0.6", prefixAware)
+	}
+	if prefixAware < 2*roundRobin {
+		t.Errorf("prefix aware hit rate %.3f, want at least twice of round-robin %.3f", prefixAware, roundRobin)
+	}
+}
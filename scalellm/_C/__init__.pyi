@@ -1,6 +1,7 @@
 from scalellm._C.llm_handler import LLMHandler, Message, Priority
-from scalellm._C.output import (LogProb, LogProbData, RequestOutput,
-                                SequenceOutput, Status, StatusCode, Usage)
+from scalellm._C.output import (LatencyBreakdown, LogProb, LogProbData,
+                                RequestOutput, SequenceOutput, Status,
+                                StatusCode, Usage)
 from scalellm._C.sampling_params import SamplingParams
 
 # Defined in scalellm/csrc/module.cpp
@@ -17,6 +18,7 @@ __all__ = [
     "Status",
     "StatusCode",
     "Usage",
+    "LatencyBreakdown",
     "LLMHandler",
     "get_metrics",
 ]
@@ -1,5 +1,5 @@
 from enum import Enum
-from typing import Callable, List, Optional
+from typing import Callable, Dict, List, Optional
 
 from scalellm._C.output import RequestOutput
 from scalellm._C.sampling_params import SamplingParams
@@ -37,6 +37,7 @@ class LLMHandler:
         max_cache_size: int
         max_memory_utilization: float
         enable_prefix_cache: bool
+        prefix_cache_eviction_policy: str
         enable_cuda_graph: bool
         cuda_graph_max_seq_len: int
         cuda_graph_batch_sizes: Optional[List[int]]
@@ -44,7 +45,24 @@ class LLMHandler:
         max_tokens_per_batch: int
         max_seqs_per_batch: int
         num_speculative_tokens: int
+        num_decode_steps: int
         num_handling_threads: int
+        scheduler_policy: str
+        priority_aging_interval: float
+        fair_share_half_life: float
+        cache_aware_max_wait: float
+        max_queue_time: float
+        enable_admission_control: bool
+        enable_overlap_scheduling: bool
+        cpu_dtype: str
+        max_prefetch_files: int
+        weights_cache_dir: str
+        lora_adapters: Dict[str, str]
+        max_loras: int
+        max_lora_rank: int
+        prefix_cache_snapshot_dir: str
+        prefix_cache_snapshot_interval: int
+        prefix_cache_summary_interval: float
 
     def __init__(self, options: Options) -> None: ...
     def __repr__(self) -> str: ...
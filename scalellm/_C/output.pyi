@@ -8,6 +8,17 @@ class Usage:
     num_prompt_tokens: int
     num_generated_tokens: int
     num_total_tokens: int
+    num_cached_tokens: int
+
+class LatencyBreakdown:
+    def __init__(self) -> None: ...
+    def __repr__(self) -> str: ...
+    queue_seconds: float
+    preempted_seconds: float
+    prefill_seconds: float
+    decode_seconds: float
+    response_seconds: float
+    num_prefill_chunks: int
 
 class LogProbData:
     def __init__(self) -> None: ...
@@ -42,6 +53,7 @@ class RequestOutput:
     status: Optional[Status]
     outputs: List[SequenceOutput]
     usage: Optional[Usage]
+    latency: Optional[LatencyBreakdown]
     finished: bool
 
 class StatusCode(Enum):
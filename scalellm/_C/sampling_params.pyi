@@ -53,3 +53,11 @@ class SamplingParams:
     stop: Optional[List[str]]
     # the list of token ids to stop generating further tokens.
     stop_token_ids: Optional[List[int]]
+    # a unique identifier representing the end-user, used for fair-share scheduling.
+    user: Optional[str]
+    # the maximum time in seconds to complete the request, aborted with DEADLINE_EXCEEDED after that.
+    timeout: Optional[float]
+    # the maximum time in seconds the request can wait in the queue before being scheduled.
+    max_queue_time: Optional[float]
+    # the name of the lora adapter to generate with. default = the base model.
+    lora_adapter: Optional[str]
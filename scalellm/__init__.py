@@ -9,9 +9,10 @@ try:
 except ImportError:
     pass
 
-from scalellm._C import (LLMHandler, LogProb, LogProbData, Message, Priority,
-                         RequestOutput, SamplingParams, SequenceOutput, Status,
-                         StatusCode, Usage, get_metrics)
+from scalellm._C import (LatencyBreakdown, LLMHandler, LogProb, LogProbData,
+                         Message, Priority, RequestOutput, SamplingParams,
+                         SequenceOutput, Status, StatusCode, Usage,
+                         get_metrics)
 from scalellm.errors import ValidationError
 from scalellm.llm import LLM
 from scalellm.llm_engine import AsyncLLMEngine, OutputAsyncStream, OutputStream
@@ -32,6 +33,7 @@ __all__ = [
     "Status",
     "StatusCode",
     "Usage",
+    "LatencyBreakdown",
     "LLMHandler",
     "get_metrics",
 ]
@@ -93,6 +93,8 @@ void init_llm_handler(py::module_& m) {
                      &LLMHandler::Options::max_memory_utilization_)
       .def_readwrite("enable_prefix_cache",
                      &LLMHandler::Options::enable_prefix_cache_)
+      .def_readwrite("prefix_cache_eviction_policy",
+                     &LLMHandler::Options::prefix_cache_eviction_policy_)
       .def_readwrite("enable_cuda_graph",
                      &LLMHandler::Options::enable_cuda_graph_)
       .def_readwrite("cuda_graph_max_seq_len",
@@ -107,16 +109,57 @@ void init_llm_handler(py::module_& m) {
                      &LLMHandler::Options::max_seqs_per_batch_)
       .def_readwrite("num_speculative_tokens",
                      &LLMHandler::Options::num_speculative_tokens_)
+      .def_readwrite("num_decode_steps",
+                     &LLMHandler::Options::num_decode_steps_)
       .def_readwrite("num_handling_threads",
                      &LLMHandler::Options::num_handling_threads_)
+      .def_readwrite("scheduler_policy",
+                     &LLMHandler::Options::scheduler_policy_)
+      .def_readwrite("priority_aging_interval",
+                     &LLMHandler::Options::priority_aging_interval_)
+      .def_readwrite("fair_share_half_life",
+                     &LLMHandler::Options::fair_share_half_life_)
+      .def_readwrite("cache_aware_max_wait",
+                     &LLMHandler::Options::cache_aware_max_wait_)
+      .def_readwrite("max_queue_time", &LLMHandler::Options::max_queue_time_)
+      .def_readwrite("enable_admission_control",
+                     &LLMHandler::Options::enable_admission_control_)
+      .def_readwrite("enable_overlap_scheduling",
+                     &LLMHandler::Options::enable_overlap_scheduling_)
+      .def_readwrite("cpu_dtype", &LLMHandler::Options::cpu_dtype_)
+      .def_readwrite("max_prefetch_files",
+                     &LLMHandler::Options::max_prefetch_files_)
+      .def_readwrite("weights_cache_dir",
+                     &LLMHandler::Options::weights_cache_dir_)
+      .def_readwrite("lora_adapters", &LLMHandler::Options::lora_adapters_)
+      .def_readwrite("max_loras", &LLMHandler::Options::max_loras_)
+      .def_readwrite("max_lora_rank", &LLMHandler::Options::max_lora_rank_)
+      .def_readwrite("prefix_cache_snapshot_dir",
+                     &LLMHandler::Options::prefix_cache_snapshot_dir_)
+      .def_readwrite("prefix_cache_snapshot_interval",
+                     &LLMHandler::Options::prefix_cache_snapshot_interval_)
+      .def_readwrite("prefix_cache_summary_interval",
+                     &LLMHandler::Options::prefix_cache_summary_interval_)
       .def("__repr__", [](const LLMHandler::Options& self) {
         return "Options(model_path={}, devices={}, draft_model_path={}, "
                "draft_devices={}, block_size={}, max_cache_size={}, "
                "max_memory_utilization={}, enable_prefix_cache={}, "
-               "enable_cuda_graph={}, cuda_graph_max_seq_len={}, "
+               "prefix_cache_eviction_policy={}, enable_cuda_graph={}, "
+               "cuda_graph_max_seq_len={}, "
                "cuda_graph_batch_sizes={}, draft_cuda_graph_batch_sizes={}, "
                "max_tokens_per_batch={}, max_seqs_per_batch={}, "
-               "num_speculative_tokens={}, num_handling_threads={})"_s.format(
+               "num_speculative_tokens={}, num_decode_steps={}, "
+               "num_handling_threads={}, "
+               "scheduler_policy={}, priority_aging_interval={}, "
+               "fair_share_half_life={}, cache_aware_max_wait={}, "
+               "max_queue_time={}, "
+               "enable_admission_control={}, "
+               "enable_overlap_scheduling={}, cpu_dtype={}, "
+               "max_prefetch_files={}, weights_cache_dir={}, "
+               "lora_adapters={}, max_loras={}, max_lora_rank={}, "
+               "prefix_cache_snapshot_dir={}, "
+               "prefix_cache_snapshot_interval={}, "
+               "prefix_cache_summary_interval={})"_s.format(
                    self.model_path_,
                    self.devices_,
                    self.draft_model_path_,
@@ -125,6 +168,7 @@ void init_llm_handler(py::module_& m) {
                    self.max_cache_size_,
                    self.max_memory_utilization_,
                    self.enable_prefix_cache_,
+                   self.prefix_cache_eviction_policy_,
                    self.enable_cuda_graph_,
                    self.cuda_graph_max_seq_len_,
                    self.cuda_graph_batch_sizes_,
@@ -132,7 +176,24 @@ void init_llm_handler(py::module_& m) {
                    self.max_tokens_per_batch_,
                    self.max_seqs_per_batch_,
                    self.num_speculative_tokens_,
-                   self.num_handling_threads_);
+                   self.num_decode_steps_,
+                   self.num_handling_threads_,
+                   self.scheduler_policy_,
+                   self.priority_aging_interval_,
+                   self.fair_share_half_life_,
+                   self.cache_aware_max_wait_,
+                   self.max_queue_time_,
+                   self.enable_admission_control_,
+                   self.enable_overlap_scheduling_,
+                   self.cpu_dtype_,
+                   self.max_prefetch_files_,
+                   self.weights_cache_dir_,
+                   self.lora_adapters_,
+                   self.max_loras_,
+                   self.max_lora_rank_,
+                   self.prefix_cache_snapshot_dir_,
+                   self.prefix_cache_snapshot_interval_,
+                   self.prefix_cache_summary_interval_);
       });
 }
 
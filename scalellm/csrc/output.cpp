@@ -15,11 +15,32 @@ void init_output(py::module_& m) {
       .def_readwrite("num_prompt_tokens", &Usage::num_prompt_tokens)
       .def_readwrite("num_generated_tokens", &Usage::num_generated_tokens)
       .def_readwrite("num_total_tokens", &Usage::num_total_tokens)
+      .def_readwrite("num_cached_tokens", &Usage::num_cached_tokens)
       .def("__repr__", [](const Usage& self) {
-        return "Usage(num_prompt_tokens={}, num_generated_tokens={}, num_total_tokens={})"_s
+        return "Usage(num_prompt_tokens={}, num_generated_tokens={}, num_total_tokens={}, num_cached_tokens={})"_s
             .format(self.num_prompt_tokens,
                     self.num_generated_tokens,
-                    self.num_total_tokens);
+                    self.num_total_tokens,
+                    self.num_cached_tokens);
+      });
+
+  py::class_<LatencyBreakdown>(m, "LatencyBreakdown")
+      .def(py::init())
+      .def_readwrite("queue_seconds", &LatencyBreakdown::queue_seconds)
+      .def_readwrite("preempted_seconds", &LatencyBreakdown::preempted_seconds)
+      .def_readwrite("prefill_seconds", &LatencyBreakdown::prefill_seconds)
+      .def_readwrite("decode_seconds", &LatencyBreakdown::decode_seconds)
+      .def_readwrite("response_seconds", &LatencyBreakdown::response_seconds)
+      .def_readwrite("num_prefill_chunks",
+                     &LatencyBreakdown::num_prefill_chunks)
+      .def("__repr__", [](const LatencyBreakdown& self) {
+        return "LatencyBreakdown(queue_seconds={}, preempted_seconds={}, prefill_seconds={}, decode_seconds={}, response_seconds={}, num_prefill_chunks={})"_s
+            .format(self.queue_seconds,
+                    self.preempted_seconds,
+                    self.prefill_seconds,
+                    self.decode_seconds,
+                    self.response_seconds,
+                    self.num_prefill_chunks);
       });
 
   py::enum_<StatusCode>(m, "StatusCode")
@@ -89,6 +110,7 @@ void init_output(py::module_& m) {
       .def_readwrite("status", &RequestOutput::status)
       .def_readwrite("outputs", &RequestOutput::outputs)
       .def_readwrite("usage", &RequestOutput::usage)
+      .def_readwrite("latency", &RequestOutput::latency)
       .def_readwrite("finished", &RequestOutput::finished)
       .def("__repr__", [](const RequestOutput& self) {
         return "RequestOutput({}, {}, {})"_s.format(
@@ -59,6 +59,10 @@ void init_sampling_params(py::module_& m) {
       .def_readwrite("ignore_eos", &SamplingParams::ignore_eos)
       .def_readwrite("stop", &SamplingParams::stop)
       .def_readwrite("stop_token_ids", &SamplingParams::stop_token_ids)
+      .def_readwrite("user", &SamplingParams::user)
+      .def_readwrite("timeout", &SamplingParams::timeout)
+      .def_readwrite("max_queue_time", &SamplingParams::max_queue_time)
+      .def_readwrite("lora_adapter", &SamplingParams::lora_adapter)
       .def("__repr__", [](const SamplingParams& self) {
         return "SamplingParams(max_tokens={}, n={}, best_of={}, echo={}, "
                "frequency_penalty={}, presence_penalty={}, "
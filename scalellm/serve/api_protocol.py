@@ -41,10 +41,25 @@ class ModelList(BaseModel):
     data: List[ModelCard] = []
 
 
+class PromptTokensDetails(BaseModel):
+    cached_tokens: int = 0
+
+
+class LatencyBreakdown(BaseModel):
+    queue_seconds: float = 0.0
+    preempted_seconds: float = 0.0
+    prefill_seconds: float = 0.0
+    decode_seconds: float = 0.0
+    response_seconds: float = 0.0
+    prefill_chunks: int = 0
+
+
 class UsageInfo(BaseModel):
     prompt_tokens: int = 0
     total_tokens: int = 0
     completion_tokens: Optional[int] = 0
+    prompt_tokens_details: Optional[PromptTokensDetails] = None
+    latency: Optional[LatencyBreakdown] = None
 
 
 class ChatCompletionLogProbData(BaseModel):
@@ -85,11 +100,12 @@ class ChatCompletionRequest(BaseModel):
     top_k: Optional[int] = -1
     logprobs: Optional[bool] = False
     top_logprobs: Optional[int] = Field(0, ge=0, le=20)
-    # user: Optional[str] = None
+    user: Optional[str] = None
     skip_special_tokens: Optional[bool] = True
     ignore_eos: Optional[bool] = False
     stop: Optional[Union[str, List[str]]] = None
     stop_token_ids: Optional[List[int]] = None
+    include_latency: Optional[bool] = False
     # seed: Optional[int] = None
 
 
@@ -153,11 +169,12 @@ class CompletionRequest(BaseModel):
     repetition_penalty: Optional[float] = 1.0
     top_p: Optional[float] = 1.0
     top_k: Optional[int] = -1
-    # user: Optional[str] = None
+    user: Optional[str] = None
     skip_special_tokens: Optional[bool] = True
     ignore_eos: Optional[bool] = False
     stop: Optional[Union[str, List[str]]] = None
     stop_token_ids: Optional[List[int]] = None
+    include_latency: Optional[bool] = False
     # seed: Optional[int] = None
 
 
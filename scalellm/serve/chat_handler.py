@@ -38,6 +38,8 @@ def to_sampling_params(request: ChatCompletionRequest) -> SamplingParams:
     sp.stop = request.stop
     sp.ignore_eos = request.ignore_eos
     sp.stop_token_ids = request.stop_token_ids
+    # the end-user is the tenant for fair-share scheduling
+    sp.user = request.user
     return sp
 
 
@@ -112,7 +114,9 @@ async def generate_chat_response(
         created=created_time,
         model=model,
         choices=choices,
-        usage=to_api_usage(output.usage),
+        usage=to_api_usage(
+            output.usage, output.latency if request.include_latency else None
+        ),
     )
 
 
@@ -140,6 +144,7 @@ async def generate_chat_stream_response(
         # to keep track of the first message sent
         first_message_sent = set()
         usage = None
+        latency = None
         async for output in output_stream:
             for seq_output in output.outputs:
                 index = seq_output.index
@@ -205,6 +210,8 @@ async def generate_chat_stream_response(
             # record last usage info
             if output.usage:
                 usage = output.usage
+            if output.latency and request.include_latency:
+                latency = output.latency
 
         # send additional chunk for usage info
         if include_usage and usage:
@@ -214,7 +221,7 @@ async def generate_chat_stream_response(
                 created=created_time,
                 model=model,
                 choices=[],
-                usage=to_api_usage(usage),
+                usage=to_api_usage(usage, latency),
             )
             yield f"data: {jsonify_model(response)}\n\n"
         yield "data: [DONE]\n\n"
@@ -2,8 +2,9 @@ from typing import Optional
 
 from pydantic import BaseModel
 
-from scalellm import Priority, Usage
-from scalellm.serve.api_protocol import UsageInfo
+from scalellm import LatencyBreakdown, Priority, Usage
+from scalellm.serve.api_protocol import LatencyBreakdown as ApiLatencyBreakdown
+from scalellm.serve.api_protocol import PromptTokensDetails, UsageInfo
 
 
 def jsonify_model(obj: BaseModel):
@@ -31,11 +32,32 @@ def get_printable_token(logprob) -> str:
 
 
 
-def to_api_usage(usage: Optional[Usage]) -> Optional[UsageInfo]:
+def to_api_latency(
+    latency: Optional[LatencyBreakdown],
+) -> Optional[ApiLatencyBreakdown]:
+    if latency is None:
+        return None
+    return ApiLatencyBreakdown(
+        queue_seconds=latency.queue_seconds,
+        preempted_seconds=latency.preempted_seconds,
+        prefill_seconds=latency.prefill_seconds,
+        decode_seconds=latency.decode_seconds,
+        response_seconds=latency.response_seconds,
+        prefill_chunks=latency.num_prefill_chunks,
+    )
+
+
+def to_api_usage(
+    usage: Optional[Usage], latency: Optional[LatencyBreakdown] = None
+) -> Optional[UsageInfo]:
     if usage is None:
         return None
     return UsageInfo(
         prompt_tokens=usage.num_prompt_tokens,
         total_tokens=usage.num_total_tokens,
         completion_tokens=usage.num_generated_tokens,
+        prompt_tokens_details=PromptTokensDetails(
+            cached_tokens=usage.num_cached_tokens
+        ),
+        latency=to_api_latency(latency),
     )
@@ -33,6 +33,8 @@ def to_sampling_params(request: CompletionRequest) -> SamplingParams:
     sp.stop = request.stop
     sp.ignore_eos = request.ignore_eos
     sp.stop_token_ids = request.stop_token_ids
+    # the end-user is the tenant for fair-share scheduling
+    sp.user = request.user
     return sp
 
 
@@ -103,7 +105,9 @@ async def generate_completion_response(
         created=created_time,
         model=model,
         choices=choices,
-        usage=to_api_usage(output.usage),
+        usage=to_api_usage(
+            output.usage, output.latency if request.include_latency else None
+        ),
     )
 
 
@@ -132,6 +136,7 @@ async def generate_completion_stream_response(
         prompt_len = len(request.prompt)
         offsets = {}
         usage = None
+        latency = None
         async for output in output_stream:
             for seq_output in output.outputs:
                 cur_offset = offsets.setdefault(seq_output.index, prompt_len)
@@ -180,6 +185,8 @@ async def generate_completion_stream_response(
             # record last usage info
             if output.usage:
                 usage = output.usage
+            if output.latency and request.include_latency:
+                latency = output.latency
 
         # send additional chunk for usage info
         if include_usage and usage:
@@ -189,7 +196,7 @@ async def generate_completion_stream_response(
                 created=created_time,
                 model=model,
                 choices=[],
-                usage=to_api_usage(usage),
+                usage=to_api_usage(usage, latency),
             )
             yield f"data: {jsonify_model(response)}\n\n"
         yield "data: [DONE]\n\n"
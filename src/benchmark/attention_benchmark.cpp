@@ -1,30 +1,221 @@
 #include <benchmark/benchmark.h>
+#include <torch/torch.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
 
-static void BM_varlen_masked_self_attention(benchmark::State& state) {
-  // Perform setup here
+#include "kernels/attention/attention_cpu.h"
+#include "layers/attention/ref_handler.h"
+#include "memory/kv_cache.h"
+#include "models/parameters.h"
 
+using namespace llm;
+
+namespace {
+// the query heads of a 7B/8B model, the kv heads are divided by the GQA ratio
+constexpr int64_t kNumHeads = 32;
+constexpr int64_t kBlockSize = 16;
+// skip the shapes whose key and value tensors don't fit into a laptop
+constexpr int64_t kMaxKVBytes = int64_t(2) << 30;
+
+// flops of the two matmuls of causal attention, q_len queries attending to
+// the last q_len positions of a context of kv_len tokens
+double attention_flops(int64_t q_len, int64_t kv_len, int64_t head_dim) {
+  // the number of (query, key) pairs under the causal mask
+  const double n_pairs =
+      static_cast<double>(q_len) * static_cast<double>(kv_len - q_len) +
+      static_cast<double>(q_len) * static_cast<double>(q_len + 1) / 2;
+  return 4.0 * n_pairs * static_cast<double>(kNumHeads * head_dim);
+}
+
+bool skip_oversized(benchmark::State& state,
+                    int64_t n_kv_tokens,
+                    int64_t n_kv_heads,
+                    int64_t head_dim) {
+  const int64_t kv_bytes =
+      2 * n_kv_tokens * n_kv_heads * head_dim * sizeof(float);
+  if (kv_bytes > kMaxKVBytes) {
+    state.SkipWithMessage("key and value tensors are too large");
+    return true;
+  }
+  return false;
+}
+
+void set_counters(benchmark::State& state,
+                  double flops_per_iter,
+                  int64_t n_kv_tokens,
+                  int64_t n_kv_heads,
+                  int64_t head_dim) {
+  state.counters["flops"] = benchmark::Counter(
+      flops_per_iter * static_cast<double>(state.iterations()),
+      benchmark::Counter::kIsRate);
+  // the key and value read from memory
+  state.SetBytesProcessed(state.iterations() * 2 * n_kv_tokens * n_kv_heads *
+                          head_dim * static_cast<int64_t>(sizeof(float)));
+}
+
+// a kv cache holding the context of each sequence in randomly shuffled
+// blocks, with the padded block table of each sequence.
+struct PagedKVCache {
+  KVCache kv_cache;
+  // [batch_size, n_blocks_per_seq] IntTensor
+  torch::Tensor block_tables;
+};
+
+PagedKVCache create_paged_kv_cache(int64_t batch_size,
+                                   int64_t kv_len,
+                                   int64_t n_kv_heads,
+                                   int64_t head_dim) {
+  const int64_t n_blocks_per_seq = (kv_len + kBlockSize - 1) / kBlockSize;
+  const int64_t n_blocks = batch_size * n_blocks_per_seq;
+  std::vector<int32_t> block_ids(n_blocks);
+  std::iota(block_ids.begin(), block_ids.end(), 0);
+  std::shuffle(block_ids.begin(), block_ids.end(), std::mt19937(0));
+
+  const std::vector<int64_t> kv_shape = {
+      n_blocks, kBlockSize, n_kv_heads, head_dim};
+  PagedKVCache cache{KVCache(torch::rand(kv_shape), torch::rand(kv_shape)),
+                     torch::tensor(block_ids, torch::kInt)
+                         .view({batch_size, n_blocks_per_seq})};
+  return cache;
+}
+
+}  // namespace
+
+// RefHandler::batch_prefill over a batch of prompts of the same length.
+static void BM_ref_batch_prefill(benchmark::State& state) {
+  const int64_t head_dim = state.range(0);
+  const int64_t n_kv_heads = kNumHeads / state.range(1);
+  const int64_t seq_len = state.range(2);
+  const int64_t batch_size = state.range(3);
+  const int64_t n_tokens = batch_size * seq_len;
+  if (skip_oversized(state, n_tokens, n_kv_heads, head_dim)) {
+    return;
+  }
+
+  torch::Tensor query = torch::rand({n_tokens, kNumHeads, head_dim});
+  torch::Tensor key = torch::rand({n_tokens, n_kv_heads, head_dim});
+  torch::Tensor value = torch::rand({n_tokens, n_kv_heads, head_dim});
+  torch::Tensor output = torch::empty_like(query);
+
+  InputParameters input_params;
+  input_params.q_cu_seq_lens =
+      torch::arange(0, n_tokens + 1, seq_len, torch::kInt);
+  input_params.kv_cu_seq_lens = input_params.q_cu_seq_lens;
+  input_params.q_max_seq_len = seq_len;
+  input_params.kv_max_seq_len = seq_len;
+
+  const float sm_scale = static_cast<float>(1.0 / std::sqrt(head_dim));
+  RefHandler handler(sm_scale, /*logits_soft_cap=*/0.0, torch::nullopt);
+  for (auto _ : state) {
+    handler.batch_prefill(
+        query, key, value, input_params, /*sliding_window=*/-1, output);
+    benchmark::DoNotOptimize(output.data_ptr());
+  }
+
+  set_counters(state,
+               batch_size * attention_flops(seq_len, seq_len, head_dim),
+               n_tokens,
+               n_kv_heads,
+               head_dim);
+}
+
+// RefHandler::batch_decode: one query per sequence attending to its context
+// gathered from a paged kv cache.
+static void BM_ref_batch_decode(benchmark::State& state) {
+  const int64_t head_dim = state.range(0);
+  const int64_t n_kv_heads = kNumHeads / state.range(1);
+  const int64_t kv_len = state.range(2);
+  const int64_t batch_size = state.range(3);
+  if (skip_oversized(state, batch_size * kv_len, n_kv_heads, head_dim)) {
+    return;
+  }
+
+  auto cache = create_paged_kv_cache(batch_size, kv_len, n_kv_heads, head_dim);
+  torch::Tensor query = torch::rand({batch_size, kNumHeads, head_dim});
+  torch::Tensor output = torch::empty_like(query);
+
+  InputParameters input_params;
+  input_params.q_cu_seq_lens = torch::arange(0, batch_size + 1, torch::kInt);
+  input_params.kv_cu_seq_lens =
+      torch::arange(0, batch_size * kv_len + 1, kv_len, torch::kInt);
+  input_params.q_max_seq_len = 1;
+  input_params.kv_max_seq_len = kv_len;
+  input_params.block_tables = cache.block_tables;
+
+  const float sm_scale = static_cast<float>(1.0 / std::sqrt(head_dim));
+  RefHandler handler(sm_scale, /*logits_soft_cap=*/0.0, torch::nullopt);
   for (auto _ : state) {
-    // Call the implementation function
+    handler.batch_decode(query,
+                         cache.kv_cache,
+                         input_params,
+                         /*sliding_window=*/-1,
+                         output);
+    benchmark::DoNotOptimize(output.data_ptr());
   }
+
+  set_counters(state,
+               batch_size * attention_flops(1, kv_len, head_dim),
+               batch_size * kv_len,
+               n_kv_heads,
+               head_dim);
 }
 
-static void BM_single_query_masked_self_attention(benchmark::State& state) {
-  // Perform setup here
+// the scalar cpu kernel for a single sequence, q_len queries attending to the
+// last q_len positions of the context.
+static void BM_mha_cpu(benchmark::State& state) {
+  const int64_t head_dim = state.range(0);
+  const int64_t n_kv_heads = kNumHeads / state.range(1);
+  const int64_t kv_len = state.range(2);
+  const int64_t q_len = state.range(3);
+  if (skip_oversized(state, kv_len, n_kv_heads, head_dim)) {
+    return;
+  }
 
+  torch::Tensor query = torch::rand({q_len, kNumHeads, head_dim});
+  torch::Tensor key = torch::rand({kv_len, n_kv_heads, head_dim});
+  torch::Tensor value = torch::rand({kv_len, n_kv_heads, head_dim});
+  torch::Tensor output = torch::zeros_like(query);
   for (auto _ : state) {
-    // Call the implementation function
+    // the kernel accumulates into the output
+    state.PauseTiming();
+    output.zero_();
+    state.ResumeTiming();
+    mha(query, key, value, output);
+    benchmark::DoNotOptimize(output.data_ptr());
   }
+
+  set_counters(state,
+               attention_flops(q_len, kv_len, head_dim),
+               kv_len,
+               n_kv_heads,
+               head_dim);
 }
 
-// Register functions as benchmarks
-BENCHMARK(BM_varlen_masked_self_attention)
-    ->ArgNames({"dim", "cuda", "slow"})
-    ->Args({/*dim=*/32, /*device=cpu*/ 0, /*slow=*/0})
-    ->Args({/*dim=*/32, /*device=cuda*/ 1, /*slow=*/0})
-    ->Args({/*dim=*/32, /*device=cuda*/ 1, /*slow=*/1});
-
-BENCHMARK(BM_single_query_masked_self_attention)
-    ->ArgNames({"dim", "cuda"})
-    ->Args({/*dim=*/32, /*device=cpu*/ 0})
-    ->Args({/*dim=*/32, /*device=cuda*/ 1});
+// head_dim x GQA ratio x prompt length x batch size, the prompts are capped
+// at 2k tokens since the reference handler materializes the attention scores
+BENCHMARK(BM_ref_batch_prefill)
+    ->ArgNames({"head_dim", "gqa", "seq_len", "batch"})
+    ->ArgsProduct({{64, 128}, {1, 4, 8}, {512, 1024, 2048}, {1, 4, 16}})
+    ->Unit(benchmark::kMillisecond);
+
+// head_dim x GQA ratio x context length x batch size
+BENCHMARK(BM_ref_batch_decode)
+    ->ArgNames({"head_dim", "gqa", "kv_len", "batch"})
+    ->ArgsProduct({{64, 128},
+                   {1, 4, 8},
+                   {512, 2048, 8192, 32768},
+                   {1, 16, 64, 256}})
+    ->Unit(benchmark::kMillisecond);
+
+// decode (1 query) over context 512-32k and a short prefill, the scalar
+// kernel is quadratic in the prompt length
+BENCHMARK(BM_mha_cpu)
+    ->ArgNames({"head_dim", "gqa", "kv_len", "q_len"})
+    ->ArgsProduct({{64, 128}, {1, 4, 8}, {512, 2048, 8192, 32768}, {1}})
+    ->ArgsProduct({{64, 128}, {1, 4, 8}, {512}, {512}})
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,181 @@
+#include <benchmark/benchmark.h>
+#include <gflags/gflags.h>
+#include <torch/torch.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/tiny_model.h"
+#include "engine/worker.h"
+#include "memory/block_allocator.h"
+#include "models/model_args.h"
+#include "quantization/quant_args.h"
+#include "request/sequence.h"
+
+DECLARE_string(linear_weight_only_quant);
+
+using namespace llm;
+
+namespace {
+constexpr int64_t kBlockSize = 16;
+constexpr int64_t kNumPromptTokens = 128;
+// upper bound of decoding steps per benchmark run
+constexpr int64_t kMaxSteps = 64;
+
+enum class CpuMode { kFloat32 = 0, kBFloat16 = 1, kInt8 = 2 };
+
+const char* mode_name(CpuMode mode) {
+  switch (mode) {
+    case CpuMode::kFloat32:
+      return "float32";
+    case CpuMode::kBFloat16:
+      return "bfloat16";
+    case CpuMode::kInt8:
+      return "bfloat16+int8";
+  }
+  return "unknown";
+}
+
+// a small llama model so that the linear layers dominate the step time
+ModelArgs small_model_args() {
+  ModelArgs args = tiny_model_args();
+  args.vocab_size(4096)
+      .hidden_size(512)
+      .intermediate_size(1408)
+      .n_layers(4)
+      .n_heads(8)
+      .n_kv_heads(8)
+      .head_dim(64)
+      .max_position_embeddings(1024);
+  return args;
+}
+
+std::unique_ptr<Worker> create_worker(CpuMode mode, int64_t num_blocks) {
+  const auto args = small_model_args();
+  const std::vector<int64_t> kv_cache_shape = {
+      num_blocks, kBlockSize, args.n_kv_heads().value(), args.head_dim()};
+  const auto dtype =
+      mode == CpuMode::kFloat32 ? torch::kFloat32 : torch::kBFloat16;
+  // linear layers are created with the flag
+  FLAGS_linear_weight_only_quant = mode == CpuMode::kInt8 ? "int8" : "";
+
+  ParallelArgs parallel_args(/*rank=*/0, /*world_size=*/1, nullptr);
+  ModelRunner::Options runner_options;
+  runner_options.block_size(kBlockSize);
+  auto worker = std::make_unique<Worker>(
+      parallel_args, torch::Device(torch::kCPU), runner_options);
+  worker->init_model(dtype, args, QuantArgs());
+  worker->load_state_dict(random_state_dict(args));
+  worker->verify_loaded_weights();
+  worker->init_kv_cache(kv_cache_shape);
+  FLAGS_linear_weight_only_quant = "";
+  return worker;
+}
+
+std::vector<std::unique_ptr<Sequence>> create_sequences(
+    int64_t batch_size,
+    BlockAllocator* allocator) {
+  Sequence::Options options;
+  options.stopping_criteria.max_tokens = kMaxSteps * 2;
+  options.stopping_criteria.ignore_eos = true;
+  const size_t capacity = kNumPromptTokens + kMaxSteps * 2;
+  const auto num_blocks_per_seq =
+      static_cast<uint32_t>((capacity + kBlockSize - 1) / kBlockSize);
+
+  std::vector<std::unique_ptr<Sequence>> sequences;
+  for (int64_t i = 0; i < batch_size; ++i) {
+    std::vector<int32_t> prompt_tokens(kNumPromptTokens, 1);
+    auto sequence =
+        std::make_unique<Sequence>(prompt_tokens, capacity, options);
+    sequence->append_blocks(allocator->allocate(num_blocks_per_seq));
+    sequences.push_back(std::move(sequence));
+  }
+  return sequences;
+}
+
+}  // namespace
+
+// Measures the decoding throughput on cpu for float32, bfloat16 and bfloat16
+// with int8 weight-only linear layers. The prompts are prefilled before the
+// timing starts.
+static void BM_cpu_decode(benchmark::State& state) {
+  const auto mode = static_cast<CpuMode>(state.range(0));
+  const int64_t batch_size = state.range(1);
+
+  const int64_t num_blocks_per_seq =
+      (kNumPromptTokens + kMaxSteps * 2 + kBlockSize - 1) / kBlockSize;
+  const int64_t num_blocks = batch_size * num_blocks_per_seq + 1;
+  auto worker = create_worker(mode, num_blocks);
+  BlockAllocator allocator(num_blocks, kBlockSize);
+  auto sequences = create_sequences(batch_size, &allocator);
+  Batch batch;
+  for (auto& sequence : sequences) {
+    batch.add(sequence.get());
+  }
+
+  // prefill
+  {
+    auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                            /*min_decoding_bach_size=*/0);
+    auto output = worker->execute_model(inputs);
+    batch.process_sample_output(output.value().sample_output);
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                            /*min_decoding_bach_size=*/0);
+    state.ResumeTiming();
+    auto output = worker->execute_model(inputs);
+    state.PauseTiming();
+    batch.process_sample_output(output.value().sample_output);
+    state.ResumeTiming();
+  }
+  state.counters["tokens_per_second"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * batch_size),
+      benchmark::Counter::kIsRate);
+  state.SetLabel(mode_name(mode));
+}
+
+// Measures the prefill throughput with the same modes.
+static void BM_cpu_prefill(benchmark::State& state) {
+  const auto mode = static_cast<CpuMode>(state.range(0));
+  const int64_t batch_size = state.range(1);
+
+  const int64_t num_blocks_per_seq =
+      (kNumPromptTokens + kMaxSteps * 2 + kBlockSize - 1) / kBlockSize;
+  const int64_t num_blocks = batch_size * num_blocks_per_seq + 1;
+  auto worker = create_worker(mode, num_blocks);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    BlockAllocator allocator(num_blocks, kBlockSize);
+    auto sequences = create_sequences(batch_size, &allocator);
+    Batch batch;
+    for (auto& sequence : sequences) {
+      batch.add(sequence.get());
+    }
+    auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                            /*min_decoding_bach_size=*/0);
+    state.ResumeTiming();
+    auto output = worker->execute_model(inputs);
+    benchmark::DoNotOptimize(output);
+  }
+  state.counters["tokens_per_second"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * batch_size * kNumPromptTokens),
+      benchmark::Counter::kIsRate);
+  state.SetLabel(mode_name(mode));
+}
+
+BENCHMARK(BM_cpu_decode)
+    ->ArgsProduct({{0, 1, 2}, {1, 16}})
+    ->Iterations(kMaxSteps)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_cpu_prefill)
+    ->ArgsProduct({{0, 1, 2}, {1, 4}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
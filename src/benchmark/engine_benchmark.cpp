@@ -0,0 +1,153 @@
+#include <benchmark/benchmark.h>
+#include <folly/futures/Future.h>
+#include <torch/torch.h>
+
+#include <memory>
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/tiny_model.h"
+#include "engine/worker.h"
+#include "memory/block_allocator.h"
+#include "models/model_args.h"
+#include "quantization/quant_args.h"
+#include "request/sequence.h"
+
+using namespace llm;
+
+namespace {
+constexpr int64_t kBlockSize = 16;
+constexpr int64_t kNumPromptTokens = 16;
+// upper bound of decoding steps per benchmark run
+constexpr int64_t kMaxSteps = 256;
+
+// workers on cpu, each one holds a full replica of the model since there is
+// no process group for cpu devices. only the first worker samples, the same
+// way as the driver in LLMEngine.
+std::vector<std::unique_ptr<Worker>> create_workers(int64_t num_workers,
+                                                    int64_t num_blocks) {
+  // a tiny llama model so that the step time is dominated by the overhead
+  ModelArgs args = tiny_model_args();
+  args.vocab_size(1024).max_position_embeddings(1024);
+  const std::vector<int64_t> kv_cache_shape = {
+      num_blocks, kBlockSize, args.n_kv_heads().value(), args.head_dim()};
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  for (int64_t i = 0; i < num_workers; ++i) {
+    ParallelArgs parallel_args(
+        static_cast<int32_t>(i), /*world_size=*/1, /*process_group=*/nullptr);
+    ModelRunner::Options runner_options;
+    runner_options.block_size(kBlockSize);
+    auto worker = std::make_unique<Worker>(
+        parallel_args, torch::Device(torch::kCPU), runner_options);
+    worker->init_model(torch::kFloat32, args, QuantArgs());
+    worker->init_kv_cache(kv_cache_shape);
+    workers.push_back(std::move(worker));
+  }
+  return workers;
+}
+
+// sequences that are done with prefill, each one decodes one token per step
+std::vector<std::unique_ptr<Sequence>> create_sequences(
+    int64_t batch_size,
+    BlockAllocator* allocator) {
+  Sequence::Options options;
+  options.stopping_criteria.max_tokens = kMaxSteps * 2;
+  options.stopping_criteria.ignore_eos = true;
+  const size_t capacity = kNumPromptTokens + kMaxSteps * 2;
+  const auto num_blocks_per_seq =
+      static_cast<uint32_t>((capacity + kBlockSize - 1) / kBlockSize);
+
+  std::vector<std::unique_ptr<Sequence>> sequences;
+  for (int64_t i = 0; i < batch_size; ++i) {
+    std::vector<int32_t> prompt_tokens(kNumPromptTokens, 1);
+    auto sequence =
+        std::make_unique<Sequence>(prompt_tokens, capacity, options);
+    sequence->append_blocks(allocator->allocate(num_blocks_per_seq));
+    sequence->commit_kv_cache(kNumPromptTokens);
+    sequence->append_token(1);
+    sequences.push_back(std::move(sequence));
+  }
+  return sequences;
+}
+
+}  // namespace
+
+// one decoding step the same way as LLMEngine::execute_model_async: build
+// inputs once, share them with all workers and process the driver's output.
+static void BM_engine_step(benchmark::State& state) {
+  const int64_t num_workers = state.range(0);
+  const int64_t batch_size = state.range(1);
+
+  const int64_t num_blocks_per_seq =
+      (kNumPromptTokens + kMaxSteps * 2 + kBlockSize - 1) / kBlockSize;
+  const int64_t num_blocks = batch_size * num_blocks_per_seq + 1;
+  auto workers = create_workers(num_workers, num_blocks);
+  BlockAllocator allocator(num_blocks, kBlockSize);
+  auto sequences = create_sequences(batch_size, &allocator);
+  Batch batch;
+  for (auto& sequence : sequences) {
+    batch.add(sequence.get());
+  }
+
+  for (auto _ : state) {
+    auto inputs = std::make_shared<const ModelInput>(
+        batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                  /*min_decoding_bach_size=*/0));
+    std::vector<folly::SemiFuture<std::optional<ModelOutput>>> futures;
+    futures.reserve(workers.size());
+    for (auto& worker : workers) {
+      futures.emplace_back(worker->execute_model_async(inputs));
+    }
+    auto results = folly::collectAll(futures).get();
+    const auto& output = results.front().value();
+    batch.process_sample_output(output.value().sample_output);
+  }
+  state.counters["step_time"] = benchmark::Counter(
+      static_cast<double>(state.iterations()),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+// the model time of one decoding step on a single worker without dispatching,
+// the difference to BM_engine_step is the per-step overhead.
+static void BM_worker_execute(benchmark::State& state) {
+  const int64_t batch_size = state.range(0);
+
+  const int64_t num_blocks_per_seq =
+      (kNumPromptTokens + kMaxSteps * 2 + kBlockSize - 1) / kBlockSize;
+  const int64_t num_blocks = batch_size * num_blocks_per_seq + 1;
+  auto workers = create_workers(/*num_workers=*/1, num_blocks);
+  BlockAllocator allocator(num_blocks, kBlockSize);
+  auto sequences = create_sequences(batch_size, &allocator);
+  Batch batch;
+  for (auto& sequence : sequences) {
+    batch.add(sequence.get());
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                            /*min_decoding_bach_size=*/0);
+    state.ResumeTiming();
+    auto output = workers.front()->execute_model(inputs);
+    state.PauseTiming();
+    batch.process_sample_output(output.value().sample_output);
+    state.ResumeTiming();
+  }
+  state.counters["step_time"] = benchmark::Counter(
+      static_cast<double>(state.iterations()),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+BENCHMARK(BM_engine_step)
+    ->ArgsProduct({{1, 2, 4, 8}, {1, 32}})
+    ->Iterations(kMaxSteps)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_worker_execute)
+    ->Arg(1)
+    ->Arg(32)
+    ->Iterations(kMaxSteps)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
@@ -0,0 +1,133 @@
+#include <benchmark/benchmark.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "memory/kv_cache.h"
+
+using namespace llm;
+
+namespace {
+constexpr int64_t kBlockSize = 16;
+// skip the shapes whose kv cache doesn't fit into a laptop
+constexpr int64_t kMaxKVBytes = int64_t(2) << 30;
+
+bool skip_oversized(benchmark::State& state,
+                    int64_t n_blocks,
+                    int64_t n_kv_heads,
+                    int64_t head_dim) {
+  const int64_t kv_bytes =
+      2 * n_blocks * kBlockSize * n_kv_heads * head_dim * sizeof(float);
+  if (kv_bytes > kMaxKVBytes) {
+    state.SkipWithMessage("kv cache is too large");
+    return true;
+  }
+  return false;
+}
+
+KVCache create_kv_cache(int64_t n_blocks,
+                        int64_t n_kv_heads,
+                        int64_t head_dim) {
+  const std::vector<int64_t> kv_shape = {
+      n_blocks, kBlockSize, n_kv_heads, head_dim};
+  return {torch::rand(kv_shape), torch::rand(kv_shape)};
+}
+
+// the block ids in a random order, as handed out by a long running allocator
+std::vector<int32_t> shuffled_block_ids(int64_t n_blocks) {
+  std::vector<int32_t> block_ids(n_blocks);
+  std::iota(block_ids.begin(), block_ids.end(), 0);
+  std::shuffle(block_ids.begin(), block_ids.end(), std::mt19937(0));
+  return block_ids;
+}
+
+void set_bytes_processed(benchmark::State& state,
+                         int64_t n_tokens,
+                         int64_t n_kv_heads,
+                         int64_t head_dim) {
+  state.SetBytesProcessed(state.iterations() * 2 * n_tokens * n_kv_heads *
+                          head_dim * static_cast<int64_t>(sizeof(float)));
+  state.SetItemsProcessed(state.iterations() * n_tokens);
+}
+
+}  // namespace
+
+// KVCache::set_kv_cache for the new tokens of a step: a decode batch with one
+// token per sequence, or a prompt.
+static void BM_kv_cache_set(benchmark::State& state) {
+  const int64_t head_dim = state.range(0);
+  const int64_t n_kv_heads = state.range(1);
+  const int64_t n_tokens = state.range(2);
+  const bool prefill = state.range(3) != 0;
+  const int64_t n_blocks = 1024;
+  if (skip_oversized(state, n_blocks, n_kv_heads, head_dim)) {
+    return;
+  }
+
+  KVCache kv_cache = create_kv_cache(n_blocks, n_kv_heads, head_dim);
+  // the prompt fills the slots of its blocks in order, while the tokens of a
+  // decode batch go to the blocks of different sequences
+  std::vector<int32_t> slot_ids;
+  slot_ids.reserve(n_tokens);
+  const auto block_ids = shuffled_block_ids(n_blocks);
+  for (int64_t i = 0; i < n_tokens; ++i) {
+    const int64_t block_idx = prefill ? i / kBlockSize : i;
+    const int64_t block_offset = prefill ? i % kBlockSize : 0;
+    slot_ids.push_back(block_ids[block_idx] * kBlockSize + block_offset);
+  }
+  torch::Tensor slots = torch::tensor(slot_ids, torch::kInt);
+  torch::Tensor keys = torch::rand({n_tokens, n_kv_heads, head_dim});
+  torch::Tensor values = torch::rand({n_tokens, n_kv_heads, head_dim});
+  for (auto _ : state) {
+    kv_cache.set_kv_cache(slots, keys, values);
+  }
+  set_bytes_processed(state, n_tokens, n_kv_heads, head_dim);
+}
+
+// KVCache::get_kv_cache for a batch of sequences with the same context length,
+// gathered from randomly placed blocks.
+static void BM_kv_cache_get(benchmark::State& state) {
+  const int64_t head_dim = state.range(0);
+  const int64_t n_kv_heads = state.range(1);
+  const int64_t kv_len = state.range(2);
+  const int64_t batch_size = state.range(3);
+  const int64_t n_blocks_per_seq = (kv_len + kBlockSize - 1) / kBlockSize;
+  const int64_t n_blocks = batch_size * n_blocks_per_seq;
+  if (skip_oversized(state, n_blocks, n_kv_heads, head_dim)) {
+    return;
+  }
+
+  KVCache kv_cache = create_kv_cache(n_blocks, n_kv_heads, head_dim);
+  torch::Tensor block_tables =
+      torch::tensor(shuffled_block_ids(n_blocks), torch::kInt)
+          .view({batch_size, n_blocks_per_seq});
+  torch::Tensor kv_cu_seq_lens =
+      torch::arange(0, batch_size * kv_len + 1, kv_len, torch::kInt);
+  for (auto _ : state) {
+    auto [keys, values] = kv_cache.get_kv_cache(block_tables, kv_cu_seq_lens);
+    benchmark::DoNotOptimize(keys.data_ptr());
+    benchmark::DoNotOptimize(values.data_ptr());
+  }
+  set_bytes_processed(state, batch_size * kv_len, n_kv_heads, head_dim);
+}
+
+// head_dim x kv heads x new tokens: decode batches of 1-256 and prompts of
+// 512-8k tokens
+BENCHMARK(BM_kv_cache_set)
+    ->ArgNames({"head_dim", "kv_heads", "tokens", "prefill"})
+    ->ArgsProduct({{64, 128}, {4, 8, 32}, {1, 16, 64, 256}, {0}})
+    ->ArgsProduct({{64, 128}, {4, 8, 32}, {512, 2048, 8192}, {1}})
+    ->Unit(benchmark::kMicrosecond);
+
+// head_dim x kv heads x context length x batch size
+BENCHMARK(BM_kv_cache_get)
+    ->ArgNames({"head_dim", "kv_heads", "kv_len", "batch"})
+    ->ArgsProduct({{64, 128},
+                   {4, 8, 32},
+                   {512, 2048, 8192, 32768},
+                   {1, 16, 64, 256}})
+    ->Unit(benchmark::kMillisecond);
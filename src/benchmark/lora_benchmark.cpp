@@ -0,0 +1,108 @@
+#include <benchmark/benchmark.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "layers/lora.h"
+#include "model_loader/state_dict.h"
+#include "model_parallel/parallel_args.h"
+#include "models/parameters.h"
+
+using namespace llm;
+
+namespace {
+constexpr int64_t kHiddenSize = 4096;
+constexpr int64_t kRank = 16;
+
+// a lora layer with n_adapters random adapters of rank kRank
+LoraLinear create_lora(int64_t n_adapters) {
+  LoraLinear lora(kHiddenSize,
+                  std::vector<int64_t>{kHiddenSize},
+                  /*row_parallel=*/false,
+                  /*max_loras=*/n_adapters,
+                  /*max_rank=*/kRank,
+                  ParallelArgs(0, 1, nullptr),
+                  torch::dtype(torch::kFloat));
+  for (int32_t slot = 1; slot <= n_adapters; ++slot) {
+    std::unordered_map<std::string, torch::Tensor> dict;
+    dict["lora_A.weight"] = torch::randn({kRank, kHiddenSize});
+    dict["lora_B.weight"] = torch::randn({kHiddenSize, kRank});
+    lora->load_adapter(
+        slot, StateDict(std::move(dict)), {""}, /*scaling=*/1.0f);
+  }
+  return lora;
+}
+
+// the tokens of each sequence are contiguous and spread over the adapters
+InputParameters create_params(int64_t n_seqs,
+                              int64_t tokens_per_seq,
+                              int64_t n_adapters) {
+  InputParameters params;
+  params.q_max_seq_len = static_cast<int32_t>(tokens_per_seq);
+  std::vector<int32_t> slot_ids;
+  for (int64_t i = 0; i < n_seqs; ++i) {
+    const auto slot = static_cast<int32_t>(i % n_adapters + 1);
+    slot_ids.insert(slot_ids.end(), tokens_per_seq, slot);
+  }
+  for (int32_t slot = 1; slot <= std::min(n_seqs, n_adapters); ++slot) {
+    params.lora_slots.push_back(slot);
+  }
+  params.lora_slot_ids = torch::tensor(slot_ids, torch::kInt);
+  return params;
+}
+
+}  // namespace
+
+// Measures the low rank updates of a batch mixing n_adapters adapters on top
+// of a (4096, 4096) linear layer. decoding batches (1 token per sequence) run
+// bgmv while prefill batches (64 tokens per sequence) run sgmv.
+static void BM_lora_linear(benchmark::State& state) {
+  const int64_t n_adapters = state.range(0);
+  const int64_t n_seqs = state.range(1);
+  const int64_t tokens_per_seq = state.range(2);
+  const int64_t n_tokens = n_seqs * tokens_per_seq;
+
+  auto lora = create_lora(n_adapters);
+  const auto params = create_params(n_seqs, tokens_per_seq, n_adapters);
+  const auto input = torch::randn({n_tokens, kHiddenSize});
+  auto output = torch::zeros({n_tokens, kHiddenSize});
+
+  for (auto _ : state) {
+    lora->forward(input, output, params);
+    benchmark::DoNotOptimize(output);
+  }
+  state.counters["tokens_per_second"] =
+      benchmark::Counter(static_cast<double>(state.iterations() * n_tokens),
+                         benchmark::Counter::kIsRate);
+}
+
+// Baseline: the dense base layer of the same shape, the lora overhead should
+// stay a small fraction of it.
+static void BM_base_linear(benchmark::State& state) {
+  const int64_t n_seqs = state.range(1);
+  const int64_t tokens_per_seq = state.range(2);
+  const int64_t n_tokens = n_seqs * tokens_per_seq;
+
+  const auto weight = torch::randn({kHiddenSize, kHiddenSize});
+  const auto input = torch::randn({n_tokens, kHiddenSize});
+  for (auto _ : state) {
+    auto output = torch::nn::functional::linear(input, weight);
+    benchmark::DoNotOptimize(output);
+  }
+  state.counters["tokens_per_second"] =
+      benchmark::Counter(static_cast<double>(state.iterations() * n_tokens),
+                         benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_lora_linear)
+    ->ArgsProduct({{1, 4, 16}, {16, 64}, {1, 64}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_base_linear)
+    ->ArgsProduct({{1}, {16, 64}, {1, 64}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
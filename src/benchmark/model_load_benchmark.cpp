@@ -0,0 +1,115 @@
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <torch/torch.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "model_loader/state_dict.h"
+#include "model_loader/state_dict_prefetcher.h"
+
+using namespace llm;
+
+namespace {
+// total size of the checkpoint, split evenly across the shards
+constexpr int64_t kCheckpointBytes = int64_t(1) << 30;
+// size of each tensor in the checkpoint
+constexpr int64_t kTensorBytes = int64_t(16) << 20;
+
+// write a safetensors file with the given number of float tensors
+void write_safetensors(const std::string& path, int64_t num_tensors) {
+  const int64_t numel = kTensorBytes / static_cast<int64_t>(sizeof(float));
+  nlohmann::json header;
+  for (int64_t i = 0; i < num_tensors; ++i) {
+    header["tensor_" + std::to_string(i)] = {
+        {"dtype", "F32"},
+        {"shape", {numel}},
+        {"data_offsets", {i * kTensorBytes, (i + 1) * kTensorBytes}}};
+  }
+  const std::string header_str = header.dump();
+  const uint64_t header_size = header_str.size();
+
+  std::ofstream file(path, std::ios::binary);
+  // 8 bytes little endian header size, then the json header and the data
+  file.write(reinterpret_cast<const char*>(&header_size), sizeof(header_size));
+  file.write(header_str.data(), static_cast<std::streamsize>(header_size));
+  const auto tensor = torch::rand({numel});
+  for (int64_t i = 0; i < num_tensors; ++i) {
+    file.write(static_cast<const char*>(tensor.data_ptr()), kTensorBytes);
+  }
+}
+
+// the checkpoint split into num_shards files, created once per shard count
+const std::vector<std::string>& checkpoint_files(int64_t num_shards) {
+  static std::map<int64_t, std::vector<std::string>> checkpoints;
+  auto& files = checkpoints[num_shards];
+  if (!files.empty()) {
+    return files;
+  }
+  const auto dir = std::filesystem::temp_directory_path() /
+                   ("model_load_benchmark_" + std::to_string(num_shards));
+  std::filesystem::create_directories(dir);
+  const int64_t tensors_per_shard =
+      kCheckpointBytes / kTensorBytes / num_shards;
+  for (int64_t i = 0; i < num_shards; ++i) {
+    const auto path =
+        (dir / ("model-" + std::to_string(i) + ".safetensors")).string();
+    write_safetensors(path, tensors_per_shard);
+    files.push_back(path);
+  }
+  return files;
+}
+
+// drop the files from the page cache to measure a cold start
+void evict_page_cache(const std::vector<std::string>& files) {
+  for (const auto& path : files) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+}
+
+}  // namespace
+
+// Measures the time to map the checkpoint and copy every tensor into model
+// weights against the number of shards and the prefetch window. the page
+// cache is dropped before each iteration.
+static void BM_model_load(benchmark::State& state) {
+  const int64_t num_shards = state.range(0);
+  const auto max_prefetch = static_cast<size_t>(state.range(1));
+  const auto& files = checkpoint_files(num_shards);
+
+  // preallocated model weights, as the workers load into existing tensors
+  const int64_t numel = kTensorBytes / static_cast<int64_t>(sizeof(float));
+  auto weight = torch::empty({numel});
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    evict_page_cache(files);
+    state.ResumeTiming();
+
+    StateDictPrefetcher prefetcher(files, /*is_pickle=*/false, max_prefetch);
+    while (auto state_dict = prefetcher.next()) {
+      for (const auto& [name, tensor] : *state_dict) {
+        weight.copy_(tensor);
+      }
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * kCheckpointBytes);
+}
+
+BENCHMARK(BM_model_load)
+    ->ArgsProduct({{1, 2, 4, 8, 16}, {1, 2, 4}})
+    ->ArgNames({"shards", "prefetch"})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
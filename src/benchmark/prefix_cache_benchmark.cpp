@@ -0,0 +1,323 @@
+#include <benchmark/benchmark.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "memory/block.h"
+#include "memory/prefix_cache.h"
+
+DEFINE_string(trace,
+              "",
+              "path to a jsonl token trace to replay, one request per line "
+              "as {\"token_ids\": [...], \"lora_adapter\": \"...\"}. a "
+              "synthetic RAG like trace is replayed if empty");
+
+DEFINE_int32(block_size, 16, "block size of the prefix cache");
+
+using namespace llm;
+
+namespace {
+const char* const kPolicies[] = {"lru", "lfu", "gdsf"};
+
+struct TraceEntry {
+  std::vector<int32_t> token_ids;
+  std::string key;
+};
+
+std::vector<TraceEntry> load_trace(const std::string& path) {
+  std::ifstream file(path);
+  CHECK(file.is_open()) << "Failed to open trace: " << path;
+  std::vector<TraceEntry> trace;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    const auto json = nlohmann::json::parse(line);
+    TraceEntry entry;
+    entry.token_ids = json.at("token_ids").get<std::vector<int32_t>>();
+    entry.key = json.value("lora_adapter", "");
+    trace.push_back(std::move(entry));
+  }
+  return trace;
+}
+
+// prompts made of one of a few system prompts, a document picked with a zipf
+// distribution and a unique question. one in ten requests brings a long
+// one-off document instead.
+std::vector<TraceEntry> synthetic_trace() {
+  constexpr size_t kNumRequests = 5000;
+  constexpr size_t kNumSystemPrompts = 4;
+  constexpr size_t kNumDocuments = 200;
+  constexpr int32_t kVocabSize = 32000;
+
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int32_t> token(0, kVocabSize - 1);
+  const auto random_tokens = [&](size_t n) {
+    std::vector<int32_t> tokens(n);
+    std::generate(tokens.begin(), tokens.end(), [&] { return token(gen); });
+    return tokens;
+  };
+
+  std::vector<std::vector<int32_t>> system_prompts;
+  for (size_t i = 0; i < kNumSystemPrompts; ++i) {
+    system_prompts.push_back(random_tokens(256));
+  }
+  std::vector<std::vector<int32_t>> documents;
+  std::uniform_int_distribution<size_t> document_size(512, 2048);
+  std::vector<double> weights;
+  for (size_t i = 0; i < kNumDocuments; ++i) {
+    documents.push_back(random_tokens(document_size(gen)));
+    weights.push_back(1.0 / static_cast<double>(i + 1));
+  }
+
+  std::uniform_int_distribution<size_t> system_prompt(0,
+                                                      kNumSystemPrompts - 1);
+  std::discrete_distribution<size_t> document(weights.begin(), weights.end());
+  std::uniform_int_distribution<size_t> question_size(32, 128);
+  std::bernoulli_distribution one_off(0.1);
+
+  std::vector<TraceEntry> trace;
+  trace.reserve(kNumRequests);
+  for (size_t i = 0; i < kNumRequests; ++i) {
+    TraceEntry entry;
+    entry.token_ids = system_prompts[system_prompt(gen)];
+    const auto doc =
+        one_off(gen) ? random_tokens(4096) : documents[document(gen)];
+    const auto question = random_tokens(question_size(gen));
+    entry.token_ids.insert(entry.token_ids.end(), doc.begin(), doc.end());
+    entry.token_ids.insert(
+        entry.token_ids.end(), question.begin(), question.end());
+    trace.push_back(std::move(entry));
+  }
+  return trace;
+}
+
+const std::vector<TraceEntry>& trace() {
+  static const std::vector<TraceEntry> trace =
+      FLAGS_trace.empty() ? synthetic_trace() : load_trace(FLAGS_trace);
+  return trace;
+}
+
+// the number of distinct full blocks in the trace, i.e. the cache size to
+// never evict
+size_t working_set_blocks(const std::vector<TraceEntry>& trace,
+                          uint32_t block_size) {
+  PrefixCache cache(block_size);
+  int32_t next_block_id = 0;
+  for (const auto& entry : trace) {
+    std::vector<Block> blocks = cache.match(entry.token_ids, entry.key);
+    const size_t n_blocks = entry.token_ids.size() / block_size;
+    while (blocks.size() < n_blocks) {
+      blocks.emplace_back(next_block_id++, block_size);
+    }
+    cache.insert(entry.token_ids, blocks, entry.key);
+  }
+  return cache.num_blocks();
+}
+
+struct ReplayStats {
+  size_t num_prompt_tokens = 0;
+  size_t num_cached_tokens = 0;
+};
+
+// replay the trace with a prefix cache holding at most num_blocks blocks
+ReplayStats replay(const std::vector<TraceEntry>& trace,
+                   const std::string& policy,
+                   size_t num_blocks,
+                   uint32_t block_size) {
+  PrefixCache cache(block_size, policy);
+  ReplayStats stats;
+  int32_t next_block_id = 0;
+  for (const auto& entry : trace) {
+    // the matched blocks are held by the request and can't be evicted
+    std::vector<Block> blocks = cache.match(entry.token_ids, entry.key);
+    stats.num_prompt_tokens += entry.token_ids.size();
+    stats.num_cached_tokens += blocks.size() * block_size;
+
+    const size_t n_blocks =
+        (entry.token_ids.size() + block_size - 1) / block_size;
+    const size_t n_new_blocks = n_blocks - blocks.size();
+    if (cache.num_blocks() + n_new_blocks > num_blocks) {
+      cache.evict(cache.num_blocks() + n_new_blocks - num_blocks);
+    }
+    while (blocks.size() < n_blocks) {
+      blocks.emplace_back(next_block_id++, block_size);
+    }
+    cache.insert(entry.token_ids, blocks, entry.key);
+  }
+  return stats;
+}
+
+// sequences of n_tokens sharing a system prompt of 256 tokens
+std::vector<std::vector<int32_t>> random_sequences(size_t n_sequences,
+                                                   size_t n_tokens) {
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int32_t> token(0, 31999);
+  std::vector<int32_t> system_prompt(std::min<size_t>(256, n_tokens));
+  std::generate(
+      system_prompt.begin(), system_prompt.end(), [&] { return token(gen); });
+
+  std::vector<std::vector<int32_t>> sequences(n_sequences);
+  for (auto& sequence : sequences) {
+    sequence = system_prompt;
+    while (sequence.size() < n_tokens) {
+      sequence.push_back(token(gen));
+    }
+  }
+  return sequences;
+}
+
+// insert the sequences into the cache with new blocks
+void fill(PrefixCache& cache,
+          const std::vector<std::vector<int32_t>>& sequences,
+          uint32_t block_size) {
+  int32_t next_block_id = 0;
+  for (const auto& sequence : sequences) {
+    std::vector<Block> blocks = cache.match(sequence);
+    const size_t n_blocks = sequence.size() / block_size;
+    while (blocks.size() < n_blocks) {
+      blocks.emplace_back(next_block_id++, block_size);
+    }
+    cache.insert(sequence, blocks);
+  }
+}
+
+}  // namespace
+
+// Replays the token trace with each eviction policy and a prefix cache sized
+// to a share of the working set, and reports the hit rate and the number of
+// prompt tokens to recompute.
+static void BM_prefix_cache_replay(benchmark::State& state) {
+  const std::string policy = kPolicies[state.range(0)];
+  const double cache_ratio = static_cast<double>(state.range(1)) / 100.0;
+  const uint32_t block_size = FLAGS_block_size;
+  const auto& requests = trace();
+  static const size_t total_blocks = working_set_blocks(requests, block_size);
+  const size_t num_blocks = std::max<size_t>(
+      1, static_cast<size_t>(std::lround(total_blocks * cache_ratio)));
+
+  ReplayStats stats;
+  for (auto _ : state) {
+    stats = replay(requests, policy, num_blocks, block_size);
+  }
+
+  state.counters["hit_rate"] =
+      static_cast<double>(stats.num_cached_tokens) /
+      static_cast<double>(std::max<size_t>(stats.num_prompt_tokens, 1));
+  state.counters["recomputed_tokens"] =
+      static_cast<double>(stats.num_prompt_tokens - stats.num_cached_tokens);
+  state.counters["cache_blocks"] = static_cast<double>(num_blocks);
+  state.SetLabel(policy);
+}
+
+BENCHMARK(BM_prefix_cache_replay)
+    ->ArgsProduct({{0, 1, 2}, {10, 25, 50}})
+    ->Unit(benchmark::kMillisecond);
+
+// PrefixCache::match of a cached sequence among n_sequences.
+static void BM_prefix_cache_match(benchmark::State& state) {
+  const size_t n_tokens = state.range(0);
+  const size_t n_sequences = state.range(1);
+  const uint32_t block_size = FLAGS_block_size;
+  const auto sequences = random_sequences(n_sequences, n_tokens);
+  PrefixCache cache(block_size);
+  fill(cache, sequences, block_size);
+
+  size_t idx = 0;
+  for (auto _ : state) {
+    auto blocks = cache.match(sequences[idx++ % n_sequences]);
+    benchmark::DoNotOptimize(blocks.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n_tokens);
+}
+
+// PrefixCache::insert of n_sequences into an empty cache, the first blocks
+// are shared with the sequences inserted before.
+static void BM_prefix_cache_insert(benchmark::State& state) {
+  const size_t n_tokens = state.range(0);
+  const size_t n_sequences = state.range(1);
+  const uint32_t block_size = FLAGS_block_size;
+  const auto sequences = random_sequences(n_sequences, n_tokens);
+  // distinct blocks for each sequence
+  std::vector<std::vector<Block>> blocks(n_sequences);
+  int32_t next_block_id = 0;
+  for (auto& sequence_blocks : blocks) {
+    for (size_t i = 0; i < n_tokens / block_size; ++i) {
+      sequence_blocks.emplace_back(next_block_id++, block_size);
+    }
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto cache = std::make_unique<PrefixCache>(block_size);
+    state.ResumeTiming();
+    for (size_t i = 0; i < n_sequences; ++i) {
+      cache->insert(sequences[i], blocks[i]);
+    }
+    state.PauseTiming();
+    cache.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n_sequences * n_tokens);
+}
+
+// PrefixCache::evict of all blocks from a full cache, a sequence worth of
+// blocks at a time as for admitting new sequences.
+static void BM_prefix_cache_evict(benchmark::State& state) {
+  const std::string policy = kPolicies[state.range(2)];
+  const size_t n_tokens = state.range(0);
+  const size_t n_sequences = state.range(1);
+  const uint32_t block_size = FLAGS_block_size;
+  const auto sequences = random_sequences(n_sequences, n_tokens);
+  const size_t n_blocks_per_sequence =
+      std::max<size_t>(1, n_tokens / block_size);
+
+  size_t n_evicted = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    PrefixCache cache(block_size, policy);
+    fill(cache, sequences, block_size);
+    state.ResumeTiming();
+    while (cache.num_blocks() > 0) {
+      n_evicted += cache.evict(n_blocks_per_sequence);
+    }
+  }
+  state.SetItemsProcessed(n_evicted);
+  state.SetLabel(policy);
+}
+
+// prompt length x cached sequences
+BENCHMARK(BM_prefix_cache_match)
+    ->ArgNames({"tokens", "sequences"})
+    ->ArgsProduct({{512, 2048, 8192, 32768}, {256, 1024}})
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_prefix_cache_insert)
+    ->ArgNames({"tokens", "sequences"})
+    ->ArgsProduct({{512, 2048, 8192, 32768}, {256}})
+    ->Unit(benchmark::kMillisecond);
+
+// prompt length x cached sequences x eviction policy
+BENCHMARK(BM_prefix_cache_evict)
+    ->ArgNames({"tokens", "sequences", "policy"})
+    ->ArgsProduct({{512, 2048, 8192, 32768}, {256}, {0, 1, 2}})
+    ->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, /*remove_flags=*/true);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
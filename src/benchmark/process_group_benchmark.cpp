@@ -0,0 +1,58 @@
+#include <benchmark/benchmark.h>
+#include <torch/torch.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "model_parallel/process_group.h"
+
+using namespace llm;
+
+namespace {
+
+// process groups shared by benchmark threads, one rank per thread
+ProcessGroup* get_process_group(int world_size, int rank) {
+  static std::mutex mutex;
+  static std::map<int, std::vector<std::unique_ptr<ProcessGroup>>> groups;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& process_groups = groups[world_size];
+  if (process_groups.empty()) {
+    const std::vector<torch::Device> devices(world_size, torch::kCPU);
+    process_groups = ProcessGroup::create_process_groups(devices);
+  }
+  return process_groups[rank].get();
+}
+
+}  // namespace
+
+// Measures the allreduce bandwidth of the shared memory process group, each
+// benchmark thread acts as one rank.
+static void BM_shm_allreduce(benchmark::State& state) {
+  const int world_size = state.threads();
+  const int64_t num_bytes = state.range(0);
+  const auto dtype = torch::kFloat;
+  const int64_t numel = num_bytes / static_cast<int64_t>(sizeof(float));
+
+  auto* pg = get_process_group(world_size, state.thread_index());
+  auto tensor = torch::rand({numel}, dtype);
+  for (auto _ : state) {
+    pg->allreduce(tensor);
+    benchmark::DoNotOptimize(tensor.data_ptr());
+  }
+
+  // algorithm bandwidth: the size of the tensor reduced per second
+  state.counters["algbw"] =
+      benchmark::Counter(static_cast<double>(num_bytes) * state.iterations(),
+                         benchmark::Counter::kIsRate |
+                             benchmark::Counter::kAvgThreads,
+                         benchmark::Counter::kIs1024);
+}
+
+BENCHMARK(BM_shm_allreduce)
+    ->RangeMultiplier(4)
+    ->Range(4 << 10, 64 << 20)
+    ->ThreadRange(2, 8)
+    ->UseRealTime();
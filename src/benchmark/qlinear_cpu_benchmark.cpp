@@ -0,0 +1,98 @@
+#include <benchmark/benchmark.h>
+#include <torch/torch.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "model_loader/state_dict.h"
+#include "model_parallel/parallel_args.h"
+#include "quantization/pack_utils.h"
+#include "quantization/qlinear_cpu_impl.h"
+#include "quantization/quant_args.h"
+
+using namespace llm;
+
+namespace {
+constexpr int64_t kGroupSize = 128;
+
+// random 4-bit gptq checkpoint for a (k, n) weight
+StateDict random_gptq_state_dict(int64_t k, int64_t n) {
+  const int64_t n_groups = k / kGroupSize;
+  const auto q = torch::randint(0, 16, {k, n}, torch::kInt);
+  const auto z = torch::randint(0, 15, {n_groups, n}, torch::kInt);
+  std::unordered_map<std::string, torch::Tensor> dict;
+  dict["qweight"] = pack_utils::pack_cols(q.t().contiguous(), /*num_bits=*/4)
+                        .t()
+                        .contiguous();
+  dict["qzeros"] = pack_utils::pack_cols(z, /*num_bits=*/4);
+  dict["scales"] = (torch::rand({n_groups, n}) / 16).to(torch::kHalf);
+  return StateDict(std::move(dict));
+}
+
+}  // namespace
+
+// Measures the int4 gemm on cpu for a (k, n) = (4096, 4096) gptq weight.
+static void BM_qlinear_int4_cpu(benchmark::State& state) {
+  const int64_t m = state.range(0);
+  const auto dtype = static_cast<torch::ScalarType>(state.range(1));
+  const int64_t k = 4096;
+  const int64_t n = 4096;
+
+  QuantArgs quant_args;
+  quant_args.quant_method("gptq").bits(4).group_size(kGroupSize);
+  ColumnParallelQLinearCpuImpl qlinear(k,
+                                       n,
+                                       /*bias=*/false,
+                                       quant_args,
+                                       /*gather_output=*/false,
+                                       ParallelArgs(0, 1, nullptr),
+                                       torch::dtype(dtype));
+  qlinear.load_state_dict(random_gptq_state_dict(k, n));
+  const auto input = torch::randn({m, k}, dtype);
+
+  for (auto _ : state) {
+    auto output = qlinear.forward(input);
+    benchmark::DoNotOptimize(output);
+  }
+  state.counters["tokens_per_second"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * m), benchmark::Counter::kIsRate);
+  state.counters["GFLOPS"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * 2 * m * k * n) / 1e9,
+      benchmark::Counter::kIsRate);
+  state.SetLabel(c10::toString(dtype));
+}
+
+// Baseline: the same shape with dense weights in the input dtype.
+static void BM_linear_dense_cpu(benchmark::State& state) {
+  const int64_t m = state.range(0);
+  const auto dtype = static_cast<torch::ScalarType>(state.range(1));
+  const int64_t k = 4096;
+  const int64_t n = 4096;
+
+  const auto weight = torch::randn({n, k}, dtype);
+  const auto input = torch::randn({m, k}, dtype);
+  for (auto _ : state) {
+    auto output = torch::nn::functional::linear(input, weight);
+    benchmark::DoNotOptimize(output);
+  }
+  state.counters["tokens_per_second"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * m), benchmark::Counter::kIsRate);
+  state.counters["GFLOPS"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * 2 * m * k * n) / 1e9,
+      benchmark::Counter::kIsRate);
+  state.SetLabel(c10::toString(dtype));
+}
+
+BENCHMARK(BM_qlinear_int4_cpu)
+    ->ArgsProduct({{1, 16, 64},
+                   {static_cast<int64_t>(torch::kFloat),
+                    static_cast<int64_t>(torch::kBFloat16)}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK(BM_linear_dense_cpu)
+    ->ArgsProduct({{1, 16, 64},
+                   {static_cast<int64_t>(torch::kFloat),
+                    static_cast<int64_t>(torch::kBFloat16)}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
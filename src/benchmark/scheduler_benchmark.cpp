@@ -0,0 +1,193 @@
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <torch/torch.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine/llm_engine.h"
+#include "engine/simulated_engine.h"
+#include "engine/tiny_model.h"
+#include "models/model_args.h"
+#include "scheduler/continuous_scheduler.h"
+
+using namespace llm;
+
+namespace {
+
+// a tiny llama checkpoint with random weights on the local disk, removed on
+// exit
+class TinyCheckpoint {
+ public:
+  TinyCheckpoint()
+      : dir_((std::filesystem::temp_directory_path() /
+              ("scheduler_benchmark_" + std::to_string(getpid())))
+                 .string()) {
+    ModelArgs args = tiny_model_args();
+    args.vocab_size(1024).max_position_embeddings(4096);
+    torch::manual_seed(0);
+    save_tiny_model(args, random_state_dict(args), dir_);
+  }
+
+  ~TinyCheckpoint() { std::filesystem::remove_all(dir_); }
+
+  const std::string& path() const { return dir_; }
+
+ private:
+  std::string dir_;
+};
+
+// LLMEngine serving the tiny model on cpu, so that the step time is dominated
+// by the host overhead.
+std::unique_ptr<LLMEngine> create_tiny_engine() {
+  static const TinyCheckpoint checkpoint;
+  LLMEngine::Options options;
+  options.devices({torch::Device(torch::kCPU)})
+      .block_size(16)
+      // 4096 blocks of the tiny model
+      .max_cache_size(int64_t(64) << 20)
+      .enable_prefix_cache(false)
+      .enable_cuda_graph(false);
+  auto engine = std::make_unique<LLMEngine>(options);
+  CHECK(engine->init(checkpoint.path()));
+  return engine;
+}
+
+std::unique_ptr<Request> create_request(size_t num_prompt_tokens,
+                                        size_t max_tokens,
+                                        float frequency_penalty = 0) {
+  std::vector<int32_t> prompt_tokens(num_prompt_tokens, 1);
+  const size_t capacity = num_prompt_tokens + max_tokens + 1;
+  auto request = std::make_unique<Request>("",
+                                           std::move(prompt_tokens),
+                                           capacity,
+                                           /*n=*/1,
+                                           /*best_of=*/1,
+                                           /*logprobs=*/false);
+  request->stopping_criteria.max_tokens = max_tokens;
+  request->stopping_criteria.ignore_eos = true;
+  request->sampling_param.frequency_penalty = frequency_penalty;
+  request->on_output = [](const RequestOutput& /*output*/) { return true; };
+  request->add_sequence();
+  return request;
+}
+
+}  // namespace
+
+// Measures the average wall time per step with and without overlapping the
+// scheduling work with the model execution.
+static void BM_scheduler_step(benchmark::State& state) {
+  const bool enable_overlap_scheduling = state.range(0) != 0;
+  const int64_t num_requests = state.range(1);
+  const auto model_time = absl::Microseconds(state.range(2));
+
+  size_t total_steps = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    SimulatedEngine::Options engine_options;
+    engine_options.num_blocks(16384).step_latency(model_time).real_time(true);
+    SimulatedEngine engine(engine_options);
+    ContinuousScheduler::Options options;
+    options.max_tokens_per_batch(1024)
+        .max_seqs_per_batch(128)
+        .enable_overlap_scheduling(enable_overlap_scheduling);
+    ContinuousScheduler scheduler(&engine, options);
+    for (int64_t i = 0; i < num_requests; ++i) {
+      auto request = create_request(/*num_prompt_tokens=*/64,
+                                    /*max_tokens=*/32);
+      scheduler.schedule(request);
+    }
+    state.ResumeTiming();
+
+    scheduler.run_until_complete();
+    total_steps += engine.num_steps();
+  }
+
+  // seconds per step
+  state.counters["step_time"] = benchmark::Counter(
+      static_cast<double>(total_steps),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  state.counters["steps"] = static_cast<double>(total_steps) /
+                            static_cast<double>(state.iterations());
+  state.SetLabel(enable_overlap_scheduling ? "overlap" : "sequential");
+}
+
+BENCHMARK(BM_scheduler_step)
+    ->ArgsProduct({{0, 1}, {256, 1024}, {1000, 5000}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Measures the latency from scheduling a request on an idle scheduler to the
+// step running it. The scheduler loop blocks on the idle engine until the
+// request wakes it up.
+static void BM_idle_wakeup(benchmark::State& state) {
+  SimulatedEngine::Options engine_options;
+  engine_options.num_blocks(1024).real_time(true);
+  SimulatedEngine engine(engine_options);
+  absl::Time step_time;
+  engine.set_step_callback(
+      [&step_time](Batch& /*batch*/) { step_time = absl::Now(); });
+  ContinuousScheduler scheduler(&engine, ContinuousScheduler::Options());
+
+  for (auto _ : state) {
+    std::thread loop([&scheduler]() { scheduler.step(absl::Seconds(10)); });
+    // let the loop block on the idle scheduler
+    absl::SleepFor(absl::Milliseconds(5));
+    auto request = create_request(/*num_prompt_tokens=*/8, /*max_tokens=*/1);
+    const auto schedule_time = absl::Now();
+    scheduler.schedule(request);
+    loop.join();
+    state.SetIterationTime(absl::ToDoubleSeconds(step_time - schedule_time));
+  }
+}
+
+BENCHMARK(BM_idle_wakeup)->UseManualTime()->Unit(benchmark::kMicrosecond);
+
+// Measures the decoding throughput of a tiny model on cpu with K decode
+// iterations per scheduler step, all requests are scheduled up front. The
+// inputs of the following steps are advanced on the device, unless the
+// requests sample with penalties, which need the token counts built on the
+// host for each step.
+static void BM_multi_step_decode(benchmark::State& state) {
+  const int32_t num_decode_steps = static_cast<int32_t>(state.range(0));
+  const int64_t num_requests = state.range(1);
+  const bool decode_on_device = state.range(2) != 0;
+  constexpr size_t kMaxTokens = 128;
+
+  const float frequency_penalty = decode_on_device ? 0.0f : 0.1f;
+  auto engine = create_tiny_engine();
+  size_t total_tokens = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    ContinuousScheduler::Options options;
+    options.max_tokens_per_batch(1024)
+        .max_seqs_per_batch(64)
+        .num_decode_steps(num_decode_steps);
+    ContinuousScheduler scheduler(engine.get(), options);
+    for (int64_t i = 0; i < num_requests; ++i) {
+      auto request = create_request(
+          /*num_prompt_tokens=*/16, kMaxTokens, frequency_penalty);
+      scheduler.schedule(request);
+    }
+    state.ResumeTiming();
+
+    scheduler.run_until_complete();
+    total_tokens += num_requests * kMaxTokens;
+  }
+
+  state.counters["tokens_per_second"] = benchmark::Counter(
+      static_cast<double>(total_tokens), benchmark::Counter::kIsRate);
+  state.SetLabel("K=" + std::to_string(num_decode_steps) +
+                 (decode_on_device ? ",device" : ",host"));
+}
+
+BENCHMARK(BM_multi_step_decode)
+    ->ArgsProduct({{1, 4, 8}, {1, 32}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,317 @@
+#include <absl/time/time.h>
+#include <benchmark/benchmark.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "engine/simulated_engine.h"
+#include "request/request.h"
+#include "scheduler/continuous_scheduler.h"
+#include "scheduler/scheduler_policy.h"
+
+DEFINE_int32(num_requests, 4000, "number of requests submitted up front");
+
+DEFINE_int32(num_tenants, 8, "number of tenants issuing the requests");
+
+DEFINE_double(heavy_tenant_share,
+              0.5,
+              "share of the requests issued by the first tenant, the rest "
+              "is spread evenly over the other tenants");
+
+DEFINE_int32(system_prompt_tokens,
+             256,
+             "tokens of the system prompt shared by the requests of a tenant");
+
+DEFINE_int32(min_prompt_tokens, 64, "min number of prompt tokens");
+
+DEFINE_int32(max_prompt_tokens, 2048, "max number of prompt tokens");
+
+DEFINE_int32(min_output_tokens, 16, "min number of output tokens");
+
+DEFINE_int32(max_output_tokens, 512, "max number of output tokens");
+
+DEFINE_int32(block_size, 16, "number of slots per block");
+
+DEFINE_bool(enable_prefix_cache, true, "enable the prefix cache");
+
+DEFINE_int32(max_tokens_per_batch, 2048, "max number of tokens per batch");
+
+DEFINE_int32(max_seqs_per_batch, 256, "max number of sequences per batch");
+
+DEFINE_int32(num_decode_steps, 1, "decode iterations per scheduler step");
+
+DEFINE_int64(step_latency_us, 5000, "fixed latency of each step");
+
+DEFINE_double(prefill_token_latency_us,
+              20,
+              "latency of each token of prefill sequences");
+
+DEFINE_double(decode_token_latency_us,
+              50,
+              "latency of each token of decode sequences");
+
+DEFINE_double(context_token_latency_us,
+              0.01,
+              "latency of each kv cache token read");
+
+using namespace llm;
+
+namespace {
+struct RequestSpec {
+  int32_t tenant = 0;
+  std::vector<int32_t> prompt_tokens;
+  size_t max_tokens = 0;
+};
+
+// requests with random prompt and output lengths, the prompts of a tenant
+// start with its own system prompt. the first tenant issues a large share of
+// the requests, so an unfair policy lets it crowd out the others.
+std::vector<RequestSpec> synthetic_workload() {
+  constexpr int32_t kVocabSize = 32000;
+  const int32_t num_tenants = std::max(FLAGS_num_tenants, 1);
+
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int32_t> token(0, kVocabSize - 1);
+  std::uniform_int_distribution<size_t> prompt_len(FLAGS_min_prompt_tokens,
+                                                   FLAGS_max_prompt_tokens);
+  std::uniform_int_distribution<size_t> output_len(FLAGS_min_output_tokens,
+                                                   FLAGS_max_output_tokens);
+  std::bernoulli_distribution heavy(FLAGS_heavy_tenant_share);
+  std::uniform_int_distribution<int32_t> light_tenant(
+      std::min(1, num_tenants - 1), num_tenants - 1);
+
+  std::vector<std::vector<int32_t>> system_prompts(num_tenants);
+  for (auto& system_prompt : system_prompts) {
+    system_prompt.resize(FLAGS_system_prompt_tokens);
+    std::generate(system_prompt.begin(), system_prompt.end(), [&] {
+      return token(gen);
+    });
+  }
+
+  std::vector<RequestSpec> workload(FLAGS_num_requests);
+  for (auto& spec : workload) {
+    spec.tenant = heavy(gen) ? 0 : light_tenant(gen);
+    spec.prompt_tokens = system_prompts[spec.tenant];
+    const size_t n_tokens = prompt_len(gen);
+    while (spec.prompt_tokens.size() < n_tokens) {
+      spec.prompt_tokens.push_back(token(gen));
+    }
+    spec.max_tokens = output_len(gen);
+  }
+  return workload;
+}
+
+const std::vector<RequestSpec>& workload() {
+  static const std::vector<RequestSpec> workload = synthetic_workload();
+  return workload;
+}
+
+std::unique_ptr<Request> create_request(const RequestSpec& spec) {
+  const size_t capacity = spec.prompt_tokens.size() + spec.max_tokens + 1;
+  auto request = std::make_unique<Request>("",
+                                           spec.prompt_tokens,
+                                           capacity,
+                                           /*n=*/1,
+                                           /*best_of=*/1,
+                                           /*logprobs=*/false);
+  request->stopping_criteria.max_tokens = spec.max_tokens;
+  request->stopping_criteria.ignore_eos = true;
+  request->tenant = std::to_string(spec.tenant);
+  request->on_output = [](const RequestOutput& /*output*/) { return true; };
+  request->add_sequence();
+  return request;
+}
+
+// tracks the simulated finish time of each request and the service received
+// by each tenant from the steps of the engine.
+class WorkloadTracker {
+ public:
+  WorkloadTracker(SimulatedEngine* engine, int32_t num_tenants)
+      : engine_(engine),
+        num_pending_(num_tenants, 0),
+        contended_service_(num_tenants, 0) {
+    engine_->set_step_callback([this](Batch& batch) { on_step(batch); });
+  }
+
+  void track(const Sequence* sequence, int32_t tenant, size_t id) {
+    sequences_[sequence] = {tenant, id, /*num_kv_cache_tokens=*/0};
+    ++num_pending_[tenant];
+    if (finish_times_.size() <= id) {
+      finish_times_.resize(id + 1);
+    }
+  }
+
+  // the simulated finish time of each request
+  const std::vector<absl::Duration>& finish_times() const {
+    return finish_times_;
+  }
+
+  // Jain's fairness index of the tokens processed for each tenant while all
+  // the tenants are backlogged: 1 if they are served equally, 1/n if a single
+  // tenant is served.
+  double fairness_index() const {
+    double sum = 0;
+    double sum_of_squares = 0;
+    for (const size_t service : contended_service_) {
+      sum += static_cast<double>(service);
+      sum_of_squares += static_cast<double>(service) * service;
+    }
+    if (sum_of_squares == 0) {
+      return 1.0;
+    }
+    return sum * sum / (contended_service_.size() * sum_of_squares);
+  }
+
+ private:
+  struct SequenceState {
+    int32_t tenant = 0;
+    size_t id = 0;
+    size_t num_kv_cache_tokens = 0;
+  };
+
+  void on_step(Batch& batch) {
+    const bool contended =
+        std::none_of(num_pending_.begin(), num_pending_.end(), [](size_t n) {
+          return n == 0;
+        });
+    for (size_t i = 0; i < batch.size(); ++i) {
+      Sequence* sequence = batch[i];
+      auto it = sequences_.find(sequence);
+      if (it == sequences_.end()) {
+        continue;
+      }
+      auto& state = it->second;
+      // the kv cache is dropped on preemption
+      const size_t n_kv_cache_tokens = sequence->num_kv_cache_tokens();
+      if (contended && n_kv_cache_tokens > state.num_kv_cache_tokens) {
+        contended_service_[state.tenant] +=
+            n_kv_cache_tokens - state.num_kv_cache_tokens;
+      }
+      state.num_kv_cache_tokens = n_kv_cache_tokens;
+
+      if (sequence->is_finished()) {
+        finish_times_[state.id] = engine_->simulated_time();
+        --num_pending_[state.tenant];
+        sequences_.erase(it);
+      }
+    }
+  }
+
+  SimulatedEngine* engine_;
+
+  std::unordered_map<const Sequence*, SequenceState> sequences_;
+
+  // the number of unfinished requests of each tenant
+  std::vector<size_t> num_pending_;
+
+  // the tokens processed for each tenant while no tenant is idle
+  std::vector<size_t> contended_service_;
+
+  std::vector<absl::Duration> finish_times_;
+};
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  const size_t idx = std::min(values.size() - 1,
+                              static_cast<size_t>(p * values.size()));
+  return values[idx];
+}
+
+}  // namespace
+
+// Runs the workload through the scheduler with each policy on a simulated
+// engine, and reports the throughput and the request latencies in simulated
+// time along with the fairness across tenants. The wall time is the host
+// overhead of the scheduler, the block manager and the prefix cache. Note the
+// policies aging requests, e.g. priority_aging and fair_share, age them by the
+// wall clock, which runs much faster than the simulated one.
+static void BM_scheduler_simulation(benchmark::State& state) {
+  const std::string policy = SchedulerPolicy::names().at(state.range(0));
+  const auto num_blocks = static_cast<uint32_t>(state.range(1));
+  const auto& specs = workload();
+  const int32_t num_tenants = std::max(FLAGS_num_tenants, 1);
+
+  SimulatedEngine::Options engine_options;
+  engine_options.num_blocks(num_blocks)
+      .block_size(FLAGS_block_size)
+      .enable_prefix_cache(FLAGS_enable_prefix_cache)
+      .step_latency(absl::Microseconds(FLAGS_step_latency_us))
+      .prefill_token_latency(
+          absl::Microseconds(1) * FLAGS_prefill_token_latency_us)
+      .decode_token_latency(
+          absl::Microseconds(1) * FLAGS_decode_token_latency_us)
+      .context_token_latency(
+          absl::Microseconds(1) * FLAGS_context_token_latency_us);
+
+  ContinuousScheduler::Options options;
+  options.max_tokens_per_batch(FLAGS_max_tokens_per_batch)
+      .max_seqs_per_batch(FLAGS_max_seqs_per_batch)
+      .num_decode_steps(FLAGS_num_decode_steps)
+      .scheduler_policy(policy);
+
+  absl::Duration simulated_time;
+  size_t num_generated_tokens = 0;
+  std::vector<double> latencies;
+  double fairness_index = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    SimulatedEngine engine(engine_options);
+    WorkloadTracker tracker(&engine, num_tenants);
+    ContinuousScheduler scheduler(&engine, options);
+    for (size_t i = 0; i < specs.size(); ++i) {
+      auto request = create_request(specs[i]);
+      tracker.track(&request->sequences[0], specs[i].tenant, i);
+      CHECK(scheduler.schedule(request)) << "Failed to schedule request";
+    }
+    state.ResumeTiming();
+
+    scheduler.run_until_complete();
+
+    state.PauseTiming();
+    simulated_time = engine.simulated_time();
+    num_generated_tokens = engine.num_generated_tokens();
+    latencies.clear();
+    for (const auto& finish_time : tracker.finish_times()) {
+      latencies.push_back(absl::ToDoubleSeconds(finish_time));
+    }
+    fairness_index = tracker.fairness_index();
+    state.ResumeTiming();
+  }
+
+  const double simulated_seconds = absl::ToDoubleSeconds(simulated_time);
+  state.counters["simulated_seconds"] = simulated_seconds;
+  state.counters["tokens_per_second"] =
+      static_cast<double>(num_generated_tokens) /
+      std::max(simulated_seconds, 1e-9);
+  state.counters["p50_latency"] = percentile(latencies, 0.5);
+  state.counters["p99_latency"] = percentile(latencies, 0.99);
+  state.counters["fairness"] = fairness_index;
+  state.SetLabel(policy);
+}
+
+// the policies by a roomy and a tight kv cache, the latter forces preemptions
+BENCHMARK(BM_scheduler_simulation)
+    ->ArgsProduct(
+        {benchmark::CreateDenseRange(
+             0, static_cast<int64_t>(SchedulerPolicy::names().size()) - 1, 1),
+         {1 << 20, 1 << 14}})
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(1);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  gflags::ParseCommandLineFlags(&argc, &argv, /*remove_flags=*/true);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
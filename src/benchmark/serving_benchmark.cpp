@@ -0,0 +1,442 @@
+#include <absl/synchronization/blocking_counter.h>
+#include <absl/synchronization/notification.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <torch/torch.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common/metrics.h"
+#include "engine/tiny_model.h"
+#include "handlers/llm_handler.h"
+#include "handlers/sampling_params.h"
+#include "request/output.h"
+
+// An end to end offline serving benchmark. It replays a request trace against
+// LLMHandler with a configurable arrival process and reports the throughput,
+// the latency percentiles and the kv cache utilization over time. Without a
+// model path, a tiny randomly initialized llama model is served on cpu, which
+// is enough to catch scheduling and host overhead regressions.
+
+DEFINE_string(trace,
+              "",
+              "path to a jsonl request trace, one request per line as "
+              "{\"prompt\": \"...\", \"max_tokens\": 16, \"timestamp\": 0.5}. "
+              "\"num_prompt_tokens\" can be given instead of the prompt. a "
+              "synthetic trace is replayed if empty");
+
+DEFINE_string(arrival,
+              "poisson",
+              "arrival process of the requests: poisson with request_rate, "
+              "or trace to follow the recorded timestamps");
+
+DEFINE_double(request_rate,
+              0,
+              "requests per second for the poisson arrival process, 0 to "
+              "send all requests at once");
+
+DEFINE_int32(num_requests, 256, "number of requests of the synthetic trace");
+
+DEFINE_int32(min_prompt_tokens, 16, "min prompt length of the synthetic trace");
+
+DEFINE_int32(max_prompt_tokens,
+             256,
+             "max prompt length of the synthetic trace");
+
+DEFINE_int32(output_tokens,
+             32,
+             "number of tokens to generate when not given in the trace");
+
+DEFINE_int32(seed, 0, "seed for the synthetic trace, arrivals and model");
+
+DEFINE_string(model_path,
+              "",
+              "hf model path to serve, a tiny random model if empty");
+
+DEFINE_string(device, "cpu", "device to serve the model on");
+
+DEFINE_int32(block_size, 16, "slots per block");
+
+DEFINE_int64(max_cache_size,
+             64 * 1024 * 1024,
+             "max kv cache size in bytes, small by default to put pressure on "
+             "the scheduler");
+
+DEFINE_int32(max_tokens_per_batch, 512, "max number of tokens per batch");
+
+DEFINE_int32(max_seqs_per_batch, 64, "max number of sequences per batch");
+
+DEFINE_int32(num_decode_steps, 1, "number of decode iterations per step");
+
+DEFINE_string(scheduler_policy, "fcfs", "policy to order waiting requests");
+
+DEFINE_bool(enable_prefix_cache, true, "enable the prefix cache");
+
+DEFINE_int32(sample_interval_ms,
+             100,
+             "interval to sample the kv cache utilization");
+
+DEFINE_string(output_json, "", "path to write the report in json");
+
+// gauges updated by the scheduler every step
+DECLARE_GAUGE(kv_cache_utilization_perc);
+DECLARE_GAUGE(num_waiting_requests);
+
+using namespace llm;
+
+namespace {
+
+// the vocabulary of the tiny model, words are "t<id>" after special tokens
+constexpr int64_t kVocabSize = 1024;
+constexpr int64_t kNumSpecialTokens = 3;
+
+struct TraceEntry {
+  std::string prompt;
+  uint32_t max_tokens = 0;
+  // the arrival time relative to the first request, in seconds
+  double timestamp = 0;
+};
+
+// a prompt of num_tokens random words from the tiny model's vocabulary
+std::string random_prompt(size_t num_tokens, std::mt19937& gen) {
+  std::uniform_int_distribution<int64_t> token(kNumSpecialTokens,
+                                               kVocabSize - 1);
+  std::string prompt;
+  for (size_t i = 0; i < num_tokens; ++i) {
+    if (i > 0) {
+      prompt += ' ';
+    }
+    prompt += "t" + std::to_string(token(gen));
+  }
+  return prompt;
+}
+
+std::vector<TraceEntry> load_trace(const std::string& path,
+                                   std::mt19937& gen) {
+  std::ifstream file(path);
+  CHECK(file.is_open()) << "Failed to open trace: " << path;
+  std::vector<TraceEntry> trace;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    const auto json = nlohmann::json::parse(line);
+    TraceEntry entry;
+    if (json.contains("prompt")) {
+      entry.prompt = json.at("prompt").get<std::string>();
+    } else {
+      entry.prompt =
+          random_prompt(json.at("num_prompt_tokens").get<size_t>(), gen);
+    }
+    entry.max_tokens = json.value("max_tokens", FLAGS_output_tokens);
+    entry.timestamp = json.value("timestamp", 0.0);
+    trace.push_back(std::move(entry));
+  }
+  return trace;
+}
+
+std::vector<TraceEntry> synthetic_trace(std::mt19937& gen) {
+  std::uniform_int_distribution<size_t> prompt_len(FLAGS_min_prompt_tokens,
+                                                   FLAGS_max_prompt_tokens);
+  std::vector<TraceEntry> trace(FLAGS_num_requests);
+  for (auto& entry : trace) {
+    entry.prompt = random_prompt(prompt_len(gen), gen);
+    entry.max_tokens = FLAGS_output_tokens;
+  }
+  return trace;
+}
+
+// the send time of each request relative to the start, in seconds
+std::vector<double> arrival_times(const std::vector<TraceEntry>& trace,
+                                  std::mt19937& gen) {
+  std::vector<double> times(trace.size(), 0);
+  if (FLAGS_arrival == "trace") {
+    const double start = trace.empty() ? 0 : trace.front().timestamp;
+    for (size_t i = 0; i < trace.size(); ++i) {
+      times[i] = std::max(trace[i].timestamp - start, 0.0);
+    }
+    return times;
+  }
+  CHECK_EQ(FLAGS_arrival, "poisson") << "Unknown arrival process";
+  if (FLAGS_request_rate <= 0) {
+    return times;
+  }
+  std::exponential_distribution<double> interval(FLAGS_request_rate);
+  double now = 0;
+  for (auto& time : times) {
+    time = now;
+    now += interval(gen);
+  }
+  return times;
+}
+
+// write a tiny llama checkpoint with random weights and a word level
+// tokenizer into the directory
+void write_tiny_model(const std::string& dir) {
+  ModelArgs args = tiny_model_args();
+  args.vocab_size(kVocabSize)
+      .hidden_size(256)
+      .intermediate_size(688)
+      .head_dim(64)
+      .max_position_embeddings(4096);
+  save_tiny_model(args, random_state_dict(args), dir);
+}
+
+// the timeline of a request, written by the response threads
+struct RequestRecord {
+  std::mutex mutex;
+  absl::Time send_time;
+  std::optional<absl::Time> last_token_time;
+  std::optional<double> ttft;
+  std::vector<double> itls;
+  double e2e = 0;
+  size_t num_prompt_tokens = 0;
+  size_t num_generated_tokens = 0;
+  bool finished = false;
+  bool ok = false;
+};
+
+struct Sample {
+  double time = 0;
+  double kv_cache_utilization = 0;
+  double num_waiting_requests = 0;
+};
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  // nearest rank
+  const size_t rank = static_cast<size_t>(
+      std::ceil(p / 100.0 * static_cast<double>(values.size())));
+  return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+}
+
+nlohmann::json summarize(const std::vector<double>& values) {
+  double sum = 0;
+  for (const double v : values) {
+    sum += v;
+  }
+  return {{"mean", values.empty() ? 0 : sum / values.size()},
+          {"p50", percentile(values, 50)},
+          {"p90", percentile(values, 90)},
+          {"p99", percentile(values, 99)},
+          {"max", percentile(values, 100)}};
+}
+
+void print_latency(const std::string& name, const nlohmann::json& stats) {
+  std::cout << std::left << std::setw(12) << name << std::right << std::fixed
+            << std::setprecision(2);
+  for (const auto* key : {"mean", "p50", "p90", "p99", "max"}) {
+    std::cout << std::setw(10) << stats[key].get<double>() * 1000.0;
+  }
+  std::cout << "\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, /*remove_flags=*/true);
+  google::InitGoogleLogging(argv[0]);
+
+  std::mt19937 gen(FLAGS_seed);
+  torch::manual_seed(FLAGS_seed);
+
+  const auto trace =
+      FLAGS_trace.empty() ? synthetic_trace(gen) : load_trace(FLAGS_trace, gen);
+  CHECK(!trace.empty()) << "Empty trace";
+  const auto send_times = arrival_times(trace, gen);
+
+  std::string model_path = FLAGS_model_path;
+  std::string tiny_model_dir;
+  if (model_path.empty()) {
+    tiny_model_dir = (std::filesystem::temp_directory_path() /
+                      ("serving_benchmark_" + std::to_string(getpid())))
+                         .string();
+    write_tiny_model(tiny_model_dir);
+    model_path = tiny_model_dir;
+  }
+
+  LLMHandler::Options options;
+  options.model_path(model_path)
+      .devices(FLAGS_device)
+      .block_size(FLAGS_block_size)
+      .max_cache_size(FLAGS_max_cache_size)
+      .enable_prefix_cache(FLAGS_enable_prefix_cache)
+      .enable_cuda_graph(false)
+      .max_tokens_per_batch(FLAGS_max_tokens_per_batch)
+      .max_seqs_per_batch(FLAGS_max_seqs_per_batch)
+      .num_decode_steps(FLAGS_num_decode_steps)
+      .scheduler_policy(FLAGS_scheduler_policy)
+      .enable_admission_control(false);
+  LLMHandler handler(options);
+  handler.start();
+
+  // sample the kv cache utilization until all requests are done
+  const auto start_time = absl::Now();
+  absl::Notification done;
+  std::vector<Sample> samples;
+  std::thread sampler([&]() {
+    const auto interval = absl::Milliseconds(FLAGS_sample_interval_ms);
+    do {
+      Sample sample;
+      sample.time = absl::ToDoubleSeconds(absl::Now() - start_time);
+      sample.kv_cache_utilization = GAUGE_kv_cache_utilization_perc.Value();
+      sample.num_waiting_requests = GAUGE_num_waiting_requests.Value();
+      samples.push_back(sample);
+    } while (!done.WaitForNotificationWithTimeout(interval));
+  });
+
+  std::vector<std::unique_ptr<RequestRecord>> records;
+  records.reserve(trace.size());
+  absl::BlockingCounter num_pending(static_cast<int>(trace.size()));
+  for (size_t i = 0; i < trace.size(); ++i) {
+    absl::SleepFor(start_time + absl::Seconds(send_times[i]) - absl::Now());
+
+    records.push_back(std::make_unique<RequestRecord>());
+    RequestRecord* record = records.back().get();
+    record->send_time = absl::Now();
+
+    SamplingParams sp;
+    sp.max_tokens = trace[i].max_tokens;
+    sp.temperature = 0;
+    sp.ignore_eos = true;
+    handler.schedule_async(
+        trace[i].prompt,
+        std::move(sp),
+        Priority::NORMAL,
+        /*stream=*/true,
+        [record, &num_pending](RequestOutput output) {
+          const auto now = absl::Now();
+          std::lock_guard<std::mutex> lock(record->mutex);
+          for (const auto& seq_output : output.outputs) {
+            const size_t num_tokens = seq_output.token_ids.size();
+            if (num_tokens == 0) {
+              continue;
+            }
+            if (!record->last_token_time.has_value()) {
+              record->ttft = absl::ToDoubleSeconds(now - record->send_time);
+            } else {
+              // tokens of a multi-step batch arrive together
+              const double itl =
+                  absl::ToDoubleSeconds(now - *record->last_token_time) /
+                  static_cast<double>(num_tokens);
+              record->itls.insert(record->itls.end(), num_tokens, itl);
+            }
+            record->last_token_time = now;
+          }
+          // rejected requests are reported with an error status only
+          const bool failed =
+              output.status.has_value() && !output.status->ok();
+          if ((output.finished || failed) && !record->finished) {
+            record->finished = true;
+            record->e2e = absl::ToDoubleSeconds(now - record->send_time);
+            record->ok = !failed;
+            if (output.usage.has_value()) {
+              record->num_prompt_tokens = output.usage->num_prompt_tokens;
+              record->num_generated_tokens =
+                  output.usage->num_generated_tokens;
+            }
+            num_pending.DecrementCount();
+          }
+          return true;
+        });
+  }
+  num_pending.Wait();
+  const double duration = absl::ToDoubleSeconds(absl::Now() - start_time);
+  done.Notify();
+  sampler.join();
+  handler.stop();
+
+  // aggregate the records
+  std::vector<double> ttfts;
+  std::vector<double> itls;
+  std::vector<double> e2es;
+  size_t num_failed = 0;
+  size_t num_prompt_tokens = 0;
+  size_t num_generated_tokens = 0;
+  for (const auto& record : records) {
+    if (!record->ok) {
+      ++num_failed;
+      continue;
+    }
+    if (record->ttft.has_value()) {
+      ttfts.push_back(*record->ttft);
+    }
+    itls.insert(itls.end(), record->itls.begin(), record->itls.end());
+    e2es.push_back(record->e2e);
+    num_prompt_tokens += record->num_prompt_tokens;
+    num_generated_tokens += record->num_generated_tokens;
+  }
+  std::vector<double> kv_cache_utilizations;
+  nlohmann::json timeline = nlohmann::json::array();
+  for (const auto& sample : samples) {
+    kv_cache_utilizations.push_back(sample.kv_cache_utilization);
+    timeline.push_back({{"time", sample.time},
+                        {"kv_cache_utilization", sample.kv_cache_utilization},
+                        {"num_waiting_requests", sample.num_waiting_requests}});
+  }
+
+  nlohmann::json report;
+  report["num_requests"] = records.size();
+  report["num_failed_requests"] = num_failed;
+  report["duration_seconds"] = duration;
+  report["requests_per_second"] = records.size() / duration;
+  report["prompt_tokens_per_second"] = num_prompt_tokens / duration;
+  report["output_tokens_per_second"] = num_generated_tokens / duration;
+  report["ttft_seconds"] = summarize(ttfts);
+  report["itl_seconds"] = summarize(itls);
+  report["e2e_seconds"] = summarize(e2es);
+  report["kv_cache_utilization"] = summarize(kv_cache_utilizations);
+  report["timeline"] = std::move(timeline);
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "requests:            " << records.size() << " (" << num_failed
+            << " failed)\n"
+            << "duration:            " << duration << " s\n"
+            << "requests/s:          "
+            << report["requests_per_second"].get<double>() << "\n"
+            << "prompt tokens/s:     "
+            << report["prompt_tokens_per_second"].get<double>() << "\n"
+            << "output tokens/s:     "
+            << report["output_tokens_per_second"].get<double>() << "\n\n"
+            << std::left << std::setw(12) << "latency(ms)" << std::right;
+  for (const auto* key : {"mean", "p50", "p90", "p99", "max"}) {
+    std::cout << std::setw(10) << key;
+  }
+  std::cout << "\n";
+  print_latency("ttft", report["ttft_seconds"]);
+  print_latency("itl", report["itl_seconds"]);
+  print_latency("e2e", report["e2e_seconds"]);
+  std::cout << "\nkv cache utilization: mean "
+            << report["kv_cache_utilization"]["mean"].get<double>()
+            << ", max " << report["kv_cache_utilization"]["max"].get<double>()
+            << std::endl;
+
+  if (!FLAGS_output_json.empty()) {
+    std::ofstream(FLAGS_output_json) << report.dump(2);
+  }
+  if (!tiny_model_dir.empty()) {
+    std::filesystem::remove_all(tiny_model_dir);
+  }
+  return 0;
+}
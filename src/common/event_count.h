@@ -0,0 +1,106 @@
+#pragma once
+
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace llm {
+
+// An event count lets consumers block until a condition becomes true without
+// polling, and costs producers a single atomic operation when nobody waits.
+// it follows the same protocol as folly::EventCount:
+//
+//   consumer:
+//     while (true) {
+//       auto key = ec.prepare_wait();
+//       if (condition()) {
+//         ec.cancel_wait();
+//         break;
+//       }
+//       ec.wait(key);
+//     }
+//
+//   producer:
+//     make condition() true;
+//     ec.notify_all();
+//
+// the slow path is built on absl::Mutex/CondVar, which parks waiting threads
+// on a futex on linux.
+class EventCount final {
+ public:
+  using Key = uint32_t;
+
+  EventCount() = default;
+
+  // disable copy/move constructor and assignment
+  EventCount(const EventCount&) = delete;
+  EventCount& operator=(const EventCount&) = delete;
+  EventCount(EventCount&&) = delete;
+  EventCount& operator=(EventCount&&) = delete;
+
+  // wake up all waiting threads
+  void notify_all() {
+    const uint64_t prev =
+        state_.fetch_add(kEpochInc, std::memory_order_seq_cst);
+    if ((prev & kWaiterMask) != 0) {
+      absl::MutexLock lock(&mutex_);
+      cond_.SignalAll();
+    }
+  }
+
+  // register as a waiter, the condition must be checked after this call and
+  // before calling wait() to avoid missing notifications.
+  Key prepare_wait() {
+    const uint64_t prev =
+        state_.fetch_add(kWaiterInc, std::memory_order_seq_cst);
+    return static_cast<Key>(prev >> kEpochShift);
+  }
+
+  // unregister as a waiter when the condition is already true
+  void cancel_wait() {
+    state_.fetch_sub(kWaiterInc, std::memory_order_seq_cst);
+  }
+
+  // block until notified after prepare_wait() returned the key
+  void wait(Key key) { wait_until(key, absl::InfiniteFuture()); }
+
+  // block until notified or the deadline is reached.
+  // returns false if timed out without being notified.
+  bool wait_until(Key key, absl::Time deadline) {
+    bool notified = true;
+    {
+      absl::MutexLock lock(&mutex_);
+      while (epoch() == key) {
+        if (cond_.WaitWithDeadline(&mutex_, deadline)) {
+          // timed out
+          notified = epoch() != key;
+          break;
+        }
+      }
+    }
+    state_.fetch_sub(kWaiterInc, std::memory_order_seq_cst);
+    return notified;
+  }
+
+ private:
+  Key epoch() const {
+    return static_cast<Key>(state_.load(std::memory_order_seq_cst) >>
+                            kEpochShift);
+  }
+
+  // the lower 32 bits count the waiters, the upper 32 bits are the epoch which
+  // is bumped on every notification.
+  static constexpr uint64_t kWaiterInc = 1;
+  static constexpr uint64_t kWaiterMask = 0xFFFFFFFF;
+  static constexpr int kEpochShift = 32;
+  static constexpr uint64_t kEpochInc = uint64_t(1) << kEpochShift;
+
+  std::atomic<uint64_t> state_{0};
+
+  absl::Mutex mutex_;
+  absl::CondVar cond_;
+};
+
+}  // namespace llm
@@ -0,0 +1,54 @@
+#include "event_count.h"
+
+#include <absl/time/clock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace llm {
+
+TEST(EventCountTest, WaitTimeout) {
+  EventCount ec;
+  const auto key = ec.prepare_wait();
+  const auto start = absl::Now();
+  EXPECT_FALSE(ec.wait_until(key, start + absl::Milliseconds(10)));
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(10));
+}
+
+TEST(EventCountTest, NotifyBeforeWait) {
+  EventCount ec;
+  const auto key = ec.prepare_wait();
+  // notification between prepare_wait and wait is not lost
+  ec.notify_all();
+  EXPECT_TRUE(ec.wait_until(key, absl::Now() + absl::Seconds(10)));
+}
+
+TEST(EventCountTest, NotifyWaiters) {
+  EventCount ec;
+  std::atomic<int> value{0};
+
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < 4; ++i) {
+    waiters.emplace_back([&ec, &value]() {
+      while (true) {
+        const auto key = ec.prepare_wait();
+        if (value.load() != 0) {
+          ec.cancel_wait();
+          break;
+        }
+        ec.wait(key);
+      }
+    });
+  }
+
+  absl::SleepFor(absl::Milliseconds(10));
+  value.store(1);
+  ec.notify_all();
+  for (auto& waiter : waiters) {
+    waiter.join();
+  }
+}
+
+}  // namespace llm
@@ -0,0 +1,83 @@
+#include "numa.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/string_view.h>
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace llm {
+namespace {
+
+// parse a cpu list in the kernel format, for example "0-3,8-11,16"
+std::vector<int> parse_cpu_list(absl::string_view cpu_list) {
+  std::vector<int> cpus;
+  for (absl::string_view range :
+       absl::StrSplit(cpu_list, ',', absl::SkipWhitespace())) {
+    std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+    int first = 0;
+    int last = 0;
+    if (!absl::SimpleAtoi(bounds[0], &first)) {
+      return {};
+    }
+    last = first;
+    if (bounds.size() > 1 && !absl::SimpleAtoi(bounds[1], &last)) {
+      return {};
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+std::string read_line(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  if (file.is_open()) {
+    std::getline(file, line);
+  }
+  return line;
+}
+
+}  // namespace
+
+int num_numa_nodes() {
+  const auto nodes =
+      parse_cpu_list(read_line("/sys/devices/system/node/online"));
+  return nodes.empty() ? 1 : static_cast<int>(nodes.size());
+}
+
+std::vector<int> numa_node_cpus(int node) {
+  return parse_cpu_list(read_line("/sys/devices/system/node/node" +
+                                  std::to_string(node) + "/cpulist"));
+}
+
+bool bind_to_numa_node(int node) {
+  const auto cpus = numa_node_cpus(node);
+  if (cpus.empty()) {
+    LOG(WARNING) << "Failed to get cpus for numa node " << node;
+    return false;
+  }
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (const int cpu : cpus) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  const int ret =
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if (ret != 0) {
+    LOG(WARNING) << "Failed to bind thread to numa node " << node
+                 << ", error: " << ret;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace llm
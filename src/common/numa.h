@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+namespace llm {
+
+// returns the number of online numa nodes, 1 if numa is not available.
+int num_numa_nodes();
+
+// returns the list of cpus that belong to the numa node, empty if unknown.
+std::vector<int> numa_node_cpus(int node);
+
+// bind the calling thread to the cpus of the numa node. memory allocated by
+// the thread afterwards is placed on the node by the first-touch policy, and
+// threads spawned by it (for example the openmp team used by torch) inherit
+// the affinity. returns false if failed.
+bool bind_to_numa_node(int node);
+
+}  // namespace llm
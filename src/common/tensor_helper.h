@@ -27,8 +27,15 @@ inline torch::Tensor create_2d_tensor(const std::vector<std::vector<T>>& vec,
 };
 
 inline torch::Tensor safe_to(const torch::Tensor& t,
-                             const torch::TensorOptions& options) {
-  return t.defined() ? t.to(options) : t;
+                             const torch::TensorOptions& options,
+                             bool non_blocking = false) {
+  return t.defined() ? t.to(options, non_blocking) : t;
+};
+
+// copy the tensor into page-locked host memory, which allows asynchronous
+// host to device copies.
+inline torch::Tensor safe_pin_memory(const torch::Tensor& t) {
+  return t.defined() ? t.pin_memory() : t;
 };
 
 }  // namespace llm
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "tracer.h"
+
+#include <absl/time/clock.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace llm {
+
+namespace {
+int64_t now_us() { return absl::GetCurrentTimeNanos() / 1000; }
+}  // namespace
+
+void Tracer::enable(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.clear();
+  events_.shrink_to_fit();
+  events_.resize(capacity);
+  num_recorded_ = 0;
+  enabled_.store(capacity > 0, std::memory_order_relaxed);
+}
+
+void Tracer::record(const TraceEvent& event) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // check again under the lock in case the tracer has been disabled
+  if (events_.empty()) {
+    return;
+  }
+  events_[num_recorded_ % events_.size()] = event;
+  ++num_recorded_;
+}
+
+std::vector<TraceEvent> Tracer::events() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t capacity = events_.size();
+  if (num_recorded_ <= capacity) {
+    return {events_.begin(), events_.begin() + num_recorded_};
+  }
+  // the ring buffer has wrapped around, the oldest span is the next to write
+  std::vector<TraceEvent> events;
+  events.reserve(capacity);
+  const size_t start = num_recorded_ % capacity;
+  events.insert(events.end(), events_.begin() + start, events_.end());
+  events.insert(events.end(), events_.begin(), events_.begin() + start);
+  return events;
+}
+
+std::string Tracer::to_chrome_trace() const {
+  const int64_t pid = static_cast<int64_t>(getpid());
+  auto trace_events = nlohmann::json::array();
+  for (const auto& event : events()) {
+    nlohmann::json args = nlohmann::json::object();
+    for (uint32_t i = 0; i < event.num_args; ++i) {
+      args[event.args[i].first] = event.args[i].second;
+    }
+    // complete events with the duration
+    trace_events.push_back({{"name", event.name},
+                            {"ph", "X"},
+                            {"ts", event.start_us},
+                            {"dur", event.duration_us},
+                            {"pid", pid},
+                            {"tid", event.thread_id},
+                            {"args", std::move(args)}});
+  }
+  nlohmann::json trace;
+  trace["traceEvents"] = std::move(trace_events);
+  trace["displayTimeUnit"] = "ms";
+  return trace.dump();
+}
+
+uint32_t Tracer::thread_id() {
+  static std::atomic<uint32_t> next_thread_id{0};
+  thread_local const uint32_t id =
+      next_thread_id.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+TraceSpan::TraceSpan(const char* name)
+    : enabled_(Tracer::Instance().enabled()) {
+  if (enabled_) {
+    event_.name = name;
+    event_.start_us = now_us();
+  }
+}
+
+TraceSpan::~TraceSpan() {
+  if (enabled_) {
+    event_.duration_us = now_us() - event_.start_us;
+    event_.thread_id = Tracer::thread_id();
+    Tracer::Instance().record(event_);
+  }
+}
+
+TraceSpan& TraceSpan::arg(const char* name, int64_t value) {
+  if (enabled_ && event_.num_args < TraceEvent::kMaxArgs) {
+    event_.args[event_.num_args++] = {name, value};
+  }
+  return *this;
+}
+
+}  // namespace llm
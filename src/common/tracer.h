@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llm {
+
+// A span recorded by the tracer
+struct TraceEvent {
+  static constexpr size_t kMaxArgs = 6;
+
+  // the name of the span, must be a string literal
+  const char* name = nullptr;
+
+  // the start time and the duration in microseconds
+  int64_t start_us = 0;
+  int64_t duration_us = 0;
+
+  // a small id of the recording thread, in the order of first use
+  uint32_t thread_id = 0;
+
+  // integer arguments of the span, e.g. the batch composition. the names must
+  // be string literals.
+  uint32_t num_args = 0;
+  std::array<std::pair<const char*, int64_t>, kMaxArgs> args{};
+};
+
+// A low overhead tracer for the inference loop. Spans are recorded into a
+// fixed size ring buffer, overwriting the oldest ones once it is full, and can
+// be dumped in the Chrome trace event format to be viewed in chrome://tracing
+// or Perfetto. Recording is a no-op until the tracer is enabled.
+class Tracer final {
+ public:
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  // a singleton class
+  static Tracer& Instance() {
+    static Tracer instance;
+    return instance;
+  }
+
+  // start recording into a ring buffer of the given number of spans, the
+  // recorded spans are dropped. 0 disables the tracer.
+  void enable(size_t capacity);
+
+  void disable() { enable(/*capacity=*/0); }
+
+  bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  // record a span, dropped if the tracer is disabled
+  void record(const TraceEvent& event);
+
+  // the recorded spans, from the oldest to the latest
+  std::vector<TraceEvent> events() const;
+
+  // the recorded spans as a Chrome trace json
+  std::string to_chrome_trace() const;
+
+  // the id of the calling thread in the trace
+  static uint32_t thread_id();
+
+ private:
+  Tracer() = default;
+  ~Tracer() = default;
+
+  std::atomic<bool> enabled_{false};
+
+  mutable std::mutex mutex_;
+
+  // the ring buffer and the number of spans recorded since enabled
+  std::vector<TraceEvent> events_;
+  size_t num_recorded_ = 0;
+};
+
+// Records a span from its construction to its destruction if the tracer is
+// enabled, for example:
+//   TraceSpan span("scheduler.step");
+//   span.arg("num_seqs", batch.size());
+class TraceSpan final {
+ public:
+  explicit TraceSpan(const char* name);
+
+  ~TraceSpan();
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  // attach an integer argument to the span, the name must be a string literal.
+  // arguments over TraceEvent::kMaxArgs are ignored.
+  TraceSpan& arg(const char* name, int64_t value);
+
+ private:
+  // only set when the tracer is enabled at construction
+  bool enabled_ = false;
+
+  TraceEvent event_;
+};
+
+}  // namespace llm
@@ -0,0 +1,61 @@
+#include "tracer.h"
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+#include <string>
+
+namespace llm {
+
+TEST(TracerTest, Disabled) {
+  auto& tracer = Tracer::Instance();
+  tracer.disable();
+  { TraceSpan span("disabled"); }
+  EXPECT_TRUE(tracer.events().empty());
+}
+
+TEST(TracerTest, RingBuffer) {
+  auto& tracer = Tracer::Instance();
+  tracer.enable(/*capacity=*/3);
+  for (int64_t i = 0; i < 5; ++i) {
+    TraceSpan span("step");
+    span.arg("step", i);
+  }
+  // the oldest spans are overwritten
+  const auto events = tracer.events();
+  ASSERT_EQ(events.size(), 3);
+  for (size_t i = 0; i < events.size(); ++i) {
+    EXPECT_STREQ(events[i].name, "step");
+    ASSERT_EQ(events[i].num_args, 1);
+    EXPECT_EQ(events[i].args[0].second, static_cast<int64_t>(i + 2));
+  }
+  tracer.disable();
+  EXPECT_TRUE(tracer.events().empty());
+}
+
+TEST(TracerTest, ChromeTrace) {
+  auto& tracer = Tracer::Instance();
+  tracer.enable(/*capacity=*/16);
+  {
+    TraceSpan outer("scheduler.step");
+    outer.arg("num_prefill_seqs", 1).arg("num_decode_seqs", 2);
+    TraceSpan inner("worker.forward");
+  }
+  const auto trace = nlohmann::json::parse(tracer.to_chrome_trace());
+  tracer.disable();
+
+  const auto& events = trace.at("traceEvents");
+  ASSERT_EQ(events.size(), 2);
+  // spans are recorded when they end
+  EXPECT_EQ(events[0]["name"], "worker.forward");
+  EXPECT_EQ(events[1]["name"], "scheduler.step");
+  EXPECT_EQ(events[1]["ph"], "X");
+  EXPECT_EQ(events[1]["args"]["num_prefill_seqs"], 1);
+  EXPECT_EQ(events[1]["args"]["num_decode_seqs"], 2);
+  // the outer span covers the inner one
+  EXPECT_LE(events[1]["ts"], events[0]["ts"]);
+  EXPECT_GE(events[1]["ts"].get<int64_t>() + events[1]["dur"].get<int64_t>(),
+            events[0]["ts"].get<int64_t>() + events[0]["dur"].get<int64_t>());
+}
+
+}  // namespace llm
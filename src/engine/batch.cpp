@@ -3,11 +3,13 @@
 #include <c10/core/DeviceType.h>
 #include <torch/torch.h>
 
+#include <algorithm>
 #include <vector>
 
 #include "common/metrics.h"
 #include "common/slice.h"
 #include "common/tensor_helper.h"
+#include "common/tracer.h"
 #include "models/parameters.h"
 #include "request/sequence.h"
 #include "sampling/parameters.h"
@@ -70,12 +72,58 @@ void Batch::clear() {
   sequences_.clear();
   token_budgets_.clear();
   budget_used_.clear();
+  num_decode_steps_ = 1;
+}
+
+void Batch::set_num_decode_steps(uint32_t num_decode_steps) {
+  CHECK_GT(num_decode_steps, 0);
+  num_decode_steps_ = num_decode_steps;
+}
+
+bool Batch::next_decode_step() {
+  // early exit for sequences hitting the stopping criteria, the remaining
+  // ones keep their order to match the sample output.
+  size_t num_running = 0;
+  for (size_t i = 0; i < sequences_.size(); ++i) {
+    auto* sequence = sequences_[i];
+    if (sequence->is_finished()) {
+      continue;
+    }
+    CHECK(!sequence->is_prefill_stage())
+        << "multi-step decoding for a prefill sequence";
+    sequences_[num_running] = sequence;
+    token_budgets_[num_running] = token_budgets_[i];
+    ++num_running;
+  }
+  sequences_.resize(num_running);
+  token_budgets_.resize(num_running);
+  budget_used_.assign(num_running, 0);
+  return num_running > 0;
+}
+
+bool Batch::drop_failed_sequences() {
+  size_t num_left = 0;
+  for (size_t i = 0; i < sequences_.size(); ++i) {
+    auto* sequence = sequences_[i];
+    if (sequence->error().has_value()) {
+      continue;
+    }
+    sequences_[num_left] = sequence;
+    token_budgets_[num_left] = token_budgets_[i];
+    budget_used_[num_left] = budget_used_[i];
+    ++num_left;
+  }
+  sequences_.resize(num_left);
+  token_budgets_.resize(num_left);
+  budget_used_.resize(num_left);
+  return num_left > 0;
 }
 
 // prepare inputs for the batch
 // NOLINTNEXTLINE
 ModelInput Batch::prepare_model_input(uint32_t num_decoding_tokens,
                                       uint32_t min_decoding_bach_size) {
+  TraceSpan span("batch.prepare_model_input");
   // flatten the token ids and positions
   std::vector<int32_t> flatten_tokens_vec;
   std::vector<int32_t> flatten_positions_vec;
@@ -101,6 +149,9 @@ ModelInput Batch::prepare_model_input(uint32_t num_decoding_tokens,
   std::vector<int32_t> new_token_slot_ids;
   std::vector<int32_t> block_tables;
   std::vector<int32_t> cu_block_lens = {0};
+  // lora slot for each token, 0 for the base model
+  std::vector<int32_t> lora_slot_ids;
+  std::vector<int32_t> lora_slots;
   const int32_t num_sequences = static_cast<int32_t>(sequences_.size());
   for (int32_t i = 0; i < num_sequences; ++i) {
     auto* sequence = sequences_[i];
@@ -154,10 +205,16 @@ ModelInput Batch::prepare_model_input(uint32_t num_decoding_tokens,
       ++adjusted_token_to_count_map[token_ids[j]];
     }
 
+    const int32_t lora_slot = sequence->lora_slot();
+    if (lora_slot > 0) {
+      lora_slots.push_back(lora_slot);
+    }
+
     bool has_selected_token = false;
     for (uint32_t j = n_kv_cache_tokens; j < seq_len; ++j) {
       flatten_tokens_vec.push_back(token_ids[j]);
       flatten_positions_vec.push_back(static_cast<int32_t>(j));
+      lora_slot_ids.push_back(lora_slot);
 
       // skip prompt tokens except the last one
       if (j + 1 < n_prompt_tokens) {
@@ -213,6 +270,8 @@ ModelInput Batch::prepare_model_input(uint32_t num_decoding_tokens,
     cu_block_lens.push_back(static_cast<int32_t>(block_tables.size()));
   }
 
+  span.arg("num_seqs", num_sequences)
+      .arg("num_tokens", flatten_tokens_vec.size());
   if (flatten_tokens_vec.empty()) {
     // no tokens to process
     return {};
@@ -234,6 +293,7 @@ ModelInput Batch::prepare_model_input(uint32_t num_decoding_tokens,
           flatten_tokens_vec.push_back(0);
           flatten_positions_vec.push_back(0);
           new_token_slot_ids.push_back(0);
+          lora_slot_ids.push_back(0);
           block_tables.push_back(0);
         }
         cu_seq_lens.push_back(cu_seq_lens.back() + num_decoding_tokens);
@@ -259,6 +319,15 @@ ModelInput Batch::prepare_model_input(uint32_t num_decoding_tokens,
   input_params.block_tables = torch::tensor(block_tables, torch::kInt);
   input_params.cu_block_lens = torch::tensor(cu_block_lens, torch::kInt);
 
+  // only set lora slots when some sequences use lora adapters
+  if (!lora_slots.empty()) {
+    std::sort(lora_slots.begin(), lora_slots.end());
+    lora_slots.erase(std::unique(lora_slots.begin(), lora_slots.end()),
+                     lora_slots.end());
+    input_params.lora_slot_ids = torch::tensor(lora_slot_ids, torch::kInt);
+    input_params.lora_slots = std::move(lora_slots);
+  }
+
   CHECK_EQ(sampling_params.size(), selected_token_idxes.size());
   if (!selected_token_idxes.empty()) {
     pad_2d_vector<int64_t>(unique_token_ids_vec, /*pad_value=*/0);
@@ -275,6 +344,7 @@ ModelInput Batch::prepare_model_input(uint32_t num_decoding_tokens,
 }
 
 void Batch::process_sample_output(const SampleOutput& sample_output) {
+  TraceSpan span("batch.process_sample_output");
   // [num_seq] LongTensor
   const auto& next_tokens = safe_to(sample_output.next_tokens, torch::kCPU);
   // it is possible that the model output is empty for prefill sequences
@@ -354,6 +424,41 @@ void Batch::process_validate_output(const SampleOutput& sample_output) {
   }
 }
 
+void Batch::process_decode_step_output(const SampleOutput& sample_output) {
+  TraceSpan span("batch.process_decode_step_output");
+  // [num_seq] LongTensor
+  const auto& next_tokens = safe_to(sample_output.next_tokens, torch::kCPU);
+  // [num_seq] FloatTensor
+  const auto& logprobs = safe_to(sample_output.logprobs, torch::kCPU);
+  // [num_seq, topk] LongTensor
+  const auto& top_tokens = safe_to(sample_output.top_tokens, torch::kCPU);
+  // [num_seq, topk] FloatTensor
+  const auto& top_logprobs = safe_to(sample_output.top_logprobs, torch::kCPU);
+
+  const int64_t num_seqs = next_tokens.size(0);
+  CHECK_EQ(num_seqs, static_cast<int64_t>(sequences_.size()));
+  for (int64_t i = 0; i < num_seqs; ++i) {
+    auto* seq = sequences_[i];
+    if (seq->is_finished()) {
+      continue;
+    }
+    seq->commit_kv_cache(/*size=*/1);
+    const auto token =
+        build_token(i, next_tokens, logprobs, top_tokens, top_logprobs);
+    seq->append_token(token);
+  }
+}
+
+bool Batch::needs_token_stats() const {
+  return std::any_of(
+      sequences_.begin(), sequences_.end(), [](const Sequence* seq) {
+        const auto* param = seq->sampling_param();
+        return param->frequency_penalty != 0.0 ||
+               param->presence_penalty != 0.0 ||
+               param->repetition_penalty != 1.0;
+      });
+}
+
 Token Batch::build_token(int64_t index,
                          torch::Tensor token_ids,
                          torch::Tensor logprobs,
@@ -44,6 +44,9 @@ class Batch {
   // TODO: remove this operator once refactoring is done
   Sequence* operator[](size_t i) { return sequences_[i]; }
 
+  // the max number of tokens to process for the i-th sequence in a step
+  uint32_t token_budget(size_t i) const { return token_budgets_[i]; }
+
   // prepare inputs for the batch, a stateful operation
   ModelInput prepare_model_input(uint32_t num_decoding_tokens,
                                  uint32_t min_decoding_bach_size);
@@ -54,9 +57,34 @@ class Batch {
   // process the accepted output for each sequence
   void process_validate_output(const SampleOutput& sample_output);
 
+  // process the sample output of a decode step whose inputs were advanced on
+  // the device from the last step: commit the kv cache of the last token and
+  // append the sampled token for each sequence. sequences finished in earlier
+  // steps are masked out and their outputs are discarded.
+  void process_decode_step_output(const SampleOutput& sample_output);
+
+  // whether any sequence samples with penalties, which need the token counts
+  // built on the host for each step
+  bool needs_token_stats() const;
+
   // set the engine type for the batch
   void set_engine_type(EngineType engine_type);
 
+  // the number of decode iterations to run the batch for before returning to
+  // the scheduler, only set for decode batches with blocks allocated for all
+  // the iterations.
+  void set_num_decode_steps(uint32_t num_decode_steps);
+  uint32_t num_decode_steps() const { return num_decode_steps_; }
+
+  // move on to the next decode iteration: drop the sequences finished in the
+  // last iteration and reset the token budget used. returns false if all
+  // sequences are finished.
+  bool next_decode_step();
+
+  // drop the sequences that failed before the step, e.g. their lora adapter
+  // failed to load. returns false if no sequence is left.
+  bool drop_failed_sequences();
+
  private:
   static Token build_token(int64_t index,
                            torch::Tensor token_ids,
@@ -72,6 +100,9 @@ class Batch {
 
   // number of used budget for each sequence
   std::vector<uint32_t> budget_used_;
+
+  // number of decode iterations to run the batch for
+  uint32_t num_decode_steps_ = 1;
 };
 
 }  // namespace llm
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <folly/futures/Future.h>
+
 #include "batch.h"
 #include "memory/block_manager.h"
 #include "models/model_args.h"
@@ -14,6 +16,12 @@ class Engine {
   // execute the model with the given batch, results are stored in the batch
   virtual ModelOutput execute_model(Batch& batch) = 0;
 
+  // execute the model asynchronously, the future is fulfilled once results
+  // are stored in the batch. the batch must outlive the future.
+  virtual folly::SemiFuture<ModelOutput> execute_model_async(Batch& batch) {
+    return folly::makeSemiFuture(execute_model(batch));
+  }
+
   // return a clone of the tokenizer
   virtual const Tokenizer* tokenizer() const = 0;
 
@@ -25,6 +33,15 @@ class Engine {
 
   // return the tokenizer args
   virtual const TokenizerArgs& tokenizer_args() const = 0;
+
+  // called by the scheduler between two steps on its own thread, when no step
+  // is running and before the next batch is built. the engine can change the
+  // state shared with the scheduler here, e.g. the prefix cache.
+  virtual void on_step_boundary() {}
+
+  // save the prefix cache to local disk to warm it up after a restart.
+  // returns false if not enabled or failed.
+  virtual bool save_prefix_cache_snapshot() { return false; }
 };
 
 }  // namespace llm
@@ -1,35 +1,64 @@
 #include "llm_engine.h"
 
 #include <ATen/cuda/CUDAContext.h>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <sys/sysinfo.h>
 
 #include <algorithm>
 #include <boost/algorithm/string.hpp>
+#include <deque>
 #include <memory>
 
 #include "common/metrics.h"
 #include "common/pretty_print.h"
+#include "common/timer.h"
 #include "model_loader/model_loader.h"
 #include "model_parallel/parallel_args.h"
 #include "models/model_args.h"
 #include "worker.h"
 
+DECLARE_string(qlinear_gptq_impl);
+DECLARE_string(linear_weight_only_quant);
+
 DEFINE_COUNTER(prepare_input_latency_seconds,
                "Latency of preparing input in seconds");
+DEFINE_GAUGE(model_load_latency_seconds,
+             "Latency of loading model weights in seconds");
+DEFINE_GAUGE(engine_init_latency_seconds,
+             "Latency of initializing the engine in seconds");
+DEFINE_GAUGE(staged_weights_load_latency_seconds,
+             "Latency of staging model weights in seconds");
+DEFINE_COUNTER(model_weights_swaps_total,
+               "Total number of model weights swaps");
+DEFINE_COUNTER(lora_adapter_load_latency_seconds,
+               "Latency of loading lora adapters in seconds");
+DEFINE_COUNTER(lora_adapter_loads_total,
+               "Total number of lora adapters loaded into the slots");
+DEFINE_GAUGE(prefix_cache_snapshot_save_latency_seconds,
+             "Latency of saving the prefix cache snapshot in seconds");
+DEFINE_GAUGE(prefix_cache_snapshot_restore_latency_seconds,
+             "Latency of restoring the prefix cache snapshot in seconds");
 
 namespace llm {
 namespace {
 const std::vector<uint32_t> kDefaultBatchSizesForCudaGraph =
     {1, 2, 4, 8, 16, 24, 32, 48, 64};
 
-torch::ScalarType parse_dtype(const std::string& dtype_str,
-                              const torch::Device& device) {
-  if (device.is_cpu()) {
-    // cpu only supports float32 for now
+torch::ScalarType parse_cpu_dtype(const std::string& dtype_str) {
+  if (dtype_str.empty() || boost::iequals(dtype_str, "float") ||
+      boost::iequals(dtype_str, "float32")) {
     return torch::kFloat32;
   }
+  // bfloat16 weights and activations, accumulate in float32
+  if (boost::iequals(dtype_str, "bfloat16")) {
+    return torch::kBFloat16;
+  }
+  CHECK(false) << "Unsupported cpu dtype: " << dtype_str;
+}
 
+torch::ScalarType parse_dtype(const std::string& dtype_str,
+                              const torch::Device& device) {
   if (boost::iequals(dtype_str, "half") ||
       boost::iequals(dtype_str, "float16")) {
     return torch::kFloat16;
@@ -48,6 +77,28 @@ torch::ScalarType parse_dtype(const std::string& dtype_str,
   }
   CHECK(false) << "Unsupported dtype: " << dtype_str << " on device " << device;
 }
+
+// whether the weights of two checkpoints are interchangeable
+bool is_same_architecture(const ModelArgs& args, const ModelArgs& other) {
+  // the vocab size may be filled from the tokenizer
+  const bool same_vocab_size =
+      other.vocab_size() <= 0 || args.vocab_size() == other.vocab_size();
+  return args.model_type() == other.model_type() &&
+         args.hidden_size() == other.hidden_size() &&
+         args.intermediate_size() == other.intermediate_size() &&
+         args.n_layers() == other.n_layers() &&
+         args.n_heads() == other.n_heads() &&
+         args.n_kv_heads() == other.n_kv_heads() &&
+         args.head_dim() == other.head_dim() && same_vocab_size;
+}
+
+// collect the results of all workers, false if any of them failed
+bool all_succeeded(std::vector<folly::SemiFuture<bool>>& futures) {
+  auto results = folly::collectAll(futures).get();
+  return std::all_of(results.begin(), results.end(), [](const auto& result) {
+    return result.hasValue() && result.value();
+  });
+}
 }  // namespace
 
 LLMEngine::LLMEngine(const Options& options) : options_(options) {
@@ -111,6 +162,7 @@ LLMEngine::LLMEngine(const Options& options) : options_(options) {
 }
 
 bool LLMEngine::init(const std::string& model_weights_path) {
+  Timer timer;
   if (!init_model(model_weights_path)) {
     LOG(ERROR) << "Failed to initialize model from: " << model_weights_path;
     return false;
@@ -126,16 +178,22 @@ bool LLMEngine::init(const std::string& model_weights_path) {
     LOG(ERROR) << "Failed to initialize kv cache";
     return false;
   }
+  // warm up the prefix cache from the previous run, serve cold if failed
+  if (!options_.prefix_cache_snapshot_dir().empty()) {
+    restore_prefix_cache_snapshot();
+  }
   if (!capture_cuda_graphs()) {
     LOG(ERROR) << "Failed to warmup model.";
     return false;
   }
+  GAUGE_SET(engine_init_latency_seconds, timer.elapsed_seconds());
   return true;
 }
 
 bool LLMEngine::init_model(const std::string& model_weights_path) {
   auto model_loader = ModelLoader::create(model_weights_path);
   LOG(INFO) << "Initializing model from: " << model_weights_path;
+  model_weights_path_ = model_weights_path;
 
   tokenizer_ = model_loader->tokenizer();
   CHECK(tokenizer_ != nullptr);
@@ -150,7 +208,10 @@ bool LLMEngine::init_model(const std::string& model_weights_path) {
   const int64_t n_kv_heads = args_.n_kv_heads().value_or(n_heads);
   n_local_kv_heads_ = std::max<int64_t>(1, n_kv_heads / world_size);
   head_dim_ = args_.head_dim();
-  dtype_ = parse_dtype(args_.dtype(), options_.devices()[0]);
+  const auto& device = options_.devices()[0];
+  // the dtype of the model checkpoint is ignored on cpu
+  dtype_ = device.is_cpu() ? parse_cpu_dtype(options_.cpu_dtype())
+                           : parse_dtype(args_.dtype(), device);
 
   // key + value for all layers
   LOG(INFO) << "Block info, block_size: " << options_.block_size()
@@ -172,6 +233,12 @@ bool LLMEngine::init_model(const std::string& model_weights_path) {
     }
   }
 
+  // the lora slots are allocated with the model
+  if (options_.max_loras() > 0) {
+    args_.max_loras(options_.max_loras())
+        .max_lora_rank(options_.max_lora_rank());
+  }
+
   LOG(INFO) << "Initializing model with " << args_;
   LOG(INFO) << "Initializing model with quant args: " << quant_args_;
   LOG(INFO) << "Initializing model with tokenizer args: " << tokenizer_args_;
@@ -191,26 +258,328 @@ bool LLMEngine::init_model(const std::string& model_weights_path) {
     }
   }
 
-  // load the weights from the checkpoint in parallel
-  for (const auto& state_dict : *model_loader) {
+  if (options_.max_loras() > 0 && !init_lora_adapters()) {
+    return false;
+  }
+
+  // restore the final layout of the weights from the cache if available
+  std::unique_ptr<WeightsCache> weights_cache;
+  if (!options_.weights_cache_dir().empty()) {
+    WeightsCache::Key key;
+    key.model_path = model_weights_path;
+    key.dtype = dtype_;
+    key.device_type = device.type();
+    key.world_size = world_size;
+    key.quant_method = quant_args_.quant_method();
+    // flags choosing the linear implementations change the layout
+    key.extras = {"qlinear_gptq_impl=" + FLAGS_qlinear_gptq_impl,
+                  "linear_weight_only_quant=" + FLAGS_linear_weight_only_quant};
+    weights_cache =
+        std::make_unique<WeightsCache>(options_.weights_cache_dir(), key);
+    if (weights_cache->is_complete()) {
+      Timer timer;
+      if (restore_weights_cache(*weights_cache)) {
+        GAUGE_SET(model_load_latency_seconds, timer.elapsed_seconds());
+        return true;
+      }
+      LOG(WARNING) << "Failed to restore weights from " << weights_cache->path()
+                   << ", loading from the checkpoint instead";
+    }
+  }
+
+  if (!load_weights(*model_loader)) {
+    return false;
+  }
+
+  // verify the weights are loaded correctly
+  for (const auto& worker : workers_) {
+    worker->verify_loaded_weights();
+  }
+
+  // save before any forward, some layers repack the weights lazily
+  if (weights_cache != nullptr) {
+    save_weights_cache(*weights_cache);
+  }
+  return true;
+}
+
+bool LLMEngine::restore_weights_cache(const WeightsCache& cache) {
+  std::vector<folly::SemiFuture<bool>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(worker->load_weights_cache_async(cache));
+  }
+  auto results = folly::collectAll(futures).get();
+  const size_t num_restored =
+      std::count_if(results.begin(), results.end(), [](const auto& result) {
+        return result.hasValue() && result.value();
+      });
+  if (num_restored == results.size()) {
+    LOG(INFO) << "Restored model weights from " << cache.path();
+    return true;
+  }
+  // the workers that restored their weights can't load the checkpoint again
+  CHECK_EQ(num_restored, 0) << "Partially restored weights from "
+                            << cache.path() << ", please remove it";
+  return false;
+}
+
+bool LLMEngine::save_weights_cache(const WeightsCache& cache) {
+  std::vector<folly::SemiFuture<bool>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(worker->save_weights_cache_async(cache));
+  }
+  auto results = folly::collectAll(futures).get();
+  for (const auto& result : results) {
+    if (!result.hasValue() || !result.value()) {
+      LOG(WARNING) << "Failed to save weights cache to " << cache.path();
+      return false;
+    }
+  }
+  if (!cache.commit()) {
+    return false;
+  }
+  LOG(INFO) << "Saved model weights cache to " << cache.path();
+  return true;
+}
+
+bool LLMEngine::load_weights(const ModelLoader& model_loader) {
+  Timer timer;
+  const auto max_prefetch =
+      static_cast<size_t>(std::max<int64_t>(1, options_.max_prefetch_files()));
+  // map and parse the files in parallel ahead of the workers
+  auto prefetcher = model_loader.prefetch_state_dicts(max_prefetch);
+
+  // state dicts being loaded by the workers, released once all workers are
+  // done with them
+  struct InflightStateDict {
+    std::unique_ptr<StateDict> state_dict;
+    std::vector<folly::SemiFuture<folly::Unit>> futures;
+  };
+  std::deque<InflightStateDict> inflight;
+  const auto wait_for_oldest = [&inflight]() {
+    auto results = folly::collectAll(inflight.front().futures).get();
+    inflight.pop_front();
+    return std::none_of(results.begin(), results.end(), [](const auto& r) {
+      return r.hasException();
+    });
+  };
+
+  // each worker loads the files in order on its own thread, hand over the
+  // next file as soon as it is mapped without waiting for the previous one.
+  while (auto state_dict = prefetcher->next()) {
     std::vector<folly::SemiFuture<folly::Unit>> futures;
     futures.reserve(workers_.size());
     for (auto& worker : workers_) {
-      futures.push_back(worker->load_state_dict_async(state_dict));
+      futures.push_back(worker->load_state_dict_async(*state_dict));
     }
-    // wait for all futures to complete
-    auto results = folly::collectAll(futures).get();
-    for (const auto& result : results) {
-      if (result.hasException()) {
+    inflight.push_back({std::move(state_dict), std::move(futures)});
+    // bound the number of state dicts held by the workers
+    while (inflight.size() > max_prefetch) {
+      if (!wait_for_oldest()) {
         return false;
       }
     }
   }
+  while (!inflight.empty()) {
+    if (!wait_for_oldest()) {
+      return false;
+    }
+  }
 
-  // verify the weights are loaded correctly
-  for (const auto& worker : workers_) {
-    worker->verify_loaded_weights();
+  const double load_latency = timer.elapsed_seconds();
+  GAUGE_SET(model_load_latency_seconds, load_latency);
+  LOG(INFO) << "Loaded " << prefetcher->size() << " model weights files in "
+            << load_latency << "s";
+  return true;
+}
+
+folly::SemiFuture<bool> LLMEngine::stage_weights(
+    const std::string& model_weights_path) {
+  if (staging_.exchange(true)) {
+    LOG(ERROR) << "Another checkpoint is being staged, ignoring "
+               << model_weights_path;
+    return folly::makeSemiFuture(false);
+  }
+  if (staging_threadpool_ == nullptr) {
+    staging_threadpool_ = std::make_unique<ThreadPool>();
+  }
+
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  staging_threadpool_->schedule([this,
+                                 model_weights_path,
+                                 promise = std::move(promise)]() mutable {
+    const bool success = this->load_staged_weights(model_weights_path);
+    if (success) {
+      // switched at the next step
+      weights_staged_.store(true);
+    } else {
+      staging_.store(false);
+    }
+    promise.setValue(success);
+  });
+  return future;
+}
+
+bool LLMEngine::load_staged_weights(const std::string& model_weights_path) {
+  Timer timer;
+  LOG(INFO) << "Staging model weights from: " << model_weights_path;
+  // marlin and exllamav2 transform the quantized weights lazily in forward,
+  // the staged weights can't be copied over the transformed ones.
+  const auto& device = options_.devices()[0];
+  if (device.is_cuda() && !quant_args_.quant_method().empty()) {
+    LOG(ERROR) << "Staging weights is not supported for quantized models on "
+               << device;
+    return false;
   }
+
+  auto model_loader = ModelLoader::create(model_weights_path);
+  if (!is_same_architecture(args_, model_loader->model_args()) ||
+      quant_args_.quant_method() != model_loader->quant_args().quant_method()) {
+    LOG(ERROR) << "Incompatible checkpoint " << model_weights_path << ": "
+               << model_loader->model_args() << ", expected " << args_;
+    return false;
+  }
+
+  std::vector<folly::SemiFuture<bool>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(worker->init_staged_model_async());
+  }
+  if (!all_succeeded(futures)) {
+    LOG(ERROR) << "Failed to create staged models";
+    return false;
+  }
+
+  // the model execution keeps running on the working threads of the workers
+  const auto max_prefetch =
+      static_cast<size_t>(std::max<int64_t>(1, options_.max_prefetch_files()));
+  auto prefetcher = model_loader->prefetch_state_dicts(max_prefetch);
+  while (auto state_dict = prefetcher->next()) {
+    std::vector<folly::SemiFuture<folly::Unit>> load_futures;
+    load_futures.reserve(workers_.size());
+    for (auto& worker : workers_) {
+      load_futures.push_back(worker->stage_state_dict_async(*state_dict));
+    }
+    folly::collectAll(load_futures).get();
+  }
+
+  futures.clear();
+  for (auto& worker : workers_) {
+    futures.push_back(worker->verify_staged_weights_async());
+  }
+  if (!all_succeeded(futures)) {
+    LOG(ERROR) << "Staged weights mismatch the model, discarding them";
+    discard_staged_weights();
+    return false;
+  }
+
+  staged_weights_path_ = model_weights_path;
+  const double latency = timer.elapsed_seconds();
+  GAUGE_SET(staged_weights_load_latency_seconds, latency);
+  LOG(INFO) << "Staged " << prefetcher->size() << " model weights files in "
+            << latency << "s";
+  return true;
+}
+
+void LLMEngine::discard_staged_weights() {
+  std::vector<folly::SemiFuture<folly::Unit>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(worker->discard_staged_weights_async());
+  }
+  folly::collectAll(futures).get();
+}
+
+void LLMEngine::swap_weights() {
+  // wait for all workers to switch, so that the staged models are released
+  // before another checkpoint can be staged.
+  std::vector<folly::SemiFuture<bool>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(worker->swap_staged_weights_async());
+  }
+  const bool swapped = all_succeeded(futures);
+  if (!swapped) {
+    LOG(ERROR) << "Failed to switch to the staged model weights from "
+               << staged_weights_path_ << ", keep serving "
+               << model_weights_path_;
+    discard_staged_weights();
+  } else {
+    // the kv cache computed with the previous weights can't be shared
+    // anymore, running sequences keep their own kv cache until they finish.
+    if (block_manager_ != nullptr) {
+      block_manager_->clear_prefix_cache();
+    }
+    model_weights_path_ = staged_weights_path_;
+    COUNTER_ADD(model_weights_swaps_total, 1);
+    LOG(INFO) << "Switched to the staged model weights";
+  }
+  weights_staged_.store(false);
+  staging_.store(false);
+}
+
+bool LLMEngine::init_lora_adapters() {
+  // loading an empty adapter checks the model supports lora adapters
+  const StateDict empty_adapter(
+      std::unordered_map<std::string, torch::Tensor>{});
+  std::vector<folly::SemiFuture<bool>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(worker->load_lora_adapter_async(
+        /*slot=*/1, empty_adapter, /*scaling=*/1.0f));
+  }
+  if (!all_succeeded(futures)) {
+    LOG(ERROR) << "Model " << args_.model_type()
+               << " doesn't support lora adapters";
+    return false;
+  }
+
+  // check the adapters upfront instead of failing in the middle of serving
+  for (const auto& [name, path] : options_.lora_adapters()) {
+    int64_t rank = 0;
+    float scaling = 1.0f;
+    if (!LoraManager::load_adapter_config(path, &rank, &scaling)) {
+      LOG(ERROR) << "Failed to load lora adapter " << name << " from " << path;
+      return false;
+    }
+    if (rank > options_.max_lora_rank()) {
+      LOG(ERROR) << "The rank of lora adapter " << name << ": " << rank
+                 << " exceeds max_lora_rank: " << options_.max_lora_rank();
+      return false;
+    }
+    LOG(INFO) << "Serving lora adapter " << name << " from " << path
+              << ", rank: " << rank << ", scaling: " << scaling;
+  }
+  lora_manager_ = std::make_unique<LoraManager>(options_.max_loras(),
+                                                options_.lora_adapters());
+  return true;
+}
+
+bool LLMEngine::load_lora_adapter(int32_t slot,
+                                  const std::string& name,
+                                  const std::string& adapter_path) {
+  Timer timer;
+  auto adapter = LoraManager::load_adapter(adapter_path);
+  if (adapter == nullptr) {
+    return false;
+  }
+  // queued after the running steps, which finish with the previous adapter
+  // in the slot
+  std::vector<folly::SemiFuture<bool>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(worker->load_lora_adapter_async(
+        slot, *adapter->state_dict, adapter->scaling));
+  }
+  if (!all_succeeded(futures)) {
+    return false;
+  }
+  COUNTER_ADD(lora_adapter_load_latency_seconds, timer.elapsed_seconds());
+  COUNTER_INC(lora_adapter_loads_total);
+  LOG(INFO) << "Loaded lora adapter " << name << " into slot " << slot;
   return true;
 }
 
@@ -322,7 +691,8 @@ bool LLMEngine::init_kv_cache(int64_t n_blocks) {
   BlockManager::Options options;
   options.num_blocks(n_blocks)
       .block_size(block_size)
-      .enable_prefix_cache(options_.enable_prefix_cache());
+      .enable_prefix_cache(options_.enable_prefix_cache())
+      .prefix_cache_eviction_policy(options_.prefix_cache_eviction_policy());
   block_manager_ = std::make_unique<BlockManager>(options);
 
   // init kv cache for each worker in parallel
@@ -341,7 +711,245 @@ bool LLMEngine::init_kv_cache(int64_t n_blocks) {
   return true;
 }
 
+PrefixCacheSnapshot LLMEngine::prefix_cache_snapshot() const {
+  PrefixCacheSnapshot::Key key;
+  key.model_path = model_weights_path_;
+  key.dtype = dtype_;
+  key.block_size = options_.block_size();
+  key.n_layers = args_.n_layers();
+  key.n_local_kv_heads = n_local_kv_heads_;
+  key.head_dim = head_dim_;
+  key.world_size = static_cast<int>(workers_.size());
+  key.extras = {"checkpoint=" +
+                WeightsCache::describe_checkpoint(model_weights_path_)};
+  // the sequences of the lora adapters are cached under their names
+  std::vector<std::string> adapters;
+  for (const auto& [name, path] : options_.lora_adapters()) {
+    adapters.push_back("lora:" + name + "=" + path);
+  }
+  std::sort(adapters.begin(), adapters.end());
+  key.extras.insert(key.extras.end(), adapters.begin(), adapters.end());
+  return {options_.prefix_cache_snapshot_dir(), key};
+}
+
+bool LLMEngine::save_prefix_cache_snapshot() {
+  if (options_.prefix_cache_snapshot_dir().empty() ||
+      !options_.enable_prefix_cache() || block_manager_ == nullptr) {
+    return false;
+  }
+  // finish the periodic snapshot first, which writes into the same files
+  wait_for_prefix_cache_snapshot();
+  snapshot_timer_.reset();
+  const auto entries = block_manager_->prefix_cache_entries();
+  if (entries.empty()) {
+    // keep the previous snapshot
+    return true;
+  }
+  return write_prefix_cache_snapshot(prefix_cache_snapshot(), entries);
+}
+
+void LLMEngine::save_prefix_cache_snapshot_async() {
+  snapshot_timer_.reset();
+  // the entries hold the blocks, so they are neither evicted nor reused until
+  // the snapshot is written.
+  snapshot_entries_ = block_manager_->prefix_cache_entries();
+  if (snapshot_entries_.empty()) {
+    // keep the previous snapshot
+    return;
+  }
+  if (snapshot_threadpool_ == nullptr) {
+    snapshot_threadpool_ = std::make_unique<ThreadPool>();
+  }
+
+  folly::Promise<bool> promise;
+  snapshot_future_ = promise.getSemiFuture();
+  snapshot_threadpool_->schedule([this,
+                                  snapshot = prefix_cache_snapshot(),
+                                  promise = std::move(promise)]() mutable {
+    promise.setValue(
+        this->write_prefix_cache_snapshot(snapshot, snapshot_entries_));
+  });
+}
+
+void LLMEngine::wait_for_prefix_cache_snapshot() {
+  if (snapshot_future_.valid()) {
+    std::move(snapshot_future_).get();
+  }
+  // release the blocks held by the snapshot
+  snapshot_entries_.clear();
+}
+
+bool LLMEngine::write_prefix_cache_snapshot(
+    const PrefixCacheSnapshot& snapshot,
+    const std::vector<PrefixCache::Entry>& entries) {
+  Timer timer;
+  if (!snapshot.save_index(entries)) {
+    return false;
+  }
+  // the cached blocks are full, so no step writes their kv cache while they
+  // are held by the entries.
+  const auto block_ids = PrefixCacheSnapshot::block_ids(entries);
+  for (auto& worker : workers_) {
+    if (!worker->save_kv_cache_snapshot(snapshot, block_ids)) {
+      LOG(WARNING) << "Failed to save prefix cache snapshot to "
+                   << snapshot.path();
+      return false;
+    }
+  }
+  if (!snapshot.commit()) {
+    LOG(WARNING) << "Failed to commit prefix cache snapshot to "
+                 << snapshot.path();
+    return false;
+  }
+  GAUGE_SET(prefix_cache_snapshot_save_latency_seconds,
+            timer.elapsed_seconds());
+  LOG(INFO) << "Saved " << entries.size() << " cached sequences with "
+            << block_ids.size() << " blocks to prefix cache snapshot "
+            << snapshot.path();
+  return true;
+}
+
+bool LLMEngine::restore_prefix_cache_snapshot() {
+  if (options_.prefix_cache_snapshot_dir().empty() ||
+      !options_.enable_prefix_cache()) {
+    return false;
+  }
+  CHECK(block_manager_ != nullptr) << "KV cache is not initialized.";
+  Timer timer;
+  const auto snapshot = prefix_cache_snapshot();
+  if (!snapshot.is_complete()) {
+    LOG(INFO) << "No prefix cache snapshot found in " << snapshot.path();
+    return false;
+  }
+  std::vector<PrefixCacheSnapshot::Entry> entries;
+  if (!snapshot.load_index(&entries)) {
+    return false;
+  }
+
+  const auto block_mapping = block_manager_->restore_prefix_cache(entries);
+  std::vector<folly::SemiFuture<bool>> futures;
+  futures.reserve(workers_.size());
+  for (auto& worker : workers_) {
+    futures.push_back(
+        worker->load_kv_cache_snapshot_async(snapshot, block_mapping));
+  }
+  if (!all_succeeded(futures)) {
+    // the blocks without valid kv cache can't be shared
+    block_manager_->clear_prefix_cache();
+    LOG(WARNING) << "Failed to restore prefix cache snapshot from "
+                 << snapshot.path();
+    return false;
+  }
+  snapshot_timer_.reset();
+  GAUGE_SET(prefix_cache_snapshot_restore_latency_seconds,
+            timer.elapsed_seconds());
+  LOG(INFO) << "Restored " << block_mapping.size()
+            << " blocks into the prefix cache from " << snapshot.path();
+  return true;
+}
+
 ModelOutput LLMEngine::execute_model(Batch& batch) {
+  return execute_model_async(batch).get();
+}
+
+void LLMEngine::on_step_boundary() {
+  // switch to the staged weights
+  if (weights_staged_.load()) {
+    swap_weights();
+  }
+
+  // save the prefix cache periodically in the background, the blocks held by
+  // the last snapshot are released here once it is written.
+  if (snapshot_future_.valid() && snapshot_future_.isReady()) {
+    wait_for_prefix_cache_snapshot();
+  }
+  const int64_t snapshot_interval = options_.prefix_cache_snapshot_interval();
+  if (snapshot_interval > 0 && !snapshot_future_.valid() &&
+      snapshot_timer_.elapsed_seconds() >= snapshot_interval) {
+    save_prefix_cache_snapshot_async();
+  }
+}
+
+folly::SemiFuture<ModelOutput> LLMEngine::execute_model_async(Batch& batch) {
+  // load the lora adapters of the batch into the slots
+  if (lora_manager_ != nullptr) {
+    const bool assigned = lora_manager_->assign_slots(
+        batch,
+        [this](int32_t slot, const std::string& name, const std::string& path) {
+          return load_lora_adapter(slot, name, path);
+        });
+    // the requests of the failed sequences are aborted by the scheduler, the
+    // rest of the batch keeps running
+    if (!assigned && !batch.drop_failed_sequences()) {
+      return folly::makeSemiFuture(ModelOutput{});
+    }
+  }
+
+  const uint32_t num_decode_steps = batch.num_decode_steps();
+  if (num_decode_steps > 1 && !batch.needs_token_stats()) {
+    auto future = execute_step_async(batch, num_decode_steps);
+    return execute_decode_steps_on_device(batch, std::move(future));
+  }
+
+  auto future = execute_step_async(batch);
+  if (num_decode_steps == 1) {
+    return future;
+  }
+  // otherwise build the inputs on the host for each step once the future is
+  // consumed
+  return std::move(future).deferValue([this, &batch](ModelOutput output) {
+    return execute_decode_steps_on_host(batch, std::move(output));
+  });
+}
+
+ModelOutput LLMEngine::execute_decode_steps_on_host(Batch& batch,
+                                                    ModelOutput output) {
+  const uint32_t num_decode_steps = batch.num_decode_steps();
+  for (uint32_t step = 1; step < num_decode_steps && batch.next_decode_step();
+       ++step) {
+    output = execute_step_async(batch).get();
+  }
+  return output;
+}
+
+folly::SemiFuture<ModelOutput> LLMEngine::execute_decode_steps_on_device(
+    Batch& batch,
+    folly::SemiFuture<ModelOutput> first_step) {
+  const uint32_t num_decode_steps = batch.num_decode_steps();
+  std::vector<std::vector<folly::SemiFuture<std::optional<ModelOutput>>>>
+      steps;
+  steps.reserve(num_decode_steps - 1);
+  for (uint32_t step = 1; step < num_decode_steps; ++step) {
+    auto& futures = steps.emplace_back();
+    futures.reserve(workers_.size());
+    for (auto& worker : workers_) {
+      futures.emplace_back(worker->execute_decode_step_async());
+    }
+  }
+
+  // sequences finished in the middle keep running on the device till the last
+  // step, their outputs are masked out.
+  return std::move(first_step).deferValue(
+      [this, &batch, steps = std::move(steps)](ModelOutput output) mutable {
+        if (!output.kept_decode_input) {
+          // the queued steps find no inputs on the workers and do nothing
+          return execute_decode_steps_on_host(batch, std::move(output));
+        }
+        for (auto& futures : steps) {
+          auto results = folly::collectAll(futures).get();
+          auto& model_output = results.front().value();
+          DCHECK(model_output.has_value()) << "Failed to execute model";
+          batch.process_decode_step_output(
+              model_output.value().sample_output);
+          output = std::move(model_output.value());
+        }
+        return output;
+      });
+}
+
+folly::SemiFuture<ModelOutput> LLMEngine::execute_step_async(
+    Batch& batch,
+    uint32_t num_decode_steps) {
   // prepare inputs for workers
   uint32_t adjusted_batch_size = 0;
   if (options_.enable_cuda_graph()) {
@@ -356,25 +964,32 @@ ModelOutput LLMEngine::execute_model(Batch& batch) {
   Timer timer;
   auto model_inputs = batch.prepare_model_input(options_.num_decoding_tokens(),
                                                 adjusted_batch_size);
-  COUNTER_ADD(prepare_input_latency_seconds, timer.elapsed_seconds());
-
   if (!model_inputs.token_ids.defined()) {
     // empty input, just return
-    return {};
+    return folly::makeSemiFuture(ModelOutput{});
   }
+  model_inputs.num_decode_steps = num_decode_steps;
+  // build inputs once in pinned memory, shared by all workers without copying
+  if (options_.devices()[0].is_cuda()) {
+    model_inputs = model_inputs.pin_memory();
+  }
+  auto shared_inputs =
+      std::make_shared<const ModelInput>(std::move(model_inputs));
+  COUNTER_ADD(prepare_input_latency_seconds, timer.elapsed_seconds());
 
   std::vector<folly::SemiFuture<std::optional<ModelOutput>>> futures;
   futures.reserve(workers_.size());
   for (auto& worker : workers_) {
-    futures.emplace_back(worker->execute_model_async(model_inputs));
+    futures.emplace_back(worker->execute_model_async(shared_inputs));
   }
-  // wait for the all future to complete
-  auto results = folly::collectAll(futures).get();
-  // return the result from the driver
-  auto model_output = results.front().value();
-  DCHECK(model_output.has_value()) << "Failed to execute model";
-  batch.process_sample_output(model_output.value().sample_output);
-  return model_output.value();
+  // process the output from the driver once all workers are done
+  return folly::collectAll(futures).deferValue(
+      [&batch](std::vector<folly::Try<std::optional<ModelOutput>>>&& results) {
+        auto& model_output = results.front().value();
+        DCHECK(model_output.has_value()) << "Failed to execute model";
+        batch.process_sample_output(model_output.value().sample_output);
+        return std::move(model_output.value());
+      });
 }
 
 int64_t LLMEngine::kv_cache_slot_size_in_bytes() const {
@@ -1,11 +1,19 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <string>
 
 #include "batch.h"
 #include "common/macros.h"
+#include "common/threadpool.h"
+#include "common/timer.h"
 #include "engine.h"
+#include "lora_manager.h"
 #include "memory/block_manager.h"
+#include "memory/prefix_cache_snapshot.h"
+#include "model_loader/model_loader.h"
+#include "model_loader/weights_cache.h"
 #include "quantization/quant_args.h"
 #include "tokenizer/tokenizer.h"
 #include "tokenizer/tokenizer_args.h"
@@ -44,6 +52,9 @@ class LLMEngine : public Engine {
     // enable prefix cache
     DEFINE_ARG(bool, enable_prefix_cache) = true;
 
+    // the eviction policy of the prefix cache: lru, lfu or gdsf
+    DEFINE_ARG(std::string, prefix_cache_eviction_policy) = "lru";
+
     // number of decoding tokens per sequence
     // in speculative decoding, it is the number of speculative tokens + 1
     DEFINE_ARG(int64_t, num_decoding_tokens) = 1;
@@ -56,6 +67,34 @@ class LLMEngine : public Engine {
 
     // batch sizes to capture cuda graphs
     DEFINE_ARG(std::optional<std::vector<uint32_t>>, cuda_graph_batch_sizes);
+
+    // dtype for weights and activations on cpu: float32 or bfloat16
+    DEFINE_ARG(std::string, cpu_dtype) = "float32";
+
+    // the maximum number of model weights files to load ahead of the workers
+    DEFINE_ARG(int64_t, max_prefetch_files) = 2;
+
+    // directory to cache the loaded weights of each rank for fast restarts,
+    // empty to disable the cache
+    DEFINE_ARG(std::string, weights_cache_dir);
+
+    // the maximum number of lora adapters in one batch, which is also the
+    // number of adapters kept on the device. 0 to disable lora adapters.
+    DEFINE_ARG(int64_t, max_loras) = 0;
+
+    // the maximum rank of the lora adapters
+    DEFINE_ARG(int64_t, max_lora_rank) = 16;
+
+    // lora adapters to serve: name -> checkpoint directory
+    DEFINE_ARG(LoraAdapterPaths, lora_adapters);
+
+    // directory to save the prefix cache on shutdown and restore it on
+    // startup, empty to disable the snapshot
+    DEFINE_ARG(std::string, prefix_cache_snapshot_dir);
+
+    // interval in seconds to save the prefix cache snapshot between steps,
+    // 0 to only save it on shutdown
+    DEFINE_ARG(int64_t, prefix_cache_snapshot_interval) = 0;
   };
 
   // create an engine with the given devices
@@ -66,6 +105,16 @@ class LLMEngine : public Engine {
   // step the engine forward by one step with the batch
   ModelOutput execute_model(Batch& batch) override;
 
+  // prepare inputs for the batch and dispatch them to all workers, returns
+  // without waiting for the model to finish. for a batch with multiple decode
+  // steps, the following steps are queued on the device at once, or run on
+  // the host one by one when the future is consumed.
+  folly::SemiFuture<ModelOutput> execute_model_async(Batch& batch) override;
+
+  // switch to the staged weights and save the prefix cache snapshot when it
+  // is due, both read or clear the prefix cache used by the scheduler.
+  void on_step_boundary() override;
+
   const Tokenizer* tokenizer() const override { return tokenizer_.get(); }
 
   BlockManager* block_manager() const override { return block_manager_.get(); }
@@ -85,8 +134,40 @@ class LLMEngine : public Engine {
 
   bool init_model(const std::string& model_weights_path);
 
+  // load the weights files in parallel and pipeline them to the workers
+  bool load_weights(const ModelLoader& model_loader);
+
+  // restore the weights of all workers from the cache
+  bool restore_weights_cache(const WeightsCache& cache);
+
+  // save the loaded weights of all workers to the cache
+  bool save_weights_cache(const WeightsCache& cache);
+
+  // load the weights of a new checkpoint of the same model into a second set
+  // of buffers in the background while serving. the engine switches to them
+  // at the next step boundary, and the future returns false if the checkpoint
+  // can't be staged. only one checkpoint can be staged at a time.
+  folly::SemiFuture<bool> stage_weights(const std::string& model_weights_path);
+
+  // whether staged weights are waiting to be switched at the next step
+  bool has_staged_weights() const { return weights_staged_.load(); }
+
+  // whether the lora adapter is served by the engine
+  bool has_lora_adapter(const std::string& name) const {
+    return lora_manager_ != nullptr && lora_manager_->has_adapter(name);
+  }
+
   bool init_kv_cache(int64_t n_blocks);
 
+  // save the cached sequences and their kv cache to the snapshot directory.
+  // blocking call, the engine must be idle.
+  bool save_prefix_cache_snapshot() override;
+
+  // restore the prefix cache from the snapshot directory if the snapshot
+  // matches the model, the most recently used sequences first until the kv
+  // cache is full.
+  bool restore_prefix_cache_snapshot();
+
   bool capture_cuda_graphs();
 
   // returns the memory size for the kv cache
@@ -99,6 +180,60 @@ class LLMEngine : public Engine {
   int64_t calculate_kv_cache_blocks(int64_t cache_size_in_bytes) const;
 
  private:
+  // run one iteration of the batch on all workers and process the sample
+  // output of the driver once they are done. the workers keep the inputs on
+  // the device to run the following steps if num_decode_steps > 1.
+  folly::SemiFuture<ModelOutput> execute_step_async(
+      Batch& batch,
+      uint32_t num_decode_steps = 1);
+
+  // run the remaining decode steps of the batch on the device after the first
+  // one: the steps are queued on the workers at once, which feed the sampled
+  // tokens into the next step by themselves, and the host only appends the
+  // sampled tokens when the future is consumed. falls back to the host steps
+  // if the workers didn't keep the inputs of the first step.
+  folly::SemiFuture<ModelOutput> execute_decode_steps_on_device(
+      Batch& batch,
+      folly::SemiFuture<ModelOutput> first_step);
+
+  // run the remaining decode steps of the batch after the first one with the
+  // inputs built on the host for each step, sequences that hit the stopping
+  // criteria drop out of the following steps. blocking call
+  ModelOutput execute_decode_steps_on_host(Batch& batch, ModelOutput output);
+
+  // load the checkpoint into the staged models of all workers. blocking call
+  bool load_staged_weights(const std::string& model_weights_path);
+
+  // switch all workers to the staged weights before the next step, blocks
+  // until all workers have switched.
+  void swap_weights();
+
+  // release the staged weights of all workers. blocking call
+  void discard_staged_weights();
+
+  // check the lora adapters are compatible with the model
+  bool init_lora_adapters();
+
+  // load the lora adapter into the slot of all workers. blocking call
+  bool load_lora_adapter(int32_t slot,
+                         const std::string& name,
+                         const std::string& adapter_path);
+
+  // the snapshot of the prefix cache for the current model
+  PrefixCacheSnapshot prefix_cache_snapshot() const;
+
+  // take the cached sequences and write the snapshot on the snapshot thread,
+  // the blocks are held until the snapshot is written.
+  void save_prefix_cache_snapshot_async();
+
+  // wait for the snapshot being written and release the blocks held by it
+  void wait_for_prefix_cache_snapshot();
+
+  // write the cached sequences and the kv cache of their blocks. blocking call
+  bool write_prefix_cache_snapshot(
+      const PrefixCacheSnapshot& snapshot,
+      const std::vector<PrefixCache::Entry>& entries);
+
   // options
   Options options_;
 
@@ -132,6 +267,36 @@ class LLMEngine : public Engine {
   // config for kv cache
   int64_t n_local_kv_heads_ = 0;
   int64_t head_dim_ = 0;
+
+  // whether a checkpoint is being staged or waiting to be switched
+  std::atomic<bool> staging_{false};
+
+  // whether the staged weights are ready to be switched
+  std::atomic<bool> weights_staged_{false};
+
+  // thread to stage the weights, created on first use
+  std::unique_ptr<ThreadPool> staging_threadpool_;
+
+  // lora adapters in the slots, only created when lora is enabled
+  std::unique_ptr<LoraManager> lora_manager_;
+
+  // the checkpoint of the serving weights and of the staged weights
+  std::string model_weights_path_;
+  std::string staged_weights_path_;
+
+  // time since the last prefix cache snapshot
+  Timer snapshot_timer_;
+
+  // the cached sequences being written by the snapshot thread
+  std::vector<PrefixCache::Entry> snapshot_entries_;
+
+  // fulfilled once the snapshot is written
+  folly::SemiFuture<bool> snapshot_future_ =
+      folly::SemiFuture<bool>::makeEmpty();
+
+  // thread to write the prefix cache snapshot, created on first use. joined
+  // first on destruction, before the blocks and workers it uses are released.
+  std::unique_ptr<ThreadPool> snapshot_threadpool_;
 };
 
 }  // namespace llm
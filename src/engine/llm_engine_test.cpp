@@ -0,0 +1,194 @@
+#include "llm_engine.h"
+
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "memory/block_manager.h"
+#include "request/sequence.h"
+#include "tiny_model.h"
+
+namespace llm {
+namespace {
+constexpr int32_t kBlockSize = 16;
+// a few dozen blocks of the tiny model
+constexpr int64_t kMaxCacheSize = int64_t(1) << 20;
+
+Sequence::Options greedy_options() {
+  Sequence::Options options;
+  options.sampling_param.temperature = 0;
+  options.stopping_criteria.max_tokens = 64;
+  options.stopping_criteria.ignore_eos = true;
+  return options;
+}
+
+// two full blocks and a partial one
+std::vector<int32_t> prompt_tokens() {
+  std::vector<int32_t> prompt(2 * kBlockSize + 4);
+  std::iota(prompt.begin(), prompt.end(), 3);
+  return prompt;
+}
+
+// run the sequence for the number of steps, one token per step after prefill
+void generate(LLMEngine& engine, Sequence& sequence, size_t num_steps) {
+  for (size_t i = 0; i < num_steps; ++i) {
+    ASSERT_TRUE(engine.block_manager()->allocate_blocks_for(&sequence));
+    Batch batch(&sequence);
+    engine.execute_model(batch);
+  }
+}
+
+std::vector<int32_t> token_ids(const Sequence& sequence) {
+  const auto ids = sequence.token_ids();
+  return {ids.begin(), ids.end()};
+}
+
+}  // namespace
+
+class LLMEngineTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() /
+            ("llm_engine_test_" + std::to_string(::getpid()));
+  }
+
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  // write a tiny model with random weights into the directory
+  std::string save_model(const std::string& name) const {
+    const auto args = tiny_model_args();
+    const std::string dir = (root_ / name).string();
+    save_tiny_model(args, random_state_dict(args), dir);
+    return dir;
+  }
+
+  static std::unique_ptr<LLMEngine> create_engine(
+      const std::string& model_path,
+      const std::string& snapshot_dir = "",
+      int64_t snapshot_interval = 0) {
+    LLMEngine::Options options;
+    options.devices({torch::Device(torch::kCPU)})
+        .block_size(kBlockSize)
+        .max_cache_size(kMaxCacheSize)
+        .enable_prefix_cache(true)
+        .enable_cuda_graph(false)
+        .prefix_cache_snapshot_dir(snapshot_dir)
+        .prefix_cache_snapshot_interval(snapshot_interval);
+    auto engine = std::make_unique<LLMEngine>(options);
+    CHECK(engine->init(model_path));
+    return engine;
+  }
+
+  std::filesystem::path root_;
+};
+
+TEST_F(LLMEngineTest, SwapStagedWeights) {
+  torch::manual_seed(0);
+  const auto old_model = save_model("old");
+  const auto new_model = save_model("new");
+  const auto prompt = prompt_tokens();
+  constexpr size_t kNumSteps = 4;
+
+  // the outputs of the prompt served by each checkpoint from the start
+  const auto serve = [&](const std::string& model) {
+    auto engine = create_engine(model);
+    Sequence sequence(prompt, /*capacity=*/64, greedy_options());
+    generate(*engine, sequence, kNumSteps);
+    return token_ids(sequence);
+  };
+  const auto old_tokens = serve(old_model);
+  const auto new_tokens = serve(new_model);
+  ASSERT_NE(old_tokens, new_tokens);
+
+  auto engine = create_engine(old_model);
+  auto* block_manager = engine->block_manager();
+
+  // a finished sequence leaves its full blocks in the prefix cache
+  {
+    Sequence sequence(prompt, /*capacity=*/64, greedy_options());
+    generate(*engine, sequence, kNumSteps);
+    EXPECT_EQ(token_ids(sequence), old_tokens);
+    block_manager->release_blocks_for(&sequence);
+  }
+  EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 2);
+
+  // stage the new checkpoint while a sequence is in flight, it keeps running
+  // with the serving weights until the step boundary
+  Sequence running(prompt, /*capacity=*/64, greedy_options());
+  ASSERT_TRUE(block_manager->allocate_blocks_for(&running));
+  EXPECT_EQ(running.num_kv_cache_tokens(), 2 * kBlockSize);
+  generate(*engine, running, 1);
+  ASSERT_TRUE(engine->stage_weights(new_model).get());
+  EXPECT_TRUE(engine->has_staged_weights());
+  generate(*engine, running, kNumSteps - 1);
+  EXPECT_EQ(token_ids(running), old_tokens);
+  EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 2);
+
+  // the swap drops the kv cache computed with the old weights
+  engine->on_step_boundary();
+  EXPECT_FALSE(engine->has_staged_weights());
+  EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 0);
+
+  // the running sequence keeps its own kv cache, new sequences don't share it
+  generate(*engine, running, 1);
+  EXPECT_EQ(running.num_tokens(), prompt.size() + kNumSteps + 1);
+  Sequence sequence(prompt, /*capacity=*/64, greedy_options());
+  ASSERT_TRUE(block_manager->allocate_blocks_for(&sequence));
+  EXPECT_EQ(sequence.num_kv_cache_tokens(), 0);
+  generate(*engine, sequence, kNumSteps);
+  EXPECT_EQ(token_ids(sequence), new_tokens);
+
+  // only the blocks computed with the new weights are cached
+  block_manager->release_blocks_for(&running);
+  EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 0);
+  block_manager->release_blocks_for(&sequence);
+  EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 2);
+  EXPECT_EQ(block_manager->num_blocks_in_use(), 0);
+}
+
+TEST_F(LLMEngineTest, PeriodicSnapshot) {
+  torch::manual_seed(0);
+  const auto model = save_model("model");
+  const std::string snapshot_dir = (root_ / "snapshot").string();
+  const auto prompt = prompt_tokens();
+
+  {
+    auto engine = create_engine(model, snapshot_dir, /*snapshot_interval=*/1);
+    auto* block_manager = engine->block_manager();
+    Sequence sequence(prompt, /*capacity=*/64, greedy_options());
+    generate(*engine, sequence, 1);
+    block_manager->release_blocks_for(&sequence);
+    EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 2);
+
+    // the interval has elapsed, the snapshot is written in the background
+    absl::SleepFor(absl::Seconds(1));
+    engine->on_step_boundary();
+    EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 2);
+
+    // the running sequences keep being served meanwhile
+    Sequence running(prompt, /*capacity=*/64, greedy_options());
+    generate(*engine, running, 2);
+    EXPECT_EQ(running.num_tokens(), prompt.size() + 2);
+    block_manager->release_blocks_for(&running);
+    // the engine waits for the snapshot being written on destruction
+  }
+
+  // the restarted engine restores the cached blocks from the snapshot
+  auto engine = create_engine(model, snapshot_dir);
+  auto* block_manager = engine->block_manager();
+  EXPECT_EQ(block_manager->num_blocks_in_prefix_cache(), 2);
+  Sequence sequence(prompt, /*capacity=*/64, greedy_options());
+  ASSERT_TRUE(block_manager->allocate_blocks_for(&sequence));
+  EXPECT_EQ(sequence.num_kv_cache_tokens(), 2 * kBlockSize);
+}
+
+}  // namespace llm
@@ -0,0 +1,174 @@
+#include "lora_manager.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "common/json_reader.h"
+#include "model_loader/state_dict.h"
+#include "request/status.h"
+
+namespace llm {
+
+LoraManager::LoraManager(int64_t max_loras, LoraAdapterPaths adapters)
+    : max_loras_(max_loras), adapters_(std::move(adapters)) {
+  CHECK_GT(max_loras_, 0) << "max_loras must be greater than 0";
+  // slot 0 is reserved for the base model, pop from the back to use the
+  // lower slots first
+  for (int32_t slot = static_cast<int32_t>(max_loras_); slot > 0; --slot) {
+    free_slots_.push_back(slot);
+  }
+}
+
+bool LoraManager::load_adapter_config(const std::string& adapter_path,
+                                      int64_t* rank,
+                                      float* scaling) {
+  JsonReader reader;
+  const std::string config_path = adapter_path + "/adapter_config.json";
+  if (!reader.parse(config_path)) {
+    LOG(ERROR) << "Failed to parse lora adapter config: " << config_path;
+    return false;
+  }
+  const auto r = reader.value<int64_t>("r");
+  if (!r.has_value() || r.value() <= 0) {
+    LOG(ERROR) << "Failed to find a valid rank in " << config_path;
+    return false;
+  }
+  const auto alpha = reader.value_or<float>("lora_alpha", r.value());
+  const bool use_rslora = reader.value_or<bool>("use_rslora", false);
+  *rank = r.value();
+  *scaling = use_rslora ? alpha / std::sqrt(static_cast<float>(r.value()))
+                        : alpha / static_cast<float>(r.value());
+  return true;
+}
+
+std::unique_ptr<LoraAdapter> LoraManager::load_adapter(
+    const std::string& adapter_path) {
+  auto adapter = std::make_unique<LoraAdapter>();
+  if (!load_adapter_config(adapter_path, &adapter->rank, &adapter->scaling)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<StateDict> state_dict;
+  const std::string safetensors_path =
+      adapter_path + "/adapter_model.safetensors";
+  const std::string pickle_path = adapter_path + "/adapter_model.bin";
+  if (std::filesystem::exists(safetensors_path)) {
+    state_dict = StateDict::load(safetensors_path, /*is_pickle=*/false);
+  } else if (std::filesystem::exists(pickle_path)) {
+    state_dict = StateDict::load(pickle_path, /*is_pickle=*/true);
+  }
+  if (state_dict == nullptr) {
+    LOG(ERROR) << "Failed to find lora adapter weights in " << adapter_path;
+    return nullptr;
+  }
+  // peft prefixes the names of the base model with "base_model.model."
+  adapter->state_dict =
+      std::make_unique<StateDict>(state_dict->select("base_model.model."));
+  return adapter;
+}
+
+bool LoraManager::assign_slots(Batch& batch, const LoadFunc& load_func) {
+  // collect the adapters used by the batch
+  std::vector<std::string> names;
+  // adapters without slot: name -> error
+  std::unordered_map<std::string, Status> errors;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    const auto& name = batch[i]->lora_adapter();
+    if (name.empty() ||
+        std::find(names.begin(), names.end(), name) != names.end() ||
+        errors.count(name) > 0) {
+      continue;
+    }
+    if (!has_adapter(name)) {
+      LOG(ERROR) << "Unknown lora adapter: " << name;
+      errors.emplace(name,
+                     Status(StatusCode::INVALID_ARGUMENT,
+                            "Unknown lora adapter: " + name));
+      continue;
+    }
+    if (names.size() >= static_cast<size_t>(max_loras_)) {
+      LOG(ERROR) << "The batch uses more lora adapters than max_loras: "
+                 << max_loras_;
+      errors.emplace(name,
+                     Status(StatusCode::RESOURCE_EXHAUSTED,
+                            "No lora slot available for adapter: " + name));
+      continue;
+    }
+    names.push_back(name);
+  }
+
+  // mark the loaded adapters as recently used first to keep them in the slots
+  for (const auto& name : names) {
+    auto it = loaded_.find(name);
+    if (it != loaded_.end()) {
+      lru_.splice(lru_.end(), lru_, it->second.lru_it);
+    }
+  }
+
+  // load the missing adapters
+  for (const auto& name : names) {
+    if (loaded_.count(name) > 0) {
+      continue;
+    }
+    const int32_t slot = acquire_slot(names);
+    CHECK_GT(slot, 0) << "no slot available for lora adapter " << name;
+    if (!load_func(slot, name, adapters_[name])) {
+      LOG(ERROR) << "Failed to load lora adapter " << name << " from "
+                 << adapters_[name];
+      free_slots_.push_back(slot);
+      errors.emplace(name,
+                     Status(StatusCode::UNAVAILABLE,
+                            "Failed to load lora adapter: " + name));
+      continue;
+    }
+    lru_.push_back(name);
+    loaded_[name] = {slot, std::prev(lru_.end())};
+  }
+
+  for (size_t i = 0; i < batch.size(); ++i) {
+    auto* sequence = batch[i];
+    auto it = errors.find(sequence->lora_adapter());
+    if (it != errors.end()) {
+      sequence->set_error(it->second);
+    }
+    sequence->set_lora_slot(slot(sequence->lora_adapter()));
+  }
+  return errors.empty();
+}
+
+int32_t LoraManager::slot(const std::string& name) const {
+  if (name.empty()) {
+    return 0;
+  }
+  auto it = loaded_.find(name);
+  return it != loaded_.end() ? it->second.slot : 0;
+}
+
+int32_t LoraManager::acquire_slot(
+    const std::vector<std::string>& names_in_use) {
+  if (!free_slots_.empty()) {
+    const int32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    return slot;
+  }
+  // evict the least recently used adapter not needed by the batch
+  for (auto it = lru_.begin(); it != lru_.end(); ++it) {
+    if (std::find(names_in_use.begin(), names_in_use.end(), *it) !=
+        names_in_use.end()) {
+      continue;
+    }
+    const int32_t slot = loaded_[*it].slot;
+    LOG(INFO) << "Evicting lora adapter " << *it << " from slot " << slot;
+    loaded_.erase(*it);
+    lru_.erase(it);
+    return slot;
+  }
+  return 0;
+}
+
+}  // namespace llm
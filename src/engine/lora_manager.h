@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "batch.h"
+#include "model_loader/state_dict.h"
+
+namespace llm {
+
+// lora adapter name -> checkpoint directory
+using LoraAdapterPaths = std::unordered_map<std::string, std::string>;
+
+// A lora adapter read from a checkpoint directory in the peft layout.
+struct LoraAdapter {
+  // weights named after the base model, e.g. "model.layers.0.mlp..."
+  std::unique_ptr<StateDict> state_dict;
+
+  // the rank of the adapter
+  int64_t rank = 0;
+
+  // lora_alpha / rank, or lora_alpha / sqrt(rank) for rslora
+  float scaling = 1.0f;
+};
+
+// Manages the lora adapters served by the engine. The adapters are registered
+// by name and loaded on demand into a fixed number of slots on the device.
+// When all slots are taken, the least recently used adapter that is not
+// needed by the current batch is evicted.
+class LoraManager final {
+ public:
+  // load the adapter into the slot, returns false on failure
+  using LoadFunc = std::function<
+      bool(int32_t slot, const std::string& name, const std::string& path)>;
+
+  LoraManager(int64_t max_loras, LoraAdapterPaths adapters);
+
+  // read the rank and scaling from adapter_config.json in the directory
+  static bool load_adapter_config(const std::string& adapter_path,
+                                  int64_t* rank,
+                                  float* scaling);
+
+  // read the config and weights of the adapter in the directory.
+  // returns nullptr on failure
+  static std::unique_ptr<LoraAdapter> load_adapter(
+      const std::string& adapter_path);
+
+  bool has_adapter(const std::string& name) const {
+    return adapters_.count(name) > 0;
+  }
+
+  const LoraAdapterPaths& adapters() const { return adapters_; }
+
+  // assign a slot to each sequence in the batch, loading the adapters that
+  // are not in the slots with load_func. the sequences using unknown
+  // adapters, more adapters than slots or adapters failing to load get an
+  // error instead. returns false if any sequence failed.
+  bool assign_slots(Batch& batch, const LoadFunc& load_func);
+
+  // get the slot holding the adapter, 0 if the adapter is not loaded
+  int32_t slot(const std::string& name) const;
+
+ private:
+  struct Entry {
+    int32_t slot = 0;
+    // position in the lru list
+    std::list<std::string>::iterator lru_it;
+  };
+
+  // get a free slot, evicting the least recently used adapter not in use
+  int32_t acquire_slot(const std::vector<std::string>& names_in_use);
+
+  // the maximum number of adapters in the slots
+  int64_t max_loras_ = 0;
+
+  // registered adapters: name -> path
+  LoraAdapterPaths adapters_;
+
+  // adapters in the slots: name -> entry
+  std::unordered_map<std::string, Entry> loaded_;
+
+  // names of the loaded adapters, the front is the least recently used
+  std::list<std::string> lru_;
+
+  // slots without adapter
+  std::vector<int32_t> free_slots_;
+};
+
+}  // namespace llm
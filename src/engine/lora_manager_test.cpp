@@ -0,0 +1,101 @@
+#include "lora_manager.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "batch.h"
+#include "request/sequence.h"
+
+namespace llm {
+namespace {
+
+Sequence make_sequence(const std::string& lora_adapter) {
+  Sequence::Options options;
+  options.lora_adapter = lora_adapter;
+  return {std::vector<int32_t>{1, 2, 3}, /*capacity=*/16, options};
+}
+
+}  // namespace
+
+TEST(LoraManagerTest, AssignSlots) {
+  LoraManager manager(/*max_loras=*/2,
+                      {{"a", "/path/a"}, {"b", "/path/b"}, {"c", "/path/c"}});
+  std::vector<std::pair<int32_t, std::string>> loads;
+  const auto load_func = [&](int32_t slot,
+                             const std::string& name,
+                             const std::string& path) {
+    EXPECT_EQ(path, "/path/" + name);
+    loads.emplace_back(slot, name);
+    return true;
+  };
+
+  auto base = make_sequence("");
+  auto seq_a = make_sequence("a");
+  auto seq_b = make_sequence("b");
+  auto seq_c = make_sequence("c");
+
+  Batch batch({&base, &seq_a, &seq_b});
+  EXPECT_TRUE(manager.assign_slots(batch, load_func));
+  EXPECT_EQ(base.lora_slot(), 0);
+  EXPECT_EQ(seq_a.lora_slot(), 1);
+  EXPECT_EQ(seq_b.lora_slot(), 2);
+  EXPECT_EQ(loads.size(), 2);
+
+  // loaded adapters are not loaded again
+  Batch batch_a({&seq_a});
+  EXPECT_TRUE(manager.assign_slots(batch_a, load_func));
+  EXPECT_EQ(seq_a.lora_slot(), 1);
+  EXPECT_EQ(loads.size(), 2);
+
+  // evict the least recently used adapter: b
+  Batch batch_ac({&seq_a, &seq_c});
+  EXPECT_TRUE(manager.assign_slots(batch_ac, load_func));
+  EXPECT_EQ(seq_a.lora_slot(), 1);
+  EXPECT_EQ(seq_c.lora_slot(), 2);
+  EXPECT_EQ(manager.slot("b"), 0);
+  ASSERT_EQ(loads.size(), 3);
+  EXPECT_EQ(loads.back(), std::make_pair(2, std::string("c")));
+}
+
+TEST(LoraManagerTest, Failures) {
+  LoraManager manager(/*max_loras=*/1, {{"a", "/path/a"}, {"b", "/path/b"}});
+  bool load_result = false;
+  const auto load_func = [&](int32_t /*slot*/,
+                             const std::string& /*name*/,
+                             const std::string& /*path*/) {
+    return load_result;
+  };
+
+  // only the sequences of the failed adapters get an error
+  auto base = make_sequence("");
+  auto unknown = make_sequence("unknown");
+  Batch batch_unknown({&base, &unknown});
+  EXPECT_FALSE(manager.assign_slots(batch_unknown, load_func));
+  EXPECT_FALSE(base.error().has_value());
+  ASSERT_TRUE(unknown.error().has_value());
+  EXPECT_EQ(unknown.error()->code(), StatusCode::INVALID_ARGUMENT);
+
+  // failed to load, the slot is released
+  auto seq_a = make_sequence("a");
+  Batch batch_a({&seq_a});
+  EXPECT_FALSE(manager.assign_slots(batch_a, load_func));
+  ASSERT_TRUE(seq_a.error().has_value());
+  EXPECT_EQ(seq_a.error()->code(), StatusCode::UNAVAILABLE);
+  EXPECT_EQ(manager.slot("a"), 0);
+
+  // more adapters than slots, the first ones get the slots
+  load_result = true;
+  auto seq_a2 = make_sequence("a");
+  auto seq_b = make_sequence("b");
+  Batch batch_ab({&seq_a2, &seq_b});
+  EXPECT_FALSE(manager.assign_slots(batch_ab, load_func));
+  EXPECT_FALSE(seq_a2.error().has_value());
+  EXPECT_EQ(seq_a2.lora_slot(), 1);
+  ASSERT_TRUE(seq_b.error().has_value());
+  EXPECT_EQ(seq_b.error()->code(), StatusCode::RESOURCE_EXHAUSTED);
+}
+
+}  // namespace llm
@@ -128,9 +128,12 @@ torch::Tensor ModelRunner::forward(const torch::Tensor& tokens,
     const bool same_num_decoding_tokens =
         params.q_max_seq_len == options_.num_decoding_tokens() &&
         n_tokens == batch_size * options_.num_decoding_tokens();
+    // the captured graphs don't include lora adapters
+    const bool without_lora = !params.lora_slot_ids.defined();
 
     // replay the graph if all conditions are met
-    if (in_decoding_phase && seq_len_supported && same_num_decoding_tokens) {
+    if (in_decoding_phase && seq_len_supported && same_num_decoding_tokens &&
+        without_lora) {
       COUNTER_INC(num_cuda_graph_replayed_total);
       return it->second->replay(tokens, positions, params);
     }
@@ -2,6 +2,7 @@
 
 #include <torch/torch.h>
 
+#include "common/tensor_helper.h"
 #include "models/parameters.h"
 #include "sampling/parameters.h"
 
@@ -10,6 +11,18 @@ namespace llm {
 // input for the model that encapsulates all the necessary
 // input information.
 struct ModelInput {
+  // copy all host tensors into page-locked memory, so that they can be copied
+  // to devices asynchronously.
+  ModelInput pin_memory() const {
+    ModelInput inputs;
+    inputs.token_ids = safe_pin_memory(token_ids);
+    inputs.positions = safe_pin_memory(positions);
+    inputs.input_params = input_params.pin_memory();
+    inputs.sampling_params = sampling_params.pin_memory();
+    inputs.num_decode_steps = num_decode_steps;
+    return inputs;
+  }
+
   // flatten token ids
   torch::Tensor token_ids;
   // flatten positions
@@ -18,6 +31,9 @@ struct ModelInput {
   InputParameters input_params;
   // sampling parameters, mainly for sampling
   SamplingParameters sampling_params;
+  // the number of decode steps run with the inputs, the steps after the first
+  // one advance the inputs on the device with Worker::execute_decode_step
+  uint32_t num_decode_steps = 1;
 };
 
 // output for the model that encapsulates all the necessary
@@ -37,6 +53,10 @@ struct ModelOutput {
 
   // logits for selected indices
   torch::Tensor logits;
+
+  // whether the worker kept the inputs on the device to run the following
+  // decode steps of the batch
+  bool kept_decode_input = false;
 };
 
 }  // namespace llm
\ No newline at end of file
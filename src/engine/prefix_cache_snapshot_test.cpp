@@ -0,0 +1,151 @@
+#include "memory/prefix_cache_snapshot.h"
+
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/tiny_model.h"
+#include "engine/worker.h"
+#include "memory/block_manager.h"
+#include "model_loader/state_dict.h"
+#include "models/model_args.h"
+#include "request/sequence.h"
+
+namespace llm {
+namespace {
+constexpr int64_t kBlockSize = 16;
+constexpr int64_t kNumBlocks = 8;
+
+BlockManager::Options block_manager_options() {
+  BlockManager::Options options;
+  options.num_blocks(kNumBlocks).block_size(kBlockSize);
+  return options;
+}
+
+}  // namespace
+
+class PrefixCacheSnapshotTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() /
+            ("prefix_cache_snapshot_test_" + std::to_string(::getpid()));
+  }
+
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  PrefixCacheSnapshot::Key key(const ModelArgs& args) const {
+    PrefixCacheSnapshot::Key key;
+    key.model_path = (root_ / "model").string();
+    key.dtype = torch::kFloat32;
+    key.block_size = kBlockSize;
+    key.n_layers = args.n_layers();
+    key.n_local_kv_heads = args.n_kv_heads().value();
+    key.head_dim = args.head_dim();
+    return key;
+  }
+
+  std::filesystem::path root_;
+};
+
+TEST_F(PrefixCacheSnapshotTest, RestartSkipsPrefill) {
+  torch::manual_seed(0);
+  const auto args = tiny_model_args();
+  const auto weights = random_state_dict(args);
+  // two full blocks and a partial one
+  std::vector<int32_t> prompt(2 * kBlockSize + 8);
+  for (size_t i = 0; i < prompt.size(); ++i) {
+    prompt[i] = static_cast<int32_t>(i % args.vocab_size());
+  }
+
+  torch::Tensor cold_logits;
+  {
+    auto worker = create_tiny_worker(args, weights, kNumBlocks, kBlockSize);
+    BlockManager block_manager(block_manager_options());
+    Sequence sequence(prompt, /*capacity=*/64, Sequence::Options());
+    ASSERT_TRUE(block_manager.allocate_blocks_for(&sequence));
+    EXPECT_EQ(sequence.num_kv_cache_tokens(), 0);
+    Batch batch(&sequence);
+    const auto inputs = batch.prepare_model_input(
+        /*num_decoding_tokens=*/1, /*min_decoding_bach_size=*/0);
+    cold_logits = worker->execute_model(inputs).value().logits;
+    // the full blocks are cached once the sequence is released
+    block_manager.release_blocks_for(&sequence);
+    EXPECT_EQ(block_manager.num_blocks_in_prefix_cache(), 2);
+
+    // save the snapshot on shutdown
+    PrefixCacheSnapshot snapshot(root_.string(), key(args));
+    const auto entries = block_manager.prefix_cache_entries();
+    ASSERT_EQ(entries.size(), 1);
+    ASSERT_TRUE(snapshot.save_index(entries));
+    ASSERT_TRUE(worker->save_kv_cache_snapshot(
+        snapshot, PrefixCacheSnapshot::block_ids(entries)));
+    ASSERT_TRUE(snapshot.commit());
+  }
+
+  // restart with a fresh kv cache and restore the snapshot
+  auto worker = create_tiny_worker(args, weights, kNumBlocks, kBlockSize);
+  BlockManager block_manager(block_manager_options());
+  PrefixCacheSnapshot snapshot(root_.string(), key(args));
+  ASSERT_TRUE(snapshot.is_complete());
+  std::vector<PrefixCacheSnapshot::Entry> entries;
+  ASSERT_TRUE(snapshot.load_index(&entries));
+  const auto block_mapping = block_manager.restore_prefix_cache(entries);
+  EXPECT_EQ(block_mapping.size(), 2);
+  ASSERT_TRUE(worker->load_kv_cache_snapshot(snapshot, block_mapping));
+  EXPECT_EQ(block_manager.num_blocks_in_prefix_cache(), 2);
+
+  // the warm prompt only prefills the tokens after the cached blocks
+  Sequence sequence(prompt, /*capacity=*/64, Sequence::Options());
+  ASSERT_TRUE(block_manager.allocate_blocks_for(&sequence));
+  EXPECT_EQ(sequence.num_kv_cache_tokens(), 2 * kBlockSize);
+  Batch batch(&sequence);
+  const auto inputs = batch.prepare_model_input(
+      /*num_decoding_tokens=*/1, /*min_decoding_bach_size=*/0);
+  EXPECT_EQ(inputs.token_ids.numel(),
+            static_cast<int64_t>(prompt.size()) - 2 * kBlockSize);
+  const auto warm_logits = worker->execute_model(inputs).value().logits;
+  EXPECT_TRUE(torch::allclose(warm_logits,
+                              cold_logits,
+                              /*rtol=*/1e-4,
+                              /*atol=*/1e-4));
+}
+
+TEST_F(PrefixCacheSnapshotTest, Fingerprint) {
+  const auto args = tiny_model_args();
+  auto worker =
+      create_tiny_worker(args, random_state_dict(args), kNumBlocks, kBlockSize);
+  BlockManager block_manager(block_manager_options());
+  const std::vector<int32_t> prompt(kBlockSize, 1);
+  block_manager.restore_prefix_cache({{"", prompt, {5}}});
+  const auto entries = block_manager.prefix_cache_entries();
+
+  PrefixCacheSnapshot snapshot(root_.string(), key(args));
+  EXPECT_FALSE(snapshot.is_complete());
+  ASSERT_TRUE(snapshot.save_index(entries));
+  ASSERT_TRUE(worker->save_kv_cache_snapshot(
+      snapshot, PrefixCacheSnapshot::block_ids(entries)));
+  // not visible until committed
+  EXPECT_FALSE(snapshot.is_complete());
+  ASSERT_TRUE(snapshot.commit());
+  EXPECT_TRUE(snapshot.is_complete());
+
+  // a different kv cache layout or dtype doesn't pick up the snapshot
+  auto other_key = key(args);
+  other_key.block_size = 2 * kBlockSize;
+  EXPECT_FALSE(PrefixCacheSnapshot(root_.string(), other_key).is_complete());
+  other_key = key(args);
+  other_key.dtype = torch::kBFloat16;
+  EXPECT_FALSE(PrefixCacheSnapshot(root_.string(), other_key).is_complete());
+
+  // saving again invalidates the previous snapshot first
+  ASSERT_TRUE(snapshot.save_index(entries));
+  EXPECT_FALSE(snapshot.is_complete());
+}
+
+}  // namespace llm
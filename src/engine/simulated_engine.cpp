@@ -0,0 +1,129 @@
+#include "simulated_engine.h"
+
+#include <absl/time/clock.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace llm {
+
+namespace {
+
+// a tokenizer that decodes each token into a single character
+class SimulatedTokenizer : public Tokenizer {
+ public:
+  bool encode(const std::string_view& /*text*/,
+              std::vector<int32_t>* /*ids*/) const override {
+    return false;
+  }
+
+  std::string decode(const Slice<int32_t>& ids,
+                     bool /*skip_special_tokens*/) const override {
+    return std::string(ids.size(), 'x');
+  }
+
+  std::optional<int32_t> token_to_id(
+      const std::string_view& /*token*/) const override {
+    return std::nullopt;
+  }
+
+  std::string id_to_token(int32_t /*id*/) const override { return "x"; }
+
+  size_t vocab_size() const override { return 32000; }
+
+  std::unique_ptr<Tokenizer> clone() const override {
+    return std::make_unique<SimulatedTokenizer>();
+  }
+};
+
+}  // namespace
+
+SimulatedEngine::SimulatedEngine(const Options& options)
+    : options_(options),
+      tokenizer_(std::make_unique<SimulatedTokenizer>()),
+      simulated_time_(absl::ZeroDuration()) {
+  CHECK_GT(options_.num_blocks(), 0) << "num_blocks must be positive";
+  CHECK_GT(options_.block_size(), 0) << "block_size must be positive";
+  BlockManager::Options block_manager_options;
+  block_manager_options.num_blocks(options_.num_blocks())
+      .block_size(options_.block_size())
+      .enable_prefix_cache(options_.enable_prefix_cache())
+      .prefix_cache_eviction_policy(options_.prefix_cache_eviction_policy());
+  block_manager_ = std::make_unique<BlockManager>(block_manager_options);
+}
+
+ModelOutput SimulatedEngine::execute_model(Batch& batch) {
+  ++num_batches_;
+  execute_step(batch);
+  for (uint32_t i = 1; i < batch.num_decode_steps(); ++i) {
+    if (!batch.next_decode_step()) {
+      break;
+    }
+    execute_step(batch);
+  }
+  return {};
+}
+
+absl::Duration SimulatedEngine::step_latency(size_t num_prefill_tokens,
+                                             size_t num_decode_tokens,
+                                             size_t num_context_tokens) const {
+  return options_.step_latency() +
+         options_.prefill_token_latency() *
+             static_cast<int64_t>(num_prefill_tokens) +
+         options_.decode_token_latency() *
+             static_cast<int64_t>(num_decode_tokens) +
+         options_.context_token_latency() *
+             static_cast<int64_t>(num_context_tokens);
+}
+
+void SimulatedEngine::execute_step(Batch& batch) {
+  ++num_steps_;
+  size_t num_prefill_tokens = 0;
+  size_t num_decode_tokens = 0;
+  size_t num_context_tokens = 0;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    Sequence* sequence = batch[i];
+    const size_t n_kv_cache_tokens = sequence->num_kv_cache_tokens();
+    // the same token budget as Batch::prepare_model_input
+    const size_t q_seq_len =
+        std::min<size_t>(sequence->num_tokens() - n_kv_cache_tokens,
+                         batch.token_budget(i));
+    if (q_seq_len == 0) {
+      // no token budget left for the prefill sequence
+      CHECK(sequence->is_prefill_stage());
+      continue;
+    }
+    if (sequence->is_prefill_stage()) {
+      num_prefill_tokens += q_seq_len;
+    } else {
+      num_decode_tokens += q_seq_len;
+    }
+    num_context_tokens += n_kv_cache_tokens + q_seq_len;
+
+    // the slots are allocated by the scheduler, only the position moves
+    sequence->commit_kv_cache(/*size=*/q_seq_len);
+    // sample the next token once the whole prompt has been processed
+    if (!sequence->is_prefill_stage()) {
+      sequence->append_token(options_.token_id());
+      ++num_generated_tokens_;
+    }
+  }
+
+  const absl::Duration latency =
+      step_latency(num_prefill_tokens, num_decode_tokens, num_context_tokens);
+  if (options_.real_time()) {
+    absl::SleepFor(latency);
+  }
+  simulated_time_ += latency;
+  num_prefill_tokens_ += num_prefill_tokens;
+  num_decode_tokens_ += num_decode_tokens;
+
+  if (step_callback_ != nullptr) {
+    step_callback_(batch);
+  }
+}
+
+}  // namespace llm
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <absl/time/time.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "batch.h"
+#include "common/macros.h"
+#include "engine.h"
+#include "memory/block_manager.h"
+#include "models/model_args.h"
+#include "tokenizer/tokenizer.h"
+#include "tokenizer/tokenizer_args.h"
+
+namespace llm {
+
+// An engine without a model, to exercise the scheduler, the block manager and
+// the prefix cache at production scale on a laptop. Each step advances the
+// sequences by their token budget and generates a fixed token for decoding
+// sequences, and takes the time of a linear latency model:
+//   step_latency + prefill_tokens * prefill_token_latency
+//                + decode_tokens * decode_token_latency
+//                + context_tokens * context_token_latency
+// where context tokens are the kv cache tokens attended to by the batch.
+// Memory is virtual: blocks are only accounted by the block manager, no kv
+// cache tensors are allocated, so millions of blocks cost a few megabytes.
+// Multi-step batches run one step per decode iteration, the same way as
+// LLMEngine.
+class SimulatedEngine final : public Engine {
+ public:
+  struct Options {
+    // the number of blocks in the virtual kv cache
+    DEFINE_ARG(uint32_t, num_blocks) = 1024;
+
+    // the number of slots per block
+    DEFINE_ARG(int32_t, block_size) = 16;
+
+    // enable prefix cache
+    DEFINE_ARG(bool, enable_prefix_cache) = false;
+
+    // the eviction policy of the prefix cache: lru, lfu or gdsf
+    DEFINE_ARG(std::string, prefix_cache_eviction_policy) = "lru";
+
+    // the fixed latency of each step, e.g. the kernel launches
+    DEFINE_ARG(absl::Duration, step_latency) = absl::ZeroDuration();
+
+    // the latency of each token of prefill sequences in a step
+    DEFINE_ARG(absl::Duration, prefill_token_latency) = absl::ZeroDuration();
+
+    // the latency of each token of decode sequences in a step
+    DEFINE_ARG(absl::Duration, decode_token_latency) = absl::ZeroDuration();
+
+    // the latency of each kv cache token read in a step
+    DEFINE_ARG(absl::Duration, context_token_latency) = absl::ZeroDuration();
+
+    // sleep for the modeled latency of each step, so that the timings of the
+    // scheduler, e.g. deadlines and latency metrics, see it. otherwise the
+    // latency is only accumulated into the simulated time.
+    DEFINE_ARG(bool, real_time) = false;
+
+    // the token generated for each decoding sequence
+    DEFINE_ARG(int64_t, token_id) = 100;
+  };
+
+  // called after each step with the batch of the step, from the thread
+  // executing the model
+  using StepCallback = std::function<void(Batch& batch)>;
+
+  explicit SimulatedEngine(const Options& options);
+
+  ModelOutput execute_model(Batch& batch) override;
+
+  const Tokenizer* tokenizer() const override { return tokenizer_.get(); }
+
+  BlockManager* block_manager() const override { return block_manager_.get(); }
+
+  const ModelArgs& model_args() const override { return model_args_; }
+
+  const TokenizerArgs& tokenizer_args() const override {
+    return tokenizer_args_;
+  }
+
+  // must be set before running any batch
+  void set_step_callback(StepCallback callback) {
+    step_callback_ = std::move(callback);
+  }
+
+  // the modeled latency of a step
+  absl::Duration step_latency(size_t num_prefill_tokens,
+                              size_t num_decode_tokens,
+                              size_t num_context_tokens) const;
+
+  // the statistics below are updated by the thread executing the model, read
+  // them from the step callback or once the scheduler is done.
+
+  // the number of steps, one per decode iteration
+  size_t num_steps() const { return num_steps_; }
+
+  // the number of batches from the scheduler
+  size_t num_batches() const { return num_batches_; }
+
+  // the sum of the modeled latency of all steps
+  absl::Duration simulated_time() const { return simulated_time_; }
+
+  // the number of tokens processed for prefill and decode sequences
+  size_t num_prefill_tokens() const { return num_prefill_tokens_; }
+  size_t num_decode_tokens() const { return num_decode_tokens_; }
+
+  // the number of tokens generated
+  size_t num_generated_tokens() const { return num_generated_tokens_; }
+
+ private:
+  void execute_step(Batch& batch);
+
+  Options options_;
+
+  std::unique_ptr<Tokenizer> tokenizer_;
+
+  ModelArgs model_args_;
+
+  TokenizerArgs tokenizer_args_;
+
+  std::unique_ptr<BlockManager> block_manager_;
+
+  StepCallback step_callback_;
+
+  size_t num_steps_ = 0;
+  size_t num_batches_ = 0;
+  absl::Duration simulated_time_;
+  size_t num_prefill_tokens_ = 0;
+  size_t num_decode_tokens_ = 0;
+  size_t num_generated_tokens_ = 0;
+};
+
+}  // namespace llm
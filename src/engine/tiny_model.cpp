@@ -0,0 +1,180 @@
+#include "tiny_model.h"
+
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "quantization/quant_args.h"
+
+namespace llm {
+namespace {
+constexpr int64_t kNumSpecialTokens = 3;
+
+// save float tensors in the safetensors format
+void save_safetensors(const StateDict& state_dict, const std::string& path) {
+  nlohmann::json header = nlohmann::json::object();
+  std::vector<torch::Tensor> tensors;
+  size_t offset = 0;
+  for (const auto& [name, tensor] : state_dict) {
+    auto t = tensor.to(torch::kFloat32).contiguous();
+    const size_t nbytes = t.numel() * t.element_size();
+    header[name] = {{"dtype", "F32"},
+                    {"shape", t.sizes().vec()},
+                    {"data_offsets", {offset, offset + nbytes}}};
+    offset += nbytes;
+    tensors.push_back(std::move(t));
+  }
+  std::string header_str = header.dump();
+  // the data starts at an 8 bytes aligned offset
+  header_str.append((8 - header_str.size() % 8) % 8, ' ');
+  const uint64_t header_size = header_str.size();
+
+  std::ofstream file(path, std::ios::binary);
+  CHECK(file.is_open()) << "Failed to open " << path;
+  file.write(reinterpret_cast<const char*>(&header_size), sizeof(header_size));
+  file.write(header_str.data(), static_cast<std::streamsize>(header_size));
+  for (const auto& t : tensors) {
+    file.write(static_cast<const char*>(t.data_ptr()),
+               static_cast<std::streamsize>(t.numel() * t.element_size()));
+  }
+}
+
+// a word level tokenizer in the huggingface format
+nlohmann::json word_level_tokenizer(int64_t vocab_size) {
+  nlohmann::json vocab = {{"<unk>", 0}, {"<s>", 1}, {"</s>", 2}};
+  for (int64_t i = kNumSpecialTokens; i < vocab_size; ++i) {
+    vocab["t" + std::to_string(i)] = i;
+  }
+  nlohmann::json added_tokens = nlohmann::json::array();
+  for (const auto* token : {"<unk>", "<s>", "</s>"}) {
+    added_tokens.push_back({{"id", vocab[token]},
+                            {"content", token},
+                            {"single_word", false},
+                            {"lstrip", false},
+                            {"rstrip", false},
+                            {"normalized", false},
+                            {"special", true}});
+  }
+  return {{"version", "1.0"},
+          {"truncation", nullptr},
+          {"padding", nullptr},
+          {"added_tokens", added_tokens},
+          {"normalizer", nullptr},
+          {"pre_tokenizer", {{"type", "Whitespace"}}},
+          {"post_processor", nullptr},
+          {"decoder", nullptr},
+          {"model",
+           {{"type", "WordLevel"}, {"vocab", vocab}, {"unk_token", "<unk>"}}}};
+}
+
+}  // namespace
+
+ModelArgs tiny_model_args() {
+  ModelArgs args;
+  args.model_type("llama")
+      .vocab_size(128)
+      .hidden_size(64)
+      .intermediate_size(128)
+      .n_layers(2)
+      .n_heads(4)
+      .n_kv_heads(4)
+      .head_dim(16)
+      .hidden_act("silu")
+      .rms_norm_eps(1e-5)
+      .max_position_embeddings(256);
+  return args;
+}
+
+StateDict random_state_dict(const ModelArgs& args) {
+  const int64_t hidden_size = args.hidden_size();
+  const int64_t intermediate_size = args.intermediate_size();
+  const int64_t q_size = args.n_heads() * args.head_dim();
+  const int64_t kv_size =
+      args.n_kv_heads().value_or(args.n_heads()) * args.head_dim();
+  const auto linear_weight = [](int64_t out_features, int64_t in_features) {
+    return torch::randn({out_features, in_features}) /
+           std::sqrt(static_cast<double>(in_features));
+  };
+
+  std::unordered_map<std::string, torch::Tensor> dict;
+  dict["model.embed_tokens.weight"] =
+      torch::randn({args.vocab_size(), hidden_size});
+  dict["model.norm.weight"] = torch::ones({hidden_size});
+  dict["lm_head.weight"] = linear_weight(args.vocab_size(), hidden_size);
+  for (int64_t i = 0; i < args.n_layers(); ++i) {
+    const std::string prefix = "model.layers." + std::to_string(i) + ".";
+    dict[prefix + "self_attn.q_proj.weight"] =
+        linear_weight(q_size, hidden_size);
+    dict[prefix + "self_attn.k_proj.weight"] =
+        linear_weight(kv_size, hidden_size);
+    dict[prefix + "self_attn.v_proj.weight"] =
+        linear_weight(kv_size, hidden_size);
+    dict[prefix + "self_attn.o_proj.weight"] =
+        linear_weight(hidden_size, q_size);
+    dict[prefix + "mlp.gate_proj.weight"] =
+        linear_weight(intermediate_size, hidden_size);
+    dict[prefix + "mlp.up_proj.weight"] =
+        linear_weight(intermediate_size, hidden_size);
+    dict[prefix + "mlp.down_proj.weight"] =
+        linear_weight(hidden_size, intermediate_size);
+    dict[prefix + "input_layernorm.weight"] = torch::ones({hidden_size});
+    dict[prefix + "post_attention_layernorm.weight"] =
+        torch::ones({hidden_size});
+  }
+  return StateDict(std::move(dict));
+}
+
+std::unique_ptr<Worker> create_tiny_worker(const ModelArgs& args,
+                                           const StateDict& state_dict,
+                                           int64_t num_blocks,
+                                           int64_t block_size) {
+  ParallelArgs parallel_args(/*rank=*/0, /*world_size=*/1, nullptr);
+  ModelRunner::Options runner_options;
+  runner_options.block_size(block_size);
+  auto worker = std::make_unique<Worker>(
+      parallel_args, torch::Device(torch::kCPU), runner_options);
+  worker->init_model(torch::kFloat32, args, QuantArgs());
+  worker->load_state_dict(state_dict);
+  worker->verify_loaded_weights();
+  worker->init_kv_cache({num_blocks,
+                         block_size,
+                         args.n_kv_heads().value_or(args.n_heads()),
+                         args.head_dim()});
+  return worker;
+}
+
+void save_tiny_model(const ModelArgs& args,
+                     const StateDict& state_dict,
+                     const std::string& dir) {
+  CHECK_GT(args.vocab_size(), kNumSpecialTokens);
+  std::filesystem::create_directories(dir);
+  const nlohmann::json config = {
+      {"model_type", args.model_type()},
+      {"torch_dtype", "float32"},
+      {"vocab_size", args.vocab_size()},
+      {"hidden_size", args.hidden_size()},
+      {"intermediate_size", args.intermediate_size()},
+      {"num_hidden_layers", args.n_layers()},
+      {"num_attention_heads", args.n_heads()},
+      {"num_key_value_heads", args.n_kv_heads().value_or(args.n_heads())},
+      {"head_dim", args.head_dim()},
+      {"hidden_act", args.hidden_act()},
+      {"max_position_embeddings", args.max_position_embeddings()},
+      {"rms_norm_eps", args.rms_norm_eps()},
+      {"bos_token_id", 1},
+      {"eos_token_id", 2}};
+  std::ofstream(dir + "/config.json") << config.dump(2);
+  std::ofstream(dir + "/tokenizer.json")
+      << word_level_tokenizer(args.vocab_size()).dump();
+  save_safetensors(state_dict, dir + "/model.safetensors");
+}
+
+}  // namespace llm
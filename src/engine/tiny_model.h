@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "model_loader/state_dict.h"
+#include "models/model_args.h"
+#include "worker.h"
+
+namespace llm {
+
+// Helpers to run a tiny llama model with random weights on cpu, shared by the
+// tests and benchmarks of the engine.
+
+// the args of a tiny llama model, adjust them with the setters as needed
+ModelArgs tiny_model_args();
+
+// random weights in the checkpoint layout of llama
+StateDict random_state_dict(const ModelArgs& args);
+
+// a float32 worker on cpu serving the weights, with a kv cache of num_blocks
+// blocks
+std::unique_ptr<Worker> create_tiny_worker(const ModelArgs& args,
+                                           const StateDict& state_dict,
+                                           int64_t num_blocks,
+                                           int64_t block_size);
+
+// write a llama checkpoint with the args and weights into the directory, along
+// with a word level tokenizer: <unk>, <s> and </s> are the tokens 0, 1 and 2,
+// and the word "t<i>" is the token i for the rest of the vocab.
+void save_tiny_model(const ModelArgs& args,
+                     const StateDict& state_dict,
+                     const std::string& dir);
+
+}  // namespace llm
@@ -10,11 +10,15 @@
 
 #include <memory>
 #include <optional>
+#include <string>
+#include <unordered_map>
 #include <utility>
 
 #include "common/metrics.h"
+#include "common/numa.h"
 #include "common/threadpool.h"
 #include "common/timer.h"
+#include "common/tracer.h"
 #include "memory/kv_cache.h"
 #include "memory/memory.h"
 #include "model_loader/state_dict.h"
@@ -37,6 +41,22 @@ DEFINE_COUNTER_INSTANCE(sampling_latency_seconds,
                         {{"stage", "sampling"}});
 
 namespace llm {
+namespace {
+
+// parameters and buffers of the module by name
+std::unordered_map<std::string, torch::Tensor> named_tensors(
+    const torch::nn::Module& module) {
+  std::unordered_map<std::string, torch::Tensor> tensors;
+  for (const auto& item : module.named_parameters(/*recurse=*/true)) {
+    tensors.emplace(item.key(), item.value());
+  }
+  for (const auto& item : module.named_buffers(/*recurse=*/true)) {
+    tensors.emplace(item.key(), item.value());
+  }
+  return tensors;
+}
+
+}  // namespace
 
 Worker::Worker(const ParallelArgs& parallel_args,
                const torch::Device& device,
@@ -46,6 +66,13 @@ Worker::Worker(const ParallelArgs& parallel_args,
       runner_options_(runner_options) {
   // first worker is the driver
   driver_ = parallel_args.rank() == 0;
+
+  if (device_.is_cpu() && parallel_args.world_size() > 1) {
+    // spread cpu workers across numa nodes, the binding is done in the
+    // working thread before any memory is allocated by it.
+    const int node = parallel_args.rank() % num_numa_nodes();
+    threadpool_.schedule([node]() { bind_to_numa_node(node); });
+  }
 }
 
 bool Worker::init_model(torch::ScalarType dtype,
@@ -55,6 +82,7 @@ bool Worker::init_model(torch::ScalarType dtype,
 
   // initialize model
   args_ = args;
+  quant_args_ = quant_args;
   dtype_ = dtype;
   const auto options = torch::dtype(dtype_).device(device_);
   model_ = CausalLM::create(args, quant_args, parallel_args_, options);
@@ -97,6 +125,110 @@ void Worker::verify_loaded_weights() const {
   model_->verify_loaded_weights();
 }
 
+bool Worker::save_weights_cache(const WeightsCache& cache) {
+  CHECK(model_ != nullptr) << "Model is not initialized.";
+  return cache.save(*model_, parallel_args_.rank());
+}
+
+bool Worker::load_weights_cache(const WeightsCache& cache) {
+  CHECK(model_ != nullptr) << "Model is not initialized.";
+  return cache.load(*model_, parallel_args_.rank());
+}
+
+bool Worker::init_staged_model() {
+  CHECK(model_ != nullptr) << "Model is not initialized.";
+  CHECK(staged_model_ == nullptr) << "Staged model is already initialized.";
+
+  torch::DeviceGuard device_guard(device_);
+  const auto options = torch::dtype(dtype_).device(device_);
+  staged_model_ =
+      CausalLM::create(args_, quant_args_, parallel_args_, options);
+  return staged_model_ != nullptr;
+}
+
+void Worker::stage_state_dict(const StateDict& state_dict) {
+  CHECK(staged_model_ != nullptr) << "Staged model is not initialized.";
+  torch::DeviceGuard device_guard(device_);
+  staged_model_->load_state_dict(state_dict);
+}
+
+bool Worker::verify_staged_weights() const {
+  CHECK(model_ != nullptr) << "Model is not initialized.";
+  if (staged_model_ == nullptr) {
+    return false;
+  }
+  staged_model_->verify_loaded_weights();
+
+  const auto staged = named_tensors(*staged_model_);
+  const auto current = named_tensors(*model_);
+  if (staged.size() != current.size()) {
+    LOG(ERROR) << "Staged model has " << staged.size()
+               << " tensors, expected " << current.size();
+    return false;
+  }
+  for (const auto& [name, tensor] : current) {
+    const auto it = staged.find(name);
+    if (it == staged.end()) {
+      LOG(ERROR) << "Missing staged tensor: " << name;
+      return false;
+    }
+    if (it->second.sizes() != tensor.sizes() ||
+        it->second.scalar_type() != tensor.scalar_type()) {
+      LOG(ERROR) << "Staged tensor " << name << " " << it->second.sizes()
+                 << " " << it->second.scalar_type() << " mismatches "
+                 << tensor.sizes() << " " << tensor.scalar_type();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Worker::swap_staged_weights() {
+  CHECK(model_ != nullptr) << "Model is not initialized.";
+  if (staged_model_ == nullptr) {
+    return false;
+  }
+
+  torch::DeviceGuard device_guard(device_);
+  torch::NoGradGuard no_grad;
+  // copy in place to keep the addresses captured by cuda graphs
+  const auto staged = named_tensors(*staged_model_);
+  for (auto& [name, tensor] : named_tensors(*model_)) {
+    tensor.copy_(staged.at(name));
+  }
+  if (device_.is_cuda()) {
+    at::cuda::getCurrentCUDAStream().synchronize();
+  }
+  staged_model_.reset();
+  return true;
+}
+
+void Worker::discard_staged_weights() { staged_model_.reset(); }
+
+bool Worker::load_lora_adapter(int32_t slot,
+                               const StateDict& state_dict,
+                               float scaling) {
+  CHECK(model_ != nullptr) << "Model is not initialized.";
+  torch::DeviceGuard device_guard(device_);
+  return model_->load_lora_adapter(slot, state_dict, scaling);
+}
+
+bool Worker::save_kv_cache_snapshot(const PrefixCacheSnapshot& snapshot,
+                                    const std::vector<int32_t>& block_ids) {
+  CHECK(!kv_caches_.empty()) << "KV caches are not initialized.";
+  torch::DeviceGuard device_guard(device_);
+  return snapshot.save_kv_cache(kv_caches_, block_ids, parallel_args_.rank());
+}
+
+bool Worker::load_kv_cache_snapshot(
+    const PrefixCacheSnapshot& snapshot,
+    const std::vector<std::pair<int32_t, int32_t>>& block_mapping) {
+  CHECK(!kv_caches_.empty()) << "KV caches are not initialized.";
+  torch::DeviceGuard device_guard(device_);
+  return snapshot.load_kv_cache(
+      kv_caches_, block_mapping, parallel_args_.rank());
+}
+
 std::tuple<int64_t, int64_t> Worker::profile_device_memory() {
   CHECK(model_ != nullptr) << "Model is not initialized.";
   CHECK(device_.is_cuda()) << "Memory profiling is only supported on GPU.";
@@ -109,7 +241,9 @@ std::tuple<int64_t, int64_t> Worker::profile_device_memory() {
 
 void Worker::process_group_test() {
   torch::DeviceGuard device_guard(device_);
-  torch::cuda::synchronize();
+  if (device_.is_cuda()) {
+    torch::cuda::synchronize();
+  }
 
   // create random tensors
   const auto options = torch::dtype(torch::kHalf).device(device_);
@@ -118,32 +252,132 @@ void Worker::process_group_test() {
   reduce_from_model_parallel_region(tensor, parallel_args_);
   // call allgather
   gather_from_model_parallel_region(tensor, parallel_args_);
-  torch::cuda::synchronize();
+  if (device_.is_cuda()) {
+    torch::cuda::synchronize();
+  }
 }
 
 std::optional<ModelOutput> Worker::execute_model(const ModelInput& inputs) {
   torch::DeviceGuard device_guard(device_);
-  at::cuda::getCurrentCUDAStream().synchronize();
+  if (device_.is_cuda()) {
+    at::cuda::getCurrentCUDAStream().synchronize();
+  }
 
-  Timer timer;
+  // all tensors should be on the same device as model. inputs are in pinned
+  // memory for cuda devices, the copies are issued asynchronously on the
+  // current stream and ordered before the model kernels.
+  DeviceInput input;
+  input.token_ids = safe_to(inputs.token_ids, device_, /*non_blocking=*/true);
+  input.positions = safe_to(inputs.positions, device_, /*non_blocking=*/true);
+  input.params = inputs.input_params.to(device_, /*non_blocking=*/true);
+  input.sampling_params =
+      inputs.sampling_params.to(device_, dtype_, /*non_blocking=*/true);
+
+  // keep the inputs for the following decode steps to run on the device if
+  // every sequence decodes one token and no penalty needs the token counts of
+  // the host.
+  const auto& params = input.params;
+  const auto& sampling_params = input.sampling_params;
+  const bool is_decode_step =
+      inputs.num_decode_steps > 1 && params.q_max_seq_len == 1 &&
+      sampling_params.selected_token_idxes.defined() &&
+      sampling_params.selected_token_idxes.numel() == params.num_sequences &&
+      !sampling_params.unique_token_ids.defined();
+  decode_input_.reset();
+  decode_next_tokens_ = torch::Tensor();
+
+  auto output = execute_model(input);
+  if (is_decode_step) {
+    // the tensors are advanced in place, which share the host memory of the
+    // inputs on cpu
+    if (device_.is_cpu()) {
+      input.token_ids = input.token_ids.clone();
+      input.positions = input.positions.clone();
+      input.params.kv_cu_seq_lens = input.params.kv_cu_seq_lens.clone();
+      input.params.new_cache_slots = input.params.new_cache_slots.clone();
+    }
+    decode_input_ = std::move(input);
+  }
+  if (output.has_value()) {
+    output->kept_decode_input = decode_input_.has_value();
+  }
+  return output;
+}
+
+std::optional<ModelOutput> Worker::execute_decode_step() {
+  if (!decode_input_.has_value()) {
+    // the last step didn't keep its inputs, the engine steps on the host
+    return std::nullopt;
+  }
+  torch::DeviceGuard device_guard(device_);
+  advance_decode_input();
+  return execute_model(decode_input_.value());
+}
+
+void Worker::advance_decode_input() {
+  auto& input = decode_input_.value();
+  auto& params = input.params;
+  const int64_t num_seqs = params.num_sequences;
+
+  // the tokens sampled by the driver, shared with other workers
+  auto next_tokens =
+      driver_ ? decode_next_tokens_.to(torch::kInt)
+              : torch::zeros({num_seqs}, input.token_ids.options());
+  if (parallel_args_.world_size() > 1) {
+    parallel_args_.process_group()->allreduce(next_tokens);
+  }
 
-  // all tensors should be on the same device as model
-  auto flatten_tokens = inputs.token_ids.to(device_);
-  auto flatten_positions = inputs.positions.to(device_);
-  auto params = inputs.input_params.to(device_);
-  auto sampling_params = inputs.sampling_params.to(device_, dtype_);
+  // one token per sequence, the padded sequences for cuda graphs stay as is
+  input.token_ids.narrow(/*dim=*/0, /*start=*/0, num_seqs).copy_(next_tokens);
+  auto positions = input.positions.narrow(/*dim=*/0, /*start=*/0, num_seqs);
+  positions.add_(1);
+  params.kv_cu_seq_lens.add_(
+      torch::arange(params.kv_cu_seq_lens.size(0),
+                    params.kv_cu_seq_lens.options())
+          .clamp_max(num_seqs));
+  params.kv_max_seq_len += 1;
+  // the scheduler ends the batch before any sequence reaches its max context
+  // length, which is within the max position embeddings
+  CHECK_LE(params.kv_max_seq_len, args_.max_position_embeddings())
+      << "Decode step beyond the max position embeddings";
+
+  // the slot of the new token from the block table, the blocks for all the
+  // decode steps are allocated up front
+  const int64_t block_size = runner_options_.block_size();
+  const auto block_idxes =
+      params.cu_block_lens.narrow(/*dim=*/0, /*start=*/0, num_seqs) +
+      torch::div(positions, block_size, /*rounding_mode=*/"floor");
+  const auto slots =
+      params.block_tables.index_select(/*dim=*/0, block_idxes) * block_size +
+      torch::remainder(positions, block_size);
+  params.new_cache_slots.narrow(/*dim=*/0, /*start=*/0, num_seqs).copy_(slots);
+}
 
-  // call model runner forward to get hidden states
-  auto hidden_states = model_runner_->forward(
-      flatten_tokens, flatten_positions, kv_caches_, params);
+std::optional<ModelOutput> Worker::execute_model(const DeviceInput& input) {
+  Timer timer;
+  const auto& params = input.params;
+  const auto& sampling_params = input.sampling_params;
 
   torch::Tensor logits;
-  if (sampling_params.selected_token_idxes.defined()) {
-    logits =
-        model_->logits(hidden_states, sampling_params.selected_token_idxes);
+  {
+    TraceSpan span("worker.forward");
+    span.arg("rank", parallel_args_.rank())
+        .arg("num_seqs", params.num_sequences)
+        .arg("num_tokens", input.token_ids.size(0));
+
+    // call model runner forward to get hidden states
+    auto hidden_states = model_runner_->forward(
+        input.token_ids, input.positions, kv_caches_, params);
+
+    if (sampling_params.selected_token_idxes.defined()) {
+      logits =
+          model_->logits(hidden_states, sampling_params.selected_token_idxes);
+    }
+
+    if (device_.is_cuda()) {
+      at::cuda::getCurrentCUDAStream().synchronize();
+    }
   }
-
-  at::cuda::getCurrentCUDAStream().synchronize();
   COUNTER_ADD(model_execution_latency_seconds, timer.elapsed_seconds());
 
   if (!driver_) {
@@ -155,29 +389,39 @@ std::optional<ModelOutput> Worker::execute_model(const ModelInput& inputs) {
   if (sampling_params.selected_token_idxes.defined()) {
     // create and call logits processors
     timer.reset();
-    auto logits_processor = LogitsProcessor::create(sampling_params);
-    // apply logits processors to logits (in place)
-    logits = logits_processor->forward(logits,
-                                       sampling_params.unique_token_ids,
-                                       sampling_params.unique_token_counts,
-                                       sampling_params.unique_token_ids_lens);
+    {
+      TraceSpan span("worker.logits_processing");
+      auto logits_processor = LogitsProcessor::create(sampling_params);
+      // apply logits processors to logits (in place)
+      logits =
+          logits_processor->forward(logits,
+                                    sampling_params.unique_token_ids,
+                                    sampling_params.unique_token_counts,
+                                    sampling_params.unique_token_ids_lens);
+    }
     COUNTER_ADD(logits_processing_latency_seconds, timer.elapsed_seconds());
 
     // set logits to output
     output.logits = logits;
 
     timer.reset();
-    auto sampler = std::make_unique<Sampler>(sampling_params.do_sample,
-                                             sampling_params.logprobs,
-                                             sampling_params.max_top_logprobs);
-    // select sample logits
-    auto sample_logits =
-        logits.index_select(/*dim=*/0, sampling_params.sample_idxes);
-    auto sample_output = sampler->forward(sample_logits);
+    SampleOutput sample_output;
+    {
+      TraceSpan span("worker.sampling");
+      auto sampler =
+          std::make_unique<Sampler>(sampling_params.do_sample,
+                                    sampling_params.logprobs,
+                                    sampling_params.max_top_logprobs);
+      // select sample logits
+      auto sample_logits =
+          logits.index_select(/*dim=*/0, sampling_params.sample_idxes);
+      sample_output = sampler->forward(sample_logits);
+    }
     COUNTER_ADD(sampling_latency_seconds, timer.elapsed_seconds());
 
     // set sample output to output
     output.sample_output = sample_output;
+    decode_next_tokens_ = sample_output.next_tokens;
 
     // carry over the sampling params
     output.do_sample = sampling_params.do_sample;
@@ -199,15 +443,28 @@ Worker::profile_device_memory_async() {
 }
 
 folly::SemiFuture<std::optional<ModelOutput>> Worker::execute_model_async(
-    const ModelInput& inputs) {
+    std::shared_ptr<const ModelInput> inputs) {
   folly::Promise<std::optional<ModelOutput>> promise;
   auto future = promise.getSemiFuture();
-  threadpool_.schedule(
-      [this, inputs = inputs, promise = std::move(promise)]() mutable {
-        // run the model on the given input in working thread
-        const auto output = this->execute_model(inputs);
-        promise.setValue(output);
-      });
+  threadpool_.schedule([this,
+                        inputs = std::move(inputs),
+                        promise = std::move(promise)]() mutable {
+    // run the model on the given input in working thread
+    auto output = this->execute_model(*inputs);
+    promise.setValue(std::move(output));
+  });
+  return future;
+}
+
+folly::SemiFuture<std::optional<ModelOutput>>
+Worker::execute_decode_step_async() {
+  folly::Promise<std::optional<ModelOutput>> promise;
+  auto future = promise.getSemiFuture();
+  threadpool_.schedule([this, promise = std::move(promise)]() mutable {
+    // run the model on the advanced inputs in working thread
+    auto output = this->execute_decode_step();
+    promise.setValue(std::move(output));
+  });
   return future;
 }
 
@@ -275,4 +532,110 @@ folly::SemiFuture<folly::Unit> Worker::load_state_dict_async(
   return future;
 }
 
+folly::SemiFuture<bool> Worker::save_weights_cache_async(
+    const WeightsCache& cache) {
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  threadpool_.schedule([this, &cache, promise = std::move(promise)]() mutable {
+    promise.setValue(this->save_weights_cache(cache));
+  });
+  return future;
+}
+
+folly::SemiFuture<bool> Worker::load_weights_cache_async(
+    const WeightsCache& cache) {
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  threadpool_.schedule([this, &cache, promise = std::move(promise)]() mutable {
+    promise.setValue(this->load_weights_cache(cache));
+  });
+  return future;
+}
+
+folly::SemiFuture<bool> Worker::init_staged_model_async() {
+  if (staging_threadpool_ == nullptr) {
+    staging_threadpool_ = std::make_unique<ThreadPool>();
+  }
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  staging_threadpool_->schedule(
+      [this, promise = std::move(promise)]() mutable {
+        promise.setValue(this->init_staged_model());
+      });
+  return future;
+}
+
+folly::SemiFuture<folly::Unit> Worker::stage_state_dict_async(
+    const StateDict& state_dict) {
+  CHECK(staging_threadpool_ != nullptr) << "Staged model is not initialized.";
+  folly::Promise<folly::Unit> promise;
+  auto future = promise.getSemiFuture();
+  staging_threadpool_->schedule(
+      [this, &state_dict, promise = std::move(promise)]() mutable {
+        this->stage_state_dict(state_dict);
+        promise.setValue();
+      });
+  return future;
+}
+
+folly::SemiFuture<bool> Worker::verify_staged_weights_async() {
+  CHECK(staging_threadpool_ != nullptr) << "Staged model is not initialized.";
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  staging_threadpool_->schedule(
+      [this, promise = std::move(promise)]() mutable {
+        promise.setValue(this->verify_staged_weights());
+      });
+  return future;
+}
+
+folly::SemiFuture<folly::Unit> Worker::discard_staged_weights_async() {
+  folly::Promise<folly::Unit> promise;
+  auto future = promise.getSemiFuture();
+  threadpool_.schedule([this, promise = std::move(promise)]() mutable {
+    this->discard_staged_weights();
+    promise.setValue();
+  });
+  return future;
+}
+
+folly::SemiFuture<bool> Worker::swap_staged_weights_async() {
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  threadpool_.schedule([this, promise = std::move(promise)]() mutable {
+    promise.setValue(this->swap_staged_weights());
+  });
+  return future;
+}
+
+folly::SemiFuture<bool> Worker::load_lora_adapter_async(
+    int32_t slot,
+    const StateDict& state_dict,
+    float scaling) {
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  threadpool_.schedule([this,
+                        slot,
+                        &state_dict,
+                        scaling,
+                        promise = std::move(promise)]() mutable {
+    promise.setValue(this->load_lora_adapter(slot, state_dict, scaling));
+  });
+  return future;
+}
+
+folly::SemiFuture<bool> Worker::load_kv_cache_snapshot_async(
+    const PrefixCacheSnapshot& snapshot,
+    std::vector<std::pair<int32_t, int32_t>> block_mapping) {
+  folly::Promise<bool> promise;
+  auto future = promise.getSemiFuture();
+  threadpool_.schedule([this,
+                        &snapshot,
+                        block_mapping = std::move(block_mapping),
+                        promise = std::move(promise)]() mutable {
+    promise.setValue(this->load_kv_cache_snapshot(snapshot, block_mapping));
+  });
+  return future;
+}
+
 }  // namespace llm
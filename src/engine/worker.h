@@ -3,8 +3,14 @@
 #include <folly/futures/Future.h>
 #include <torch/torch.h>
 
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "common/threadpool.h"
+#include "memory/prefix_cache_snapshot.h"
 #include "model_loader/state_dict.h"
+#include "model_loader/weights_cache.h"
 #include "model_parallel/parallel_args.h"
 #include "model_runner.h"
 #include "models/causal_lm.h"
@@ -35,6 +41,46 @@ class Worker final {
   // verify if the model is loaded correctly
   void verify_loaded_weights() const;
 
+  // save the loaded weights of this rank to the cache. blocking call
+  bool save_weights_cache(const WeightsCache& cache);
+
+  // restore the weights of this rank from the cache. blocking call
+  bool load_weights_cache(const WeightsCache& cache);
+
+  // create a second model to stage the weights of a new checkpoint while the
+  // current model keeps serving. blocking call
+  bool init_staged_model();
+
+  // Load the weights of the new checkpoint into the staged model. blocking call
+  void stage_state_dict(const StateDict& state_dict);
+
+  // verify the staged weights are complete and match the current model
+  bool verify_staged_weights() const;
+
+  // switch to the staged weights by copying them into the current model in
+  // place, so that the captured cuda graphs stay valid. blocking call
+  bool swap_staged_weights();
+
+  // release the staged model without switching to it
+  void discard_staged_weights();
+
+  // load the lora adapter into the slot, replacing the adapter in it.
+  // returns false if the model doesn't support lora adapters. blocking call
+  bool load_lora_adapter(int32_t slot,
+                         const StateDict& state_dict,
+                         float scaling);
+
+  // save the kv cache of the blocks to the prefix cache snapshot. the blocks
+  // must be full, so it can run off the working thread. blocking call
+  bool save_kv_cache_snapshot(const PrefixCacheSnapshot& snapshot,
+                              const std::vector<int32_t>& block_ids);
+
+  // restore the kv cache of the saved blocks into the allocated blocks from
+  // the prefix cache snapshot. blocking call
+  bool load_kv_cache_snapshot(
+      const PrefixCacheSnapshot& snapshot,
+      const std::vector<std::pair<int32_t, int32_t>>& block_mapping);
+
   // returns available memory and total memory
   std::tuple<int64_t, int64_t> profile_device_memory();
 
@@ -44,6 +90,14 @@ class Worker final {
   // Run the model on the given input. blocking call
   std::optional<ModelOutput> execute_model(const ModelInput& inputs);
 
+  // Run the next decode step of the last batch without any input from the
+  // host: the inputs of the last step are advanced by one token on the device
+  // and fed with the tokens sampled in the last step. only valid after a
+  // decode step without token penalties, run with inputs of more than one
+  // decode step. returns std::nullopt if the last step didn't keep its inputs.
+  // blocking call
+  std::optional<ModelOutput> execute_decode_step();
+
   // capture cuda graph for the model. blocking call
   void capture_cuda_graph(uint32_t batch_size);
 
@@ -57,6 +111,39 @@ class Worker final {
   folly::SemiFuture<folly::Unit> load_state_dict_async(
       const StateDict& state_dict);
 
+  // save the loaded weights of this rank to the cache. async call
+  folly::SemiFuture<bool> save_weights_cache_async(const WeightsCache& cache);
+
+  // restore the weights of this rank from the cache. async call
+  folly::SemiFuture<bool> load_weights_cache_async(const WeightsCache& cache);
+
+  // the staging calls run on a separate thread without blocking the model
+  // execution. async call
+  folly::SemiFuture<bool> init_staged_model_async();
+
+  folly::SemiFuture<folly::Unit> stage_state_dict_async(
+      const StateDict& state_dict);
+
+  folly::SemiFuture<bool> verify_staged_weights_async();
+
+  folly::SemiFuture<folly::Unit> discard_staged_weights_async();
+
+  // the swap runs on the working thread, ordered with the model execution.
+  // async call
+  folly::SemiFuture<bool> swap_staged_weights_async();
+
+  // load the lora adapter on the working thread, ordered with the model
+  // execution. async call
+  folly::SemiFuture<bool> load_lora_adapter_async(int32_t slot,
+                                                  const StateDict& state_dict,
+                                                  float scaling);
+
+  // the snapshot load runs on the working thread, ordered with the model
+  // execution. async call
+  folly::SemiFuture<bool> load_kv_cache_snapshot_async(
+      const PrefixCacheSnapshot& snapshot,
+      std::vector<std::pair<int32_t, int32_t>> block_mapping);
+
   folly::SemiFuture<std::tuple<int64_t, int64_t>> profile_device_memory_async();
 
   // initialize kv cache. async call
@@ -64,9 +151,13 @@ class Worker final {
       const std::vector<int64_t>& kv_cache_shape);
 
   // Run the model on the given input. async call
-  // the future returns a successfull status with no meaningful value
+  // the inputs are shared among workers without copying, and kept alive until
+  // the model finishes. only the driver returns the output.
   folly::SemiFuture<std::optional<ModelOutput>> execute_model_async(
-      const ModelInput& inputs);
+      std::shared_ptr<const ModelInput> inputs);
+
+  // Run the next decode step of the last batch. async call
+  folly::SemiFuture<std::optional<ModelOutput>> execute_decode_step_async();
 
   folly::SemiFuture<folly::Unit> process_group_test_async();
 
@@ -76,6 +167,20 @@ class Worker final {
   const torch::Device& device() const { return device_; }
 
  private:
+  // model inputs on the device
+  struct DeviceInput {
+    torch::Tensor token_ids;
+    torch::Tensor positions;
+    InputParameters params;
+    SamplingParameters sampling_params;
+  };
+
+  // run the model on the inputs already on the device
+  std::optional<ModelOutput> execute_model(const DeviceInput& input);
+
+  // advance the inputs of the last decode step by one token on the device
+  void advance_decode_input();
+
   void process_group_test();
 
   // whether the worker is a driver, who takes care of the sampling
@@ -96,6 +201,9 @@ class Worker final {
   // model args
   ModelArgs args_;
 
+  // quantization args
+  QuantArgs quant_args_;
+
   // kv caches
   std::vector<llm::KVCache> kv_caches_;
 
@@ -107,6 +215,17 @@ class Worker final {
 
   // model runner that runs the model, with cuda graph if enabled
   std::unique_ptr<ModelRunner> model_runner_;
+
+  // model holding the staged weights of a new checkpoint
+  std::unique_ptr<CausalLM> staged_model_;
+
+  // thread to stage the weights, created on first use
+  std::unique_ptr<ThreadPool> staging_threadpool_;
+
+  // the inputs of the last decode step kept on the device, and the tokens
+  // sampled by the driver in that step
+  std::optional<DeviceInput> decode_input_;
+  torch::Tensor decode_next_tokens_;
 };
 
 }  // namespace llm
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/tiny_model.h"
+#include "engine/worker.h"
+#include "memory/block_allocator.h"
+#include "request/sequence.h"
+
+namespace llm {
+namespace {
+constexpr int64_t kBlockSize = 16;
+constexpr int64_t kNumBlocks = 8;
+}  // namespace
+
+TEST(WorkerDecodeTest, DecodeStepOnDevice) {
+  torch::manual_seed(0);
+  const auto args = tiny_model_args();
+  const auto weights = random_state_dict(args);
+  constexpr size_t kNumSteps = 4;
+
+  // greedy decode a batch of two sequences, the longer one crosses a block
+  // boundary in the middle
+  const auto decode = [&](bool on_device) {
+    auto worker = create_tiny_worker(args, weights, kNumBlocks, kBlockSize);
+    BlockAllocator allocator(kNumBlocks, kBlockSize);
+    Sequence::Options options;
+    options.sampling_param.temperature = 0;
+    std::vector<std::unique_ptr<Sequence>> sequences;
+    Batch batch;
+    for (const size_t n_prompt_tokens : {5, 14}) {
+      std::vector<int32_t> prompt(n_prompt_tokens);
+      std::iota(prompt.begin(), prompt.end(), 1);
+      auto sequence =
+          std::make_unique<Sequence>(prompt, /*capacity=*/32, options);
+      sequence->append_blocks(allocator.allocate(2));
+      batch.add(sequence.get());
+      sequences.push_back(std::move(sequence));
+    }
+
+    // prefill and the first decode step from the host
+    for (size_t i = 0; i < 2; ++i) {
+      auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                              /*min_decoding_bach_size=*/0);
+      if (on_device && i == 1) {
+        inputs.num_decode_steps = 1 + kNumSteps;
+      }
+      batch.process_sample_output(
+          worker->execute_model(inputs).value().sample_output);
+    }
+    for (size_t i = 0; i < kNumSteps; ++i) {
+      if (on_device) {
+        batch.process_decode_step_output(
+            worker->execute_decode_step().value().sample_output);
+        continue;
+      }
+      auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                              /*min_decoding_bach_size=*/0);
+      batch.process_sample_output(
+          worker->execute_model(inputs).value().sample_output);
+    }
+
+    std::vector<std::vector<int32_t>> token_ids;
+    for (const auto& sequence : sequences) {
+      EXPECT_EQ(sequence->num_kv_cache_tokens(), sequence->num_tokens() - 1);
+      const auto ids = sequence->token_ids();
+      token_ids.emplace_back(ids.begin(), ids.end());
+    }
+    return token_ids;
+  };
+
+  const auto expected = decode(/*on_device=*/false);
+  EXPECT_EQ(expected[1].size(), 14 + 2 + kNumSteps);
+  EXPECT_EQ(decode(/*on_device=*/true), expected);
+}
+
+TEST(WorkerDecodeTest, DecodeInputNotKept) {
+  torch::manual_seed(0);
+  const auto args = tiny_model_args();
+  const auto weights = random_state_dict(args);
+  auto worker = create_tiny_worker(args, weights, kNumBlocks, kBlockSize);
+  BlockAllocator allocator(kNumBlocks, kBlockSize);
+  Sequence::Options options;
+  options.sampling_param.temperature = 0;
+  Sequence sequence(std::vector<int32_t>{1, 2, 3, 4, 5},
+                    /*capacity=*/32,
+                    options);
+  sequence.append_blocks(allocator.allocate(1));
+  Batch batch(&sequence);
+
+  // the inputs of a prefill step are not kept to continue on the device
+  auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                          /*min_decoding_bach_size=*/0);
+  inputs.num_decode_steps = 2;
+  auto output = worker->execute_model(inputs);
+  ASSERT_TRUE(output.has_value());
+  EXPECT_FALSE(output->kept_decode_input);
+  EXPECT_FALSE(worker->execute_decode_step().has_value());
+  batch.process_sample_output(output->sample_output);
+
+  // the inputs of a decode step are kept
+  inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                     /*min_decoding_bach_size=*/0);
+  inputs.num_decode_steps = 2;
+  output = worker->execute_model(inputs);
+  ASSERT_TRUE(output.has_value());
+  EXPECT_TRUE(output->kept_decode_input);
+  EXPECT_TRUE(worker->execute_decode_step().has_value());
+}
+
+}  // namespace llm
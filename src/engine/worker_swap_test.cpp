@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+
+#include <vector>
+
+#include "engine/batch.h"
+#include "engine/tiny_model.h"
+#include "engine/worker.h"
+#include "memory/block_allocator.h"
+#include "model_loader/state_dict.h"
+#include "models/model_args.h"
+#include "request/sequence.h"
+
+namespace llm {
+namespace {
+constexpr int64_t kBlockSize = 16;
+constexpr int64_t kNumBlocks = 8;
+}  // namespace
+
+TEST(WorkerSwapTest, SwapStagedWeights) {
+  torch::manual_seed(0);
+  const auto args = tiny_model_args();
+  const auto weights = random_state_dict(args);
+  const auto new_weights = random_state_dict(args);
+  auto worker = create_tiny_worker(args, weights, kNumBlocks, kBlockSize);
+  auto expected_worker =
+      create_tiny_worker(args, new_weights, kNumBlocks, kBlockSize);
+
+  BlockAllocator allocator(kNumBlocks, kBlockSize);
+  const std::vector<int32_t> prompt = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  Sequence sequence(prompt, /*capacity=*/32, Sequence::Options());
+  sequence.append_blocks(allocator.allocate(2));
+  Batch batch(&sequence);
+  const auto inputs = batch.prepare_model_input(/*num_decoding_tokens=*/1,
+                                                /*min_decoding_bach_size=*/0);
+
+  const auto logits = worker->execute_model(inputs).value().logits;
+  const auto expected_logits =
+      expected_worker->execute_model(inputs).value().logits;
+  ASSERT_FALSE(torch::allclose(logits, expected_logits));
+
+  // nothing to swap before staging
+  EXPECT_FALSE(worker->swap_staged_weights());
+
+  // stage the new weights on the staging thread
+  ASSERT_TRUE(worker->init_staged_model_async().get());
+  worker->stage_state_dict_async(new_weights).get();
+  ASSERT_TRUE(worker->verify_staged_weights_async().get());
+
+  // the current weights keep serving until the swap
+  EXPECT_TRUE(torch::equal(worker->execute_model(inputs).value().logits,
+                           logits));
+
+  ASSERT_TRUE(worker->swap_staged_weights_async().get());
+  EXPECT_TRUE(torch::allclose(worker->execute_model(inputs).value().logits,
+                              expected_logits,
+                              /*rtol=*/1e-5,
+                              /*atol=*/1e-5));
+  // the staged model is released after the swap
+  EXPECT_FALSE(worker->swap_staged_weights());
+}
+
+TEST(WorkerSwapTest, DiscardStagedWeights) {
+  torch::manual_seed(0);
+  const auto args = tiny_model_args();
+  const auto weights = random_state_dict(args);
+  auto worker = create_tiny_worker(args, weights, kNumBlocks, kBlockSize);
+
+  ASSERT_TRUE(worker->init_staged_model_async().get());
+  worker->stage_state_dict_async(random_state_dict(args)).get();
+  worker->discard_staged_weights_async().get();
+  EXPECT_FALSE(worker->verify_staged_weights());
+  EXPECT_FALSE(worker->swap_staged_weights());
+}
+
+}  // namespace llm
@@ -5,6 +5,7 @@
 #include <grpcpp/grpcpp.h>
 
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <string>
@@ -69,6 +70,11 @@ class StreamCallData : public CallData {
 
   const Request& request() const { return request_; }
 
+  // the deadline set by the client, time_point::max() if not set
+  std::chrono::system_clock::time_point deadline() const {
+    return ctx_.deadline();
+  }
+
   // returns true if the rpc is ok
   bool is_rpc_ok() const { return rpc_ok_.load(std::memory_order_relaxed); }
 
@@ -51,6 +51,7 @@ void set_logprobs(proto::ChatChoice* choice,
 
 bool send_delta_to_client(ChatCallData* call_data,
                           bool include_usage,
+                          bool include_latency,
                           std::unordered_set<size_t>* first_message_sent,
                           const std::string& request_id,
                           int64_t created_time,
@@ -127,6 +128,11 @@ bool send_delta_to_client(ChatCallData* call_data,
     proto_usage->set_completion_tokens(
         static_cast<int32_t>(usage.num_generated_tokens));
     proto_usage->set_total_tokens(static_cast<int32_t>(usage.num_total_tokens));
+    proto_usage->mutable_prompt_tokens_details()->set_cached_tokens(
+        static_cast<int32_t>(usage.num_cached_tokens));
+    if (include_latency && output.latency.has_value()) {
+      set_latency(output.latency.value(), proto_usage);
+    }
     if (!call_data->write(std::move(response))) {
       return false;
     }
@@ -140,6 +146,7 @@ bool send_delta_to_client(ChatCallData* call_data,
 }
 
 bool send_result_to_client(ChatCallData* call_data,
+                           bool include_latency,
                            const std::string& request_id,
                            int64_t created_time,
                            const std::string& model,
@@ -172,6 +179,11 @@ bool send_result_to_client(ChatCallData* call_data,
     proto_usage->set_completion_tokens(
         static_cast<int32_t>(usage.num_generated_tokens));
     proto_usage->set_total_tokens(static_cast<int32_t>(usage.num_total_tokens));
+    proto_usage->mutable_prompt_tokens_details()->set_cached_tokens(
+        static_cast<int32_t>(usage.num_cached_tokens));
+    if (include_latency && req_output.latency.has_value()) {
+      set_latency(req_output.latency.value(), proto_usage);
+    }
   }
 
   return call_data->write_and_finish(response);
@@ -224,6 +236,9 @@ SamplingParams grpc_request_to_sampling_params(
     sampling_params.stop_token_ids = std::vector<int32_t>(
         request.stop_token_ids().begin(), request.stop_token_ids().end());
   }
+  if (!request.user().empty()) {
+    sampling_params.user = request.user();
+  }
   return sampling_params;
 }
 
@@ -247,6 +262,12 @@ void ChatHandler::chat_async(ChatCallData* call_data) {
   }
 
   auto sp = grpc_request_to_sampling_params(grpc_request);
+  // lora adapters are served as models
+  if (llm_handler_->is_lora_adapter(model)) {
+    sp.lora_adapter = model;
+  }
+  // honor the deadline set by the client
+  sp.timeout = to_timeout_seconds(call_data->deadline());
   auto priority = to_priority(grpc_request.priority());
   auto stream = grpc_request.stream();
 
@@ -259,6 +280,7 @@ void ChatHandler::chat_async(ChatCallData* call_data) {
   if (grpc_request.has_stream_options()) {
     include_usage = grpc_request.stream_options().include_usage();
   }
+  const bool include_latency = grpc_request.include_latency();
 
   // schedule the request
   llm_handler_->schedule_chat_async(
@@ -270,6 +292,7 @@ void ChatHandler::chat_async(ChatCallData* call_data) {
        model,
        stream = stream,
        include_usage = include_usage,
+       include_latency = include_latency,
        first_message_sent = std::unordered_set<size_t>(),
        request_id = generate_request_id(),
        created_time = absl::ToUnixSeconds(absl::Now())](
@@ -286,14 +309,19 @@ void ChatHandler::chat_async(ChatCallData* call_data) {
           // send delta to client
           return send_delta_to_client(call_data,
                                       include_usage,
+                                      include_latency,
                                       &first_message_sent,
                                       request_id,
                                       created_time,
                                       model,
                                       req_output);
         }
-        return send_result_to_client(
-            call_data, request_id, created_time, model, req_output);
+        return send_result_to_client(call_data,
+                                     include_latency,
+                                     request_id,
+                                     created_time,
+                                     model,
+                                     req_output);
       });
 }
 
@@ -37,6 +37,7 @@ void set_logprobs(proto::Choice* choice,
 
 bool send_delta_to_client(CompletionCallData* call_data,
                           bool include_usage,
+                          bool include_latency,
                           const std::string& request_id,
                           int64_t created_time,
                           const std::string& model,
@@ -89,6 +90,11 @@ bool send_delta_to_client(CompletionCallData* call_data,
     proto_usage->set_completion_tokens(
         static_cast<int32_t>(usage.num_generated_tokens));
     proto_usage->set_total_tokens(static_cast<int32_t>(usage.num_total_tokens));
+    proto_usage->mutable_prompt_tokens_details()->set_cached_tokens(
+        static_cast<int32_t>(usage.num_cached_tokens));
+    if (include_latency && output.latency.has_value()) {
+      set_latency(output.latency.value(), proto_usage);
+    }
     if (!call_data->write(std::move(response))) {
       return false;
     }
@@ -102,6 +108,7 @@ bool send_delta_to_client(CompletionCallData* call_data,
 }
 
 bool send_result_to_client(CompletionCallData* call_data,
+                           bool include_latency,
                            const std::string& request_id,
                            int64_t created_time,
                            const std::string& model,
@@ -132,6 +139,11 @@ bool send_result_to_client(CompletionCallData* call_data,
     proto_usage->set_completion_tokens(
         static_cast<int32_t>(usage.num_generated_tokens));
     proto_usage->set_total_tokens(static_cast<int32_t>(usage.num_total_tokens));
+    proto_usage->mutable_prompt_tokens_details()->set_cached_tokens(
+        static_cast<int32_t>(usage.num_cached_tokens));
+    if (include_latency && req_output.latency.has_value()) {
+      set_latency(req_output.latency.value(), proto_usage);
+    }
   }
 
   return call_data->write_and_finish(response);
@@ -188,6 +200,9 @@ SamplingParams grpc_request_to_sampling_params(
     sampling_params.stop_token_ids = std::vector<int32_t>(
         request.stop_token_ids().begin(), request.stop_token_ids().end());
   }
+  if (!request.user().empty()) {
+    sampling_params.user = request.user();
+  }
   return sampling_params;
 }
 
@@ -211,6 +226,12 @@ void CompletionHandler::complete_async(CompletionCallData* call_data) {
   }
 
   auto sp = grpc_request_to_sampling_params(grpc_request);
+  // lora adapters are served as models
+  if (llm_handler_->is_lora_adapter(model)) {
+    sp.lora_adapter = model;
+  }
+  // honor the deadline set by the client
+  sp.timeout = to_timeout_seconds(call_data->deadline());
   auto priority = to_priority(grpc_request.priority());
   const size_t best_of = sp.best_of.value_or(sp.n);
   // results cannot be streamed when best_of != n
@@ -219,6 +240,7 @@ void CompletionHandler::complete_async(CompletionCallData* call_data) {
   if (grpc_request.has_stream_options()) {
     include_usage = grpc_request.stream_options().include_usage();
   }
+  const bool include_latency = grpc_request.include_latency();
 
   // schedule the request
   llm_handler_->schedule_async(
@@ -230,6 +252,7 @@ void CompletionHandler::complete_async(CompletionCallData* call_data) {
        model,
        stream = stream,
        include_usage = include_usage,
+       include_latency = include_latency,
        request_id = generate_request_id(),
        created_time = absl::ToUnixSeconds(absl::Now())](
           const RequestOutput& req_output) -> bool {
@@ -245,13 +268,18 @@ void CompletionHandler::complete_async(CompletionCallData* call_data) {
           // send delta to client
           return send_delta_to_client(call_data,
                                       include_usage,
+                                      include_latency,
                                       request_id,
                                       created_time,
                                       model,
                                       req_output);
         }
-        return send_result_to_client(
-            call_data, request_id, created_time, model, req_output);
+        return send_result_to_client(call_data,
+                                     include_latency,
+                                     request_id,
+                                     created_time,
+                                     model,
+                                     req_output);
       });
 }
 
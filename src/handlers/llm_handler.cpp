@@ -1,5 +1,6 @@
 #include "llm_handler.h"
 
+#include <absl/time/time.h>
 #include <glog/logging.h>
 
 #include <atomic>
@@ -17,6 +18,7 @@
 #include "models/model_registry.h"
 #include "request/output.h"
 #include "request/request.h"
+#include "scheduler/scheduler_policy.h"
 #include "speculative/speculative_engine.h"
 
 DEFINE_COUNTER_FAMILY(request_status_total, "Total number of request status");
@@ -59,6 +61,8 @@ DEFINE_COUNTER(tokenization_latency_seconds,
                "Prompt tokenization latency in seconds");
 DEFINE_COUNTER(chat_template_latency_seconds,
                "Chat template latency in seconds");
+DEFINE_GAUGE(prefix_cache_summary_refresh_latency_seconds,
+             "Latency of refreshing the prefix cache summary in seconds");
 
 namespace llm {
 namespace {
@@ -147,6 +151,12 @@ bool verify_params(const SamplingParams& sp, OutputCallback callback) {
     }
   }
 
+  if (sp.max_queue_time.has_value() && sp.max_queue_time.value() < 0) {
+    CALLBACK_WITH_ERROR(StatusCode::INVALID_ARGUMENT,
+                        "max_queue_time must be non-negative");
+    return false;
+  }
+
   // presence_penalty between [-2.0, 2.0]
   if (sp.presence_penalty < -2.0 || sp.presence_penalty > 2.0) {
     CALLBACK_WITH_ERROR(StatusCode::INVALID_ARGUMENT,
@@ -163,9 +173,27 @@ bool verify_params(const SamplingParams& sp, OutputCallback callback) {
   return true;
 }
 
+// the text of the conversation to route requests on, which must match the
+// gateway: the role and content of each message, ended by newlines.
+std::string chat_routing_text(const std::vector<Message>& messages) {
+  std::string text;
+  for (const auto& message : messages) {
+    text += message.role;
+    text += '\n';
+    text += message.content;
+    text += '\n';
+  }
+  return text;
+}
+
 }  // namespace
 
 LLMHandler::LLMHandler(const Options& options) : options_(options) {
+  // fail before loading the model
+  CHECK(SchedulerPolicy::is_supported(options.scheduler_policy()))
+      << "Unknown scheduler policy: " << options.scheduler_policy()
+      << ", expected one of: " << SchedulerPolicy::joined_names();
+
   // construct engine
   const auto devices = parse_devices(options.devices().value_or("auto"));
   LOG(INFO) << "Creating engine with devices: " << to_string(devices);
@@ -183,12 +211,24 @@ LLMHandler::LLMHandler(const Options& options) : options_(options) {
         .max_cache_size(options.max_cache_size())
         .max_memory_utilization(options.max_memory_utilization())
         .enable_prefix_cache(options.enable_prefix_cache())
+        .prefix_cache_eviction_policy(options.prefix_cache_eviction_policy())
         .num_speculative_tokens(options.num_speculative_tokens())
         .enable_cuda_graph(options.enable_cuda_graph())
         .cuda_graph_max_seq_len(options.cuda_graph_max_seq_len())
         .cuda_graph_batch_sizes(options.cuda_graph_batch_sizes())
-        .draft_cuda_graph_batch_sizes(options.draft_cuda_graph_batch_sizes());
-
+        .draft_cuda_graph_batch_sizes(options.draft_cuda_graph_batch_sizes())
+        .cpu_dtype(options.cpu_dtype())
+        .max_prefetch_files(options.max_prefetch_files())
+        .weights_cache_dir(options.weights_cache_dir());
+
+    if (!options.lora_adapters().empty()) {
+      LOG(WARNING) << "Lora adapters are not supported with speculative "
+                      "decoding, ignoring them";
+    }
+    if (!options.prefix_cache_snapshot_dir().empty()) {
+      LOG(WARNING) << "Prefix cache snapshot is not supported with "
+                      "speculative decoding, ignoring it";
+    }
     auto spec_engine = std::make_unique<SpeculativeEngine>(spec_options);
     CHECK(spec_engine->init(options.model_path(), draft_model_path));
     engine_ = std::move(spec_engine);
@@ -199,9 +239,24 @@ LLMHandler::LLMHandler(const Options& options) : options_(options) {
         .max_cache_size(options.max_cache_size())
         .max_memory_utilization(options.max_memory_utilization())
         .enable_prefix_cache(options.enable_prefix_cache())
+        .prefix_cache_eviction_policy(options.prefix_cache_eviction_policy())
         .enable_cuda_graph(options.enable_cuda_graph())
         .cuda_graph_max_seq_len(options.cuda_graph_max_seq_len())
-        .cuda_graph_batch_sizes(options.cuda_graph_batch_sizes());
+        .cuda_graph_batch_sizes(options.cuda_graph_batch_sizes())
+        .cpu_dtype(options.cpu_dtype())
+        .max_prefetch_files(options.max_prefetch_files())
+        .weights_cache_dir(options.weights_cache_dir())
+        .prefix_cache_snapshot_dir(options.prefix_cache_snapshot_dir())
+        .prefix_cache_snapshot_interval(
+            options.prefix_cache_snapshot_interval());
+    if (!options.lora_adapters().empty()) {
+      eng_options.max_loras(options.max_loras())
+          .max_lora_rank(options.max_lora_rank())
+          .lora_adapters(options.lora_adapters());
+      for (const auto& [name, path] : options.lora_adapters()) {
+        lora_adapters_.insert(name);
+      }
+    }
 
     auto engine = std::make_unique<LLMEngine>(eng_options);
     CHECK(engine->init(options.model_path()));
@@ -213,7 +268,21 @@ LLMHandler::LLMHandler(const Options& options) : options_(options) {
   ContinuousScheduler::Options scheduler_options;
   scheduler_options.max_tokens_per_batch(options.max_tokens_per_batch())
       .max_seqs_per_batch(options.max_seqs_per_batch())
-      .num_speculative_tokens(options.num_speculative_tokens());
+      .num_speculative_tokens(options.num_speculative_tokens())
+      .num_decode_steps(options.num_decode_steps())
+      .scheduler_policy(options.scheduler_policy())
+      .priority_aging_interval(
+          absl::Seconds(options.priority_aging_interval()))
+      .fair_share_half_life(absl::Seconds(options.fair_share_half_life()))
+      .cache_aware_max_wait(absl::Seconds(options.cache_aware_max_wait()))
+      .enable_admission_control(options.enable_admission_control())
+      .enable_overlap_scheduling(options.enable_overlap_scheduling());
+  if (!lora_adapters_.empty()) {
+    scheduler_options.max_loras(static_cast<int32_t>(options.max_loras()));
+  }
+  if (options.max_queue_time() > 0) {
+    scheduler_options.max_queue_time(absl::Seconds(options.max_queue_time()));
+  }
   scheduler_ =
       std::make_unique<ContinuousScheduler>(engine_.get(), scheduler_options);
 
@@ -232,6 +301,16 @@ LLMHandler::LLMHandler(const Options& options) : options_(options) {
     }
   }
 
+  if (options.prefix_cache_summary_interval() > 0) {
+    if (!options.enable_prefix_cache()) {
+      LOG(WARNING) << "Prefix cache summary requires the prefix cache, "
+                      "ignoring it";
+    } else {
+      prefix_cache_summary_ =
+          std::make_unique<PrefixCacheSummary>(PrefixCacheSummary::Options());
+    }
+  }
+
   // construct tokenizers and handling threads
   const auto* tokenizer = engine_->tokenizer();
   for (size_t i = 0; i < options.num_handling_threads(); ++i) {
@@ -375,6 +454,10 @@ std::future<bool> LLMHandler::schedule(std::string prompt,
       promise.set_value(false);
       return;
     }
+    if (prefix_cache_summary_ != nullptr) {
+      prefix_cache_summary_->record(
+          request->lora_adapter, request->prompt, request->prompt_tokens);
+    }
 
     if (!scheduler_->schedule(request)) {
       CALLBACK_WITH_ERROR(StatusCode::RESOURCE_EXHAUSTED,
@@ -418,6 +501,12 @@ std::future<bool> LLMHandler::schedule(std::vector<Message> messages,
       promise.set_value(false);
       return;
     }
+    if (prefix_cache_summary_ != nullptr) {
+      // the gateway can't apply the chat template, use the messages instead
+      prefix_cache_summary_->record(request->lora_adapter,
+                                    chat_routing_text(messages),
+                                    request->prompt_tokens);
+    }
 
     if (!scheduler_->schedule(request)) {
       CALLBACK_WITH_ERROR(StatusCode::RESOURCE_EXHAUSTED,
@@ -447,10 +536,20 @@ void LLMHandler::start() {
     CHECK(!running) << "Handler is already running";
 
     running_.store(true, std::memory_order_relaxed);
+    // the scheduler wakes up as soon as new requests arrive, the timeout only
+    // bounds the time to notice the stop flag when idle.
     const auto timeout = absl::Milliseconds(500);
+    Timer summary_timer;
     while (!stoped_.load(std::memory_order_relaxed)) {
       // move scheduler forward
       scheduler_->step(timeout);
+
+      if (prefix_cache_summary_ != nullptr &&
+          summary_timer.elapsed_seconds() >=
+              options_.prefix_cache_summary_interval()) {
+        refresh_prefix_cache_summary();
+        summary_timer.reset();
+      }
     }
     running_.store(false, std::memory_order_relaxed);
   });
@@ -475,6 +574,21 @@ void LLMHandler::run_until_complete() {
   running_.store(false, std::memory_order_relaxed);
 }
 
+void LLMHandler::refresh_prefix_cache_summary() {
+  Timer timer;
+  prefix_cache_summary_->refresh(
+      engine_->block_manager()->prefix_cache_entries(), options_.block_size());
+  GAUGE_SET(prefix_cache_summary_refresh_latency_seconds,
+            timer.elapsed_seconds());
+}
+
+std::optional<std::string> LLMHandler::prefix_cache_summary() const {
+  if (prefix_cache_summary_ == nullptr) {
+    return std::nullopt;
+  }
+  return prefix_cache_summary_->to_json();
+}
+
 std::unique_ptr<Request> LLMHandler::create_request(size_t tid,
                                                     std::string prompt,
                                                     const SamplingParams& sp,
@@ -486,6 +600,13 @@ std::unique_ptr<Request> LLMHandler::create_request(size_t tid,
     return nullptr;
   }
 
+  if (sp.lora_adapter.has_value() && !sp.lora_adapter->empty() &&
+      !is_lora_adapter(sp.lora_adapter.value())) {
+    CALLBACK_WITH_ERROR(StatusCode::INVALID_ARGUMENT,
+                        "Unknown lora adapter: " + sp.lora_adapter.value());
+    return nullptr;
+  }
+
   // encode the prompt
   Timer timer;
   std::vector<int> prompt_tokens;
@@ -575,6 +696,16 @@ std::unique_ptr<Request> LLMHandler::create_request(size_t tid,
   }
   request->stream = stream;
   request->priority = priority;
+  request->tenant = sp.user.value_or("");
+  request->lora_adapter = sp.lora_adapter.value_or("");
+  if (sp.timeout.has_value()) {
+    request->deadline =
+        request->created_time + absl::Seconds(sp.timeout.value());
+  }
+  if (sp.max_queue_time.has_value()) {
+    request->queue_deadline =
+        request->created_time + absl::Seconds(sp.max_queue_time.value());
+  }
   request->echo = sp.echo;
 
   // set callback for outputs
@@ -650,6 +781,11 @@ void LLMHandler::reset() {
   }
   handling_threads_.clear();
 
+  // save the prefix cache once the engine is idle
+  if (engine_ != nullptr) {
+    engine_->save_prefix_cache_snapshot();
+  }
+
   // release all underlying resources
   scheduler_.reset();
   engine_.reset();
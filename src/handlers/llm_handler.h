@@ -7,11 +7,14 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include "chat_template/chat_template.h"
 #include "common/concurrent_queue.h"
 #include "engine/engine.h"
+#include "engine/lora_manager.h"
+#include "memory/prefix_cache_summary.h"
 #include "request/output.h"
 #include "sampling_params.h"
 #include "scheduler/continuous_scheduler.h"
@@ -75,6 +78,9 @@ class LLMHandler {
     // enable prefix cache
     DEFINE_ARG(bool, enable_prefix_cache) = true;
 
+    // the eviction policy of the prefix cache: lru, lfu or gdsf
+    DEFINE_ARG(std::string, prefix_cache_eviction_policy) = "lru";
+
     // enable cuda graph
     DEFINE_ARG(bool, enable_cuda_graph) = true;
 
@@ -97,6 +103,69 @@ class LLMHandler {
     // the number of speculative tokens per step
     DEFINE_ARG(int32_t, num_speculative_tokens) = 0;
 
+    // the number of decode iterations per step when no request is waiting.
+    // not used with speculative decoding.
+    DEFINE_ARG(int32_t, num_decode_steps) = 1;
+
+    // the policy to order waiting requests: fcfs, spf, priority_aging,
+    // fair_share or cache_aware
+    DEFINE_ARG(std::string, scheduler_policy) = "fcfs";
+
+    // priority_aging: the waiting time in seconds to promote a request by one
+    // priority level
+    DEFINE_ARG(double, priority_aging_interval) = 5;
+
+    // fair_share: the half life in seconds of the per-tenant usage
+    DEFINE_ARG(double, fair_share_half_life) = 60;
+
+    // cache_aware: the waiting time in seconds after which a request is no
+    // longer reordered by its cost
+    DEFINE_ARG(double, cache_aware_max_wait) = 2;
+
+    // the maximum time in seconds a request can wait in the queue before
+    // being scheduled, 0 means no limit
+    DEFINE_ARG(double, max_queue_time) = 0;
+
+    // reject requests up front if they are predicted to miss their deadline
+    DEFINE_ARG(bool, enable_admission_control) = true;
+
+    // plan the next step while the current step is running on the device
+    DEFINE_ARG(bool, enable_overlap_scheduling) = false;
+
+    // dtype for weights and activations on cpu: float32 or bfloat16
+    DEFINE_ARG(std::string, cpu_dtype) = "float32";
+
+    // the maximum number of model weights files to load ahead of the workers
+    DEFINE_ARG(int64_t, max_prefetch_files) = 2;
+
+    // directory to cache the loaded weights for fast restarts, empty to
+    // disable the cache
+    DEFINE_ARG(std::string, weights_cache_dir);
+
+    // lora adapters to serve on top of the model: name -> adapter path.
+    // not supported with speculative decoding.
+    DEFINE_ARG(LoraAdapterPaths, lora_adapters);
+
+    // the maximum number of lora adapters per batch, which are kept on the
+    // device. only used when lora adapters are given.
+    DEFINE_ARG(int64_t, max_loras) = 4;
+
+    // the maximum rank of the lora adapters
+    DEFINE_ARG(int64_t, max_lora_rank) = 16;
+
+    // directory to save the prefix cache on shutdown and restore it on
+    // startup, empty to disable the snapshot. not supported with speculative
+    // decoding.
+    DEFINE_ARG(std::string, prefix_cache_snapshot_dir);
+
+    // interval in seconds to save the prefix cache snapshot while serving, 0
+    // to only save it on shutdown
+    DEFINE_ARG(int64_t, prefix_cache_snapshot_interval) = 0;
+
+    // interval in seconds to refresh the summary of the resident prefixes,
+    // which is used by the gateway to route requests. 0 to disable the summary
+    DEFINE_ARG(double, prefix_cache_summary_interval) = 0;
+
     // the number of threads to use for handling requests
     DEFINE_ARG(size_t, num_handling_threads) = 4;
   };
@@ -159,6 +228,15 @@ class LLMHandler {
 
   const Options& options() const { return options_; }
 
+  // whether the name is a lora adapter served by the handler
+  bool is_lora_adapter(const std::string& name) const {
+    return lora_adapters_.count(name) > 0;
+  }
+
+  // the last refreshed summary of the resident prefixes in json, nullopt if
+  // the summary is disabled. thread safe.
+  std::optional<std::string> prefix_cache_summary() const;
+
  private:
   using Task = folly::Function<void(size_t tid)>;
   std::unique_ptr<Request> create_request(size_t tid,
@@ -190,6 +268,9 @@ class LLMHandler {
 
   void handling_loop(size_t tid);
 
+  // refresh the summary of the resident prefixes on the scheduler thread
+  void refresh_prefix_cache_summary();
+
   const Options options_;
 
   std::unique_ptr<Engine> engine_;
@@ -199,6 +280,9 @@ class LLMHandler {
   // model args
   ModelArgs model_args_;
 
+  // names of the served lora adapters
+  std::unordered_set<std::string> lora_adapters_;
+
   // thread pool for handling requests
   std::vector<std::thread> handling_threads_;
 
@@ -212,6 +296,9 @@ class LLMHandler {
   // chat template instance
   std::unique_ptr<ChatTemplate> chat_template_;
 
+  // summary of the resident prefixes, nullptr if disabled
+  std::unique_ptr<PrefixCacheSummary> prefix_cache_summary_;
+
   // thread for moving forward the scheduler
   std::thread loop_thread_;
 
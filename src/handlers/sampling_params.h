@@ -100,6 +100,21 @@ struct SamplingParams {
 
   // the list of token ids to stop generating further tokens.
   std::optional<std::vector<int32_t>> stop_token_ids;
+
+  // a unique identifier representing the end-user, used as the tenant for
+  // fair-share scheduling.
+  std::optional<std::string> user;
+
+  // the maximum time in seconds to complete the request, the request is
+  // aborted with DEADLINE_EXCEEDED after that. default = no limit.
+  std::optional<double> timeout;
+
+  // the maximum time in seconds the request can wait in the queue before
+  // being scheduled. default = the server's max_queue_time.
+  std::optional<double> max_queue_time;
+
+  // the name of the lora adapter to generate with. default = the base model.
+  std::optional<std::string> lora_adapter;
 };
 
 }  // namespace llm
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
 #include <glog/logging.h>
 #include <grpcpp/grpcpp.h>
 
@@ -49,4 +51,23 @@ grpc::StatusCode to_grpc_status_code(StatusCode code) {
   return grpc::StatusCode::UNKNOWN;
 }
 
+void set_latency(const LatencyBreakdown& latency, proto::Usage* usage) {
+  auto* proto_latency = usage->mutable_latency();
+  proto_latency->set_queue_seconds(latency.queue_seconds);
+  proto_latency->set_preempted_seconds(latency.preempted_seconds);
+  proto_latency->set_prefill_seconds(latency.prefill_seconds);
+  proto_latency->set_decode_seconds(latency.decode_seconds);
+  proto_latency->set_response_seconds(latency.response_seconds);
+  proto_latency->set_prefill_chunks(
+      static_cast<int32_t>(latency.num_prefill_chunks));
+}
+
+std::optional<double> to_timeout_seconds(
+    const std::chrono::system_clock::time_point& deadline) {
+  if (deadline == std::chrono::system_clock::time_point::max()) {
+    return std::nullopt;
+  }
+  return absl::ToDoubleSeconds(absl::FromChrono(deadline) - absl::Now());
+}
+
 }  // namespace llm
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #include <grpcpp/grpcpp.h>
 
+#include <chrono>
+#include <optional>
+
 #include "common.pb.h"
 #include "request/output.h"
 #include "request/status.h"
@@ -11,4 +14,12 @@ Priority to_priority(proto::Priority priority);
 
 grpc::StatusCode to_grpc_status_code(StatusCode code);
 
+// fill the latency breakdown of a finished request into the usage.
+void set_latency(const LatencyBreakdown& latency, proto::Usage* usage);
+
+// convert the deadline of a grpc call into timeout in seconds from now,
+// returns nullopt if no deadline is set.
+std::optional<double> to_timeout_seconds(
+    const std::chrono::system_clock::time_point& deadline);
+
 }  // namespace llm
\ No newline at end of file
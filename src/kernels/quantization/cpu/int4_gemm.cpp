@@ -0,0 +1,171 @@
+#include "int4_gemm.h"
+
+#include <ATen/Parallel.h>
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace cpu {
+namespace {
+// number of rows of A sharing one dequantized block of B
+constexpr int64_t kBlockM = 4;
+
+// computes C[m0:m0+m_len, n_start:n_start+n_len] for one block of columns.
+// the loops over kInt4BlockN have a fixed trip count and unit stride so that
+// the compiler can vectorize them with the SIMD width of the target.
+void int4_gemm_block(const float* a,
+                     const uint8_t* b_block,
+                     const float* scales,
+                     const float* scaled_zeros,
+                     float* c,
+                     int64_t m0,
+                     int64_t m_len,
+                     int64_t k,
+                     int64_t n,
+                     int64_t padded_n,
+                     int64_t n_start,
+                     int64_t n_len,
+                     int64_t group_size) {
+  float out[kBlockM][kInt4BlockN] = {};
+  const int64_t n_groups = k / group_size;
+  for (int64_t g = 0; g < n_groups; ++g) {
+    float acc[kBlockM][kInt4BlockN] = {};
+    float a_sum[kBlockM] = {};
+    const int64_t k_end = (g + 1) * group_size;
+    for (int64_t kk = g * group_size; kk < k_end; kk += 2) {
+      const uint8_t* b = b_block + (kk / 2) * kInt4BlockN;
+      float w0[kInt4BlockN];
+      float w1[kInt4BlockN];
+      for (int64_t j = 0; j < kInt4BlockN; ++j) {
+        w0[j] = static_cast<float>(b[j] & 0xF);
+        w1[j] = static_cast<float>(b[j] >> 4);
+      }
+      for (int64_t i = 0; i < m_len; ++i) {
+        const float x0 = a[(m0 + i) * k + kk];
+        const float x1 = a[(m0 + i) * k + kk + 1];
+        a_sum[i] += x0 + x1;
+        for (int64_t j = 0; j < kInt4BlockN; ++j) {
+          acc[i][j] += x0 * w0[j] + x1 * w1[j];
+        }
+      }
+    }
+    // apply scales and zeros once per group
+    const float* s = scales + g * padded_n + n_start;
+    const float* sz = scaled_zeros + g * padded_n + n_start;
+    for (int64_t i = 0; i < m_len; ++i) {
+      for (int64_t j = 0; j < kInt4BlockN; ++j) {
+        out[i][j] += s[j] * acc[i][j] - sz[j] * a_sum[i];
+      }
+    }
+  }
+
+  for (int64_t i = 0; i < m_len; ++i) {
+    std::copy(out[i], out[i] + n_len, c + (m0 + i) * n + n_start);
+  }
+}
+
+}  // namespace
+
+torch::Tensor int4_pack(const torch::Tensor& qweight) {
+  CHECK_EQ(qweight.dim(), 2);
+  const int64_t k = qweight.size(0);
+  const int64_t n = qweight.size(1);
+  CHECK(k % 2 == 0) << "k " << k << " must be even";
+  const int64_t n_blocks = (n + kInt4BlockN - 1) / kInt4BlockN;
+
+  const auto q = qweight.to(torch::kCPU, torch::kInt32).contiguous();
+  auto packed = torch::zeros({n_blocks, k / 2, kInt4BlockN}, torch::kUInt8);
+  const int32_t* src = q.data_ptr<int32_t>();
+  uint8_t* dst = packed.data_ptr<uint8_t>();
+  for (int64_t nb = 0; nb < n_blocks; ++nb) {
+    for (int64_t kk = 0; kk < k / 2; ++kk) {
+      uint8_t* row = dst + (nb * (k / 2) + kk) * kInt4BlockN;
+      for (int64_t j = 0; j < kInt4BlockN; ++j) {
+        const int64_t col = nb * kInt4BlockN + j;
+        if (col >= n) {
+          break;
+        }
+        const int32_t lo = src[(2 * kk) * n + col] & 0xF;
+        const int32_t hi = src[(2 * kk + 1) * n + col] & 0xF;
+        row[j] = static_cast<uint8_t>(lo | (hi << 4));
+      }
+    }
+  }
+  return packed;
+}
+
+torch::Tensor int4_pad_params(const torch::Tensor& params) {
+  CHECK_EQ(params.dim(), 2);
+  const int64_t n = params.size(1);
+  const int64_t padded_n =
+      (n + kInt4BlockN - 1) / kInt4BlockN * kInt4BlockN;
+  auto padded = torch::zeros({params.size(0), padded_n}, torch::kFloat);
+  padded.narrow(/*dim=*/1, /*start=*/0, /*length=*/n)
+      .copy_(params.to(torch::kCPU, torch::kFloat));
+  return padded;
+}
+
+torch::Tensor int4_gemm(const torch::Tensor& A,
+                        const torch::Tensor& B,
+                        const torch::Tensor& scales,
+                        const torch::Tensor& scaled_zeros,
+                        int64_t n,
+                        int64_t group_size) {
+  CHECK(A.is_cpu()) << "int4_gemm only supports cpu tensors";
+  CHECK_EQ(A.dim(), 2);
+  CHECK_EQ(B.dim(), 3);
+  CHECK_EQ(B.scalar_type(), torch::kUInt8);
+  CHECK_EQ(scales.scalar_type(), torch::kFloat);
+  CHECK_EQ(scaled_zeros.scalar_type(), torch::kFloat);
+
+  const int64_t m = A.size(0);
+  const int64_t k = A.size(1);
+  const int64_t n_blocks = B.size(0);
+  const int64_t padded_n = n_blocks * kInt4BlockN;
+  CHECK_EQ(B.size(1) * 2, k) << "k mismatch between A and B";
+  CHECK(group_size > 0 && group_size % 2 == 0 && k % group_size == 0)
+      << "invalid group_size " << group_size << " for k " << k;
+  CHECK_EQ(scales.size(0), k / group_size);
+  CHECK_EQ(scales.size(1), padded_n);
+  CHECK(n <= padded_n && n > padded_n - kInt4BlockN);
+
+  // compute in float32 regardless of the input dtype
+  const auto a = A.to(torch::kFloat).contiguous();
+  auto c = torch::empty({m, n}, A.options().dtype(torch::kFloat));
+
+  const float* a_ptr = a.data_ptr<float>();
+  const uint8_t* b_ptr = B.data_ptr<uint8_t>();
+  const float* s_ptr = scales.data_ptr<float>();
+  const float* sz_ptr = scaled_zeros.data_ptr<float>();
+  float* c_ptr = c.data_ptr<float>();
+  // each task owns whole blocks of columns, no synchronization is needed
+  at::parallel_for(
+      0, n_blocks, /*grain_size=*/1, [&](int64_t begin, int64_t end) {
+        for (int64_t nb = begin; nb < end; ++nb) {
+          const int64_t n_start = nb * kInt4BlockN;
+          const int64_t n_len = std::min(kInt4BlockN, n - n_start);
+          const uint8_t* b_block = b_ptr + nb * (k / 2) * kInt4BlockN;
+          for (int64_t m0 = 0; m0 < m; m0 += kBlockM) {
+            const int64_t m_len = std::min(kBlockM, m - m0);
+            int4_gemm_block(a_ptr,
+                            b_block,
+                            s_ptr,
+                            sz_ptr,
+                            c_ptr,
+                            m0,
+                            m_len,
+                            k,
+                            n,
+                            padded_n,
+                            n_start,
+                            n_len,
+                            group_size);
+          }
+        }
+      });
+  return c.to(A.scalar_type());
+}
+
+}  // namespace cpu
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <torch/torch.h>
+
+namespace cpu {
+
+// number of output columns in one block of the packed weight
+constexpr int64_t kInt4BlockN = 32;
+
+// repack unpacked 4-bit weights into the blocked layout used by int4_gemm:
+// two consecutive rows share one byte (low nibble first) and the columns are
+// split into blocks of kInt4BlockN, padded with zeros.
+// returns uint8 tensor: (n_blocks, k/2, kInt4BlockN)
+torch::Tensor int4_pack(const torch::Tensor& qweight);  // (k, n) in [0, 15]
+
+// pad the per group parameters to the blocked columns of the packed weight.
+// returns float tensor: (n_groups, n_blocks * kInt4BlockN)
+torch::Tensor int4_pad_params(const torch::Tensor& params);  // (n_groups, n)
+
+// C = A * (scales * (B - zeros)), accumulated in float32.
+// scaled_zeros holds scales * zeros to factor the zero points out of the
+// inner loop: sum_k(a * s * (b - z)) = s * sum_k(a * b) - s * z * sum_k(a)
+torch::Tensor int4_gemm(
+    const torch::Tensor& A,             // (m, k)
+    const torch::Tensor& B,             // (n_blocks, k/2, kInt4BlockN)
+    const torch::Tensor& scales,        // (n_groups, n_blocks * kInt4BlockN)
+    const torch::Tensor& scaled_zeros,  // (n_groups, n_blocks * kInt4BlockN)
+    int64_t n,
+    int64_t group_size);
+
+}  // namespace cpu
@@ -24,13 +24,14 @@ FusedColumnParallelLinearImpl::FusedColumnParallelLinearImpl(
     // fused linear layer
     const int64_t out_features = std::accumulate(
         out_features_vec.begin(), out_features_vec.end(), int64_t(0));
-    fused_linear_ = ColumnParallelLinear(in_features,
-                                         out_features,
-                                         bias,
-                                         gather_output,
-                                         quant_args,
-                                         parallel_args,
-                                         options);
+    fused_linear_ = register_module("fused_linear",
+                                    ColumnParallelLinear(in_features,
+                                                         out_features,
+                                                         bias,
+                                                         gather_output,
+                                                         quant_args,
+                                                         parallel_args,
+                                                         options));
     // calculate split sizes
     split_sizes_.reserve(out_features_vec.size());
     const auto world_size = parallel_args.world_size();
@@ -43,14 +44,16 @@ FusedColumnParallelLinearImpl::FusedColumnParallelLinearImpl(
   } else {
     // non-fused linear layers
     parallel_linears_.reserve(out_features_vec.size());
-    for (const auto& out_features : out_features_vec) {
-      parallel_linears_.emplace_back(in_features,
-                                     out_features,
-                                     bias,
-                                     gather_output,
-                                     quant_args,
-                                     parallel_args,
-                                     options);
+    for (size_t i = 0; i < out_features_vec.size(); ++i) {
+      parallel_linears_.push_back(
+          register_module("parallel_linear_" + std::to_string(i),
+                          ColumnParallelLinear(in_features,
+                                               out_features_vec[i],
+                                               bias,
+                                               gather_output,
+                                               quant_args,
+                                               parallel_args,
+                                               options)));
     }
   }
 }
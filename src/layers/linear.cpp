@@ -7,8 +7,10 @@
 #include <memory>
 
 #include "linear_impl.h"
+#include "linear_int8_impl.h"
 #include "quantization/qlinear_awq_impl.h"
 #include "quantization/qlinear_awq_marlin_impl.h"
+#include "quantization/qlinear_cpu_impl.h"
 #include "quantization/qlinear_exllamav2_impl.h"
 #include "quantization/qlinear_gptq_impl.h"
 #include "quantization/qlinear_gptq_marlin_impl.h"
@@ -18,6 +20,11 @@ DEFINE_string(
     "auto",
     "type of qlinear gptq impl: slow, cuda, exllamav2, marlin or auto");
 
+DEFINE_string(linear_weight_only_quant,
+              "",
+              "quantize weights of unquantized linear layers on cpu while "
+              "loading: int8 or empty to disable");
+
 namespace llm {
 namespace {
 #define MAKE_ROW_PARALLEL_QLINEAR(QLinearlImplClass)         \
@@ -127,6 +134,10 @@ std::shared_ptr<ParallelLinearImpl> create_column_parallel_qlinear(
                                                             options)) {
     return qlinear;
   }
+  if (options.device().is_cpu()) {
+    // native int4 gemm for both gptq and awq on cpu
+    return MAKE_COLUMN_PARALLEL_QLINEAR(ColumnParallelQLinearCpuImpl);
+  }
   if (boost::iequals(quant_args.quant_method(), "gptq")) {
     // default to use marlin implementation for gptq
     return MAKE_COLUMN_PARALLEL_QLINEAR(ColumnParallelQLinearGPTQMarlinImpl);
@@ -158,6 +169,10 @@ std::shared_ptr<ParallelLinearImpl> create_row_parallel_qlinear(
                                                          options)) {
     return qlinear;
   }
+  if (options.device().is_cpu()) {
+    // native int4 gemm for both gptq and awq on cpu
+    return MAKE_ROW_PARALLEL_QLINEAR(RowParallelQLinearCpuImpl);
+  }
   if (boost::iequals(quant_args.quant_method(), "gptq")) {
     // default to use marlin implementation for gptq
     return MAKE_ROW_PARALLEL_QLINEAR(RowParallelQLinearGPTQMarlinImpl);
@@ -189,6 +204,10 @@ std::shared_ptr<ParallelLinearImpl> create_column_parallel_linear(
                                           parallel_args,
                                           options);
   }
+  if (options.device().is_cpu() &&
+      boost::iequals(FLAGS_linear_weight_only_quant, "int8")) {
+    return MAKE_COLUMN_PARALLEL_LINEAR(ColumnParallelLinearInt8Impl);
+  }
   return MAKE_COLUMN_PARALLEL_LINEAR(ColumnParallelLinearImpl);
 }
 
@@ -209,6 +228,10 @@ std::shared_ptr<ParallelLinearImpl> create_row_parallel_linear(
                                        parallel_args,
                                        options);
   }
+  if (options.device().is_cpu() &&
+      boost::iequals(FLAGS_linear_weight_only_quant, "int8")) {
+    return MAKE_ROW_PARALLEL_LINEAR(RowParallelLinearInt8Impl);
+  }
   return MAKE_ROW_PARALLEL_LINEAR(RowParallelLinearImpl);
 }
 }  // namespace
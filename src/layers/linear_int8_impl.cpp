@@ -0,0 +1,221 @@
+#include "linear_int8_impl.h"
+
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include "model_loader/state_dict.h"
+#include "model_parallel/model_parallel.h"
+
+namespace llm {
+namespace detail {
+
+std::tuple<torch::Tensor, torch::Tensor> quantize_per_channel_int8(
+    const torch::Tensor& weight) {
+  CHECK_EQ(weight.dim(), 2) << "weight must be a 2D tensor";
+  const auto w = weight.to(torch::kFloat);
+  // [out_features, 1]
+  const auto scales =
+      w.abs().amax(/*dim=*/1, /*keepdim=*/true).clamp_min(1e-8) / 127.0;
+  const auto qweight =
+      torch::round(w / scales).clamp(-127, 127).to(torch::kInt8);
+  return {qweight, scales.squeeze(1)};
+}
+
+torch::Tensor int8_weight_only_linear(const torch::Tensor& input,
+                                      const torch::Tensor& qweight,
+                                      const torch::Tensor& scales) {
+  const int64_t in_features = qweight.size(1);
+  const int64_t out_features = qweight.size(0);
+  auto output_shape = input.sizes().vec();
+  output_shape.back() = out_features;
+
+  // [n_tokens, in_features]
+  const auto x = input.reshape({-1, in_features}).contiguous();
+  torch::Tensor output;
+  if (input.is_cpu()) {
+    // dequantize on the fly within the kernel, accumulate in float32
+    output = at::_weight_int8pack_mm(x, qweight, scales);
+  } else {
+    // slow path: dequantize the whole weight
+    const auto weight =
+        qweight.to(torch::kFloat) * scales.to(torch::kFloat).unsqueeze(1);
+    output = torch::matmul(x.to(torch::kFloat), weight.t()).type_as(input);
+  }
+  return output.view(output_shape);
+}
+
+}  // namespace detail
+
+ColumnParallelLinearInt8Impl::ColumnParallelLinearInt8Impl(
+    int64_t in_features,
+    int64_t out_features,
+    bool bias,
+    bool gather_output,
+    const ParallelArgs& parallel_args,
+    const torch::TensorOptions& options)
+    : gather_output_(gather_output),
+      parallel_args_(parallel_args),
+      options_(options) {
+  const auto world_size = parallel_args_.world_size();
+  CHECK(out_features % world_size == 0)
+      << "out_features " << out_features << " not divisible by world_size "
+      << world_size;
+  const int64_t out_features_per_partition = out_features / world_size;
+
+  qweight_ = register_buffer(
+      "qweight",
+      torch::empty({out_features_per_partition, in_features},
+                   options.dtype(torch::kInt8)));
+  scales_ = register_buffer(
+      "scales", torch::empty({out_features_per_partition}, options));
+
+  if (bias) {
+    bias_ =
+        register_parameter("bias",
+                           torch::empty({out_features_per_partition}, options),
+                           /*requires_grad=*/false);
+  }
+}
+
+torch::Tensor ColumnParallelLinearInt8Impl::forward(torch::Tensor input) {
+  auto output = detail::int8_weight_only_linear(input, qweight_, scales_);
+  if (bias_.defined()) {
+    output.add_(bias_);
+  }
+  if (parallel_args_.world_size() > 1 && gather_output_) {
+    output = gather_from_model_parallel_region(output, parallel_args_);
+  }
+  return output;
+}
+
+void ColumnParallelLinearInt8Impl::prepare_weight() {
+  weight_ = torch::empty(qweight_.sizes(), options_);
+}
+
+void ColumnParallelLinearInt8Impl::quantize_weight() {
+  if (weight_is_loaded_) {
+    auto [qweight, scales] = detail::quantize_per_channel_int8(weight_);
+    qweight_.copy_(qweight);
+    scales_.copy_(scales);
+  }
+  // release the float weight
+  weight_ = torch::Tensor();
+}
+
+// load the weight from the checkpoint
+void ColumnParallelLinearInt8Impl::load_state_dict(
+    const StateDict& state_dict) {
+  // call load_state_dict with identity transform
+  load_state_dict(state_dict,
+                  [](const torch::Tensor& tensor) { return tensor; });
+}
+
+void ColumnParallelLinearInt8Impl::load_state_dict(
+    const StateDict& state_dict,
+    TensorTransform transform_func) {
+  CHECK(transform_func != nullptr) << "transform_func must be provided";
+  const auto rank = parallel_args_.rank();
+  const auto world_size = parallel_args_.world_size();
+
+  if (!weight_is_loaded_) {
+    prepare_weight();
+    // load sharded weights on dim 0
+    LOAD_SHARDED_WEIGHT_WITH_TRANSFORM(weight, 0);
+    quantize_weight();
+  }
+
+  if (bias_.defined()) {
+    // load sharded bias on dim 0
+    LOAD_SHARDED_WEIGHT_WITH_TRANSFORM(bias, 0);
+  }
+}
+
+// special load_state_dict for fused cases
+void ColumnParallelLinearInt8Impl::load_state_dict(
+    const StateDict& state_dict,
+    const std::vector<std::string>& prefixes) {
+  const auto rank = parallel_args_.rank();
+  const auto world_size = parallel_args_.world_size();
+
+  if (!weight_is_loaded_) {
+    prepare_weight();
+    // load and merge the weights on dim 0
+    LOAD_FUSED_WEIGHT(weight, 0);
+    quantize_weight();
+  }
+
+  if (bias_.defined()) {
+    // load and merge the bias on dim 0
+    LOAD_FUSED_WEIGHT(bias, 0);
+  }
+}
+
+RowParallelLinearInt8Impl::RowParallelLinearInt8Impl(
+    int64_t in_features,
+    int64_t out_features,
+    bool bias,
+    bool input_is_parallelized,
+    const ParallelArgs& parallel_args,
+    const torch::TensorOptions& options)
+    : input_is_parallelized_(input_is_parallelized),
+      parallel_args_(parallel_args),
+      options_(options) {
+  const auto world_size = parallel_args_.world_size();
+  CHECK(in_features % world_size == 0)
+      << "in_features " << in_features << " not divisible by world_size "
+      << world_size;
+  const int64_t in_features_per_partition = in_features / world_size;
+
+  qweight_ = register_buffer(
+      "qweight",
+      torch::empty({out_features, in_features_per_partition},
+                   options.dtype(torch::kInt8)));
+  scales_ = register_buffer("scales", torch::empty({out_features}, options));
+
+  if (bias) {
+    bias_ = register_parameter("bias",
+                               torch::empty({out_features}, options),
+                               /*requires_grad=*/false);
+  }
+}
+
+torch::Tensor RowParallelLinearInt8Impl::forward(torch::Tensor input) {
+  if (!input_is_parallelized_) {
+    input = scatter_to_model_parallel_region(input, parallel_args_);
+  }
+  auto output = detail::int8_weight_only_linear(input, qweight_, scales_);
+  if (parallel_args_.world_size() > 1) {
+    output = reduce_from_model_parallel_region(output, parallel_args_);
+  }
+  // N.B. need to apply bias after the reduce
+  if (bias_.defined()) {
+    output.add_(bias_);
+  }
+  return output;
+}
+
+// load the weight from the checkpoint
+void RowParallelLinearInt8Impl::load_state_dict(const StateDict& state_dict) {
+  const auto rank = parallel_args_.rank();
+  const auto world_size = parallel_args_.world_size();
+
+  if (!weight_is_loaded_) {
+    // the float weight only lives during the call
+    weight_ = torch::empty(qweight_.sizes(), options_);
+    // load sharded weights on dim 1
+    LOAD_SHARDED_WEIGHT(weight, 1);
+    if (weight_is_loaded_) {
+      auto [qweight, scales] = detail::quantize_per_channel_int8(weight_);
+      qweight_.copy_(qweight);
+      scales_.copy_(scales);
+    }
+    // release the float weight
+    weight_ = torch::Tensor();
+  }
+
+  if (bias_.defined()) {
+    LOAD_WEIGHT(bias);
+  }
+}
+
+}  // namespace llm
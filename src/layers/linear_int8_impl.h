@@ -0,0 +1,153 @@
+#pragma once
+
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <tuple>
+
+#include "linear.h"
+#include "model_loader/state_dict.h"
+#include "weight_utils.h"
+
+namespace llm {
+namespace detail {
+
+// symmetric per output channel quantization: weight = qweight * scales
+// weight: [out_features, in_features]
+// returns qweight: int8 [out_features, in_features]
+//         scales: float [out_features]
+std::tuple<torch::Tensor, torch::Tensor> quantize_per_channel_int8(
+    const torch::Tensor& weight);
+
+// Y = X (qweight * scales)^T, accumulated in float32.
+// input: [..., in_features]
+// qweight: int8 [out_features, in_features]
+// scales: [out_features] with the same dtype as input
+torch::Tensor int8_weight_only_linear(const torch::Tensor& input,
+                                      const torch::Tensor& qweight,
+                                      const torch::Tensor& scales);
+
+}  // namespace detail
+
+// Linear layer with column parallelism and int8 weight-only quantization.
+// The float weights are loaded from the checkpoint as usual, quantized per
+// output channel once fully loaded and then released, the activations stay in
+// the original dtype.
+class ColumnParallelLinearInt8Impl : public ParallelLinearImpl {
+ public:
+  ColumnParallelLinearInt8Impl(int64_t in_features,
+                               int64_t out_features,
+                               bool bias,
+                               bool gather_output,
+                               const ParallelArgs& parallel_args,
+                               const torch::TensorOptions& options);
+
+  torch::Tensor forward(torch::Tensor input) override;
+
+  // load the weight from the checkpoint
+  void load_state_dict(const StateDict& state_dict) override;
+
+  // load state dict with a transform function
+  void load_state_dict(const StateDict& state_dict,
+                       TensorTransform transform_func) override;
+
+  // special load_state_dict for fused cases
+  void load_state_dict(const StateDict& state_dict,
+                       const std::vector<std::string>& prefixes) override;
+
+  // whether the weight is loaded
+  void verify_loaded_weights(const std::string& prefix) const override {
+    CHECK(weight_is_loaded_)
+        << "weight is not loaded for " << prefix + "weight";
+    CHECK(!bias_.defined() || bias_is_loaded_)
+        << "bias is not loaded for " << prefix + "bias";
+  }
+
+  void pretty_print(std::ostream& stream) const override {
+    stream << name() << " " << qweight_.sizes() << " " << qweight_.device();
+  }
+
+  // return the quantized weight and scales (for testing)
+  torch::Tensor qweight() const { return qweight_; }
+  torch::Tensor scales() const { return scales_; }
+
+ private:
+  // allocate the float weight for loading, it only lives during the call to
+  // avoid holding float weights for all layers at the same time
+  void prepare_weight();
+
+  // quantize the float weight if fully loaded and release it
+  void quantize_weight();
+
+  // buffer members, must be registered
+  // qweight: [out_features_per_partition, in_features]
+  torch::Tensor qweight_;
+  // scales: [out_features_per_partition]
+  torch::Tensor scales_;
+
+  // float weight used for loading only, partial weights of fused cases are
+  // accumulated in weight_list_
+  DEFINE_FUSED_WEIGHT(weight);
+  DEFINE_FUSED_WEIGHT(bias);
+
+  // whether to gather the output
+  bool gather_output_;
+
+  // parallel args
+  ParallelArgs parallel_args_;
+
+  // options for the float weight
+  torch::TensorOptions options_;
+};
+
+// Linear layer with row parallelism and int8 weight-only quantization.
+class RowParallelLinearInt8Impl : public ParallelLinearImpl {
+ public:
+  RowParallelLinearInt8Impl(int64_t in_features,
+                            int64_t out_features,
+                            bool bias,
+                            bool input_is_parallelized,
+                            const ParallelArgs& parallel_args,
+                            const torch::TensorOptions& options);
+
+  torch::Tensor forward(torch::Tensor input) override;
+
+  // load the weight from the checkpoint
+  void load_state_dict(const StateDict& state_dict) override;
+
+  // whether the weight is loaded
+  void verify_loaded_weights(const std::string& prefix = "") const override {
+    CHECK(weight_is_loaded_)
+        << "weight is not loaded for " << prefix + "weight";
+    CHECK(!bias_.defined() || bias_is_loaded_)
+        << "bias is not loaded for " << prefix + "bias";
+  }
+
+  void pretty_print(std::ostream& stream) const override {
+    stream << name() << " " << qweight_.sizes() << " " << qweight_.device();
+  }
+
+  // return the quantized weight and scales (for testing)
+  torch::Tensor qweight() const { return qweight_; }
+  torch::Tensor scales() const { return scales_; }
+
+ private:
+  // qweight: [out_features, in_features_per_partition]
+  torch::Tensor qweight_;
+  // scales: [out_features]
+  torch::Tensor scales_;
+
+  // float weight used for loading only
+  DEFINE_WEIGHT(weight);
+  DEFINE_WEIGHT(bias);
+
+  // whether the input is already parallelized
+  bool input_is_parallelized_;
+
+  // parallel args
+  ParallelArgs parallel_args_;
+
+  // options for the float weight
+  torch::TensorOptions options_;
+};
+}  // namespace llm
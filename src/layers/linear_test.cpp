@@ -9,9 +9,17 @@
 #include <torch/csrc/distributed/c10d/ProcessGroupNCCL.hpp>
 
 #include "linear_impl.h"
+#include "linear_int8_impl.h"
 #include "model_loader/state_dict.h"
 
 namespace llm {
+namespace {
+// relative error in l2 norm against the float32 reference
+double relative_error(const torch::Tensor& output, const torch::Tensor& ref) {
+  const auto diff = (output.to(torch::kFloat) - ref).norm().item<double>();
+  return diff / ref.norm().item<double>();
+}
+}  // namespace
 
 TEST(LinearTest, RowParallelLoadWeight) {
   // test load state dict for row parallel linear
@@ -235,4 +243,107 @@ TEST(LinearTest, ColumnParallelLoadFusedWeight) {
   }
 }
 
+TEST(LinearTest, QuantizePerChannelInt8) {
+  const int64_t in_features = 64;
+  const int64_t out_features = 32;
+  const auto weight = torch::randn({out_features, in_features});
+
+  auto [qweight, scales] = detail::quantize_per_channel_int8(weight);
+  EXPECT_EQ(qweight.scalar_type(), torch::kInt8);
+  EXPECT_EQ(qweight.sizes(), weight.sizes());
+  EXPECT_EQ(scales.sizes(), torch::IntArrayRef({out_features}));
+  // the max value of each channel is mapped to 127
+  EXPECT_TRUE(torch::equal(qweight.abs().amax(/*dim=*/1).to(torch::kInt),
+                           torch::full({out_features}, 127, torch::kInt)));
+
+  // the rounding error is at most half of the scale
+  const auto dequantized = qweight.to(torch::kFloat) * scales.unsqueeze(1);
+  const auto max_error = (dequantized - weight).abs().amax(/*dim=*/1);
+  EXPECT_TRUE((max_error <= scales * 0.5 + 1e-6).all().item<bool>());
+}
+
+TEST(LinearTest, ColumnParallelInt8Accuracy) {
+  const int64_t in_features = 256;
+  const int64_t out_features = 128;
+  const int64_t num_tokens = 16;
+
+  const auto query_weight = torch::randn({out_features, in_features});
+  const auto key_weight = torch::randn({out_features, in_features});
+  // the fused weights come from two checkpoint files
+  StateDict state_dict_0({{"query.weight", query_weight}});
+  StateDict state_dict_1({{"key.weight", key_weight}});
+  const auto weight = torch::cat({query_weight, key_weight}, /*dim=*/0);
+
+  const auto input = torch::randn({num_tokens, in_features});
+  namespace F = torch::nn::functional;
+  const auto ref = F::linear(input, weight);
+
+  ParallelArgs parallel_args(0, 1, nullptr);
+  for (const auto dtype : {torch::kFloat, torch::kBFloat16}) {
+    const auto options = torch::dtype(dtype).device(torch::kCPU);
+    ColumnParallelLinearInt8Impl linear(in_features,
+                                        out_features * 2,
+                                        /*bias=*/false,
+                                        /*gather_output=*/false,
+                                        parallel_args,
+                                        options);
+    linear.load_state_dict(state_dict_0, {"query.", "key."});
+    linear.load_state_dict(state_dict_1, {"query.", "key."});
+    linear.verify_loaded_weights("");
+    // only int8 weights are kept after loading
+    EXPECT_EQ(linear.qweight().scalar_type(), torch::kInt8);
+    EXPECT_FALSE(linear.named_parameters(/*recurse=*/false).contains("weight"));
+
+    const auto output = linear.forward(input.to(dtype));
+    EXPECT_EQ(output.scalar_type(), dtype);
+    EXPECT_LT(relative_error(output, ref), 2e-2) << dtype;
+  }
+}
+
+TEST(LinearTest, RowParallelInt8Accuracy) {
+  const int64_t in_features = 256;
+  const int64_t out_features = 128;
+  const int64_t num_tokens = 16;
+
+  std::unordered_map<std::string, torch::Tensor> state_dict_data;
+  state_dict_data["weight"] = torch::randn({out_features, in_features});
+  state_dict_data["bias"] = torch::randn({out_features});
+  StateDict state_dict(state_dict_data);
+
+  // [2, num_tokens, in_features]
+  const auto input = torch::randn({2, num_tokens, in_features});
+  namespace F = torch::nn::functional;
+  const auto ref =
+      F::linear(input, state_dict_data["weight"], state_dict_data["bias"]);
+
+  ParallelArgs parallel_args(0, 1, nullptr);
+  for (const auto dtype : {torch::kFloat, torch::kBFloat16}) {
+    const auto options = torch::dtype(dtype).device(torch::kCPU);
+    RowParallelLinearInt8Impl linear(in_features,
+                                     out_features,
+                                     /*bias=*/true,
+                                     /*input_is_parallelized=*/true,
+                                     parallel_args,
+                                     options);
+    linear.load_state_dict(state_dict);
+    linear.verify_loaded_weights();
+
+    const auto output = linear.forward(input.to(dtype));
+    EXPECT_EQ(output.sizes(), ref.sizes());
+    EXPECT_LT(relative_error(output, ref), 2e-2) << dtype;
+  }
+
+  // bfloat16 without quantization, accumulated in float32
+  const auto options = torch::dtype(torch::kBFloat16).device(torch::kCPU);
+  RowParallelLinearImpl linear(in_features,
+                               out_features,
+                               /*bias=*/true,
+                               /*input_is_parallelized=*/true,
+                               parallel_args,
+                               options);
+  linear.load_state_dict(state_dict);
+  const auto output = linear.forward(input.to(torch::kBFloat16));
+  EXPECT_LT(relative_error(output, ref), 1e-2);
+}
+
 }  // namespace llm
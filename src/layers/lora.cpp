@@ -0,0 +1,158 @@
+#include "lora.h"
+
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <string>
+#include <vector>
+
+#include "model_loader/state_dict.h"
+#include "model_parallel/model_parallel.h"
+
+namespace llm {
+namespace lora {
+
+torch::Tensor bgmv(const torch::Tensor& x,
+                   const torch::Tensor& weights,
+                   const torch::Tensor& slot_ids) {
+  CHECK_EQ(x.dim(), 2);
+  CHECK_EQ(weights.dim(), 3);
+  // [n_tokens, out, in] * [n_tokens, in, 1] => [n_tokens, out, 1]
+  const auto gathered = weights.index_select(/*dim=*/0, slot_ids);
+  return torch::bmm(gathered, x.unsqueeze(/*dim=*/-1)).squeeze(/*dim=*/-1);
+}
+
+torch::Tensor sgmv(const torch::Tensor& x,
+                   const torch::Tensor& weights,
+                   const torch::Tensor& slot_ids,
+                   const std::vector<int32_t>& slots) {
+  CHECK_EQ(x.dim(), 2);
+  CHECK_EQ(weights.dim(), 3);
+  auto output = torch::zeros({x.size(0), weights.size(1)}, x.options());
+  for (const int32_t slot : slots) {
+    const auto idxes = torch::nonzero(slot_ids == slot).squeeze(/*dim=*/-1);
+    if (idxes.numel() == 0) {
+      continue;
+    }
+    // [n, in] * [in, out] => [n, out]
+    const auto y = torch::matmul(x.index_select(/*dim=*/0, idxes),
+                                 weights[slot].t());
+    output.index_copy_(/*dim=*/0, idxes, y);
+  }
+  return output;
+}
+
+}  // namespace lora
+
+LoraLinearImpl::LoraLinearImpl(int64_t in_features,
+                               const std::vector<int64_t>& out_features,
+                               bool row_parallel,
+                               int64_t max_loras,
+                               int64_t max_rank,
+                               const ParallelArgs& parallel_args,
+                               const torch::TensorOptions& options)
+    : row_parallel_(row_parallel),
+      max_rank_(max_rank),
+      parallel_args_(parallel_args) {
+  CHECK_GT(max_loras, 0) << "max_loras must be greater than 0";
+  CHECK_GT(max_rank, 0) << "max_rank must be greater than 0";
+  const int64_t world_size = parallel_args_.world_size();
+  // slot 0 is reserved for sequences without adapter
+  const int64_t n_slots = max_loras + 1;
+
+  if (row_parallel_) {
+    CHECK(in_features % world_size == 0)
+        << "in_features " << in_features << " not divisible by world_size "
+        << world_size;
+  }
+  const int64_t in_features_per_partition =
+      row_parallel_ ? in_features / world_size : in_features;
+  for (const int64_t out : out_features) {
+    if (!row_parallel_) {
+      CHECK(out % world_size == 0) << "out_features " << out
+                                   << " not divisible by world_size "
+                                   << world_size;
+    }
+    const int64_t out_features_per_partition =
+        row_parallel_ ? out : out / world_size;
+    lora_a_.push_back(torch::zeros(
+        {n_slots, max_rank, in_features_per_partition}, options));
+    lora_b_.push_back(torch::zeros(
+        {n_slots, out_features_per_partition, max_rank}, options));
+  }
+}
+
+void LoraLinearImpl::forward(const torch::Tensor& input,
+                             const std::vector<torch::Tensor>& outputs,
+                             const InputParameters& params) {
+  // no sequence in the batch uses an adapter
+  if (!params.lora_slot_ids.defined() || params.lora_slots.empty()) {
+    return;
+  }
+  CHECK_EQ(outputs.size(), lora_a_.size());
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    // [n_tokens, in] => [n_tokens, max_rank]
+    auto shrinked = matmul(input, lora_a_[i], params);
+    if (row_parallel_ && parallel_args_.world_size() > 1) {
+      // the input is sharded, reduce the low rank activations which are much
+      // smaller than the output
+      shrinked = reduce_from_model_parallel_region(shrinked, parallel_args_);
+    }
+    // [n_tokens, max_rank] => [n_tokens, out]
+    outputs[i].add_(matmul(shrinked, lora_b_[i], params));
+  }
+}
+
+torch::Tensor LoraLinearImpl::matmul(const torch::Tensor& x,
+                                     const torch::Tensor& weights,
+                                     const InputParameters& params) const {
+  // gather the weights per token for decoding, otherwise per adapter
+  if (params.q_max_seq_len == 1) {
+    return lora::bgmv(x, weights, params.lora_slot_ids);
+  }
+  return lora::sgmv(x, weights, params.lora_slot_ids, params.lora_slots);
+}
+
+void LoraLinearImpl::load_adapter(int32_t slot,
+                                  const StateDict& state_dict,
+                                  const std::vector<std::string>& prefixes,
+                                  float scaling) {
+  CHECK_EQ(prefixes.size(), lora_a_.size());
+  CHECK(slot > 0 && slot < lora_a_[0].size(0)) << "invalid lora slot " << slot;
+  torch::NoGradGuard no_grad;
+  const auto rank = parallel_args_.rank();
+  const auto world_size = parallel_args_.world_size();
+  for (size_t i = 0; i < prefixes.size(); ++i) {
+    auto a_slot = lora_a_[i][slot];
+    auto b_slot = lora_b_[i][slot];
+    a_slot.zero_();
+    b_slot.zero_();
+
+    const auto a_name = prefixes[i] + "lora_A.weight";
+    const auto b_name = prefixes[i] + "lora_B.weight";
+    // A: [rank, in_features], B: [out_features, rank]
+    const auto a = row_parallel_
+                       ? state_dict.get_sharded_tensor(
+                             a_name, /*dim=*/1, rank, world_size)
+                       : state_dict.get_tensor(a_name);
+    const auto b = row_parallel_
+                       ? state_dict.get_tensor(b_name)
+                       : state_dict.get_sharded_tensor(
+                             b_name, /*dim=*/0, rank, world_size);
+    if (!a.defined() || !b.defined()) {
+      // the projection is not adapted
+      continue;
+    }
+    const int64_t lora_rank = a.size(0);
+    CHECK_LE(lora_rank, max_rank_)
+        << "lora rank " << lora_rank << " exceeds max rank " << max_rank_;
+    CHECK_EQ(b.size(1), lora_rank) << "rank mismatch for " << b_name;
+    CHECK_EQ(a.size(1), a_slot.size(1)) << "shape mismatch for " << a_name;
+    CHECK_EQ(b.size(0), b_slot.size(0)) << "shape mismatch for " << b_name;
+    a_slot.narrow(/*dim=*/0, /*start=*/0, lora_rank).copy_(a);
+    b_slot.narrow(/*dim=*/1, /*start=*/0, lora_rank)
+        .copy_(b.to(torch::kFloat) * scaling);
+  }
+}
+
+}  // namespace llm
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <string>
+#include <vector>
+
+#include "model_loader/state_dict.h"
+#include "model_parallel/parallel_args.h"
+#include "models/parameters.h"
+
+namespace llm {
+namespace lora {
+
+// batched gather matrix-vector multiplication: y[i] = x[i] * w[slot_ids[i]]^T.
+// the weights are gathered for each token, which suits decoding batches where
+// each sequence contributes a single token.
+// returns: [n_tokens, out_features]
+torch::Tensor bgmv(const torch::Tensor& x,          // [n_tokens, in_features]
+                   const torch::Tensor& weights,    // [n_slots, out, in]
+                   const torch::Tensor& slot_ids);  // [n_tokens]
+
+// segmented gather matrix multiplication: the tokens of each slot are gathered
+// and multiplied in one gemm, which suits prefill batches where the tokens of
+// a sequence share the same adapter. tokens of other slots are left as zeros.
+// returns: [n_tokens, out_features]
+torch::Tensor sgmv(const torch::Tensor& x,          // [n_tokens, in_features]
+                   const torch::Tensor& weights,    // [n_slots, out, in]
+                   const torch::Tensor& slot_ids,   // [n_tokens]
+                   const std::vector<int32_t>& slots);
+
+}  // namespace lora
+
+// Low rank adapters of a (fused) linear layer, serving multiple adapters in
+// one batch. The weights of each adapter live in a slot, slot 0 is reserved
+// for sequences without adapter and always stays zero.
+//   y += (x * A[slot]^T) * B[slot]^T * scaling
+// The scaling is folded into B when loading the adapter.
+class LoraLinearImpl : public torch::nn::Module {
+ public:
+  // out_features holds the output size of each fused projection.
+  // column parallel layers shard B along the output dim while row parallel
+  // layers shard A along the input dim and reduce the low rank activations.
+  LoraLinearImpl(int64_t in_features,
+                 const std::vector<int64_t>& out_features,
+                 bool row_parallel,
+                 int64_t max_loras,
+                 int64_t max_rank,
+                 const ParallelArgs& parallel_args,
+                 const torch::TensorOptions& options);
+
+  // add the low rank updates to the outputs of the base layer in place
+  void forward(const torch::Tensor& input,
+               const std::vector<torch::Tensor>& outputs,
+               const InputParameters& params);
+
+  void forward(const torch::Tensor& input,
+               const torch::Tensor& output,
+               const InputParameters& params) {
+    forward(input, std::vector<torch::Tensor>{output}, params);
+  }
+
+  // load the adapter weights into the slot. prefixes are the names of the
+  // fused projections, e.g. {"q_proj.", "k_proj.", "v_proj."}. projections
+  // missing in the adapter are left as zeros.
+  void load_adapter(int32_t slot,
+                    const StateDict& state_dict,
+                    const std::vector<std::string>& prefixes,
+                    float scaling);
+
+ private:
+  torch::Tensor matmul(const torch::Tensor& x,
+                       const torch::Tensor& weights,
+                       const InputParameters& params) const;
+
+  // A: [n_slots, max_rank, in_features_per_partition] for each projection
+  std::vector<torch::Tensor> lora_a_;
+  // B: [n_slots, out_features_per_partition, max_rank] for each projection
+  std::vector<torch::Tensor> lora_b_;
+
+  bool row_parallel_ = false;
+
+  int64_t max_rank_ = 0;
+
+  // parallel args
+  ParallelArgs parallel_args_;
+};
+TORCH_MODULE(LoraLinear);
+
+}  // namespace llm
@@ -0,0 +1,173 @@
+#include "lora.h"
+
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "model_loader/state_dict.h"
+#include "models/parameters.h"
+
+namespace llm {
+namespace {
+InputParameters make_params(const std::vector<int32_t>& slot_ids,
+                            int32_t q_max_seq_len) {
+  InputParameters params;
+  params.q_max_seq_len = q_max_seq_len;
+  params.lora_slot_ids = torch::tensor(slot_ids, torch::kInt);
+  for (const int32_t slot : slot_ids) {
+    if (slot > 0 && std::find(params.lora_slots.begin(),
+                              params.lora_slots.end(),
+                              slot) == params.lora_slots.end()) {
+      params.lora_slots.push_back(slot);
+    }
+  }
+  return params;
+}
+}  // namespace
+
+TEST(LoraTest, BgmvAndSgmv) {
+  const int64_t n_slots = 4;
+  const int64_t in_features = 32;
+  const int64_t out_features = 8;
+  const std::vector<int32_t> slot_ids = {0, 2, 2, 1, 3, 0, 1};
+  const int64_t n_tokens = static_cast<int64_t>(slot_ids.size());
+
+  const auto x = torch::randn({n_tokens, in_features});
+  const auto weights = torch::randn({n_slots, out_features, in_features});
+  const auto ids = torch::tensor(slot_ids, torch::kInt);
+
+  // naive reference, one token at a time
+  auto ref = torch::empty({n_tokens, out_features});
+  for (int64_t i = 0; i < n_tokens; ++i) {
+    ref[i] = torch::matmul(weights[slot_ids[i]], x[i]);
+  }
+
+  const auto bgmv_out = lora::bgmv(x, weights, ids);
+  EXPECT_TRUE(torch::allclose(bgmv_out, ref, /*rtol=*/1e-4, /*atol=*/1e-4));
+
+  // sgmv skips slot 0 and leaves the tokens as zeros
+  const auto sgmv_out = lora::sgmv(x, weights, ids, {1, 2, 3});
+  ref.index_fill_(/*dim=*/0, torch::tensor({0, 5}), 0);
+  EXPECT_TRUE(torch::allclose(sgmv_out, ref, /*rtol=*/1e-4, /*atol=*/1e-4));
+}
+
+TEST(LoraTest, LoraLinear) {
+  const int64_t in_features = 16;
+  const std::vector<int64_t> out_features = {8, 4};
+  const int64_t max_loras = 2;
+  const int64_t max_rank = 8;
+  const auto options = torch::dtype(torch::kFloat).device(torch::kCPU);
+
+  ParallelArgs parallel_args(/*rank=*/0, /*world_size=*/1, nullptr);
+  LoraLinear lora(in_features,
+                  out_features,
+                  /*row_parallel=*/false,
+                  max_loras,
+                  max_rank,
+                  parallel_args,
+                  options);
+
+  // adapter 1 with rank 4 adapts both projections, adapter 2 with rank 8
+  // only adapts the first one
+  const std::vector<int64_t> ranks = {4, 8};
+  const std::vector<float> scalings = {2.0f, 0.5f};
+  // merged delta weights for each slot and projection
+  std::vector<std::vector<torch::Tensor>> deltas(
+      max_loras + 1,
+      {torch::zeros({out_features[0], in_features}),
+       torch::zeros({out_features[1], in_features})});
+  const std::vector<std::string> prefixes = {"q_proj.", "k_proj."};
+  for (int32_t slot = 1; slot <= max_loras; ++slot) {
+    const int64_t rank = ranks[slot - 1];
+    const size_t n_projections = slot == 1 ? 2 : 1;
+    std::unordered_map<std::string, torch::Tensor> dict;
+    for (size_t i = 0; i < n_projections; ++i) {
+      const auto a = torch::randn({rank, in_features});
+      const auto b = torch::randn({out_features[i], rank});
+      dict[prefixes[i] + "lora_A.weight"] = a;
+      dict[prefixes[i] + "lora_B.weight"] = b;
+      deltas[slot][i] = torch::matmul(b, a) * scalings[slot - 1];
+    }
+    lora->load_adapter(slot, StateDict(dict), prefixes, scalings[slot - 1]);
+  }
+
+  const std::vector<int32_t> slot_ids = {1, 0, 2, 2, 1};
+  const int64_t n_tokens = static_cast<int64_t>(slot_ids.size());
+  const auto x = torch::randn({n_tokens, in_features});
+  std::vector<torch::Tensor> refs;
+  for (size_t i = 0; i < out_features.size(); ++i) {
+    auto ref = torch::zeros({n_tokens, out_features[i]});
+    for (int64_t t = 0; t < n_tokens; ++t) {
+      ref[t] = torch::matmul(deltas[slot_ids[t]][i], x[t]);
+    }
+    refs.push_back(ref);
+  }
+
+  // both the prefill path (sgmv) and the decoding path (bgmv)
+  for (const int32_t q_max_seq_len : {1, 4}) {
+    const auto params = make_params(slot_ids, q_max_seq_len);
+    std::vector<torch::Tensor> outputs = {
+        torch::zeros({n_tokens, out_features[0]}),
+        torch::zeros({n_tokens, out_features[1]})};
+    lora->forward(x, outputs, params);
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      EXPECT_TRUE(torch::allclose(
+          outputs[i], refs[i], /*rtol=*/1e-4, /*atol=*/1e-4));
+    }
+  }
+
+  // no adapter in the batch, the outputs are untouched
+  std::vector<torch::Tensor> outputs = {
+      torch::ones({n_tokens, out_features[0]}),
+      torch::ones({n_tokens, out_features[1]})};
+  lora->forward(x, outputs, InputParameters());
+  EXPECT_TRUE(torch::equal(outputs[0], torch::ones_like(outputs[0])));
+  EXPECT_TRUE(torch::equal(outputs[1], torch::ones_like(outputs[1])));
+}
+
+TEST(LoraTest, ColumnParallelShards) {
+  const int64_t in_features = 16;
+  const int64_t out_features = 8;
+  const int64_t rank = 4;
+  const float scaling = 1.5f;
+  const auto options = torch::dtype(torch::kFloat).device(torch::kCPU);
+
+  std::unordered_map<std::string, torch::Tensor> dict;
+  const auto a = torch::randn({rank, in_features});
+  const auto b = torch::randn({out_features, rank});
+  dict["lora_A.weight"] = a;
+  dict["lora_B.weight"] = b;
+  const StateDict state_dict(dict);
+
+  const std::vector<int32_t> slot_ids = {1, 0, 1};
+  const auto x = torch::randn({3, in_features});
+  const auto params = make_params(slot_ids, /*q_max_seq_len=*/1);
+  auto ref = torch::matmul(x, (torch::matmul(b, a) * scaling).t());
+  ref[1].zero_();
+
+  // each shard computes a slice of the output features
+  const int32_t num_shards = 2;
+  std::vector<torch::Tensor> shard_outputs;
+  for (int32_t shard_id = 0; shard_id < num_shards; ++shard_id) {
+    ParallelArgs parallel_args(shard_id, num_shards, nullptr);
+    LoraLinear lora(in_features,
+                    std::vector<int64_t>{out_features},
+                    /*row_parallel=*/false,
+                    /*max_loras=*/1,
+                    /*max_rank=*/rank,
+                    parallel_args,
+                    options);
+    lora->load_adapter(/*slot=*/1, state_dict, {""}, scaling);
+    auto output = torch::zeros({3, out_features / num_shards});
+    lora->forward(x, output, params);
+    shard_outputs.push_back(output);
+  }
+  EXPECT_TRUE(torch::allclose(
+      torch::cat(shard_outputs, /*dim=*/1), ref, /*rtol=*/1e-4, /*atol=*/1e-4));
+}
+
+}  // namespace llm
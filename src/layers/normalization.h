@@ -55,7 +55,18 @@ inline torch::Tensor layer_norm(torch::Tensor input,
                                 const torch::Tensor& bias,
                                 double eps) {
   namespace F = torch::nn::functional;
-  return F::detail::layer_norm(input, normalized_shape, weight, bias, eps);
+  if (input.scalar_type() == torch::kFloat) {
+    return F::detail::layer_norm(input, normalized_shape, weight, bias, eps);
+  }
+  // it is important to use float to calculate the mean and std
+  const auto output =
+      F::detail::layer_norm(input.to(torch::kFloat),
+                            normalized_shape,
+                            weight.to(torch::kFloat),
+                            bias.defined() ? bias.to(torch::kFloat) : bias,
+                            eps);
+  // convert back to the original dtype
+  return output.type_as(input);
 }
 
 }  // namespace detail
@@ -89,9 +100,7 @@ class LayerNormImpl : public torch::nn::Module {
       kernel::layer_norm(output, input, weight_, bias_, eps_);
       return output;
     }
-    namespace F = torch::nn::functional;
-    return F::detail::layer_norm(
-        input, normalized_shape_, weight_, bias_, eps_);
+    return detail::layer_norm(input, normalized_shape_, weight_, bias_, eps_);
   }
 
   // load the weight from the checkpoint
@@ -36,6 +36,31 @@ TEST(NormalizationTest, LayerNorm) {
   EXPECT_TRUE(torch::allclose(output, desired_output));
 }
 
+TEST(NormalizationTest, LayerNormBFloat16) {
+  const auto options = torch::dtype(torch::kBFloat16).device(torch::kCPU);
+
+  const int64_t dim = 1038;
+  const float eps = 1e-5;
+
+  const auto weight = torch::rand({dim});
+  const auto bias = torch::rand({dim});
+  StateDict state_dict({{"weight", weight}, {"bias", bias}});
+
+  LayerNorm norm(dim, eps, /*bias=*/true, options);
+  norm->load_state_dict(state_dict);
+
+  const auto input = torch::randn({100, dim});
+  auto output = norm(input.to(torch::kBFloat16));
+  EXPECT_EQ(output.scalar_type(), torch::kBFloat16);
+
+  // use float result as baseline
+  auto desired_output = detail::layer_norm(input, {dim}, weight, bias, eps);
+  EXPECT_TRUE(torch::allclose(output.to(torch::kFloat),
+                              desired_output,
+                              /*rtol=*/2e-02,
+                              /*atol=*/1e-02));
+}
+
 TEST(NormalizationTest, LayerNormKernel) {
   if (!torch::cuda::is_available()) {
     GTEST_SKIP() << "CUDA not available, skipping test";
@@ -101,6 +126,30 @@ TEST(NormalizationTest, RMSNorm) {
   EXPECT_TRUE(torch::allclose(output, desired_output));
 }
 
+TEST(NormalizationTest, RMSNormBFloat16) {
+  const auto options = torch::dtype(torch::kBFloat16).device(torch::kCPU);
+
+  const int64_t dim = 1038;
+  const float eps = 1e-5;
+
+  const auto weight = torch::rand({dim});
+  StateDict state_dict({{"weight", weight}});
+
+  RMSNorm norm(dim, eps, options);
+  norm->load_state_dict(state_dict);
+
+  const auto input = torch::randn({100, dim});
+  auto output = norm(input.to(torch::kBFloat16));
+  EXPECT_EQ(output.scalar_type(), torch::kBFloat16);
+
+  // use float result as baseline
+  auto desired_output = detail::rms_norm(input, weight, eps);
+  EXPECT_TRUE(torch::allclose(output.to(torch::kFloat),
+                              desired_output,
+                              /*rtol=*/2e-02,
+                              /*atol=*/1e-02));
+}
+
 TEST(NormalizationTest, RMSNormKernel) {
   if (!torch::cuda::is_available()) {
     GTEST_SKIP() << "CUDA not available, skipping test";
@@ -155,7 +155,11 @@ RotaryEmbeddingGeneric::RotaryEmbeddingGeneric(
   }
 
   const auto cos_sin = torch::cat({emd.cos(), emd.sin()}, /*dim=*/-1);
-  cos_sin_cache_ = register_buffer("cos_sin_cache", cos_sin.to(options));
+  // keep the cache in float32 on cpu to compute the rotation in float32 for
+  // low precision inputs
+  const auto cache_options =
+      options.device().is_cpu() ? options.dtype(torch::kFloat32) : options;
+  cos_sin_cache_ = register_buffer("cos_sin_cache", cos_sin.to(cache_options));
 }
 
 // inplace rotary positional embedding
@@ -174,8 +178,16 @@ std::tuple<torch::Tensor, torch::Tensor> RotaryEmbeddingGeneric::forward(
   auto cos_sin = F::embedding(positions, cos_sin_cache_);
   // add a new dimension for n_heads
   cos_sin = cos_sin.unsqueeze(1);
-  std::tie(query_rotary, key_rotary) = detail::apply_rotary_pos_emb(
-      query_rotary, key_rotary, cos_sin, interleaved_);
+  // no-op unless the cache is kept in higher precision than the inputs
+  const auto compute_dtype = cos_sin_cache_.scalar_type();
+  std::tie(query_rotary, key_rotary) =
+      detail::apply_rotary_pos_emb(query_rotary.to(compute_dtype),
+                                   key_rotary.to(compute_dtype),
+                                   cos_sin,
+                                   interleaved_);
+  // convert back to the original dtype
+  query_rotary = query_rotary.type_as(query);
+  key_rotary = key_rotary.type_as(key);
   return std::make_tuple(torch::cat({query_rotary, query_pass}, /*dim=*/-1),
                          torch::cat({key_rotary, key_pass}, /*dim=*/-1));
 }
@@ -214,6 +214,48 @@ INSTANTIATE_TEST_SUITE_P(
         ::testing::Values(4096, 8192)  // max_position_embeddings
         ));
 
+TEST(RotaryEmbeddingTest, BFloat16OnCpu) {
+  const int64_t num_tokens = 16;
+  const int64_t n_heads = 8;
+  const int64_t head_dim = 128;
+  const int64_t max_position_embeddings = 8192;
+  const float theta = 500000.0f;
+  const auto options = torch::dtype(torch::kBFloat16).device(torch::kCPU);
+
+  const auto query = torch::rand({num_tokens, n_heads, head_dim}, options);
+  const auto key = torch::rand({num_tokens, n_heads, head_dim}, options);
+  const auto positions = torch::randint(
+      0, max_position_embeddings, {num_tokens}, options.dtype(torch::kInt));
+
+  const auto inv_freq = detail::compute_default_inv_freq(head_dim, theta);
+  for (const bool interleaved : {false, true}) {
+    RotaryEmbeddingGeneric rotary_embedding(
+        head_dim, max_position_embeddings, inv_freq, interleaved, options);
+    const auto [query_output, key_output] =
+        rotary_embedding.forward(query, key, positions);
+    EXPECT_EQ(query_output.scalar_type(), torch::kBFloat16);
+    EXPECT_EQ(key_output.scalar_type(), torch::kBFloat16);
+
+    // the float32 reference with the same bfloat16 inputs
+    auto [query_ref, key_ref] = apply_rotary_emb_ref(query.to(torch::kFloat),
+                                                     key.to(torch::kFloat),
+                                                     positions,
+                                                     head_dim,
+                                                     max_position_embeddings,
+                                                     theta,
+                                                     interleaved);
+    // only rounding of the output to bfloat16 is allowed
+    EXPECT_TRUE(torch::allclose(query_output.to(torch::kFloat),
+                                query_ref,
+                                /*rtol=*/1e-02,
+                                /*atol=*/1e-02));
+    EXPECT_TRUE(torch::allclose(key_output.to(torch::kFloat),
+                                key_ref,
+                                /*rtol=*/1e-02,
+                                /*atol=*/1e-02));
+  }
+}
+
 class PosEmbeddingKernelTest
     : public ::testing::TestWithParam<
           std::tuple<torch::Device,
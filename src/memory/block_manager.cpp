@@ -4,6 +4,8 @@
 
 #include <cstdint>
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "block_allocator.h"
@@ -26,6 +28,10 @@ DEFINE_COUNTER_INSTANCE(prefix_cache_evict_latency_seconds,
 
 DEFINE_COUNTER(prefix_cache_match_length_total,
                "Length of matched prefix in tokens");
+DEFINE_HISTOGRAM(
+    prefix_cache_hit_ratio,
+    "Histogram of the ratio of prompt tokens served from the prefix cache",
+    std::vector<double>{0.0, 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9});
 
 DEFINE_COUNTER(allocate_blocks_latency_seconds,
                "Latency of blocks allocation in seconds");
@@ -35,7 +41,8 @@ namespace llm {
 BlockManager::BlockManager(const Options& options)
     : options_(options),
       block_allocator_(options.num_blocks(), options.block_size()),
-      prefix_cache_(options.block_size()) {
+      prefix_cache_(options.block_size(),
+                    options.prefix_cache_eviction_policy()) {
   // reserve block 0 for padding
   padding_block_ = block_allocator_.allocate();
   CHECK_EQ(padding_block_.id(), 0) << "Padding block id should be 0";
@@ -52,6 +59,7 @@ bool BlockManager::allocate_blocks_for(Sequence* sequence, size_t num_tokens) {
   DCHECK(sequence != nullptr);
   // first try to allocate shared blocks
   if (sequence->num_blocks() == 0) {
+    sequence->set_cache_epoch(cache_epoch_);
     allocate_shared_blocks_for(sequence);
   }
 
@@ -104,8 +112,20 @@ void BlockManager::release_blocks_for(std::vector<Sequence*>& sequences) {
 void BlockManager::release_blocks_for(Sequence* sequence) {
   DCHECK(sequence != nullptr);
 
-  // add blocks to the prefix cache
-  cache_blocks_for(sequence);
+  if (is_stale(sequence)) {
+    // the blocks are freed without caching them
+    for (const auto& block : sequence->blocks()) {
+      // the block is not shared by other sequence
+      if (block.ref_count() <= 1) {
+        --num_blocks_in_use_;
+      }
+    }
+    // the blocks allocated from now on belong to the current epoch
+    sequence->set_cache_epoch(cache_epoch_);
+  } else {
+    // add blocks to the prefix cache
+    cache_blocks_for(sequence);
+  }
 
   // release the blocks after prefix cache insertion
   sequence->release_blocks();
@@ -148,12 +168,18 @@ void BlockManager::allocate_shared_blocks_for(Sequence* sequence) {
     AUTO_COUNTER(prefix_cache_match_latency_seconds);
 
     const auto tokens_ids = sequence->token_ids();
-    std::vector<Block> shared_blocks = prefix_cache_.match(tokens_ids);
+    std::vector<Block> shared_blocks =
+        prefix_cache_.match(tokens_ids, sequence->lora_adapter());
 
     const size_t prefix_length =
         shared_blocks.empty() ? 0
                               : shared_blocks.size() * shared_blocks[0].size();
     COUNTER_ADD(prefix_cache_match_length_total, prefix_length);
+    if (sequence->record_cached_tokens(prefix_length)) {
+      HISTOGRAM_OBSERVE(prefix_cache_hit_ratio,
+                        static_cast<double>(sequence->num_cached_tokens()) /
+                            sequence->num_prompt_tokens());
+    }
 
     // update effective block usage
     for (const auto& block : shared_blocks) {
@@ -167,6 +193,10 @@ void BlockManager::allocate_shared_blocks_for(Sequence* sequence) {
 }
 
 void BlockManager::cache_blocks_for(Sequence* sequence) {
+  if (is_stale(sequence)) {
+    // the kv cache can't be shared, the blocks stay in use by the sequence
+    return;
+  }
   if (options_.enable_prefix_cache()) {
     AUTO_COUNTER(prefix_cache_insert_latency_seconds);
 
@@ -174,7 +204,7 @@ void BlockManager::cache_blocks_for(Sequence* sequence) {
     const auto tokens_ids = sequence->tokens_in_kv_cache();
     const auto blocks = sequence->blocks();
     // Add the kv cache to the prefix cache
-    prefix_cache_.insert(tokens_ids, blocks);
+    prefix_cache_.insert(tokens_ids, blocks, sequence->lora_adapter());
 
     // update effective block usage
     for (const auto& block : sequence->blocks()) {
@@ -188,4 +218,60 @@ void BlockManager::cache_blocks_for(Sequence* sequence) {
   }
 }
 
+size_t BlockManager::num_cached_tokens(const Sequence* sequence) const {
+  if (!options_.enable_prefix_cache()) {
+    return 0;
+  }
+  return prefix_cache_.probe(sequence->token_ids(), sequence->lora_adapter());
+}
+
+void BlockManager::clear_prefix_cache() {
+  prefix_cache_.clear();
+  ++cache_epoch_;
+}
+
+std::vector<std::pair<int32_t, int32_t>> BlockManager::restore_prefix_cache(
+    const std::vector<PrefixCacheSnapshot::Entry>& entries) {
+  std::vector<std::pair<int32_t, int32_t>> block_mapping;
+  if (!options_.enable_prefix_cache()) {
+    return block_mapping;
+  }
+
+  const size_t block_size = options_.block_size();
+  // saved block id -> allocated block, shared by the entries
+  std::unordered_map<int32_t, Block> blocks;
+  std::vector<PrefixCache::Entry> restored;
+  for (const auto& entry : entries) {
+    PrefixCache::Entry restored_entry;
+    restored_entry.key = entry.key;
+    for (const int32_t saved_id : entry.block_ids) {
+      auto it = blocks.find(saved_id);
+      if (it == blocks.end()) {
+        if (block_allocator_.num_free_blocks() == 0) {
+          // keep the prefix that fits
+          break;
+        }
+        it = blocks.emplace(saved_id, block_allocator_.allocate()).first;
+        block_mapping.emplace_back(saved_id, it->second.id());
+      }
+      restored_entry.blocks.push_back(it->second);
+    }
+    if (restored_entry.blocks.empty()) {
+      continue;
+    }
+    const size_t n_tokens = restored_entry.blocks.size() * block_size;
+    CHECK_LE(n_tokens, entry.token_ids.size());
+    restored_entry.token_ids.assign(entry.token_ids.begin(),
+                                    entry.token_ids.begin() + n_tokens);
+    restored.push_back(std::move(restored_entry));
+  }
+
+  // insert the least recently used first to keep the order of the LRU list
+  for (auto it = restored.rbegin(); it != restored.rend(); ++it) {
+    prefix_cache_.insert(it->token_ids, it->blocks, it->key);
+  }
+  // the blocks are only held by the prefix cache from now on
+  return block_mapping;
+}
+
 }  // namespace llm
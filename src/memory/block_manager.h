@@ -1,12 +1,15 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "block_allocator.h"
 #include "common/macros.h"
 #include "memory/block.h"
 #include "prefix_cache.h"
+#include "prefix_cache_snapshot.h"
 #include "request/request.h"
 #include "request/sequence.h"
 
@@ -20,6 +23,9 @@ class BlockManager final {
     DEFINE_ARG(int32_t, block_size) = 0;
 
     DEFINE_ARG(bool, enable_prefix_cache) = true;
+
+    // the eviction policy of the prefix cache: lru, lfu or gdsf
+    DEFINE_ARG(std::string, prefix_cache_eviction_policy) = "lru";
   };
 
   BlockManager(const Options& options);
@@ -40,9 +46,30 @@ class BlockManager final {
   // try to share blocks among sequences with the same prefix
   void allocate_shared_blocks_for(Sequence* sequence);
 
-  // cache the blocks for the sequence
+  // cache the blocks for the sequence, skipped if the kv cache is stale
   void cache_blocks_for(Sequence* sequence);
 
+  // get the number of tokens of the sequence found in the prefix cache,
+  // without touching the prefix cache. 0 if the prefix cache is disabled.
+  size_t num_cached_tokens(const Sequence* sequence) const;
+
+  // drop all blocks in the prefix cache, e.g. after the model weights are
+  // switched. blocks of running sequences are not cached once released.
+  void clear_prefix_cache();
+
+  // get the sequences in the prefix cache, the most recently used first
+  std::vector<PrefixCache::Entry> prefix_cache_entries() const {
+    return prefix_cache_.entries();
+  }
+
+  // insert the saved sequences into the prefix cache with newly allocated
+  // blocks, the most recently used first until running out of free blocks.
+  // returns the mapping from the saved block ids to the allocated ones:
+  // [(saved block id, allocated block id)], the kv cache of the allocated
+  // blocks should be restored by the caller.
+  std::vector<std::pair<int32_t, int32_t>> restore_prefix_cache(
+      const std::vector<PrefixCacheSnapshot::Entry>& entries);
+
   // get the options for the block manager
   const Options& options() const { return options_; }
 
@@ -68,6 +95,13 @@ class BlockManager final {
   // from the prefix cache
   bool has_enough_blocks(uint32_t num_blocks);
 
+  // whether the kv cache of the sequence was computed before the last clear
+  // of the prefix cache, which can't be shared anymore
+  bool is_stale(const Sequence* sequence) const {
+    return options_.enable_prefix_cache() &&
+           sequence->cache_epoch() != cache_epoch_;
+  }
+
   // the options for the block manager
   Options options_;
 
@@ -82,6 +116,9 @@ class BlockManager final {
 
   // number of blocks in use
   size_t num_blocks_in_use_ = 0;
+
+  // bumped on each clear of the prefix cache
+  uint64_t cache_epoch_ = 0;
 };
 
 }  // namespace llm
@@ -12,4 +12,109 @@ TEST(BlockManagerTest, Basic) {
   // TODO: add more tests
 }
 
+TEST(BlockManagerTest, ClearPrefixCache) {
+  BlockManager::Options options;
+  options.num_blocks(10).block_size(2);
+  BlockManager manager(options);
+
+  const std::vector<int32_t> prompt = {1, 2, 3, 4, 5};
+  Sequence::Options seq_options;
+
+  // cache the blocks of a finished sequence
+  Sequence seq1(prompt, /*capacity=*/16, seq_options);
+  ASSERT_TRUE(manager.allocate_blocks_for(&seq1));
+  EXPECT_EQ(seq1.num_blocks(), 3);
+  seq1.commit_kv_cache(prompt.size());
+  manager.release_blocks_for(&seq1);
+  EXPECT_EQ(manager.num_blocks_in_prefix_cache(), 2);
+  EXPECT_EQ(manager.num_blocks_in_use(), 0);
+  EXPECT_EQ(manager.num_free_blocks(), 7);
+
+  // a running sequence shares the cached blocks when the cache is cleared
+  Sequence seq2(prompt, /*capacity=*/16, seq_options);
+  ASSERT_TRUE(manager.allocate_blocks_for(&seq2));
+  EXPECT_EQ(seq2.num_kv_cache_tokens(), 4);
+  EXPECT_EQ(manager.num_blocks_in_use(), 3);
+  manager.clear_prefix_cache();
+  EXPECT_EQ(manager.num_blocks_in_prefix_cache(), 0);
+  EXPECT_EQ(manager.num_free_blocks(), 6);
+
+  // the stale blocks are released without caching
+  seq2.commit_kv_cache(1);
+  manager.release_blocks_for(&seq2);
+  EXPECT_EQ(manager.num_blocks_in_prefix_cache(), 0);
+  EXPECT_EQ(manager.num_blocks_in_use(), 0);
+  EXPECT_EQ(manager.num_free_blocks(), 9);
+
+  // sequences allocated after the clear are cached again
+  Sequence seq3(prompt, /*capacity=*/16, seq_options);
+  ASSERT_TRUE(manager.allocate_blocks_for(&seq3));
+  EXPECT_EQ(seq3.num_kv_cache_tokens(), 0);
+  seq3.commit_kv_cache(prompt.size());
+  manager.release_blocks_for(&seq3);
+  EXPECT_EQ(manager.num_blocks_in_prefix_cache(), 2);
+  EXPECT_EQ(manager.num_blocks_in_use(), 0);
+}
+
+TEST(BlockManagerTest, CacheStaleBlocks) {
+  BlockManager::Options options;
+  options.num_blocks(10).block_size(2);
+  BlockManager manager(options);
+
+  const std::vector<int32_t> prompt = {1, 2, 3, 4, 5};
+  Sequence::Options seq_options;
+  Sequence seq(prompt, /*capacity=*/16, seq_options);
+  ASSERT_TRUE(manager.allocate_blocks_for(&seq));
+  seq.commit_kv_cache(prompt.size());
+  EXPECT_EQ(manager.num_blocks_in_use(), 3);
+  manager.clear_prefix_cache();
+
+  // caching the stale blocks of a running sequence, e.g. to share the prompt
+  // with the other sequences of the request, is skipped and the blocks are
+  // counted once until they are freed
+  manager.cache_blocks_for(&seq);
+  EXPECT_EQ(manager.num_blocks_in_prefix_cache(), 0);
+  EXPECT_EQ(manager.num_blocks_in_use(), 3);
+  manager.release_blocks_for(&seq);
+  EXPECT_EQ(manager.num_blocks_in_use(), 0);
+  EXPECT_EQ(manager.num_free_blocks(), 9);
+}
+
+TEST(BlockManagerTest, CachedTokens) {
+  BlockManager::Options options;
+  options.num_blocks(10).block_size(2);
+  BlockManager manager(options);
+
+  const std::vector<int32_t> prompt = {1, 2, 3, 4, 5};
+  Sequence::Options seq_options;
+
+  Sequence seq1(prompt, /*capacity=*/16, seq_options);
+  ASSERT_TRUE(manager.allocate_blocks_for(&seq1));
+  EXPECT_EQ(seq1.num_cached_tokens(), 0);
+  seq1.commit_kv_cache(prompt.size());
+  manager.release_blocks_for(&seq1);
+
+  // the full blocks of the prompt are served from the prefix cache
+  Sequence seq2(prompt, /*capacity=*/16, seq_options);
+  EXPECT_EQ(manager.num_cached_tokens(&seq2), 4);
+  ASSERT_TRUE(manager.allocate_blocks_for(&seq2));
+  EXPECT_EQ(seq2.num_cached_tokens(), 4);
+
+  // the first match is kept when the sequence is preempted
+  seq2.commit_kv_cache(prompt.size());
+  seq2.append_token(6);
+  manager.release_blocks_for(&seq2);
+  EXPECT_EQ(manager.num_cached_tokens(&seq2), 4);
+  ASSERT_TRUE(manager.allocate_blocks_for(&seq2));
+  EXPECT_EQ(seq2.num_cached_tokens(), 4);
+  manager.release_blocks_for(&seq2);
+
+  // no tokens are cached when the prefix cache is disabled
+  options.enable_prefix_cache(false);
+  BlockManager no_cache_manager(options);
+  Sequence seq3(prompt, /*capacity=*/16, seq_options);
+  ASSERT_TRUE(no_cache_manager.allocate_blocks_for(&seq3));
+  EXPECT_EQ(seq3.num_cached_tokens(), 0);
+}
+
 }  // namespace llm
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "eviction_policy.h"
+
+#include <glog/logging.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llm {
+
+std::unique_ptr<EvictionPolicy> EvictionPolicy::create(
+    const std::string& name) {
+  if (name.empty() || name == "lru") {
+    return std::make_unique<LRUEvictionPolicy>();
+  }
+  if (name == "lfu") {
+    return std::make_unique<LFUEvictionPolicy>();
+  }
+  if (name == "gdsf") {
+    return std::make_unique<GDSFEvictionPolicy>();
+  }
+  LOG(ERROR) << "Unknown eviction policy: " << name;
+  return nullptr;
+}
+
+double LRUEvictionPolicy::priority(const NodeStats& stats,
+                                   double /*age*/) const {
+  // exact for timestamps in microseconds, less than 2^53
+  return static_cast<double>(stats.last_access_time);
+}
+
+double LFUEvictionPolicy::priority(const NodeStats& stats, double age) const {
+  return age + static_cast<double>(stats.hits);
+}
+
+double GDSFEvictionPolicy::priority(const NodeStats& stats, double age) const {
+  // cost / size = (n_tokens * depth) / n_tokens
+  return age + static_cast<double>(stats.hits * stats.depth);
+}
+
+}  // namespace llm
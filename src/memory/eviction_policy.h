@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace llm {
+
+// An eviction policy ranks the leaf nodes of the prefix cache, the leaf with
+// the lowest priority is evicted first and ties are broken in LRU order. The
+// priority of a node is computed when the node is accessed, so policies with
+// aging only need the priority of the last evicted node, the "age" of the
+// cache, instead of re-ranking all nodes on every eviction.
+class EvictionPolicy {
+ public:
+  // the access statistics of a node in the prefix tree
+  struct NodeStats {
+    // the last access time in microseconds
+    int64_t last_access_time = 0;
+
+    // the number of times the node has been used, including the insertion
+    uint64_t hits = 0;
+
+    // the number of tokens held by the node
+    size_t n_tokens = 0;
+
+    // the number of tokens from the root to the end of the node
+    size_t depth = 0;
+  };
+
+  // create a policy by name: lru, lfu or gdsf. returns nullptr for unknown
+  // policy.
+  static std::unique_ptr<EvictionPolicy> create(const std::string& name);
+
+  virtual ~EvictionPolicy() = default;
+
+  // the priority of a node on access. age is the largest priority of the
+  // evicted nodes so far.
+  virtual double priority(const NodeStats& stats, double age) const = 0;
+
+  // whether the priority follows the access order, then the LRU list of the
+  // prefix cache is already sorted by priority.
+  virtual bool in_lru_order() const { return false; }
+};
+
+// Least Recently Used: the priority is the last access time.
+class LRUEvictionPolicy final : public EvictionPolicy {
+ public:
+  double priority(const NodeStats& stats, double age) const override;
+
+  bool in_lru_order() const override { return true; }
+};
+
+// Least Frequently Used with dynamic aging (LFU-DA): the priority is the age
+// plus the number of hits. A node that was hot long ago falls behind the
+// nodes accessed since, as the age grows with every eviction.
+class LFUEvictionPolicy final : public EvictionPolicy {
+ public:
+  double priority(const NodeStats& stats, double age) const override;
+};
+
+// Greedy-Dual-Size-Frequency: the priority is the age plus the number of hits
+// times the recompute cost per token. The cost of recomputing a node is
+// approximated by its tokens times its depth, since every recomputed token
+// attends to the whole prefix, and the size is its tokens. So with the same
+// hits, the blocks deep in a long prompt outlive the ones of short prompts.
+class GDSFEvictionPolicy final : public EvictionPolicy {
+ public:
+  double priority(const NodeStats& stats, double age) const override;
+};
+
+}  // namespace llm
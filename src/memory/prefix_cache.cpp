@@ -4,7 +4,10 @@
 #include <absl/time/time.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "common/slice.h"
@@ -29,15 +32,22 @@ size_t round_down(size_t n, size_t multiple) {
 
 }  // namespace
 
-PrefixCache::PrefixCache(uint32_t block_size) : block_size_(block_size) {
+PrefixCache::PrefixCache(uint32_t block_size,
+                         const std::string& eviction_policy)
+    : block_size_(block_size),
+      eviction_policy_(EvictionPolicy::create(eviction_policy)) {
   CHECK_GT(block_size, 0) << "Block size should be greater than 0";
+  CHECK(eviction_policy_ != nullptr)
+      << "Unknown eviction policy: " << eviction_policy;
 
   // initialize the lru list
   lru_front_.next = &lru_back_;
   lru_back_.prev = &lru_front_;
 }
 
-PrefixCache::~PrefixCache() {
+PrefixCache::~PrefixCache() { clear(); }
+
+void PrefixCache::clear() {
   // iterator the lru list to release nodes
   size_t num_nodes = 0;
   Node* node = lru_front_.next;
@@ -48,13 +58,26 @@ PrefixCache::~PrefixCache() {
     ++num_nodes;
   }
   CHECK(num_nodes_ == num_nodes) << "detected memory leak";
+
+  roots_.clear();
+  leaves_.clear();
+  lru_front_.next = &lru_back_;
+  lru_back_.prev = &lru_front_;
+  num_blocks_ = 0;
+  num_nodes_ = 0;
+  age_ = 0;
 }
 
 // match the token ids with the prefix tree
 // return matched blocks
-std::vector<Block> PrefixCache::match(const Slice<int32_t>& token_ids) {
+std::vector<Block> PrefixCache::match(const Slice<int32_t>& token_ids,
+                                      const std::string& key) {
   const int64_t now = absl::ToUnixMicros(absl::Now());
   std::vector<Block> blocks;
+  auto root_it = roots_.find(key);
+  if (root_it == roots_.end()) {
+    return blocks;
+  }
 
   // allign tokens to block boundary
   const size_t n_tokens = round_down(token_ids.size(), block_size_);
@@ -62,7 +85,7 @@ std::vector<Block> PrefixCache::match(const Slice<int32_t>& token_ids) {
 
   size_t matched_tokens = 0;
   // start from the root node
-  Node* next_node = &root_;
+  Node* next_node = &root_it->second;
   while (next_node != nullptr && !tokens_slice.empty()) {
     Node* curr = next_node;
     // reset the next node
@@ -77,9 +100,9 @@ std::vector<Block> PrefixCache::match(const Slice<int32_t>& token_ids) {
 
       // find a match
       if (prefix_length > 0) {
-        // update the last access time and move the node to the back of the LRU
-        child->last_access_time = now;
-        move_node_to_lru_back(child);
+        // update the access statistics and move the node to the back of the
+        // LRU
+        touch_node(child, now, /*hit=*/true);
 
         matched_tokens += prefix_length;
 
@@ -105,10 +128,44 @@ std::vector<Block> PrefixCache::match(const Slice<int32_t>& token_ids) {
   return blocks;
 }
 
+size_t PrefixCache::probe(const Slice<int32_t>& token_ids,
+                          const std::string& key) const {
+  auto root_it = roots_.find(key);
+  if (root_it == roots_.end()) {
+    return 0;
+  }
+
+  // allign tokens to block boundary
+  const size_t n_tokens = round_down(token_ids.size(), block_size_);
+  auto tokens_slice = token_ids.slice(0, n_tokens);
+
+  size_t matched_tokens = 0;
+  const Node* next_node = &root_it->second;
+  while (next_node != nullptr && !tokens_slice.empty()) {
+    const Node* curr = next_node;
+    next_node = nullptr;
+    for (const Node* child : curr->children) {
+      const size_t prefix_length = round_down(
+          common_prefix_length(tokens_slice, child->token_ids), block_size_);
+      if (prefix_length > 0) {
+        matched_tokens += prefix_length;
+        tokens_slice = tokens_slice.slice(prefix_length);
+        // continue to grand children on full match
+        if (prefix_length == child->token_ids.size()) {
+          next_node = child;
+        }
+        break;
+      }
+    }
+  }
+  return matched_tokens;
+}
+
 // insert the token ids and blocks into the prefix tree
 // return the length of new inserted tokens
 size_t PrefixCache::insert(const Slice<int32_t>& token_ids,
-                           const Slice<Block>& blocks) {
+                           const Slice<Block>& blocks,
+                           const std::string& key) {
   const int64_t now = absl::ToUnixMicros(absl::Now());
   // allign tokens to block boundary
   const size_t n_blocks =
@@ -121,7 +178,7 @@ size_t PrefixCache::insert(const Slice<int32_t>& token_ids,
 
   size_t new_inserted_tokens = 0;
   // start from the root node
-  Node* next_node = &root_;
+  Node* next_node = &roots_[key];
   while (next_node != nullptr && !tokens_slice.empty()) {
     Node* curr = next_node;
     // reset the next node
@@ -136,9 +193,9 @@ size_t PrefixCache::insert(const Slice<int32_t>& token_ids,
 
       // find a match
       if (prefix_length > 0) {
-        // update the last access time and move the node to the back of the LRU
-        child->last_access_time = now;
-        move_node_to_lru_back(child);
+        // update the access statistics and move the node to the back of the
+        // LRU. the blocks were matched before, so it is not counted as a hit.
+        touch_node(child, now, /*hit=*/false);
 
         CHECK(prefix_length % block_size_ == 0)
             << "The prefix length should be multiple of block size";
@@ -165,6 +222,44 @@ size_t PrefixCache::insert(const Slice<int32_t>& token_ids,
   return new_inserted_tokens;
 }
 
+std::vector<PrefixCache::Entry> PrefixCache::entries() const {
+  // map the root nodes to their keys
+  std::unordered_map<const Node*, const std::string*> root_keys;
+  for (const auto& [key, root] : roots_) {
+    root_keys[&root] = &key;
+  }
+
+  std::vector<Entry> entries;
+  // walk the LRU list backwards to get the most recently used first
+  for (const Node* node = lru_back_.prev; node != &lru_front_;
+       node = node->prev) {
+    // skip non-leaf nodes
+    if (!node->children.empty()) {
+      continue;
+    }
+
+    // collect the nodes on the path up to the root
+    std::vector<const Node*> path;
+    const Node* curr = node;
+    for (; curr->parent != nullptr; curr = curr->parent) {
+      path.push_back(curr);
+    }
+    Entry entry;
+    entry.key = *root_keys.at(curr);
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+      const Node* path_node = *it;
+      entry.token_ids.insert(entry.token_ids.end(),
+                             path_node->token_ids.begin(),
+                             path_node->token_ids.end());
+      entry.blocks.insert(entry.blocks.end(),
+                          path_node->blocks.begin(),
+                          path_node->blocks.end());
+    }
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
 // release the blocks hold by the prefix cache
 size_t PrefixCache::evict(size_t n_blocks_to_evict) {
   size_t total_evicted = 0;
@@ -185,19 +280,7 @@ size_t PrefixCache::evict_helper(size_t n_blocks_to_evict) {
   size_t total_evicted = 0;
   // evict nodes at the end to avoid invaliding iterator
   std::vector<Node*> nodes_to_evict;
-  int64_t pre_access_time = 0;
-  for (Node* node = lru_front_.next;
-       total_evicted < n_blocks_to_evict && node != &lru_back_;
-       node = node->next) {
-    CHECK(pre_access_time <= node->last_access_time)
-        << "The last access time should be in ascending order";
-    pre_access_time = node->last_access_time;
-
-    // skip non-leaf nodes
-    if (!node->children.empty()) {
-      continue;
-    }
-
+  const auto evict_leaf = [&](Node* node) {
     // find first non-shared block to evict
     const auto& blocks = node->blocks;
     const size_t n_blocks = blocks.size();
@@ -212,15 +295,39 @@ size_t PrefixCache::evict_helper(size_t n_blocks_to_evict) {
     const size_t n_to_evict = std::min(n_blocks_to_evict - total_evicted,
                                        n_blocks - non_shared_start);
     total_evicted += n_to_evict;
+    if (n_to_evict > 0) {
+      // age the cache by the evicted node
+      age_ = std::max(age_, node->priority);
+    }
     if (n_to_evict == n_blocks) {
       // mark the node as to be evicted
       nodes_to_evict.push_back(node);
     } else if (n_to_evict > 0) {
-      // partially evict non-shared blocks
+      // partially evict non-shared blocks, the priority is kept
       const size_t n_blocks_left = n_blocks - n_to_evict;
       DCHECK(n_blocks_left >= non_shared_start);
       node->token_ids.resize(n_blocks_left * block_size_);
       node->blocks.resize(n_blocks_left);
+      node->depth -= n_to_evict * block_size_;
+    }
+  };
+
+  // the leaf nodes with the lowest priority first, in LRU order on ties
+  if (eviction_policy_->in_lru_order()) {
+    // the LRU list is already in the order of the policy
+    for (Node* node = lru_front_.next;
+         node != &lru_back_ && total_evicted < n_blocks_to_evict;
+         node = node->next) {
+      // only leaf nodes can be evicted
+      if (node->children.empty()) {
+        evict_leaf(node);
+      }
+    }
+  } else {
+    for (auto it = leaves_.begin();
+         it != leaves_.end() && total_evicted < n_blocks_to_evict;
+         ++it) {
+      evict_leaf(*it);
     }
   }
 
@@ -235,12 +342,17 @@ size_t PrefixCache::evict_helper(size_t n_blocks_to_evict) {
 }
 
 void PrefixCache::release_node(Node* node) {
-  DCHECK(node != &root_);
+  // root nodes have no parent
+  DCHECK(node->parent != nullptr);
   DCHECK(node->children.empty()) << "should only release leaf node";
+  remove_leaf(node);
   // remove the node from the parent's children
   auto* parent = node->parent;
   DCHECK(parent->children.count(node) > 0);
   parent->children.erase(node);
+  if (parent->children.empty()) {
+    add_leaf(parent);
+  }
 
   // delete the node
   remove_node_from_lru(node);
@@ -256,6 +368,9 @@ void PrefixCache::split_node(Node* node, size_t common_prefix_length) {
         node->blocks.size() > n_blocks)
       << "The common prefix length should be less than the token ids length";
 
+  // the node is no longer a leaf after the split
+  remove_leaf(node);
+
   // split the node at the common prefix
   Node* child = new Node();
   add_node_to_lru_back(child);
@@ -267,6 +382,8 @@ void PrefixCache::split_node(Node* node, size_t common_prefix_length) {
   child->token_ids = token_ids.slice(common_prefix_length);
   child->blocks = blocks.slice(n_blocks);
   child->last_access_time = node->last_access_time;
+  child->hits = node->hits;
+  child->depth = node->depth;
   // point to parent
   child->parent = node;
   // take over children
@@ -276,10 +393,18 @@ void PrefixCache::split_node(Node* node, size_t common_prefix_length) {
   }
 
   // truncate token_ids and blocks to the common prefix length
+  node->depth -= node->token_ids.size() - common_prefix_length;
   node->token_ids.resize(common_prefix_length);
   node->blocks.resize(n_blocks);
   // put the new child into the children set
   node->children.insert(child);
+
+  // the node ends earlier after the split
+  update_priority(node);
+  update_priority(child);
+  if (child->children.empty()) {
+    add_leaf(child);
+  }
 }
 
 void PrefixCache::create_child(Node* node,
@@ -296,15 +421,55 @@ void PrefixCache::create_child(Node* node,
 
   num_blocks_ += blocks.size();
 
+  remove_leaf(node);
   child->token_ids = tokens;
   child->blocks = blocks;
-  child->last_access_time = now;
   child->parent = node;
+  child->depth = node->depth + tokens.size();
   node->children.insert(child);
+  // count the insertion as the first hit
+  touch_node(child, now, /*hit=*/true);
+}
+
+void PrefixCache::touch_node(Node* node, int64_t now, bool hit) {
+  remove_leaf(node);
+  node->last_access_time = now;
+  if (hit) {
+    ++node->hits;
+  }
+
+  update_priority(node);
+  move_node_to_lru_back(node);
+  if (node->children.empty()) {
+    add_leaf(node);
+  }
+}
+
+void PrefixCache::update_priority(Node* node) {
+  EvictionPolicy::NodeStats stats;
+  stats.last_access_time = node->last_access_time;
+  stats.hits = node->hits;
+  stats.n_tokens = node->token_ids.size();
+  stats.depth = node->depth;
+  node->priority = eviction_policy_->priority(stats, age_);
+}
+
+void PrefixCache::add_leaf(Node* node) {
+  // root nodes can't be evicted
+  if (node->parent != nullptr && !eviction_policy_->in_lru_order()) {
+    leaves_.insert(node);
+  }
+}
+
+void PrefixCache::remove_leaf(Node* node) {
+  if (node->parent != nullptr && !eviction_policy_->in_lru_order()) {
+    leaves_.erase(node);
+  }
 }
 
 // add a new node to the back of the LRU list
 void PrefixCache::add_node_to_lru_back(Node* node) {
+  node->lru_seq = ++lru_seq_;
   node->prev = lru_back_.prev;
   node->next = &lru_back_;
   lru_back_.prev->next = node;
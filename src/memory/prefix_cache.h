@@ -1,17 +1,35 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include "block.h"
 #include "common/slice.h"
+#include "eviction_policy.h"
 
 namespace llm {
 
 class PrefixCache final {
  public:
-  explicit PrefixCache(uint32_t block_size);
+  // a cached token sequence from the root to a leaf of the prefix tree
+  struct Entry {
+    // the key of the prefix tree
+    std::string key;
+    // the token ids of the sequence, aligned to block boundary
+    std::vector<int32_t> token_ids;
+    // the blocks holding the kv cache of the token ids
+    std::vector<Block> blocks;
+  };
+
+  // the eviction policy is one of lru, lfu or gdsf, see eviction_policy.h
+  explicit PrefixCache(uint32_t block_size,
+                       const std::string& eviction_policy = "lru");
 
   ~PrefixCache();
 
@@ -22,24 +40,49 @@ class PrefixCache final {
   PrefixCache& operator=(PrefixCache&&) = delete;
 
   // match the token ids with the prefix tree
+  // the key separates the trees of different lora adapters, since the kv
+  // cache computed by an adapter can't be shared with others. empty key for
+  // the base model.
   // return matched blocks
-  std::vector<Block> match(const std::vector<int32_t>& token_ids) {
-    return match(Slice<int32_t>(token_ids));
+  std::vector<Block> match(const std::vector<int32_t>& token_ids,
+                           const std::string& key = "") {
+    return match(Slice<int32_t>(token_ids), key);
+  }
+  std::vector<Block> match(const Slice<int32_t>& token_ids,
+                           const std::string& key = "");
+
+  // get the number of leading token ids in the prefix tree of the key,
+  // aligned to block boundary. unlike match(), the access time, the LRU list
+  // and the tree are left untouched, which makes it safe for estimations.
+  size_t probe(const std::vector<int32_t>& token_ids,
+               const std::string& key = "") const {
+    return probe(Slice<int32_t>(token_ids), key);
   }
-  std::vector<Block> match(const Slice<int32_t>& token_ids);
+  size_t probe(const Slice<int32_t>& token_ids,
+               const std::string& key = "") const;
 
-  // insert the token ids and blocks into the prefix tree
+  // insert the token ids and blocks into the prefix tree of the key
   // return the length of new inserted tokens
   size_t insert(const std::vector<int32_t>& token_ids,
-                const std::vector<Block>& blocks) {
-    return insert(Slice<int32_t>(token_ids), Slice<Block>(blocks));
+                const std::vector<Block>& blocks,
+                const std::string& key = "") {
+    return insert(Slice<int32_t>(token_ids), Slice<Block>(blocks), key);
   }
-  size_t insert(const Slice<int32_t>& token_ids, const Slice<Block>& blocks);
+  size_t insert(const Slice<int32_t>& token_ids,
+                const Slice<Block>& blocks,
+                const std::string& key = "");
 
-  // evict blocks hold by the prefix cache
+  // evict blocks hold by the prefix cache, the leaf nodes with the lowest
+  // priority of the eviction policy first
   // return the actual number of evicted blocks
   size_t evict(size_t n_blocks);
 
+  // release all nodes and the blocks hold by the prefix cache
+  void clear();
+
+  // get all cached sequences, one per leaf node, the most recently used first
+  std::vector<Entry> entries() const;
+
   // get the number of blocks in the prefix cache
   size_t num_blocks() const { return num_blocks_; }
 
@@ -62,9 +105,30 @@ class PrefixCache final {
     // the last access time of the node, used to evict blocks
     int64_t last_access_time = 0;
 
+    // the number of times the node has been used, including the insertion
+    uint64_t hits = 0;
+
+    // the number of tokens from the root to the end of the node
+    size_t depth = 0;
+
+    // the eviction priority computed on the last access
+    double priority = 0;
+
     // the previous and next nodes, used to maintain the LRU list
     Node* prev = nullptr;
     Node* next = nullptr;
+
+    // the order of the node in the LRU list, increased on each move to the
+    // back of the list
+    uint64_t lru_seq = 0;
+  };
+
+  // the lowest priority first, the LRU order breaks ties
+  struct LeafOrder {
+    bool operator()(const Node* lhs, const Node* rhs) const {
+      return std::tie(lhs->priority, lhs->lru_seq) <
+             std::tie(rhs->priority, rhs->lru_seq);
+    }
   };
 
   // release the node and update leaf_nodes_
@@ -81,6 +145,19 @@ class PrefixCache final {
 
   size_t evict_helper(size_t n_blocks);
 
+  // update the access statistics and the eviction priority of the node, and
+  // move it to the back of the LRU list
+  void touch_node(Node* node, int64_t now, bool hit);
+
+  // compute the eviction priority of the node with its current statistics
+  void update_priority(Node* node);
+
+  // add or remove the node in the leaves ordered by priority, only kept for
+  // the policies not in LRU order. must be removed before its priority or
+  // LRU order changes.
+  void add_leaf(Node* node);
+  void remove_leaf(Node* node);
+
   // remove the node from the LRU list
   static void remove_node_from_lru(Node* node);
 
@@ -90,8 +167,8 @@ class PrefixCache final {
   // move the node to the back of the LRU list
   void move_node_to_lru_back(Node* node);
 
-  // the root node of the prefix tree
-  Node root_;
+  // the root nodes of the prefix trees, keyed by the lora adapter
+  std::unordered_map<std::string, Node> roots_;
 
   // the front and back nodes of the LRU list
   // the front node is the least recently used node
@@ -102,6 +179,19 @@ class PrefixCache final {
   // the block size of the memory blocks
   uint32_t block_size_;
 
+  // the policy to rank the nodes to evict
+  std::unique_ptr<EvictionPolicy> eviction_policy_;
+
+  // the leaf nodes ordered by priority, evicted from the front. empty if the
+  // LRU list is in the order of the policy, which is walked instead.
+  std::set<Node*, LeafOrder> leaves_;
+
+  // the last order given to a node moved to the back of the LRU list
+  uint64_t lru_seq_ = 0;
+
+  // the largest priority of the evicted nodes, used by policies with aging
+  double age_ = 0;
+
   // the total number of blocks in the prefix cache
   size_t num_blocks_ = 0;
 
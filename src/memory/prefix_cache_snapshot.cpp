@@ -0,0 +1,344 @@
+#include "prefix_cache_snapshot.h"
+
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace llm {
+namespace {
+// bump the version when the layout of the files changes
+constexpr int kPrefixCacheSnapshotVersion = 1;
+
+constexpr char kMagic[8] = {'L', 'L', 'M', 'P', 'C', 'S', 'N', 'P'};
+
+constexpr size_t kHeaderPrefixSize = sizeof(kMagic) + sizeof(uint64_t);
+
+bool write_file_atomic(const std::string& path, const std::string& content) {
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    if (!file) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  return !ec;
+}
+
+bool read_file(const std::string& path, std::string* content) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::stringstream ss;
+  ss << file.rdbuf();
+  *content = ss.str();
+  return true;
+}
+
+}  // namespace
+
+PrefixCacheSnapshot::PrefixCacheSnapshot(const std::string& snapshot_root,
+                                         const Key& key)
+    : world_size_(key.world_size), block_size_(key.block_size) {
+  std::error_code ec;
+  auto model_path = std::filesystem::weakly_canonical(key.model_path, ec);
+  if (ec) {
+    model_path = key.model_path;
+  }
+  const nlohmann::json fingerprint = {
+      {"version", kPrefixCacheSnapshotVersion},
+      {"model_path", model_path.string()},
+      {"dtype", c10::toString(key.dtype)},
+      {"block_size", key.block_size},
+      {"n_layers", key.n_layers},
+      {"n_local_kv_heads", key.n_local_kv_heads},
+      {"head_dim", key.head_dim},
+      {"world_size", key.world_size},
+      {"extras", key.extras}};
+  fingerprint_ = fingerprint.dump(/*indent=*/2);
+
+  std::ostringstream name;
+  name << "prefix-cache-" << std::hex
+       << std::hash<std::string>{}(fingerprint_);
+  path_ = (std::filesystem::path(snapshot_root) / name.str()).string();
+}
+
+std::string PrefixCacheSnapshot::rank_file(int rank) const {
+  return path_ + "/rank-" + std::to_string(rank) + ".bin";
+}
+
+bool PrefixCacheSnapshot::is_complete() const {
+  std::string meta;
+  if (!read_file(path_ + "/meta.json", &meta)) {
+    return false;
+  }
+  // guard against collisions of the directory name
+  if (meta != fingerprint_) {
+    return false;
+  }
+  if (!std::filesystem::exists(path_ + "/index.json")) {
+    return false;
+  }
+  for (int rank = 0; rank < world_size_; ++rank) {
+    if (!std::filesystem::exists(rank_file(rank))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PrefixCacheSnapshot::save_index(
+    const std::vector<PrefixCache::Entry>& entries) const {
+  std::error_code ec;
+  std::filesystem::create_directories(path_, ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to create prefix cache snapshot directory " << path_
+               << ": " << ec.message();
+    return false;
+  }
+  // the previous snapshot is invalid once any of its files is overwritten
+  std::filesystem::remove(path_ + "/meta.json", ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to invalidate prefix cache snapshot " << path_
+               << ": " << ec.message();
+    return false;
+  }
+
+  nlohmann::json index = nlohmann::json::array();
+  for (const auto& entry : entries) {
+    std::vector<int32_t> block_ids;
+    block_ids.reserve(entry.blocks.size());
+    for (const auto& block : entry.blocks) {
+      block_ids.push_back(block.id());
+    }
+    index.push_back({{"key", entry.key},
+                     {"token_ids", entry.token_ids},
+                     {"block_ids", block_ids}});
+  }
+  if (!write_file_atomic(path_ + "/index.json", index.dump())) {
+    LOG(ERROR) << "Failed to write prefix cache snapshot index to " << path_;
+    return false;
+  }
+  return true;
+}
+
+bool PrefixCacheSnapshot::load_index(std::vector<Entry>* entries) const {
+  std::string content;
+  if (!read_file(path_ + "/index.json", &content)) {
+    LOG(ERROR) << "Failed to read prefix cache snapshot index from " << path_;
+    return false;
+  }
+  const auto index = nlohmann::json::parse(content,
+                                           /*cb=*/nullptr,
+                                           /*allow_exceptions=*/false);
+  if (!index.is_array()) {
+    LOG(ERROR) << "Invalid prefix cache snapshot index in " << path_;
+    return false;
+  }
+
+  entries->clear();
+  entries->reserve(index.size());
+  for (const auto& item : index) {
+    if (!item.is_object() || !item.contains("key") ||
+        !item["key"].is_string() || !item.contains("token_ids") ||
+        !item["token_ids"].is_array() || !item.contains("block_ids") ||
+        !item["block_ids"].is_array()) {
+      LOG(ERROR) << "Invalid entry in prefix cache snapshot index " << path_;
+      return false;
+    }
+    Entry entry;
+    entry.key = item["key"].get<std::string>();
+    entry.token_ids = item["token_ids"].get<std::vector<int32_t>>();
+    entry.block_ids = item["block_ids"].get<std::vector<int32_t>>();
+    if (entry.block_ids.empty() ||
+        entry.token_ids.size() != entry.block_ids.size() * block_size_) {
+      LOG(ERROR) << "Misaligned entry in prefix cache snapshot index "
+                 << path_;
+      return false;
+    }
+    entries->push_back(std::move(entry));
+  }
+  return true;
+}
+
+bool PrefixCacheSnapshot::save_kv_cache(const std::vector<KVCache>& kv_caches,
+                                        const std::vector<int32_t>& block_ids,
+                                        int rank) const {
+  CHECK(!kv_caches.empty()) << "KV caches are not initialized.";
+  const auto key_cache = std::get<0>(kv_caches[0].get_kv_cache());
+  // [block_size, num_heads, head_dim]
+  const auto block_shape = key_cache.sizes().slice(1).vec();
+  const nlohmann::json header = {
+      {"n_layers", kv_caches.size()},
+      {"dtype", static_cast<int>(key_cache.scalar_type())},
+      {"block_shape", block_shape},
+      {"block_ids", block_ids}};
+  const std::string header_str = header.dump();
+  const uint64_t header_size = header_str.size();
+
+  const std::string path = rank_file(rank);
+  const std::string tmp_path = path + ".tmp";
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  file.write(kMagic, sizeof(kMagic));
+  file.write(reinterpret_cast<const char*>(&header_size), sizeof(header_size));
+  file.write(header_str.data(), static_cast<std::streamsize>(header_size));
+
+  // gather the blocks one layer at a time to bound the host memory
+  const auto index = torch::tensor(block_ids, torch::kLong)
+                         .to(key_cache.device());
+  for (const auto& kv_cache : kv_caches) {
+    const auto [keys, values] = kv_cache.get_kv_cache();
+    for (const auto& cache : {keys, values}) {
+      const auto blocks =
+          cache.index_select(/*dim=*/0, index).to(torch::kCPU).contiguous();
+      file.write(static_cast<const char*>(blocks.data_ptr()),
+                 static_cast<std::streamsize>(blocks.nbytes()));
+    }
+  }
+  file.close();
+  if (!file) {
+    LOG(ERROR) << "Failed to write prefix cache snapshot file " << tmp_path;
+    return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to rename " << tmp_path << ": " << ec.message();
+    return false;
+  }
+  LOG(INFO) << "Saved kv cache of " << block_ids.size()
+            << " blocks to prefix cache snapshot " << path;
+  return true;
+}
+
+bool PrefixCacheSnapshot::load_kv_cache(
+    std::vector<KVCache>& kv_caches,
+    const std::vector<std::pair<int32_t, int32_t>>& block_mapping,
+    int rank) const {
+  CHECK(!kv_caches.empty()) << "KV caches are not initialized.";
+  const std::string path = rank_file(rank);
+  std::ifstream file(path, std::ios::binary);
+  char magic[sizeof(kMagic)] = {};
+  uint64_t header_size = 0;
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(&header_size), sizeof(header_size));
+  if (!file || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+    LOG(ERROR) << "Invalid prefix cache snapshot file " << path;
+    return false;
+  }
+  std::string header_str(header_size, '\0');
+  file.read(header_str.data(), static_cast<std::streamsize>(header_size));
+  const auto header = nlohmann::json::parse(header_str,
+                                            /*cb=*/nullptr,
+                                            /*allow_exceptions=*/false);
+  if (!file || !header.is_object()) {
+    LOG(ERROR) << "Invalid header in prefix cache snapshot file " << path;
+    return false;
+  }
+
+  // validate the layout before touching the kv cache
+  const auto key_cache = std::get<0>(kv_caches[0].get_kv_cache());
+  const auto block_shape = key_cache.sizes().slice(1).vec();
+  const auto dtype = key_cache.scalar_type();
+  if (header.value("n_layers", size_t(0)) != kv_caches.size() ||
+      header.value("dtype", -1) != static_cast<int>(dtype) ||
+      header.value("block_shape", std::vector<int64_t>{}) != block_shape) {
+    LOG(ERROR) << "KV cache layout mismatch in prefix cache snapshot file "
+               << path;
+    return false;
+  }
+  const auto saved_block_ids =
+      header.value("block_ids", std::vector<int32_t>{});
+  const int64_t n_saved_blocks = static_cast<int64_t>(saved_block_ids.size());
+  const size_t data_start = kHeaderPrefixSize + header_size;
+  const size_t cache_nbytes =
+      n_saved_blocks * key_cache[0].numel() * key_cache.element_size();
+  std::error_code ec;
+  const auto file_size = std::filesystem::file_size(path, ec);
+  if (ec || file_size != data_start + 2 * kv_caches.size() * cache_nbytes) {
+    LOG(ERROR) << "Truncated prefix cache snapshot file " << path;
+    return false;
+  }
+
+  // the positions of the saved blocks in the file
+  std::unordered_map<int32_t, int64_t> positions;
+  for (int64_t i = 0; i < n_saved_blocks; ++i) {
+    positions[saved_block_ids[i]] = i;
+  }
+  std::vector<int64_t> src_positions;
+  std::vector<int64_t> dst_block_ids;
+  for (const auto& [saved_id, allocated_id] : block_mapping) {
+    const auto it = positions.find(saved_id);
+    if (it == positions.end()) {
+      LOG(ERROR) << "Missing block " << saved_id
+                 << " in prefix cache snapshot file " << path;
+      return false;
+    }
+    src_positions.push_back(it->second);
+    dst_block_ids.push_back(allocated_id);
+  }
+  const auto src_index = torch::tensor(src_positions, torch::kLong);
+  const auto dst_index = torch::tensor(dst_block_ids, torch::kLong)
+                             .to(key_cache.device());
+
+  std::vector<int64_t> shape = {n_saved_blocks};
+  shape.insert(shape.end(), block_shape.begin(), block_shape.end());
+  auto buffer = torch::empty(shape, torch::dtype(dtype));
+  for (const auto& kv_cache : kv_caches) {
+    const auto [keys, values] = kv_cache.get_kv_cache();
+    for (const auto& cache : {keys, values}) {
+      file.read(static_cast<char*>(buffer.data_ptr()),
+                static_cast<std::streamsize>(cache_nbytes));
+      if (!file) {
+        LOG(ERROR) << "Failed to read prefix cache snapshot file " << path;
+        return false;
+      }
+      const auto blocks =
+          buffer.index_select(/*dim=*/0, src_index).to(cache.device());
+      // the tensors share the storage with the kv cache
+      cache.index_copy_(/*dim=*/0, dst_index, blocks);
+    }
+  }
+  LOG(INFO) << "Restored kv cache of " << block_mapping.size()
+            << " blocks from prefix cache snapshot " << path;
+  return true;
+}
+
+bool PrefixCacheSnapshot::commit() const {
+  if (!write_file_atomic(path_ + "/meta.json", fingerprint_)) {
+    LOG(ERROR) << "Failed to commit prefix cache snapshot " << path_;
+    return false;
+  }
+  return true;
+}
+
+std::vector<int32_t> PrefixCacheSnapshot::block_ids(
+    const std::vector<PrefixCache::Entry>& entries) {
+  std::vector<int32_t> block_ids;
+  for (const auto& entry : entries) {
+    for (const auto& block : entry.blocks) {
+      block_ids.push_back(block.id());
+    }
+  }
+  std::sort(block_ids.begin(), block_ids.end());
+  block_ids.erase(std::unique(block_ids.begin(), block_ids.end()),
+                  block_ids.end());
+  return block_ids;
+}
+
+}  // namespace llm
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "kv_cache.h"
+#include "prefix_cache.h"
+
+namespace llm {
+
+// A snapshot of the prefix cache on local disk, used to warm up the prefix
+// cache after a restart. It holds the cached token sequences and the kv cache
+// of their blocks, one file per rank.
+//
+// The snapshot directory is keyed on the model, dtype, world size and the
+// layout of the kv cache. A new snapshot invalidates the previous one first
+// and only becomes visible once committed.
+//
+// layout of a rank file:
+//  | magic (8 bytes) | header size (8 bytes) | header (json) |
+//  | layer 0 keys | layer 0 values | layer 1 keys | layer 1 values | ... |
+// the header lists the saved block ids in the order of the data.
+class PrefixCacheSnapshot final {
+ public:
+  struct Key {
+    // path to the model checkpoint
+    std::string model_path;
+
+    torch::ScalarType dtype = torch::kFloat;
+
+    int32_t block_size = 0;
+
+    int64_t n_layers = 0;
+
+    int64_t n_local_kv_heads = 0;
+
+    int64_t head_dim = 0;
+
+    int world_size = 1;
+
+    // extra options affecting the kv cache, e.g. the checkpoint files or the
+    // lora adapters
+    std::vector<std::string> extras;
+  };
+
+  // a cached token sequence with the ids of its blocks when saved
+  struct Entry {
+    std::string key;
+    std::vector<int32_t> token_ids;
+    std::vector<int32_t> block_ids;
+  };
+
+  PrefixCacheSnapshot(const std::string& snapshot_root, const Key& key);
+
+  // directory of the snapshot for the key
+  const std::string& path() const { return path_; }
+
+  // whether all ranks are saved and the snapshot is committed
+  bool is_complete() const;
+
+  // invalidate the previous snapshot and save the cached sequences.
+  bool save_index(const std::vector<PrefixCache::Entry>& entries) const;
+
+  // load the cached sequences, the most recently used first
+  bool load_index(std::vector<Entry>* entries) const;
+
+  // save the kv cache of the blocks for the given rank
+  bool save_kv_cache(const std::vector<KVCache>& kv_caches,
+                     const std::vector<int32_t>& block_ids,
+                     int rank) const;
+
+  // copy the kv cache of the saved blocks into the allocated blocks for the
+  // given rank. block_mapping: [(saved block id, allocated block id)]
+  bool load_kv_cache(
+      std::vector<KVCache>& kv_caches,
+      const std::vector<std::pair<int32_t, int32_t>>& block_mapping,
+      int rank) const;
+
+  // mark the snapshot as complete once all ranks are saved
+  bool commit() const;
+
+  // get the sorted unique ids of the blocks used by the entries
+  static std::vector<int32_t> block_ids(
+      const std::vector<PrefixCache::Entry>& entries);
+
+ private:
+  std::string rank_file(int rank) const;
+
+  // description of the key
+  std::string fingerprint_;
+
+  std::string path_;
+
+  int world_size_ = 1;
+
+  int32_t block_size_ = 0;
+};
+
+}  // namespace llm
@@ -0,0 +1,216 @@
+#include "prefix_cache_summary.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace llm {
+namespace {
+// bump the version when the format of the summary changes
+constexpr int kPrefixCacheSummaryVersion = 1;
+
+constexpr uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+constexpr uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+// the start of the hash chains for the key
+uint64_t key_hash(std::string_view key) {
+  const uint64_t hash = fnv1a(kFnvOffsetBasis, key.data(), key.size());
+  const char separator = '\0';
+  return fnv1a(hash, &separator, 1);
+}
+
+size_t round_up_to_power_of_2(size_t n) {
+  size_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+std::string to_hex(const std::vector<uint8_t>& bytes) {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(bytes.size() * 2);
+  for (const uint8_t byte : bytes) {
+    hex.push_back(kDigits[byte >> 4]);
+    hex.push_back(kDigits[byte & 0xf]);
+  }
+  return hex;
+}
+
+}  // namespace
+
+PrefixCacheSummary::PrefixCacheSummary(const Options& options)
+    : options_(options) {
+  CHECK_GT(options_.chunk_size(), 0);
+  CHECK_GT(options_.num_hashes(), 0);
+  // start with an empty filter
+  bits_.resize(8, 0);
+}
+
+std::vector<uint64_t> PrefixCacheSummary::chunk_hashes(std::string_view key,
+                                                       std::string_view text,
+                                                       size_t chunk_size) {
+  std::vector<uint64_t> hashes;
+  uint64_t hash = key_hash(key);
+  const size_t n_chunks = text.size() / chunk_size;
+  hashes.reserve(n_chunks);
+  for (size_t i = 0; i < n_chunks; ++i) {
+    hash = fnv1a(hash, text.data() + i * chunk_size, chunk_size);
+    hashes.push_back(hash);
+  }
+  return hashes;
+}
+
+void PrefixCacheSummary::record(const std::string& key,
+                                std::string_view text,
+                                const std::vector<int32_t>& token_ids) {
+  auto hashes = chunk_hashes(key, text, options_.chunk_size());
+  // too short to be routed on
+  if (hashes.empty() || token_ids.empty()) {
+    return;
+  }
+  const uint64_t prompt_hash = fnv1a(key_hash(key), text.data(), text.size());
+
+  std::lock_guard<std::mutex> lock(prompts_mutex_);
+  auto it = prompt_index_.find(prompt_hash);
+  if (it != prompt_index_.end()) {
+    // move the prompt to the front
+    prompts_.splice(prompts_.begin(), prompts_, it->second);
+    return;
+  }
+  prompts_.push_front(
+      {prompt_hash, key, std::move(hashes), text.size(), token_ids});
+  prompt_index_[prompt_hash] = prompts_.begin();
+  // drop the least recently recorded prompts
+  while (prompts_.size() > options_.max_prompts()) {
+    prompt_index_.erase(prompts_.back().hash);
+    prompts_.pop_back();
+  }
+}
+
+void PrefixCacheSummary::refresh(
+    const std::vector<PrefixCache::Entry>& entries,
+    uint32_t block_size) {
+  CHECK_GT(block_size, 0);
+  // hash chains of the resident blocks
+  std::unordered_set<uint64_t> resident_blocks;
+  for (const auto& entry : entries) {
+    uint64_t hash = key_hash(entry.key);
+    const size_t n_blocks = entry.token_ids.size() / block_size;
+    for (size_t i = 0; i < n_blocks; ++i) {
+      hash = fnv1a(hash,
+                   entry.token_ids.data() + i * block_size,
+                   block_size * sizeof(int32_t));
+      resident_blocks.insert(hash);
+    }
+  }
+
+  std::vector<uint64_t> chunks;
+  size_t n_resident_prompts = 0;
+  std::set<std::string> keys;
+  {
+    std::lock_guard<std::mutex> lock(prompts_mutex_);
+    for (const auto& prompt : prompts_) {
+      if (!prompt.key.empty()) {
+        keys.insert(prompt.key);
+      }
+      // the resident prefix of the prompt tokens
+      uint64_t hash = key_hash(prompt.key);
+      size_t n_matched_tokens = 0;
+      const size_t n_blocks = prompt.token_ids.size() / block_size;
+      for (size_t i = 0; i < n_blocks; ++i) {
+        hash = fnv1a(hash,
+                     prompt.token_ids.data() + i * block_size,
+                     block_size * sizeof(int32_t));
+        if (resident_blocks.count(hash) == 0) {
+          break;
+        }
+        n_matched_tokens += block_size;
+      }
+      if (n_matched_tokens == 0) {
+        continue;
+      }
+      // assume the same share of the text is resident
+      const size_t n_matched_bytes =
+          prompt.text_size * n_matched_tokens / prompt.token_ids.size();
+      const size_t n_chunks = std::min(n_matched_bytes / options_.chunk_size(),
+                                       prompt.chunk_hashes.size());
+      chunks.insert(chunks.end(),
+                    prompt.chunk_hashes.begin(),
+                    prompt.chunk_hashes.begin() + n_chunks);
+      ++n_resident_prompts;
+    }
+  }
+  std::sort(chunks.begin(), chunks.end());
+  chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+
+  // size the filter to the number of chunks, at least 64 bits
+  const size_t num_bits = round_up_to_power_of_2(
+      std::max<size_t>(chunks.size() * options_.bits_per_chunk(), 64));
+  std::vector<uint8_t> bits(num_bits / 8, 0);
+  for (const uint64_t chunk : chunks) {
+    const uint64_t step = (chunk >> 32) | 1;
+    for (uint32_t i = 0; i < options_.num_hashes(); ++i) {
+      const uint64_t bit = (chunk + i * step) % num_bits;
+      bits[bit / 8] |= static_cast<uint8_t>(1 << (bit % 8));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(summary_mutex_);
+  bits_ = std::move(bits);
+  num_chunks_ = chunks.size();
+  num_resident_prompts_ = n_resident_prompts;
+  keys_.assign(keys.begin(), keys.end());
+}
+
+std::string PrefixCacheSummary::to_json() const {
+  std::lock_guard<std::mutex> lock(summary_mutex_);
+  const nlohmann::json summary = {
+      {"version", kPrefixCacheSummaryVersion},
+      {"chunk_size", options_.chunk_size()},
+      {"num_hashes", options_.num_hashes()},
+      {"num_bits", bits_.size() * 8},
+      {"bits", to_hex(bits_)},
+      {"num_chunks", num_chunks_},
+      {"num_prompts", num_resident_prompts_},
+      {"lora_adapters", keys_}};
+  return summary.dump();
+}
+
+bool PrefixCacheSummary::contains(uint64_t chunk_hash) const {
+  std::lock_guard<std::mutex> lock(summary_mutex_);
+  const uint64_t num_bits = bits_.size() * 8;
+  const uint64_t step = (chunk_hash >> 32) | 1;
+  for (uint32_t i = 0; i < options_.num_hashes(); ++i) {
+    const uint64_t bit = (chunk_hash + i * step) % num_bits;
+    if ((bits_[bit / 8] & (1 << (bit % 8))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t PrefixCacheSummary::num_prompts() const {
+  std::lock_guard<std::mutex> lock(prompts_mutex_);
+  return prompts_.size();
+}
+
+}  // namespace llm
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common/macros.h"
+#include "prefix_cache.h"
+
+namespace llm {
+
+// A compact summary of the prompts whose prefixes are resident in the prefix
+// cache, published to the gateway to route requests to the replica with the
+// longest predicted cache match.
+//
+// The gateway has no tokenizer, so the summary is keyed on the prompt text
+// instead of the token ids. The text is split into fixed size chunks, and
+// each chunk is identified by the 64-bit FNV-1a hash of the key, a '\0'
+// separator and all the text up to the end of the chunk, i.e. a hash chain.
+// The key is the lora adapter, empty for the base model.
+//
+// The recent prompts are recorded with their token ids. On refresh, the
+// resident token prefix of each prompt is looked up in the prefix cache, and
+// the chunks covered by the same share of the text are added into a bloom
+// filter. The bit of the i-th probe for a chunk hash h is
+//   (h + i * ((h >> 32) | 1)) % num_bits
+// and the bits are stored as bytes in little endian order, hex encoded.
+//
+// Which prompts are resident is exact, from the hash chains of the token
+// blocks that PrefixCache matches on. Only the share of the text is an
+// estimate: without the tokenizer, the gateway can't rebuild the token blocks
+// of a request, and the tokens of a text prefix may change with the text that
+// follows, so the chunks can't line up with the blocks. A wrong estimate only
+// costs recomputing the kv cache of some chunks on the chosen replica, the
+// outputs are the same.
+class PrefixCacheSummary final {
+ public:
+  struct Options {
+    // the size of the text chunks in bytes
+    DEFINE_ARG(size_t, chunk_size) = 64;
+
+    // the maximum number of recent prompts to track
+    DEFINE_ARG(size_t, max_prompts) = 4096;
+
+    // the number of bloom filter probes per chunk
+    DEFINE_ARG(uint32_t, num_hashes) = 7;
+
+    // the number of bloom filter bits per chunk, about 1% false positives
+    DEFINE_ARG(size_t, bits_per_chunk) = 10;
+  };
+
+  explicit PrefixCacheSummary(const Options& options);
+
+  // hash chain of the full text chunks
+  static std::vector<uint64_t> chunk_hashes(std::string_view key,
+                                            std::string_view text,
+                                            size_t chunk_size);
+
+  // record a prompt scheduled with the given key. thread safe.
+  void record(const std::string& key,
+              std::string_view text,
+              const std::vector<int32_t>& token_ids);
+
+  // rebuild the summary from the sequences resident in the prefix cache.
+  void refresh(const std::vector<PrefixCache::Entry>& entries,
+               uint32_t block_size);
+
+  // the last refreshed summary in json. thread safe.
+  std::string to_json() const;
+
+  // whether the chunk hash is in the last refreshed summary, for testing
+  bool contains(uint64_t chunk_hash) const;
+
+  // the number of prompts tracked
+  size_t num_prompts() const;
+
+ private:
+  struct Prompt {
+    // the hash of the whole prompt
+    uint64_t hash = 0;
+    std::string key;
+    // the chunk hashes of the text
+    std::vector<uint64_t> chunk_hashes;
+    size_t text_size = 0;
+    std::vector<int32_t> token_ids;
+  };
+
+  const Options options_;
+
+  // recent prompts, the most recently recorded first
+  mutable std::mutex prompts_mutex_;
+  std::list<Prompt> prompts_;
+  // the hash of the whole prompt -> prompt, to deduplicate the prompts
+  std::unordered_map<uint64_t, std::list<Prompt>::iterator> prompt_index_;
+
+  // the last refreshed bloom filter
+  mutable std::mutex summary_mutex_;
+  std::vector<uint8_t> bits_;
+  size_t num_chunks_ = 0;
+  size_t num_resident_prompts_ = 0;
+  // lora adapters of the tracked prompts
+  std::vector<std::string> keys_;
+};
+
+}  // namespace llm
@@ -0,0 +1,99 @@
+#include "prefix_cache_summary.h"
+
+#include <gtest/gtest.h>
+
+#include <nlohmann/json.hpp>
+
+#include "prefix_cache.h"
+
+namespace llm {
+
+TEST(PrefixCacheSummaryTest, ChunkHashes) {
+  // golden values shared with the gateway
+  EXPECT_EQ(PrefixCacheSummary::chunk_hashes("", "hello world!", 4),
+            std::vector<uint64_t>(
+                {0x7b495389bdbdd4a8, 0x049a755b29a3dcb5, 0xc77bf3872ce5f174}));
+  // only full chunks
+  EXPECT_EQ(PrefixCacheSummary::chunk_hashes("", "hello world", 4).size(), 2);
+  EXPECT_TRUE(PrefixCacheSummary::chunk_hashes("", "hel", 4).empty());
+  // different trees for lora adapters
+  EXPECT_EQ(PrefixCacheSummary::chunk_hashes("sql", "hello world!", 4),
+            std::vector<uint64_t>({0x898e6e7d049f1a7e,
+                                   0x5a94a16df34b703f,
+                                   0xa553a5b1c873a91a}));
+}
+
+TEST(PrefixCacheSummaryTest, Refresh) {
+  const uint32_t block_size = 2;
+  PrefixCacheSummary::Options options;
+  options.chunk_size(4);
+  PrefixCacheSummary summary(options);
+
+  const std::string text = "hello world!";
+  const auto hashes = PrefixCacheSummary::chunk_hashes("", text, 4);
+  const auto sql_hashes = PrefixCacheSummary::chunk_hashes("sql", text, 4);
+  summary.record("", text, {1, 2, 3, 4, 5, 6});
+  summary.record("", "see you later", {9, 9, 9, 9});
+  summary.record("sql", text, {1, 2});
+  // too short to be routed on
+  summary.record("", "hi", {1});
+  EXPECT_EQ(summary.num_prompts(), 3);
+  // duplicated prompts are recorded once
+  summary.record("", text, {1, 2, 3, 4, 5, 6});
+  EXPECT_EQ(summary.num_prompts(), 3);
+
+  // nothing is resident yet
+  summary.refresh({}, block_size);
+  for (const auto hash : hashes) {
+    EXPECT_FALSE(summary.contains(hash));
+  }
+
+  PrefixCache cache(block_size);
+  cache.insert(std::vector<int32_t>{1, 2, 3, 4}, std::vector<Block>{1, 2});
+  cache.insert(std::vector<int32_t>{1, 2}, std::vector<Block>{3}, "sql");
+  summary.refresh(cache.entries(), block_size);
+  // 4 of the 6 tokens are resident, so are the first 2 of the 3 chunks
+  EXPECT_TRUE(summary.contains(hashes[0]));
+  EXPECT_TRUE(summary.contains(hashes[1]));
+  EXPECT_FALSE(summary.contains(hashes[2]));
+  // all the tokens of the lora adapter are resident
+  for (const auto hash : sql_hashes) {
+    EXPECT_TRUE(summary.contains(hash));
+  }
+  for (const auto hash :
+       PrefixCacheSummary::chunk_hashes("", "see you later", 4)) {
+    EXPECT_FALSE(summary.contains(hash));
+  }
+
+  const auto json = nlohmann::json::parse(summary.to_json());
+  EXPECT_EQ(json["version"], 1);
+  EXPECT_EQ(json["chunk_size"], 4);
+  EXPECT_EQ(json["num_chunks"], 5);
+  EXPECT_EQ(json["num_prompts"], 2);
+  EXPECT_EQ(json["lora_adapters"], nlohmann::json::array({"sql"}));
+  const size_t num_bits = json["num_bits"].get<size_t>();
+  EXPECT_EQ(json["bits"].get<std::string>().size() * 4, num_bits);
+}
+
+TEST(PrefixCacheSummaryTest, MaxPrompts) {
+  PrefixCacheSummary::Options options;
+  options.chunk_size(4).max_prompts(2);
+  PrefixCacheSummary summary(options);
+  summary.record("", "aaaa", {1});
+  summary.record("", "bbbb", {2});
+  summary.record("", "aaaa", {1});
+  summary.record("", "cccc", {3});
+  EXPECT_EQ(summary.num_prompts(), 2);
+
+  // the least recently recorded prompt is dropped
+  PrefixCache cache(/*block_size=*/1);
+  cache.insert(std::vector<int32_t>{1}, std::vector<Block>{1});
+  cache.insert(std::vector<int32_t>{2}, std::vector<Block>{2});
+  summary.refresh(cache.entries(), /*block_size=*/1);
+  EXPECT_TRUE(
+      summary.contains(PrefixCacheSummary::chunk_hashes("", "aaaa", 4)[0]));
+  EXPECT_FALSE(
+      summary.contains(PrefixCacheSummary::chunk_hashes("", "bbbb", 4)[0]));
+}
+
+}  // namespace llm
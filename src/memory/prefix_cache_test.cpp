@@ -133,6 +133,176 @@ TEST(PrefixCacheTest, Basic) {
   }
 }
 
+TEST(PrefixCacheTest, Clear) {
+  const uint32_t block_size = 2;
+  PrefixCache cache(block_size);
+
+  const std::vector<int32_t> token_ids = {1, 2, 3, 4, 5, 6};
+  const std::vector<int32_t> other_token_ids = {1, 2, 7, 8};
+  cache.insert(token_ids, std::vector<Block>{0, 1, 2});
+  cache.insert(other_token_ids, std::vector<Block>{0, 3});
+  EXPECT_EQ(cache.num_blocks(), 4);
+  EXPECT_EQ(cache.num_nodes(), 3);
+
+  cache.clear();
+  EXPECT_EQ(cache.num_blocks(), 0);
+  EXPECT_EQ(cache.num_nodes(), 0);
+  EXPECT_TRUE(cache.match(token_ids).empty());
+
+  // the cache is usable after the clear
+  EXPECT_EQ(cache.insert(token_ids, std::vector<Block>{4, 5, 6}), 6);
+  const std::vector<Block> desired_blocks = {4, 5, 6};
+  EXPECT_EQ(cache.match(token_ids), desired_blocks);
+  EXPECT_EQ(cache.num_nodes(), 1);
+}
+
+TEST(PrefixCacheTest, SeparateKeys) {
+  const uint32_t block_size = 2;
+  PrefixCache cache(block_size);
+
+  const std::vector<int32_t> token_ids = {1, 2, 3, 4};
+  std::vector<Block> base_blocks = {0, 1};
+  std::vector<Block> adapter_blocks = {2, 3};
+  EXPECT_EQ(cache.insert(token_ids, base_blocks), 4);
+  // the same tokens are inserted again for the adapter
+  EXPECT_EQ(cache.insert(token_ids, adapter_blocks, "adapter"), 4);
+  EXPECT_EQ(cache.num_blocks(), 4);
+  EXPECT_EQ(cache.num_nodes(), 2);
+
+  EXPECT_EQ(cache.match(token_ids), base_blocks);
+  EXPECT_EQ(cache.match(token_ids, "adapter"), adapter_blocks);
+  EXPECT_TRUE(cache.match(token_ids, "other").empty());
+
+  // evict all blocks of both trees once they are released
+  base_blocks.clear();
+  adapter_blocks.clear();
+  EXPECT_EQ(cache.evict(4), 4);
+  EXPECT_EQ(cache.num_nodes(), 0);
+  EXPECT_TRUE(cache.match(token_ids, "adapter").empty());
+}
+
+TEST(PrefixCacheTest, Entries) {
+  const uint32_t block_size = 2;
+  PrefixCache cache(block_size);
+  EXPECT_TRUE(cache.entries().empty());
+
+  //   tokens: [1, 2] -> [3, 4]
+  //                  -> [5, 6]
+  //   adapter: [7, 8]
+  cache.insert(std::vector<int32_t>{1, 2, 3, 4}, std::vector<Block>{1, 2});
+  cache.insert(std::vector<int32_t>{1, 2, 5, 6}, std::vector<Block>{1, 3});
+  cache.insert(
+      std::vector<int32_t>{7, 8}, std::vector<Block>{4}, /*key=*/"adapter");
+
+  // one entry per leaf, the most recently used first
+  const auto entries = cache.entries();
+  ASSERT_EQ(entries.size(), 3);
+  EXPECT_EQ(entries[0].key, "adapter");
+  EXPECT_EQ(entries[0].token_ids, std::vector<int32_t>({7, 8}));
+  EXPECT_EQ(entries[0].blocks, std::vector<Block>({4}));
+  EXPECT_EQ(entries[1].key, "");
+  EXPECT_EQ(entries[1].token_ids, std::vector<int32_t>({1, 2, 5, 6}));
+  EXPECT_EQ(entries[1].blocks, std::vector<Block>({1, 3}));
+  EXPECT_EQ(entries[2].token_ids, std::vector<int32_t>({1, 2, 3, 4}));
+  EXPECT_EQ(entries[2].blocks, std::vector<Block>({1, 2}));
+}
+
+TEST(PrefixCacheTest, Probe) {
+  const uint32_t block_size = 2;
+  PrefixCache cache(block_size);
+  EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2, 3, 4}), 0);
+
+  //   tokens: [1, 2, 3, 4, 5, 6]
+  //   adapter: [1, 2]
+  cache.insert(std::vector<int32_t>{1, 2, 3, 4, 5, 6},
+               std::vector<Block>{1, 2, 3});
+  cache.insert(std::vector<int32_t>{7, 8}, std::vector<Block>{4});
+  cache.insert(
+      std::vector<int32_t>{1, 2}, std::vector<Block>{5}, /*key=*/"adapter");
+  const auto entries = cache.entries();
+  const size_t num_nodes = cache.num_nodes();
+
+  // matched length aligned to block boundary
+  EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2, 3, 4, 5, 6, 7}), 6);
+  EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2, 3, 9}), 2);
+  EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2, 3}), 2);
+  EXPECT_EQ(cache.probe(std::vector<int32_t>{9, 2}), 0);
+  EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2, 3, 4}, "adapter"), 2);
+  EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2}, "unknown"), 0);
+
+  // neither the LRU order nor the tree changes, unlike match
+  EXPECT_EQ(cache.num_nodes(), num_nodes);
+  const auto probed_entries = cache.entries();
+  ASSERT_EQ(probed_entries.size(), entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    EXPECT_EQ(probed_entries[i].key, entries[i].key);
+    EXPECT_EQ(probed_entries[i].token_ids, entries[i].token_ids);
+  }
+  cache.match(std::vector<int32_t>{1, 2, 3, 9});
+  EXPECT_EQ(cache.num_nodes(), num_nodes + 1);
+}
+
+TEST(PrefixCacheTest, EvictionPolicy) {
+  const uint32_t block_size = 1;
+  // [1, 2] is hot but least recently used, [3, 4] and [5, 6] are used once
+  const auto fill = [](PrefixCache& cache) {
+    cache.insert(std::vector<int32_t>{1, 2}, std::vector<Block>{1, 2});
+    for (int i = 0; i < 3; ++i) {
+      cache.match(std::vector<int32_t>{1, 2});
+    }
+    cache.insert(std::vector<int32_t>{3, 4}, std::vector<Block>{3, 4});
+    cache.insert(std::vector<int32_t>{5, 6}, std::vector<Block>{5, 6});
+  };
+
+  {
+    PrefixCache cache(block_size, "lru");
+    fill(cache);
+    EXPECT_EQ(cache.evict(2), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2}), 0);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{3, 4}), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{5, 6}), 2);
+  }
+
+  {
+    PrefixCache cache(block_size, "lfu");
+    fill(cache);
+    // the least frequently used first, in LRU order on ties
+    EXPECT_EQ(cache.evict(2), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2}), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{3, 4}), 0);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{5, 6}), 2);
+
+    // new nodes start from the age of the cache
+    cache.insert(std::vector<int32_t>{7, 8}, std::vector<Block>{7, 8});
+    EXPECT_EQ(cache.evict(2), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{5, 6}), 0);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{7, 8}), 2);
+    EXPECT_EQ(cache.evict(2), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2}), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{7, 8}), 0);
+  }
+
+  {
+    PrefixCache cache(block_size, "gdsf");
+    cache.insert(std::vector<int32_t>{1, 2, 3, 4},
+                 std::vector<Block>{1, 2, 3, 4});
+    cache.insert(std::vector<int32_t>{5, 6}, std::vector<Block>{5, 6});
+    // the short prompt is cheaper to recompute
+    EXPECT_EQ(cache.evict(2), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2, 3, 4}), 4);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{5, 6}), 0);
+
+    // unless it is hit more often
+    cache.insert(std::vector<int32_t>{7, 8}, std::vector<Block>{7, 8});
+    for (int i = 0; i < 3; ++i) {
+      cache.match(std::vector<int32_t>{7, 8});
+    }
+    EXPECT_EQ(cache.evict(2), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{1, 2, 3, 4}), 2);
+    EXPECT_EQ(cache.probe(std::vector<int32_t>{7, 8}), 2);
+  }
+}
+
 struct SequenceData {
   std::vector<int32_t> token_ids;
   std::vector<Block> blocks;
@@ -145,18 +315,21 @@ std::vector<T> sub_vector(const std::vector<T>& data, size_t size) {
 }
 
 class PrefixCacheRandomTest
-    : public ::testing::TestWithParam<std::tuple<int32_t /*block_size*/,
-                                                 int32_t /*max_seq_len*/,
-                                                 int32_t /*num_seqs*/>> {};
+    : public ::testing::TestWithParam<
+          std::tuple<int32_t /*block_size*/,
+                     int32_t /*max_seq_len*/,
+                     int32_t /*num_seqs*/,
+                     std::string /*eviction_policy*/>> {};
 
 TEST_P(PrefixCacheRandomTest, Random) {
-  const auto& [block_size, max_seq_len, num_seqs] = GetParam();
+  const auto& [block_size, max_seq_len, num_seqs, eviction_policy] =
+      GetParam();
 
   const int32_t vocab_size = 2000;
   const int32_t total_blocks = (max_seq_len * num_seqs) / block_size + 10;
 
   BlockAllocator allocator(total_blocks, block_size);
-  PrefixCache cache(block_size);
+  PrefixCache cache(block_size, eviction_policy);
 
   absl::BitGen gen;
   // construct sequences and insert into prefix cache
@@ -257,7 +430,8 @@ INSTANTIATE_TEST_SUITE_P(
     PrefixCacheRandomTest,
     ::testing::Combine(::testing::Values(1, 4, 8, 32, 128, 256),  // block_size
                        ::testing::Values(1000),                   // max_seq_len
-                       ::testing::Values(1000)                    // num_seqs
+                       ::testing::Values(1000),                   // num_seqs
+                       ::testing::Values("lru", "lfu", "gdsf")  // policy
                        ));
 
 }  // namespace llm
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "model_loader/state_dict.h"
+#include "model_loader/state_dict_prefetcher.h"
 #include "models/model_args.h"
 #include "quantization/quant_args.h"
 #include "tokenizer/tokenizer.h"
@@ -74,6 +75,11 @@ class ModelLoader {
   virtual StateDictIterator begin() const = 0;
   virtual StateDictIterator end() const = 0;
 
+  // load the model weights files in parallel, keeping at most max_prefetch
+  // files in memory ahead of the consumer
+  virtual std::unique_ptr<StateDictPrefetcher> prefetch_state_dicts(
+      size_t max_prefetch) const = 0;
+
   // create a model loader from the given path
   static std::unique_ptr<ModelLoader> create(
       const std::string& model_weights_path);
@@ -106,6 +112,12 @@ class HFModelLoader : public ModelLoader {
     return {model_weights_files_, weights_files_count(), true, false};
   }
 
+  std::unique_ptr<StateDictPrefetcher> prefetch_state_dicts(
+      size_t max_prefetch) const override {
+    return std::make_unique<StateDictPrefetcher>(
+        model_weights_files_, is_pickle_, max_prefetch);
+  }
+
  private:
   bool load_model_args(const std::string& args_file_path);
 
@@ -8,7 +8,9 @@
 #include <torch/csrc/jit/serialization/storage_context.h>
 #include <torch/torch.h>
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "huggingface/safetensors.h"
 
@@ -67,6 +69,14 @@ torch::ScalarType get_dtype(const Dtype& dtype) {
   __builtin_unreachable();
 }
 
+bool entry_less(const StateDict::Entry& lhs, const StateDict::Entry& rhs) {
+  return lhs.name < rhs.name;
+}
+
+bool entry_name_less(const StateDict::Entry& entry, const std::string& name) {
+  return entry.name < name;
+}
+
 std::vector<int64_t> get_sizes(const View* view) {
   std::vector<int64_t> sizes;
   sizes.reserve(view->rank);
@@ -117,8 +127,8 @@ std::unique_ptr<StateDict> StateDict::load_safetensors(
   const uint8_t* data = reinterpret_cast<const uint8_t*>(content.data());
   const size_t size = content.size();
 
-  std::unordered_map<std::string, torch::Tensor> dict;
-  // safetensors
+  // index the tensors by the header, tensors are created on demand
+  std::vector<Entry> entries;
   Handle* handle = nullptr;
   CHECK(safetensors_deserialize(&handle, data, size) == Status::Ok)
       << "Failed to open safetensors file " << weights_file;
@@ -128,6 +138,7 @@ std::unique_ptr<StateDict> StateDict::load_safetensors(
   CHECK(safetensors_names(handle, &tensor_names, &num_tensors) == Status::Ok)
       << "Failed to get tensor names from safetensors file " << weights_file;
 
+  entries.reserve(num_tensors);
   for (size_t i = 0; i < num_tensors; i++) {
     const char* tensor_name = tensor_names[i];
     View* tensor_view = nullptr;
@@ -136,41 +147,99 @@ std::unique_ptr<StateDict> StateDict::load_safetensors(
         << "Failed to get tensor " << tensor_name << " from safetensors file "
         << weights_file;
 
-    const auto scalar_type = get_dtype(tensor_view->dtype);
-    const void* tensor_data = data + tensor_view->start;
-    const std::vector<int64_t> tensor_sizes = get_sizes(tensor_view);
-    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
-    const auto tensor = at::from_blob(const_cast<void*>(tensor_data),
-                                      tensor_sizes,
-                                      torch::dtype(scalar_type));
+    Entry entry;
+    entry.name = tensor_name;
+    entry.dtype = get_dtype(tensor_view->dtype);
+    entry.sizes = get_sizes(tensor_view);
+    entry.offset = tensor_view->start;
+    CHECK(entry.offset <= size) << "Invalid offset for tensor " << tensor_name;
     CHECK(safetensors_free_tensor(tensor_view) == Status::Ok)
         << "Failed to free tensor view";
-    dict[tensor_name] = tensor;
+    entries.push_back(std::move(entry));
   }
   CHECK(safetensors_free_names(tensor_names, num_tensors) == Status::Ok)
       << "Failed to free tensor names";
   CHECK(safetensors_destroy(handle) == Status::Ok)
       << "Failed to destroy safetensors handle";
 
-  return std::make_unique<StateDict>(std::move(mem_map), std::move(dict));
+  return std::make_unique<StateDict>(std::move(mem_map), std::move(entries));
 }
 
 StateDict::StateDict(std::unordered_map<std::string, torch::Tensor> dict,
                      const std::string& prefix)
-    : dict_(std::move(dict)), prefix_(prefix) {}
+    : prefix_(prefix) {
+  auto index = std::make_shared<Index>();
+  index->entries.reserve(dict.size());
+  for (auto& [name, tensor] : dict) {
+    Entry entry;
+    entry.name = name;
+    entry.tensor = std::move(tensor);
+    index->entries.push_back(std::move(entry));
+  }
+  std::sort(index->entries.begin(), index->entries.end(), entry_less);
+  end_ = index->entries.size();
+  index_ = std::move(index);
+}
 
 StateDict::StateDict(std::unique_ptr<folly::MemoryMapping> mem_map,
-                     std::unordered_map<std::string, torch::Tensor> dict)
-    : mem_map_(std::move(mem_map)), dict_(std::move(dict)) {}
+                     std::vector<Entry> entries) {
+  auto index = std::make_shared<Index>();
+  index->mem_map = std::move(mem_map);
+  index->entries = std::move(entries);
+  std::sort(index->entries.begin(), index->entries.end(), entry_less);
+  end_ = index->entries.size();
+  index_ = std::move(index);
+}
+
+StateDict::StateDict(std::shared_ptr<const Index> index,
+                     size_t begin,
+                     size_t end,
+                     std::string name_prefix,
+                     std::string prefix)
+    : index_(std::move(index)),
+      begin_(begin),
+      end_(end),
+      name_prefix_(std::move(name_prefix)),
+      prefix_(std::move(prefix)) {}
+
+const StateDict::Entry* StateDict::find(const std::string& tensor_name) const {
+  const auto first = index_->entries.begin() + begin_;
+  const auto last = index_->entries.begin() + end_;
+  const std::string name = name_prefix_ + tensor_name;
+  const auto it = std::lower_bound(first, last, name, entry_name_less);
+  if (it == last || it->name != name) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+torch::Tensor StateDict::to_tensor(const Entry& entry) const {
+  if (entry.tensor.defined()) {
+    return entry.tensor;
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+  auto* data = const_cast<uint8_t*>(index_->mem_map->range().data());
+  // the tensor keeps the memory mapping alive
+  return at::from_blob(data + entry.offset,
+                       entry.sizes,
+                       [index = index_](void* /*data*/) {},
+                       torch::dtype(entry.dtype));
+}
 
 torch::Tensor StateDict::get_tensor(const std::string& tensor_name) const {
-  const auto it = dict_.find(tensor_name);
-  if (it == dict_.end()) {
+  const Entry* entry = find(tensor_name);
+  if (entry == nullptr) {
     return torch::Tensor{nullptr};
   }
+  const auto tensor = to_tensor(*entry);
   // apply transform function if exists
-  return transform_func_ ? transform_func_(tensor_name, it->second)
-                         : it->second;
+  return transform_func_ ? transform_func_(tensor_name, tensor) : tensor;
+}
+
+StateDict::Iterator::value_type StateDict::Iterator::operator*() const {
+  const auto& entry = state_dict_->index_->entries[index_];
+  return {entry.name.substr(state_dict_->name_prefix_.size()),
+          state_dict_->to_tensor(entry)};
 }
 
 torch::Tensor StateDict::get_sharded_tensor(const std::string& tensor_name,
@@ -202,13 +271,20 @@ torch::Tensor StateDict::get_sharded_tensor(const std::string& tensor_name,
 
 // select all the tensors whose name starts with prefix.
 StateDict StateDict::select(const std::string& prefix) const {
-  std::unordered_map<std::string, torch::Tensor> selected;
-  for (const auto& [name, tensor] : dict_) {
-    if (absl::StartsWith(name, prefix)) {
-      selected[name.substr(prefix.length())] = tensor;
-    }
-  }
-  return {std::move(selected), prefix_ + prefix};
+  // names starting with the prefix are contiguous in the sorted index
+  const auto first = index_->entries.begin() + begin_;
+  const auto last = index_->entries.begin() + end_;
+  std::string name_prefix = name_prefix_ + prefix;
+  const auto lower =
+      std::lower_bound(first, last, name_prefix, entry_name_less);
+  const auto upper = std::partition_point(lower, last, [&](const Entry& e) {
+    return absl::StartsWith(e.name, name_prefix);
+  });
+  return {index_,
+          static_cast<size_t>(lower - index_->entries.begin()),
+          static_cast<size_t>(upper - index_->entries.begin()),
+          std::move(name_prefix),
+          prefix_ + prefix};
 }
 
 StateDict StateDict::select_with_transform(
@@ -3,14 +3,33 @@
 #include <folly/system/MemoryMapping.h>
 #include <torch/torch.h>
 
+#include <iterator>
 #include <memory>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace llm {
 
+// A read-only view of the tensors in a checkpoint file.
+// The tensor names are kept in a sorted index shared by all the views of the
+// same file. For safetensors, the index only holds the metadata from the
+// header and tensors are created from the memory mapping on get_tensor.
+// select() returns a view of the prefix range without copying the index.
 class StateDict final {
  public:
+  // metadata of a tensor in the index
+  struct Entry {
+    std::string name;
+    // set if the tensor is owned by the index, e.g. from a pickle file
+    torch::Tensor tensor;
+    // location of the tensor in the memory mapping
+    torch::ScalarType dtype = torch::kFloat;
+    std::vector<int64_t> sizes;
+    size_t offset = 0;
+  };
+
   static std::unique_ptr<StateDict> load(const std::string& weights_file,
                                          bool is_pickle);
 
@@ -24,7 +43,7 @@ class StateDict final {
             const std::string& prefix = "");
 
   StateDict(std::unique_ptr<folly::MemoryMapping> mem_map,
-            std::unordered_map<std::string, torch::Tensor> dict);
+            std::vector<Entry> entries);
 
   // get the tensor with the given name. return nullptr if not found.
   torch::Tensor get_tensor(const std::string& tensor_name) const;
@@ -46,19 +65,74 @@ class StateDict final {
   StateDict select_with_transform(const std::string& prefix,
                                   TensorTransform transform_func) const;
 
-  size_t size() const { return dict_.size(); }
+  size_t size() const { return end_ - begin_; }
 
   std::string_view prefix() const { return prefix_; }
 
+  // iterates over (name, tensor) pairs in the order of names, tensors are
+  // created on dereference
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<std::string, torch::Tensor>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    Iterator(const StateDict* state_dict, size_t index)
+        : state_dict_(state_dict), index_(index) {}
+
+    value_type operator*() const;
+
+    Iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return index_ == other.index_;
+    }
+    bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+   private:
+    const StateDict* state_dict_;
+    size_t index_;
+  };
+
   // support range-based for loop
-  auto begin() const { return dict_.begin(); }
-  auto end() const { return dict_.end(); }
+  Iterator begin() const { return {this, begin_}; }
+  Iterator end() const { return {this, end_}; }
 
  private:
-  // memory mapping for safetensors
-  std::unique_ptr<folly::MemoryMapping> mem_map_;
+  // index shared by all the views of a checkpoint file
+  struct Index {
+    // memory mapping for safetensors
+    std::unique_ptr<folly::MemoryMapping> mem_map;
+
+    // sorted by name
+    std::vector<Entry> entries;
+  };
+
+  StateDict(std::shared_ptr<const Index> index,
+            size_t begin,
+            size_t end,
+            std::string name_prefix,
+            std::string prefix);
+
+  // find the entry for the name relative to the view, nullptr if not found
+  const Entry* find(const std::string& tensor_name) const;
+
+  // create the tensor for the entry
+  torch::Tensor to_tensor(const Entry& entry) const;
+
+  std::shared_ptr<const Index> index_;
+
+  // range of the view in the index
+  size_t begin_ = 0;
+  size_t end_ = 0;
 
-  std::unordered_map<std::string, torch::Tensor> dict_;
+  // prefix stripped from the names in the index
+  std::string name_prefix_;
 
   TensorTransform transform_func_ = nullptr;
 
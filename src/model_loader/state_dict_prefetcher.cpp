@@ -0,0 +1,56 @@
+#include "state_dict_prefetcher.h"
+
+#include <folly/futures/Future.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/timer.h"
+
+namespace llm {
+
+StateDictPrefetcher::StateDictPrefetcher(std::vector<std::string> weights_files,
+                                         bool is_pickle,
+                                         size_t max_prefetch)
+    : weights_files_(std::move(weights_files)),
+      is_pickle_(is_pickle),
+      max_prefetch_(std::max<size_t>(max_prefetch, 1)),
+      threadpool_(std::min(max_prefetch_,
+                           std::max<size_t>(weights_files_.size(), 1))) {
+  fill_window();
+}
+
+std::unique_ptr<StateDict> StateDictPrefetcher::next() {
+  if (inflight_.empty()) {
+    return nullptr;
+  }
+  auto future = std::move(inflight_.front());
+  inflight_.pop_front();
+  auto state_dict = std::move(future).get();
+  // the consumer owns the returned state dict, start loading the next file
+  fill_window();
+  return state_dict;
+}
+
+void StateDictPrefetcher::fill_window() {
+  while (inflight_.size() < max_prefetch_ &&
+         next_index_ < weights_files_.size()) {
+    folly::Promise<std::unique_ptr<StateDict>> promise;
+    inflight_.push_back(promise.getSemiFuture());
+    threadpool_.schedule([weights_file = weights_files_[next_index_],
+                          is_pickle = is_pickle_,
+                          promise = std::move(promise)]() mutable {
+      Timer timer;
+      auto state_dict = StateDict::load(weights_file, is_pickle);
+      LOG(INFO) << "Loaded model weights from " << weights_file << " in "
+                << timer.elapsed_seconds() << "s";
+      promise.setValue(std::move(state_dict));
+    });
+    ++next_index_;
+  }
+}
+
+}  // namespace llm
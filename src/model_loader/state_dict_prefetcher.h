@@ -0,0 +1,55 @@
+#pragma once
+
+#include <folly/futures/Future.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/threadpool.h"
+#include "state_dict.h"
+
+namespace llm {
+
+// Maps and parses model weights files on a thread pool ahead of the consumer.
+// At most max_prefetch files are loaded or waiting to be consumed at any time,
+// which bounds the memory used by the mappings. state dicts are returned in
+// the order of the given files.
+class StateDictPrefetcher final {
+ public:
+  StateDictPrefetcher(std::vector<std::string> weights_files,
+                      bool is_pickle,
+                      size_t max_prefetch);
+
+  // disable copy and move
+  StateDictPrefetcher(const StateDictPrefetcher&) = delete;
+  StateDictPrefetcher& operator=(const StateDictPrefetcher&) = delete;
+
+  // return the next state dict, blocking until it is loaded.
+  // returns nullptr once all the files are consumed.
+  std::unique_ptr<StateDict> next();
+
+  size_t size() const { return weights_files_.size(); }
+
+ private:
+  // schedule loading of files until the prefetch window is full
+  void fill_window();
+
+  std::vector<std::string> weights_files_;
+
+  bool is_pickle_ = false;
+
+  size_t max_prefetch_ = 1;
+
+  // index of the next file to schedule
+  size_t next_index_ = 0;
+
+  // state dicts being loaded, in the order of the files
+  std::deque<folly::SemiFuture<std::unique_ptr<StateDict>>> inflight_;
+
+  // threads to load the files, one per file in the window
+  ThreadPool threadpool_;
+};
+
+}  // namespace llm
@@ -3,6 +3,12 @@
 #include <c10/core/Device.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "state_dict_prefetcher.h"
+
 namespace llm {
 
 // test data was generated with the following python code:
@@ -74,4 +80,79 @@ TEST(StateDictTest, SharedTensor) {
   EXPECT_TRUE(rank1_tensor.equal(chunks[1]));
 }
 
+TEST(StateDictTest, Select) {
+  auto state_dict = StateDict::load_safetensors("data/test.safetensors");
+
+  // key_1, key_10, ..., key_19
+  const auto selected = state_dict->select("key_1");
+  EXPECT_EQ(selected.size(), 11);
+  EXPECT_EQ(selected.prefix(), "key_1");
+  EXPECT_TRUE(selected.get_tensor("").equal(torch::ones({10, 10})));
+  EXPECT_TRUE(selected.get_tensor("5").equal(torch::ones({10, 10}) * 15));
+  EXPECT_FALSE(selected.get_tensor("key_15").defined());
+  EXPECT_FALSE(selected.get_tensor("2").defined());
+
+  // names are iterated in order without the prefix
+  std::vector<std::string> names;
+  for (const auto& [name, tensor] : selected) {
+    EXPECT_TRUE(tensor.equal(state_dict->get_tensor("key_1" + name)));
+    names.push_back(name);
+  }
+  EXPECT_EQ(names.front(), "");
+  EXPECT_EQ(names.back(), "9");
+  EXPECT_TRUE(std::is_sorted(names.begin(), names.end()));
+
+  // nested select
+  const auto nested = selected.select("1");
+  EXPECT_EQ(nested.size(), 1);
+  EXPECT_EQ(nested.prefix(), "key_11");
+  EXPECT_TRUE(nested.get_tensor("").equal(torch::ones({10, 10}) * 11));
+  EXPECT_EQ(state_dict->select("key_3").select("1").size(), 0);
+  EXPECT_EQ(state_dict->select("value").size(), 0);
+
+  // tensors outlive the state dict
+  const auto tensor = state_dict->get_tensor("key_7");
+  state_dict.reset();
+  EXPECT_TRUE(tensor.equal(torch::ones({10, 10}) * 7));
+}
+
+TEST(StateDictTest, SelectWithTransform) {
+  StateDict state_dict({{"a.weight", torch::ones({2})},
+                        {"a.bias", torch::zeros({2})},
+                        {"ab.weight", torch::ones({3})}});
+  const auto selected = state_dict.select_with_transform(
+      "a.", [](const std::string& name, const torch::Tensor& tensor) {
+        return name == "weight" ? tensor * 2 : tensor;
+      });
+  EXPECT_EQ(selected.size(), 2);
+  EXPECT_TRUE(selected.get_tensor("weight").equal(torch::ones({2}) * 2));
+  EXPECT_TRUE(selected.get_tensor("bias").equal(torch::zeros({2})));
+  // select drops the transform as before
+  EXPECT_TRUE(selected.select("weight").get_tensor("").equal(torch::ones({2})));
+}
+
+TEST(StateDictTest, Prefetcher) {
+  const std::vector<std::string> files(5, "data/test.safetensors");
+  for (const size_t max_prefetch : {0, 1, 2, 8}) {
+    StateDictPrefetcher prefetcher(files, /*is_pickle=*/false, max_prefetch);
+    EXPECT_EQ(prefetcher.size(), files.size());
+    size_t num_state_dicts = 0;
+    while (auto state_dict = prefetcher.next()) {
+      ++num_state_dicts;
+      EXPECT_EQ(state_dict->size(), 20);
+      EXPECT_TRUE(
+          state_dict->get_tensor("key_3").equal(torch::ones({10, 10}) * 3));
+    }
+    EXPECT_EQ(num_state_dicts, files.size());
+    EXPECT_EQ(prefetcher.next(), nullptr);
+  }
+
+  // pickle files
+  StateDictPrefetcher prefetcher(
+      {"data/test.pth", "data/test.pth"}, /*is_pickle=*/true, 2);
+  EXPECT_NE(prefetcher.next(), nullptr);
+  EXPECT_NE(prefetcher.next(), nullptr);
+  EXPECT_EQ(prefetcher.next(), nullptr);
+}
+
 }  // namespace llm
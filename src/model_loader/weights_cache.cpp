@@ -0,0 +1,339 @@
+#include "weights_cache.h"
+
+#include <folly/File.h>
+#include <folly/system/MemoryMapping.h>
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llm {
+namespace {
+// bump the version when the layout of the files changes
+constexpr int kWeightsCacheVersion = 1;
+
+constexpr char kMagic[8] = {'L', 'L', 'M', 'W', 'C', 'A', 'C', 'H'};
+
+constexpr size_t kHeaderPrefixSize = sizeof(kMagic) + sizeof(uint64_t);
+
+size_t align_up(size_t size) {
+  constexpr size_t alignment = WeightsCache::kWeightsCacheAlignment;
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+struct NamedTensor {
+  std::string name;
+  bool is_buffer = false;
+  torch::Tensor tensor;
+};
+
+// parameters and buffers of the module, named after their module path
+std::vector<NamedTensor> named_tensors(const torch::nn::Module& module) {
+  std::vector<NamedTensor> tensors;
+  for (const auto& item : module.named_parameters(/*recurse=*/true)) {
+    tensors.push_back({item.key(), /*is_buffer=*/false, item.value()});
+  }
+  for (const auto& item : module.named_buffers(/*recurse=*/true)) {
+    tensors.push_back({item.key(), /*is_buffer=*/true, item.value()});
+  }
+  return tensors;
+}
+
+std::string entry_key(const std::string& name, bool is_buffer) {
+  return (is_buffer ? "b:" : "p:") + name;
+}
+
+// check the fields of an index entry before reading them, the index is parsed
+// without exceptions
+bool is_valid_entry(const nlohmann::json& entry) {
+  if (!entry.is_object() || !entry.contains("name") ||
+      !entry.contains("buffer") || !entry.contains("dtype") ||
+      !entry.contains("shape") || !entry.contains("offset") ||
+      !entry.contains("nbytes")) {
+    return false;
+  }
+  if (!entry["name"].is_string() || !entry["buffer"].is_boolean() ||
+      !entry["dtype"].is_number_integer() || !entry["shape"].is_array() ||
+      !entry["offset"].is_number_unsigned() ||
+      !entry["nbytes"].is_number_unsigned()) {
+    return false;
+  }
+  return std::all_of(
+      entry["shape"].begin(), entry["shape"].end(), [](const auto& dim) {
+        return dim.is_number_unsigned();
+      });
+}
+
+// the checkpoint files are identified by name, size and modification time
+nlohmann::json checkpoint_files(const std::string& model_path) {
+  std::vector<std::filesystem::path> paths;
+  std::error_code ec;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(model_path, ec)) {
+    const auto ext = entry.path().extension();
+    if (entry.is_regular_file() &&
+        (ext == ".safetensors" || ext == ".bin" || ext == ".json")) {
+      paths.push_back(entry.path());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+
+  nlohmann::json files = nlohmann::json::array();
+  for (const auto& path : paths) {
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    files.push_back({{"name", path.filename().string()},
+                     {"size", std::filesystem::file_size(path, ec)},
+                     {"mtime", mtime.time_since_epoch().count()}});
+  }
+  return files;
+}
+
+bool write_file_atomic(const std::string& path, const std::string& content) {
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    if (!file) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  return !ec;
+}
+
+}  // namespace
+
+WeightsCache::WeightsCache(const std::string& cache_root, const Key& key)
+    : world_size_(key.world_size) {
+  std::error_code ec;
+  auto model_path = std::filesystem::weakly_canonical(key.model_path, ec);
+  if (ec) {
+    model_path = key.model_path;
+  }
+  const nlohmann::json fingerprint = {
+      {"version", kWeightsCacheVersion},
+      {"model_path", model_path.string()},
+      {"dtype", c10::toString(key.dtype)},
+      {"device_type", c10::DeviceTypeName(key.device_type)},
+      {"world_size", key.world_size},
+      {"quant_method", key.quant_method},
+      {"extras", key.extras},
+      {"files", checkpoint_files(key.model_path)}};
+  fingerprint_ = fingerprint.dump(/*indent=*/2);
+
+  std::ostringstream name;
+  name << "weights-" << std::hex << std::hash<std::string>{}(fingerprint_);
+  path_ = (std::filesystem::path(cache_root) / name.str()).string();
+}
+
+std::string WeightsCache::describe_checkpoint(const std::string& model_path) {
+  return checkpoint_files(model_path).dump();
+}
+
+std::string WeightsCache::rank_file(int rank) const {
+  return path_ + "/rank-" + std::to_string(rank) + ".bin";
+}
+
+bool WeightsCache::is_complete() const {
+  std::ifstream meta_file(path_ + "/meta.json");
+  if (!meta_file) {
+    return false;
+  }
+  std::stringstream meta;
+  meta << meta_file.rdbuf();
+  // guard against collisions of the directory name
+  if (meta.str() != fingerprint_) {
+    return false;
+  }
+  for (int rank = 0; rank < world_size_; ++rank) {
+    if (!std::filesystem::exists(rank_file(rank))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool WeightsCache::save(const torch::nn::Module& module, int rank) const {
+  std::error_code ec;
+  std::filesystem::create_directories(path_, ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to create weights cache directory " << path_ << ": "
+               << ec.message();
+    return false;
+  }
+
+  const auto tensors = named_tensors(module);
+  // build the index from the metadata, the data is copied one by one later
+  nlohmann::json index = nlohmann::json::array();
+  size_t data_size = 0;
+  for (const auto& [name, is_buffer, tensor] : tensors) {
+    const size_t nbytes = tensor.numel() * tensor.element_size();
+    index.push_back({{"name", name},
+                     {"buffer", is_buffer},
+                     {"dtype", static_cast<int>(tensor.scalar_type())},
+                     {"shape", tensor.sizes().vec()},
+                     {"offset", data_size},
+                     {"nbytes", nbytes}});
+    data_size = align_up(data_size + nbytes);
+  }
+  const std::string index_str = index.dump();
+  const uint64_t index_size = index_str.size();
+  const size_t data_start = align_up(kHeaderPrefixSize + index_size);
+
+  const std::string path = rank_file(rank);
+  const std::string tmp_path = path + ".tmp";
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  file.write(kMagic, sizeof(kMagic));
+  file.write(reinterpret_cast<const char*>(&index_size), sizeof(index_size));
+  file.write(index_str.data(), static_cast<std::streamsize>(index_size));
+
+  const std::vector<char> zeros(kWeightsCacheAlignment, 0);
+  const auto pad_to = [&](size_t pos) {
+    const auto current = static_cast<size_t>(file.tellp());
+    file.write(zeros.data(), static_cast<std::streamsize>(pos - current));
+  };
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    pad_to(data_start + index[i]["offset"].get<size_t>());
+    const auto tensor = tensors[i].tensor.detach().to(torch::kCPU).contiguous();
+    file.write(static_cast<const char*>(tensor.data_ptr()),
+               static_cast<std::streamsize>(tensor.nbytes()));
+  }
+  file.close();
+  if (!file) {
+    LOG(ERROR) << "Failed to write weights cache file " << tmp_path;
+    return false;
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    LOG(ERROR) << "Failed to rename " << tmp_path << ": " << ec.message();
+    return false;
+  }
+  LOG(INFO) << "Saved " << tensors.size() << " tensors to weights cache "
+            << path;
+  return true;
+}
+
+bool WeightsCache::commit() const {
+  if (!write_file_atomic(path_ + "/meta.json", fingerprint_)) {
+    LOG(ERROR) << "Failed to commit weights cache " << path_;
+    return false;
+  }
+  return true;
+}
+
+bool WeightsCache::load(torch::nn::Module& module, int rank) const {
+  const std::string path = rank_file(rank);
+  // private writable mapping: pages are shared with the page cache until
+  // written, and writes never reach the file.
+  folly::MemoryMapping::Options options;
+  options.setReadable(true).setWritable(true).setShared(false);
+  auto mapping = std::make_shared<folly::MemoryMapping>(
+      folly::File(path.c_str()), /*offset=*/0, /*length=*/-1, options);
+  const auto range = mapping->writableRange();
+  if (range.size() < kHeaderPrefixSize ||
+      std::memcmp(range.data(), kMagic, sizeof(kMagic)) != 0) {
+    LOG(ERROR) << "Invalid weights cache file " << path;
+    return false;
+  }
+  uint64_t index_size = 0;
+  std::memcpy(&index_size, range.data() + sizeof(kMagic), sizeof(index_size));
+  if (kHeaderPrefixSize + index_size > range.size()) {
+    LOG(ERROR) << "Truncated weights cache file " << path;
+    return false;
+  }
+  const auto index = nlohmann::json::parse(
+      range.data() + kHeaderPrefixSize,
+      range.data() + kHeaderPrefixSize + index_size,
+      /*cb=*/nullptr,
+      /*allow_exceptions=*/false);
+  if (!index.is_array()) {
+    LOG(ERROR) << "Invalid index in weights cache file " << path;
+    return false;
+  }
+  const size_t data_start = align_up(kHeaderPrefixSize + index_size);
+
+  std::unordered_map<std::string, const nlohmann::json*> entries;
+  for (const auto& entry : index) {
+    if (!is_valid_entry(entry)) {
+      LOG(ERROR) << "Invalid index entry in weights cache file " << path;
+      return false;
+    }
+    entries[entry_key(entry["name"].get<std::string>(),
+                      entry["buffer"].get<bool>())] = &entry;
+  }
+
+  // validate all the tensors before touching the module
+  const auto tensors = named_tensors(module);
+  if (tensors.size() != entries.size()) {
+    LOG(ERROR) << "Weights cache " << path << " has " << entries.size()
+               << " tensors, expected " << tensors.size();
+    return false;
+  }
+  std::vector<torch::Tensor> cached;
+  cached.reserve(tensors.size());
+  for (const auto& [name, is_buffer, tensor] : tensors) {
+    const auto it = entries.find(entry_key(name, is_buffer));
+    if (it == entries.end()) {
+      LOG(ERROR) << "Missing " << name << " in weights cache " << path;
+      return false;
+    }
+    const auto& entry = *it->second;
+    if (entry["dtype"].get<int>() != static_cast<int>(tensor.scalar_type())) {
+      LOG(ERROR) << "Dtype mismatch for " << name << " in weights cache "
+                 << path;
+      return false;
+    }
+    const auto dtype = tensor.scalar_type();
+    // empty placeholders, like the packed buffers of quantized layers, only
+    // get their shape once the weights are loaded
+    const auto shape = entry["shape"].get<std::vector<int64_t>>();
+    if (tensor.numel() > 0 && tensor.sizes() != torch::IntArrayRef(shape)) {
+      LOG(ERROR) << "Shape mismatch for " << name << " in weights cache "
+                 << path << ": " << torch::IntArrayRef(shape) << " vs "
+                 << tensor.sizes();
+      return false;
+    }
+    const auto offset = entry["offset"].get<size_t>();
+    const auto nbytes = entry["nbytes"].get<size_t>();
+    const int64_t numel = std::accumulate(
+        shape.begin(), shape.end(), int64_t(1), std::multiplies<int64_t>());
+    if (nbytes != numel * c10::elementSize(dtype)) {
+      LOG(ERROR) << "Size mismatch for " << name << " in weights cache "
+                 << path;
+      return false;
+    }
+    if (data_start + offset + nbytes > range.size()) {
+      LOG(ERROR) << "Truncated weights cache file " << path;
+      return false;
+    }
+    // the mapping is kept alive as long as any tensor points into it
+    cached.push_back(torch::from_blob(range.data() + data_start + offset,
+                                      shape,
+                                      [mapping](void* /*data*/) {},
+                                      torch::dtype(dtype)));
+  }
+
+  // point the tensors at the mapping, or copy them onto the device
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    auto tensor = tensors[i].tensor;
+    const auto& device = tensor.device();
+    tensor.set_data(device.is_cpu() ? cached[i] : cached[i].to(device));
+  }
+  LOG(INFO) << "Restored " << tensors.size() << " tensors from weights cache "
+            << path;
+  return true;
+}
+
+}  // namespace llm
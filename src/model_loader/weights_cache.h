@@ -0,0 +1,80 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <string>
+#include <vector>
+
+namespace llm {
+
+// A cache of the loaded weights of a model, one file per rank. Each file
+// holds the parameters and buffers of the rank in their final in-memory
+// layout: sharded, fused and repacked. Restoring maps the file and points the
+// tensors of the model at it instead of loading and transforming the
+// checkpoint again.
+//
+// The cache directory is keyed on the checkpoint files, dtype, device type,
+// world size and quantization method. The tensors must be saved before the
+// first forward so that layers repacking lazily in forward start from the
+// same state after restoring.
+//
+// layout of a rank file:
+//  | magic (8 bytes) | index size (8 bytes) | index (json) | padding |
+//  | tensor 0 | padding | tensor 1 | padding | ... |
+// tensors are aligned to kWeightsCacheAlignment bytes.
+class WeightsCache final {
+ public:
+  static constexpr size_t kWeightsCacheAlignment = 4096;
+
+  struct Key {
+    // path to the huggingface checkpoint
+    std::string model_path;
+
+    torch::ScalarType dtype = torch::kFloat;
+
+    torch::DeviceType device_type = torch::kCPU;
+
+    int world_size = 1;
+
+    std::string quant_method;
+
+    // extra options affecting the layout, e.g. the linear implementation
+    std::vector<std::string> extras;
+  };
+
+  WeightsCache(const std::string& cache_root, const Key& key);
+
+  // directory of the cache for the key
+  const std::string& path() const { return path_; }
+
+  // whether all ranks are saved and the cache is committed
+  bool is_complete() const;
+
+  // save the parameters and buffers of the module for the given rank.
+  bool save(const torch::nn::Module& module, int rank) const;
+
+  // mark the cache as complete once all ranks are saved
+  bool commit() const;
+
+  // restore the parameters and buffers of the module for the given rank.
+  // returns false without touching the module if the cache does not match
+  // the names, dtypes or shapes of its tensors. empty tensors take the cached
+  // shape, like packed buffers filled in by loading.
+  bool load(torch::nn::Module& module, int rank) const;
+
+  // describe the checkpoint files in the directory by name, size and
+  // modification time, used to detect checkpoints modified in place.
+  static std::string describe_checkpoint(const std::string& model_path);
+
+ private:
+  std::string rank_file(int rank) const;
+
+  // description of the key and the checkpoint files
+  std::string fingerprint_;
+
+  std::string path_;
+
+  int world_size_ = 1;
+};
+
+}  // namespace llm
@@ -0,0 +1,144 @@
+#include "weights_cache.h"
+
+#include <gtest/gtest.h>
+#include <torch/torch.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace llm {
+namespace {
+
+// a module with a nested linear layer, a buffer and a tensor whose shape
+// changes after loading, like the repacked weights of quantized layers.
+class TestModuleImpl : public torch::nn::Module {
+ public:
+  explicit TestModuleImpl(int64_t in_features = 8) {
+    linear_ = register_module(
+        "linear",
+        torch::nn::Linear(torch::nn::LinearOptions(in_features, 4)));
+    scales_ = register_buffer("scales", torch::zeros({4}));
+    packed_ = register_buffer("packed", torch::empty({0}, torch::kUInt8));
+  }
+
+  void randomize() {
+    torch::NoGradGuard no_grad;
+    linear_->weight.normal_();
+    linear_->bias.normal_();
+    scales_.uniform_();
+    packed_.set_data(torch::randint(0, 255, {3, 5}, torch::kUInt8));
+  }
+
+  torch::nn::Linear linear_{nullptr};
+  torch::Tensor scales_;
+  torch::Tensor packed_;
+};
+TORCH_MODULE(TestModule);
+
+class WeightsCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    root_ = std::filesystem::temp_directory_path() /
+            ("weights_cache_test_" + std::to_string(::getpid()));
+    model_path_ = root_ / "model";
+    std::filesystem::create_directories(model_path_);
+    std::ofstream(model_path_ / "config.json") << "{}";
+  }
+
+  void TearDown() override { std::filesystem::remove_all(root_); }
+
+  WeightsCache::Key key(int world_size) const {
+    WeightsCache::Key key;
+    key.model_path = model_path_.string();
+    key.dtype = torch::kFloat;
+    key.world_size = world_size;
+    return key;
+  }
+
+  std::filesystem::path root_;
+  std::filesystem::path model_path_;
+};
+
+}  // namespace
+
+TEST_F(WeightsCacheTest, SaveAndLoad) {
+  const int world_size = 2;
+  WeightsCache cache((root_ / "cache").string(), key(world_size));
+  EXPECT_FALSE(cache.is_complete());
+
+  std::vector<TestModule> saved;
+  for (int rank = 0; rank < world_size; ++rank) {
+    TestModule module;
+    module->randomize();
+    ASSERT_TRUE(cache.save(*module, rank));
+    saved.push_back(module);
+  }
+  // not complete until committed
+  EXPECT_FALSE(cache.is_complete());
+  ASSERT_TRUE(cache.commit());
+
+  // a new cache with the same key finds the committed files
+  WeightsCache restored_cache((root_ / "cache").string(), key(world_size));
+  EXPECT_EQ(restored_cache.path(), cache.path());
+  ASSERT_TRUE(restored_cache.is_complete());
+  for (int rank = 0; rank < world_size; ++rank) {
+    TestModule module;
+    ASSERT_TRUE(restored_cache.load(*module, rank));
+    EXPECT_TRUE(
+        torch::equal(module->linear_->weight, saved[rank]->linear_->weight));
+    EXPECT_TRUE(
+        torch::equal(module->linear_->bias, saved[rank]->linear_->bias));
+    EXPECT_TRUE(torch::equal(module->scales_, saved[rank]->scales_));
+    EXPECT_EQ(module->packed_.sizes(), torch::IntArrayRef({3, 5}));
+    EXPECT_TRUE(torch::equal(module->packed_, saved[rank]->packed_));
+
+    // the restored tensors can be written without touching the file
+    module->scales_.fill_(-1);
+  }
+  TestModule module;
+  ASSERT_TRUE(restored_cache.load(*module, /*rank=*/0));
+  EXPECT_TRUE(torch::equal(module->scales_, saved[0]->scales_));
+}
+
+TEST_F(WeightsCacheTest, KeyMismatch) {
+  WeightsCache cache((root_ / "cache").string(), key(/*world_size=*/1));
+  TestModule module;
+  module->randomize();
+  ASSERT_TRUE(cache.save(*module, /*rank=*/0));
+  ASSERT_TRUE(cache.commit());
+
+  // different world size
+  WeightsCache other_cache((root_ / "cache").string(), key(/*world_size=*/2));
+  EXPECT_NE(other_cache.path(), cache.path());
+  EXPECT_FALSE(other_cache.is_complete());
+
+  // checkpoint changed
+  std::ofstream(model_path_ / "config.json") << "{\"model_type\": \"llama\"}";
+  WeightsCache changed_cache((root_ / "cache").string(), key(1));
+  EXPECT_FALSE(changed_cache.is_complete());
+}
+
+TEST_F(WeightsCacheTest, ModuleMismatch) {
+  WeightsCache cache((root_ / "cache").string(), key(/*world_size=*/1));
+  TestModule module;
+  module->randomize();
+  ASSERT_TRUE(cache.save(*module, /*rank=*/0));
+  ASSERT_TRUE(cache.commit());
+
+  // a module with a different set of tensors is left untouched
+  torch::nn::Linear linear(torch::nn::LinearOptions(8, 4));
+  const auto weight = linear->weight.clone();
+  EXPECT_FALSE(cache.load(*linear, /*rank=*/0));
+  EXPECT_TRUE(torch::equal(linear->weight, weight));
+
+  // the same tensors with a different shape are rejected as well
+  TestModule other(/*in_features=*/16);
+  const auto other_weight = other->linear_->weight.clone();
+  EXPECT_FALSE(cache.load(*other, /*rank=*/0));
+  EXPECT_TRUE(torch::equal(other->linear_->weight, other_weight));
+}
+
+}  // namespace llm
@@ -75,6 +75,14 @@ void check_input(torch::Tensor input) {
 std::vector<std::unique_ptr<ProcessGroup>> ProcessGroup::create_process_groups(
     const std::vector<torch::Device>& devices) {
   CHECK(!devices.empty()) << "devices should not be empty";
+  if (devices[0].is_cpu()) {
+    // all devices should be cpu devices
+    for (const auto& device : devices) {
+      CHECK(device.is_cpu()) << "device should be cpu device";
+    }
+    return ProcessGroupSHM::create_process_groups(devices);
+  }
+
   // all devices should be cuda devices
   for (const auto& device : devices) {
     CHECK(device.is_cuda()) << "device should be cuda device";
@@ -30,7 +30,8 @@ class ProcessGroup {
   virtual void allgather(torch::Tensor input,
                          std::vector<torch::Tensor>& outputs) = 0;
 
-  // Create a process group where each process has a single GPU
+  // Create a process group where each process has a single device. cuda
+  // devices communicate through nccl, cpu devices through shared memory.
   // devices: list of devices to create process groups on.
   static std::vector<std::unique_ptr<ProcessGroup>> create_process_groups(
       const std::vector<torch::Device>& devices);
@@ -73,4 +74,43 @@ class ProcessGroupNCCL : public ProcessGroup {
   // nccl communicator.
   ncclComm_t comm_ = nullptr;
 };
+
+namespace detail {
+struct SHMContext;
+}  // namespace detail
+
+// A process group for workers running as threads in the same process, for
+// example one worker per cpu socket. Ranks exchange tensors through memory
+// shared by all of them and synchronize with spinning barriers, without locks:
+// allreduce is a reduce-scatter into per-rank buffers followed by an
+// all-gather. Only supports contiguous cpu tensors.
+class ProcessGroupSHM : public ProcessGroup {
+ public:
+  ProcessGroupSHM(int rank,
+                  int world_size,
+                  const torch::Device& device,
+                  std::shared_ptr<detail::SHMContext> context);
+
+  ~ProcessGroupSHM() override;
+
+  void allreduce(torch::Tensor& input) override;
+
+  void allgather(torch::Tensor input,
+                 std::vector<torch::Tensor>& outputs) override;
+
+  // create process groups sharing the same context, one for each cpu device
+  static std::vector<std::unique_ptr<ProcessGroup>> create_process_groups(
+      const std::vector<torch::Device>& devices);
+
+ private:
+  // wait until all ranks reach the barrier
+  void barrier();
+
+  // state shared by all ranks
+  std::shared_ptr<detail::SHMContext> context_;
+
+  // the local sense of the sense-reversing barrier
+  bool sense_ = false;
+};
+
 }  // namespace llm
@@ -0,0 +1,171 @@
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "process_group.h"
+
+namespace llm {
+namespace detail {
+
+// State shared by all ranks of ProcessGroupSHM. Each rank only writes its own
+// slots, the barriers order the writes against reads from other ranks.
+struct SHMContext {
+  explicit SHMContext(int world_size)
+      : world_size(world_size), inputs(world_size), buffers(world_size) {}
+
+  const int world_size;
+
+  // number of ranks arrived at the barrier
+  std::atomic<int> num_arrived{0};
+
+  // flipped by the last arriving rank to release the others
+  std::atomic<bool> sense{false};
+
+  // the input of each rank for the ongoing collective
+  std::vector<torch::Tensor*> inputs;
+
+  // per rank buffer holding the reduced chunk owned by the rank
+  std::vector<torch::Tensor> buffers;
+};
+
+}  // namespace detail
+
+namespace {
+// spin for a while before yielding, workers may outnumber the cores
+constexpr int kMaxSpins = 1024;
+
+void check_input(const torch::Tensor& input) {
+  CHECK(input.is_cpu()) << "input should be cpu tensor";
+  CHECK(input.is_contiguous()) << "input should be contiguous";
+  CHECK(!input.is_sparse()) << "input have to be cpu dense tensor";
+}
+
+// the range of elements [start, end) owned by the rank
+std::pair<int64_t, int64_t> chunk_range(int64_t numel,
+                                        int rank,
+                                        int world_size) {
+  return {numel * rank / world_size, numel * (rank + 1) / world_size};
+}
+
+}  // namespace
+
+std::vector<std::unique_ptr<ProcessGroup>>
+ProcessGroupSHM::create_process_groups(
+    const std::vector<torch::Device>& devices) {
+  const int world_size = static_cast<int>(devices.size());
+  auto context = std::make_shared<detail::SHMContext>(world_size);
+
+  std::vector<std::unique_ptr<ProcessGroup>> process_groups;
+  process_groups.reserve(devices.size());
+  for (int i = 0; i < world_size; ++i) {
+    process_groups.emplace_back(std::make_unique<ProcessGroupSHM>(
+        /*rank=*/i, world_size, devices[i], context));
+  }
+  return process_groups;
+}
+
+ProcessGroupSHM::ProcessGroupSHM(int rank,
+                                 int world_size,
+                                 const torch::Device& device,
+                                 std::shared_ptr<detail::SHMContext> context)
+    : ProcessGroup(rank, world_size, device), context_(std::move(context)) {
+  CHECK(context_ != nullptr);
+  CHECK_EQ(context_->world_size, world_size);
+}
+
+ProcessGroupSHM::~ProcessGroupSHM() = default;
+
+void ProcessGroupSHM::barrier() {
+  auto& context = *context_;
+  sense_ = !sense_;
+  if (context.num_arrived.fetch_add(1, std::memory_order_acq_rel) ==
+      world_size() - 1) {
+    // the last one resets the counter and releases all waiting ranks
+    context.num_arrived.store(0, std::memory_order_relaxed);
+    context.sense.store(sense_, std::memory_order_release);
+    return;
+  }
+
+  int spins = 0;
+  while (context.sense.load(std::memory_order_acquire) != sense_) {
+    if (++spins > kMaxSpins) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void ProcessGroupSHM::allreduce(torch::Tensor& input) {
+  check_input(input);
+  auto& context = *context_;
+  const int rank = this->rank();
+  const int world_size = this->world_size();
+  if (world_size == 1) {
+    return;
+  }
+
+  // publish the input to other ranks
+  context.inputs[rank] = &input;
+  barrier();
+
+  // reduce-scatter: sum up the chunk owned by this rank from all ranks. start
+  // from the local input which is likely in the local numa node.
+  const int64_t numel = input.numel();
+  const auto range = chunk_range(numel, rank, world_size);
+  const int64_t start = range.first;
+  const int64_t len = range.second - range.first;
+  if (len > 0) {
+    auto& buffer = context.buffers[rank];
+    if (!buffer.defined() || buffer.numel() < len ||
+        buffer.scalar_type() != input.scalar_type()) {
+      buffer = torch::empty({len}, input.options());
+    }
+    auto reduced = buffer.narrow(/*dim=*/0, /*start=*/0, /*length=*/len);
+    auto chunk = [&](int i) {
+      return context.inputs[i]->view({-1}).narrow(0, start, len);
+    };
+    const int next = (rank + 1) % world_size;
+    torch::add_out(reduced, chunk(rank), chunk(next));
+    for (int i = (next + 1) % world_size; i != rank; i = (i + 1) % world_size) {
+      reduced.add_(chunk(i));
+    }
+  }
+  barrier();
+
+  // all-gather: collect reduced chunks from all ranks into the input
+  auto flat_input = input.view({-1});
+  for (int i = 0; i < world_size; ++i) {
+    const auto [chunk_start, chunk_end] = chunk_range(numel, i, world_size);
+    const int64_t chunk_len = chunk_end - chunk_start;
+    if (chunk_len > 0) {
+      flat_input.narrow(0, chunk_start, chunk_len)
+          .copy_(context.buffers[i].narrow(0, 0, chunk_len));
+    }
+  }
+  // no barrier needed here: buffers are only written again after all ranks
+  // pass the first barrier of the next collective.
+}
+
+void ProcessGroupSHM::allgather(torch::Tensor input,
+                                std::vector<torch::Tensor>& outputs) {
+  check_input(input);
+  CHECK(outputs.size() == world_size())
+      << "outputs should have the same size as world_size";
+  auto& context = *context_;
+
+  // publish the input to other ranks
+  context.inputs[rank()] = &input;
+  barrier();
+
+  for (int i = 0; i < world_size(); ++i) {
+    outputs[i].copy_(*context.inputs[i]);
+  }
+  // wait for all ranks to finish reading the input before returning
+  barrier();
+}
+
+}  // namespace llm
@@ -8,15 +8,11 @@
 namespace llm {
 
 void run_collective_test(
-    int world_size,
+    const std::vector<torch::Device>& devices,
     std::function<void(const std::vector<torch::Tensor>& tensors,
                        ProcessGroup* pg)> func) {
   // create process groups
-  std::vector<torch::Device> devices;
-  devices.reserve(world_size);
-  for (int i = 0; i < world_size; ++i) {
-    devices.emplace_back(torch::kCUDA, i);
-  }
+  const int world_size = static_cast<int>(devices.size());
   auto process_groups = ProcessGroup::create_process_groups(devices);
   EXPECT_EQ(process_groups.size(), world_size);
 
@@ -28,7 +24,7 @@ void run_collective_test(
     tensors.push_back(torch::ones({100, 4096}, torch::kHalf));
   }
 
-  // run all reduce
+  // run collectives
   std::vector<std::thread> threads;
   threads.reserve(process_groups.size());
   for (int i = 0; i < world_size; ++i) {
@@ -45,6 +41,15 @@ void run_collective_test(
   }
 }
 
+std::vector<torch::Device> cuda_devices(int world_size) {
+  std::vector<torch::Device> devices;
+  devices.reserve(world_size);
+  for (int i = 0; i < world_size; ++i) {
+    devices.emplace_back(torch::kCUDA, i);
+  }
+  return devices;
+}
+
 TEST(ProcessGroupTest, NCCLAllReduce) {
   // skip test if less than two gpus
   if (torch::cuda::device_count() < 2) {
@@ -53,7 +58,8 @@ TEST(ProcessGroupTest, NCCLAllReduce) {
 
   for (int i = 2; i <= torch::cuda::device_count(); i *= 2) {
     run_collective_test(
-        i, [](const std::vector<torch::Tensor>& tensors, ProcessGroup* pg) {
+        cuda_devices(i),
+        [](const std::vector<torch::Tensor>& tensors, ProcessGroup* pg) {
           const int rank = pg->rank();
           const int world_size = pg->world_size();
           const auto& device = pg->device();
@@ -81,7 +87,8 @@ TEST(ProcessGroupTest, NCCLAllGather) {
 
   for (int i = 2; i <= torch::cuda::device_count(); i *= 2) {
     run_collective_test(
-        i, [](const std::vector<torch::Tensor>& tensors, ProcessGroup* pg) {
+        cuda_devices(i),
+        [](const std::vector<torch::Tensor>& tensors, ProcessGroup* pg) {
           const int rank = pg->rank();
           const int world_size = pg->world_size();
           const auto& device = pg->device();
@@ -103,4 +110,56 @@ TEST(ProcessGroupTest, NCCLAllGather) {
   }
 }
 
+TEST(ProcessGroupTest, SHMAllReduce) {
+  // including world size not dividing the number of elements
+  for (int world_size : {2, 3, 4}) {
+    const std::vector<torch::Device> devices(world_size, torch::kCPU);
+    run_collective_test(
+        devices,
+        [](const std::vector<torch::Tensor>& tensors, ProcessGroup* pg) {
+          const int rank = pg->rank();
+          const int world_size = pg->world_size();
+          for (int i = 0; i <= tensors.size() - world_size; ++i) {
+            // scale by rank to tell the ranks apart
+            auto tensor = tensors[i + rank] * (rank + 1);
+            pg->allreduce(tensor);
+            auto expected = torch::zeros_like(tensors[i]);
+            for (int j = 0; j < world_size; ++j) {
+              expected += tensors[i + j] * (j + 1);
+            }
+            EXPECT_TRUE(torch::equal(tensor, expected));
+          }
+
+          // tensors with fewer elements than ranks
+          auto small = torch::full({1}, rank + 1, torch::kFloat);
+          pg->allreduce(small);
+          EXPECT_EQ(small.item<float>(), world_size * (world_size + 1) / 2);
+        });
+  }
+}
+
+TEST(ProcessGroupTest, SHMAllGather) {
+  for (int world_size : {2, 3, 4}) {
+    const std::vector<torch::Device> devices(world_size, torch::kCPU);
+    run_collective_test(
+        devices,
+        [](const std::vector<torch::Tensor>& tensors, ProcessGroup* pg) {
+          const int rank = pg->rank();
+          const int world_size = pg->world_size();
+          for (int i = 0; i <= tensors.size() - world_size; ++i) {
+            // scale by rank to tell the ranks apart
+            auto tensor = tensors[i + rank] * (rank + 1);
+            std::vector<torch::Tensor> outputs(world_size);
+            for (int j = 0; j < world_size; ++j) {
+              outputs[j] = torch::empty_like(tensor);
+            }
+            pg->allgather(tensor, outputs);
+            for (int j = 0; j < world_size; ++j) {
+              EXPECT_TRUE(torch::equal(tensors[i + j] * (j + 1), outputs[j]));
+            }
+          }
+        });
+  }
+}
+
 }  // namespace llm
\ No newline at end of file
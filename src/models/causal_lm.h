@@ -3,6 +3,7 @@
 #include <c10/core/Device.h>
 #include <torch/torch.h>
 
+#include <type_traits>
 #include <vector>
 
 #include "memory/kv_cache.h"
@@ -39,6 +40,14 @@ class CausalLM : public torch::nn::Module {
   // verify if the model is loaded correctly
   virtual void verify_loaded_weights() const = 0;
 
+  // load the lora adapter into the slot.
+  // returns false if the model doesn't support lora adapters
+  virtual bool load_lora_adapter(int32_t /*slot*/,
+                                 const StateDict& /*state_dict*/,
+                                 float /*scaling*/) {
+    return false;
+  }
+
   virtual torch::Device device() const = 0;
 
   virtual const torch::TensorOptions& options() const = 0;
@@ -50,12 +59,26 @@ class CausalLM : public torch::nn::Module {
                                           const torch::TensorOptions& options);
 };
 
+namespace detail {
+// detect if the model supports lora adapters
+template <typename Model, typename = void>
+struct has_load_lora_adapter : std::false_type {};
+
+template <typename Model>
+struct has_load_lora_adapter<
+    Model,
+    std::void_t<decltype(std::declval<Model&>()->load_lora_adapter(
+        std::declval<int32_t>(),
+        std::declval<const StateDict&>(),
+        std::declval<float>()))>> : std::true_type {};
+}  // namespace detail
+
 // an template class to hold different models without using virtual functions.
 template <typename Model>
 class CausalLMImpl : public CausalLM {
  public:
   CausalLMImpl(Model model, const torch::TensorOptions& options)
-      : model_(std::move(model)), options_(options) {}
+      : model_(register_module("model", std::move(model))), options_(options) {}
 
   torch::Tensor forward(const torch::Tensor& tokens,     // [num_tokens]
                         const torch::Tensor& positions,  // [num_tokens]
@@ -77,6 +100,17 @@ class CausalLMImpl : public CausalLM {
     return model_->verify_loaded_weights();
   }
 
+  bool load_lora_adapter(int32_t slot,
+                         const StateDict& state_dict,
+                         float scaling) override {
+    if constexpr (detail::has_load_lora_adapter<Model>::value) {
+      model_->load_lora_adapter(slot, state_dict, scaling);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
   torch::Device device() const override { return options_.device(); }
 
   const torch::TensorOptions& options() const override { return options_; }
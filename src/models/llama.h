@@ -10,6 +10,7 @@
 #include "layers/embedding.h"
 #include "layers/fused_linear.h"
 #include "layers/linear.h"
+#include "layers/lora.h"
 #include "layers/normalization.h"
 #include "layers/qkv_linear.h"
 #include "memory/kv_cache.h"
@@ -53,11 +54,40 @@ class LlamaMLPImpl : public torch::nn::Module {
                                           quant_args,
                                           parallel_args,
                                           options));
+
+    if (args.max_loras() > 0) {
+      gate_up_lora_ = register_module(
+          "gate_up_lora",
+          LoraLinear(hidden_size,
+                     std::vector<int64_t>{intermediate_size, intermediate_size},
+                     /*row_parallel=*/false,
+                     args.max_loras(),
+                     args.max_lora_rank(),
+                     parallel_args,
+                     options));
+      down_lora_ = register_module(
+          "down_lora",
+          LoraLinear(intermediate_size,
+                     std::vector<int64_t>{hidden_size},
+                     /*row_parallel=*/true,
+                     args.max_loras(),
+                     args.max_lora_rank(),
+                     parallel_args,
+                     options));
+    }
   }
 
-  torch::Tensor forward(torch::Tensor x) {
+  torch::Tensor forward(torch::Tensor x, const InputParameters& input_params) {
     const auto gate_up = gate_up_proj_(x);
-    return down_proj_(act_func_(gate_up[0]) * gate_up[1]);
+    if (gate_up_lora_) {
+      gate_up_lora_->forward(x, gate_up, input_params);
+    }
+    const auto h = act_func_(gate_up[0]) * gate_up[1];
+    auto output = down_proj_(h);
+    if (down_lora_) {
+      down_lora_->forward(h, output, input_params);
+    }
+    return output;
   }
 
   // load the weight from the checkpoint
@@ -67,6 +97,15 @@ class LlamaMLPImpl : public torch::nn::Module {
     down_proj_->load_state_dict(state_dict.select("down_proj."));
   }
 
+  // load the lora adapter into the slot
+  void load_lora_adapter(int32_t slot,
+                         const StateDict& state_dict,
+                         float scaling) {
+    gate_up_lora_->load_adapter(
+        slot, state_dict, {"gate_proj.", "up_proj."}, scaling);
+    down_lora_->load_adapter(slot, state_dict, {"down_proj."}, scaling);
+  }
+
   void verify_loaded_weights(const std::string& prefix) const {
     gate_up_proj_->verify_loaded_weights(prefix + "[gate_proj,up_proj].");
     down_proj_->verify_loaded_weights(prefix + "down_proj.");
@@ -77,6 +116,10 @@ class LlamaMLPImpl : public torch::nn::Module {
   FusedColumnParallelLinear gate_up_proj_{nullptr};
   RowParallelLinear down_proj_{nullptr};
 
+  // low rank adapters, only created when lora is enabled
+  LoraLinear gate_up_lora_{nullptr};
+  LoraLinear down_lora_{nullptr};
+
   // activation function
   ActFunc act_func_{nullptr};
 };
@@ -119,6 +162,30 @@ class LlamaAttentionImpl : public torch::nn::Module {
                                                 parallel_args,
                                                 options));
 
+    if (args.max_loras() > 0) {
+      CHECK(n_kv_heads % world_size == 0)
+          << "lora requires n_kv_heads to be divisible by world_size";
+      qkv_lora_ = register_module(
+          "qkv_lora",
+          LoraLinear(hidden_size,
+                     std::vector<int64_t>{n_heads * head_dim,
+                                          n_kv_heads * head_dim,
+                                          n_kv_heads * head_dim},
+                     /*row_parallel=*/false,
+                     args.max_loras(),
+                     args.max_lora_rank(),
+                     parallel_args,
+                     options));
+      o_lora_ = register_module("o_lora",
+                                LoraLinear(hidden_size,
+                                           std::vector<int64_t>{hidden_size},
+                                           /*row_parallel=*/true,
+                                           args.max_loras(),
+                                           args.max_lora_rank(),
+                                           parallel_args,
+                                           options));
+    }
+
     // initialize attention
     const float scale = 1.0f / std::sqrt(static_cast<float>(head_dim));
     atten_ = register_module(
@@ -132,10 +199,17 @@ class LlamaAttentionImpl : public torch::nn::Module {
     // (num_tokens, dim) x (dim, n_local_heads * head_dim)
     // => (num_tokens, n_local_heads * head_dim)
     const auto qkv = qkv_proj_(x);
+    if (qkv_lora_) {
+      qkv_lora_->forward(x, qkv, input_params);
+    }
     // calculate attention, output: (num_tokens, n_local_heads * head_dim)
     const auto output =
         atten_(qkv[0], qkv[1], qkv[2], positions, kv_cache, input_params);
-    return o_proj_(output);
+    auto out = o_proj_(output);
+    if (o_lora_) {
+      o_lora_->forward(output, out, input_params);
+    }
+    return out;
   }
 
   // load the weight from the checkpoint
@@ -146,6 +220,15 @@ class LlamaAttentionImpl : public torch::nn::Module {
     o_proj_->load_state_dict(state_dict.select("o_proj."));
   }
 
+  // load the lora adapter into the slot
+  void load_lora_adapter(int32_t slot,
+                         const StateDict& state_dict,
+                         float scaling) {
+    qkv_lora_->load_adapter(
+        slot, state_dict, {"q_proj.", "k_proj.", "v_proj."}, scaling);
+    o_lora_->load_adapter(slot, state_dict, {"o_proj."}, scaling);
+  }
+
   void verify_loaded_weights(const std::string& prefix) const {
     qkv_proj_->verify_loaded_weights(prefix + "[q_proj,k_proj,v_proj].");
     o_proj_->verify_loaded_weights(prefix + "o_proj.");
@@ -157,6 +240,10 @@ class LlamaAttentionImpl : public torch::nn::Module {
 
   RowParallelLinear o_proj_{nullptr};
 
+  // low rank adapters, only created when lora is enabled
+  LoraLinear qkv_lora_{nullptr};
+  LoraLinear o_lora_{nullptr};
+
   // module members without parameters
   Attention atten_{nullptr};
 
@@ -192,7 +279,7 @@ class LlamaDecoderLayerImpl : public torch::nn::Module {
                         const InputParameters& input_params) {
     auto h =
         x + self_attn_(input_layernorm_(x), positions, kv_cache, input_params);
-    return h + mlp_(post_attention_layernorm_(h));
+    return h + mlp_(post_attention_layernorm_(h), input_params);
   }
 
   // load the weight from the checkpoint
@@ -205,6 +292,15 @@ class LlamaDecoderLayerImpl : public torch::nn::Module {
         state_dict.select("post_attention_layernorm."));
   }
 
+  // load the lora adapter into the slot
+  void load_lora_adapter(int32_t slot,
+                         const StateDict& state_dict,
+                         float scaling) {
+    self_attn_->load_lora_adapter(
+        slot, state_dict.select("self_attn."), scaling);
+    mlp_->load_lora_adapter(slot, state_dict.select("mlp."), scaling);
+  }
+
   void verify_loaded_weights(const std::string& prefix) const {
     self_attn_->verify_loaded_weights(prefix + "self_attn.");
     mlp_->verify_loaded_weights(prefix + "mlp.");
@@ -279,6 +375,18 @@ class LlamaModelImpl : public torch::nn::Module {
     norm_->load_state_dict(state_dict.select("norm."));
   }
 
+  // load the lora adapter into the slot
+  void load_lora_adapter(int32_t slot,
+                         const StateDict& state_dict,
+                         float scaling) {
+    for (int i = 0; i < layers_.size(); i++) {
+      layers_[i]->load_lora_adapter(
+          slot,
+          state_dict.select("layers." + std::to_string(i) + "."),
+          scaling);
+    }
+  }
+
   void verify_loaded_weights(const std::string& prefix) const {
     embed_tokens_->verify_loaded_weights(prefix + "embed_tokens.");
     for (int i = 0; i < layers_.size(); i++) {
@@ -351,6 +459,14 @@ class LlamaForCausalLMImpl : public torch::nn::Module {
     lm_head_->load_state_dict(state_dict.select("lm_head."));
   }
 
+  // load the lora adapter into the slot, adapters in the peft layout are
+  // selected with "base_model.model." by the caller
+  void load_lora_adapter(int32_t slot,
+                         const StateDict& state_dict,
+                         float scaling) {
+    model_->load_lora_adapter(slot, state_dict.select("model."), scaling);
+  }
+
   void verify_loaded_weights() const {
     model_->verify_loaded_weights("model.");
     lm_head_->verify_loaded_weights("lm_head.");
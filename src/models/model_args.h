@@ -125,6 +125,12 @@ struct ModelArgs {
   DEFINE_ARG(bool, use_sliding_window) = false;
   DEFINE_ARG(int32_t, sliding_window) = -1;
   DEFINE_ARG(int32_t, max_window_layers) = 0;
+
+  // the number of lora adapters served at the same time, set by the engine.
+  // 0 disables the lora adapters.
+  DEFINE_ARG(int64_t, max_loras) = 0;
+  // the maximum rank of the lora adapters
+  DEFINE_ARG(int64_t, max_lora_rank) = 0;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const ModelArgs& args) {
@@ -163,6 +169,8 @@ inline std::ostream& operator<<(std::ostream& os, const ModelArgs& args) {
   os << ", linear_bias: " << args.linear_bias();
   os << ", qkv_bias: " << args.qkv_bias();
   os << ", residual_post_layernorm: " << args.residual_post_layernorm();
+  os << ", max_loras: " << args.max_loras();
+  os << ", max_lora_rank: " << args.max_lora_rank();
   os << "]";
   return os;
 }
@@ -2,6 +2,8 @@
 
 #include <torch/torch.h>
 
+#include <vector>
+
 #include "common/tensor_helper.h"
 
 namespace llm {
@@ -9,21 +11,36 @@ namespace llm {
 // information required to process a batch efficiently, mainly for
 // self-attention and kv-cache.
 struct InputParameters {
-  InputParameters to(const torch::Device& device) const {
+  InputParameters to(const torch::Device& device,
+                     bool non_blocking = false) const {
     InputParameters params;
     // copy scalar values
     params.empty_kv_cache = empty_kv_cache;
     params.num_sequences = num_sequences;
     params.kv_max_seq_len = kv_max_seq_len;
     params.q_max_seq_len = q_max_seq_len;
+    params.lora_slots = lora_slots;
 
     // all tensors should be on the same device
-    params.kv_cu_seq_lens = safe_to(kv_cu_seq_lens, device);
-    params.q_cu_seq_lens = safe_to(q_cu_seq_lens, device);
+    params.kv_cu_seq_lens = safe_to(kv_cu_seq_lens, device, non_blocking);
+    params.q_cu_seq_lens = safe_to(q_cu_seq_lens, device, non_blocking);
+
+    params.new_cache_slots = safe_to(new_cache_slots, device, non_blocking);
+    params.block_tables = safe_to(block_tables, device, non_blocking);
+    params.cu_block_lens = safe_to(cu_block_lens, device, non_blocking);
+    params.lora_slot_ids = safe_to(lora_slot_ids, device, non_blocking);
+    return params;
+  }
 
-    params.new_cache_slots = safe_to(new_cache_slots, device);
-    params.block_tables = safe_to(block_tables, device);
-    params.cu_block_lens = safe_to(cu_block_lens, device);
+  // copy all host tensors into page-locked memory
+  InputParameters pin_memory() const {
+    InputParameters params = *this;
+    params.kv_cu_seq_lens = safe_pin_memory(kv_cu_seq_lens);
+    params.q_cu_seq_lens = safe_pin_memory(q_cu_seq_lens);
+    params.new_cache_slots = safe_pin_memory(new_cache_slots);
+    params.block_tables = safe_pin_memory(block_tables);
+    params.cu_block_lens = safe_pin_memory(cu_block_lens);
+    params.lora_slot_ids = safe_pin_memory(lora_slot_ids);
     return params;
   }
 
@@ -57,6 +74,13 @@ struct InputParameters {
   // cumulative block length for each sequence.
   // IntTensor: [n_seq + 1]
   torch::Tensor cu_block_lens;
+
+  // lora adapter slot for each token, 0 for tokens without adapter.
+  // only defined if any sequence in the batch uses an adapter.
+  // IntTensor: [n_tokens]
+  torch::Tensor lora_slot_ids;
+  // distinct non-zero adapter slots in the batch
+  std::vector<int32_t> lora_slots;
 };
 
 }  // namespace llm
@@ -0,0 +1,229 @@
+#include "qlinear_cpu_impl.h"
+
+#include <glog/logging.h>
+#include <torch/torch.h>
+
+#include <boost/algorithm/string.hpp>
+#include <tuple>
+#include <vector>
+
+#include "kernels/quantization/cpu/int4_gemm.h"
+#include "model_loader/state_dict.h"
+#include "pack_utils.h"
+
+namespace llm {
+namespace {
+constexpr int64_t kBits = 4;
+
+// argsort([0, 2, 4, 6, 1, 3, 5, 7]), the order awq packs 4-bit values
+const std::vector<int64_t> kUndoAWQInterleavingBits4 = {
+    0, 4, 1, 5, 2, 6, 3, 7};
+
+bool is_awq_format(const QuantArgs& quant_args) {
+  return boost::iequals(quant_args.quant_method(), "awq") ||
+         boost::iequals(quant_args.quant_method(), "GEMM");
+}
+
+void check_cpu_quant_args(const QuantArgs& quant_args) {
+  CHECK_EQ(quant_args.bits(), kBits)
+      << "Only 4 bits are supported for quantized linear on cpu";
+  CHECK(!quant_args.desc_act())
+      << "desc_act is not supported for quantized linear on cpu";
+}
+
+// gptq packs qweight on dim 0 and awq on dim 1
+int64_t qweight_pack_dim(const QuantArgs& quant_args) {
+  return is_awq_format(quant_args) ? 1 : 0;
+}
+
+torch::Tensor undo_awq_interleaving(const torch::Tensor& unpacked) {
+  const int64_t len = static_cast<int64_t>(kUndoAWQInterleavingBits4.size());
+  return unpacked.reshape({-1, len})
+      .index_select(/*dim=*/1, torch::tensor(kUndoAWQInterleavingBits4))
+      .reshape(unpacked.sizes())
+      .contiguous();
+}
+
+// unpack the checkpoint weights to (k, n) and zeros to (n_groups, n), then
+// repack them into the blocked layout of cpu::int4_gemm.
+// returns packed qweight, scales and scales * zeros
+std::tuple<torch::Tensor, torch::Tensor, torch::Tensor> repack_weights(
+    const torch::Tensor& qweight,
+    const torch::Tensor& qzeros,
+    const torch::Tensor& scales,
+    bool awq_format) {
+  torch::Tensor weights;
+  torch::Tensor zeros;
+  if (awq_format) {
+    // awq: (k, n/pack_factor) with interleaving, w = s * (q - z)
+    weights = undo_awq_interleaving(
+        pack_utils::unpack_cols(qweight.contiguous(), kBits));
+    zeros = undo_awq_interleaving(
+        pack_utils::unpack_cols(qzeros.contiguous(), kBits));
+  } else {
+    // gptq: (k/pack_factor, n), w = s * (q - (z + 1))
+    weights =
+        pack_utils::unpack_cols(qweight.t().contiguous(), kBits).t();
+    zeros = pack_utils::unpack_cols(qzeros.contiguous(), kBits) + 1;
+  }
+  const auto float_scales = scales.to(torch::kFloat);
+  return {cpu::int4_pack(weights),
+          cpu::int4_pad_params(float_scales),
+          cpu::int4_pad_params(float_scales * zeros)};
+}
+
+// release the memory of the checkpoint layout
+void release(torch::Tensor& tensor) {
+  tensor.set_data(torch::empty({0}, tensor.options()));
+}
+
+}  // namespace
+
+ColumnParallelQLinearCpuImpl::ColumnParallelQLinearCpuImpl(
+    int64_t in_features,
+    int64_t out_features,
+    bool bias,
+    const QuantArgs& quant_args,
+    bool gather_output,
+    const ParallelArgs& parallel_args,
+    const torch::TensorOptions& options)
+    : ColumnParallelQLinearImpl(in_features,
+                                out_features,
+                                bias,
+                                quant_args,
+                                qweight_pack_dim(quant_args),
+                                gather_output,
+                                parallel_args,
+                                options),
+      out_features_(out_features / parallel_args.world_size()),
+      group_size_(quant_args.group_size() > 0 ? quant_args.group_size()
+                                              : in_features),
+      awq_format_(is_awq_format(quant_args)) {
+  check_cpu_quant_args(quant_args);
+  register_packed_buffers();
+}
+
+torch::Tensor ColumnParallelQLinearCpuImpl::quant_matmul(
+    const torch::Tensor& input,
+    const torch::Tensor& /*qweight*/,
+    const torch::Tensor& /*qzeros*/,
+    const torch::Tensor& /*scales*/) const {
+  CHECK(packed_qweight_.numel() > 0) << "weights are not loaded";
+  return cpu::int4_gemm(input,
+                        packed_qweight_,
+                        packed_scales_,
+                        packed_scaled_zeros_,
+                        out_features_,
+                        group_size_);
+}
+
+void ColumnParallelQLinearCpuImpl::load_state_dict(
+    const StateDict& state_dict) {
+  ColumnParallelQLinearImpl::load_state_dict(state_dict);
+  repack_weights_if_loaded();
+}
+
+void ColumnParallelQLinearCpuImpl::load_state_dict(
+    const StateDict& state_dict,
+    const std::vector<std::string>& prefixes) {
+  ColumnParallelQLinearImpl::load_state_dict(state_dict, prefixes);
+  repack_weights_if_loaded();
+}
+
+void ColumnParallelQLinearCpuImpl::register_packed_buffers() {
+  // filled in by the repacking once the weights are loaded
+  packed_qweight_ =
+      register_buffer("packed_qweight", torch::empty({0}, torch::kUInt8));
+  packed_scales_ =
+      register_buffer("packed_scales", torch::empty({0}, torch::kFloat));
+  packed_scaled_zeros_ =
+      register_buffer("packed_scaled_zeros", torch::empty({0}, torch::kFloat));
+}
+
+void ColumnParallelQLinearCpuImpl::repack_weights_if_loaded() {
+  if (repacked_ || !qweight_is_loaded_ || !qzeros_is_loaded_ ||
+      !scales_is_loaded_) {
+    return;
+  }
+  auto [qweight, scales, scaled_zeros] =
+      repack_weights(qweight_, qzeros_, scales_, awq_format_);
+  packed_qweight_.set_data(qweight);
+  packed_scales_.set_data(scales);
+  packed_scaled_zeros_.set_data(scaled_zeros);
+  repacked_ = true;
+  release(qweight_);
+  release(qzeros_);
+  release(scales_);
+}
+
+RowParallelQLinearCpuImpl::RowParallelQLinearCpuImpl(
+    int64_t in_features,
+    int64_t out_features,
+    bool bias,
+    const QuantArgs& quant_args,
+    bool input_is_parallelized,
+    const ParallelArgs& parallel_args,
+    const torch::TensorOptions& options)
+    : RowParallelQLinearImpl(in_features,
+                             out_features,
+                             bias,
+                             quant_args,
+                             qweight_pack_dim(quant_args),
+                             input_is_parallelized,
+                             parallel_args,
+                             options),
+      out_features_(out_features),
+      group_size_(quant_args.group_size() > 0
+                      ? quant_args.group_size()
+                      : in_features / parallel_args.world_size()),
+      awq_format_(is_awq_format(quant_args)) {
+  check_cpu_quant_args(quant_args);
+  register_packed_buffers();
+}
+
+torch::Tensor RowParallelQLinearCpuImpl::quant_matmul(
+    const torch::Tensor& input,
+    const torch::Tensor& /*qweight*/,
+    const torch::Tensor& /*qzeros*/,
+    const torch::Tensor& /*scales*/) const {
+  CHECK(packed_qweight_.numel() > 0) << "weights are not loaded";
+  return cpu::int4_gemm(input,
+                        packed_qweight_,
+                        packed_scales_,
+                        packed_scaled_zeros_,
+                        out_features_,
+                        group_size_);
+}
+
+void RowParallelQLinearCpuImpl::load_state_dict(const StateDict& state_dict) {
+  RowParallelQLinearImpl::load_state_dict(state_dict);
+  repack_weights_if_loaded();
+}
+
+void RowParallelQLinearCpuImpl::register_packed_buffers() {
+  // filled in by the repacking once the weights are loaded
+  packed_qweight_ =
+      register_buffer("packed_qweight", torch::empty({0}, torch::kUInt8));
+  packed_scales_ =
+      register_buffer("packed_scales", torch::empty({0}, torch::kFloat));
+  packed_scaled_zeros_ =
+      register_buffer("packed_scaled_zeros", torch::empty({0}, torch::kFloat));
+}
+
+void RowParallelQLinearCpuImpl::repack_weights_if_loaded() {
+  if (repacked_ || !qweight_is_loaded_ || !qzeros_is_loaded_ ||
+      !scales_is_loaded_) {
+    return;
+  }
+  auto [qweight, scales, scaled_zeros] =
+      repack_weights(qweight_, qzeros_, scales_, awq_format_);
+  packed_qweight_.set_data(qweight);
+  packed_scales_.set_data(scales);
+  packed_scaled_zeros_.set_data(scaled_zeros);
+  repacked_ = true;
+  release(qweight_);
+  release(qzeros_);
+  release(scales_);
+}
+
+}  // namespace llm
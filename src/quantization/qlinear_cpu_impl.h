@@ -0,0 +1,98 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include "model_loader/state_dict.h"
+#include "models/model_args.h"
+#include "qlinear_impl.h"
+
+namespace llm {
+
+// Quantized linear layer with column parallelism for 4-bit gptq and awq
+// checkpoints on cpu. The packed weights are repacked into a blocked layout
+// once fully loaded and multiplied without dequantizing the whole matrix.
+class ColumnParallelQLinearCpuImpl : public ColumnParallelQLinearImpl {
+ public:
+  ColumnParallelQLinearCpuImpl(int64_t in_features,
+                               int64_t out_features,
+                               bool bias,
+                               const QuantArgs& quant_args,
+                               bool gather_output,
+                               const ParallelArgs& parallel_args,
+                               const torch::TensorOptions& options);
+
+  torch::Tensor quant_matmul(const torch::Tensor& input,
+                             const torch::Tensor& qweight,
+                             const torch::Tensor& qzeros,
+                             const torch::Tensor& scales) const override;
+
+  // load the weight from the checkpoint
+  void load_state_dict(const StateDict& state_dict) override;
+
+  // special load_state_dict for fused cases
+  void load_state_dict(const StateDict& state_dict,
+                       const std::vector<std::string>& prefixes) override;
+
+ private:
+  void register_packed_buffers();
+
+  // repack the weights once qweight, qzeros and scales are all loaded
+  void repack_weights_if_loaded();
+
+  // buffers for the blocked layout
+  torch::Tensor packed_qweight_;
+  torch::Tensor packed_scales_;
+  torch::Tensor packed_scaled_zeros_;
+
+  int64_t out_features_ = 0;
+  int64_t group_size_ = 0;
+
+  // true for awq checkpoints that pack qweight along the output dim
+  bool awq_format_ = false;
+
+  // whether the weights are repacked into the buffers
+  bool repacked_ = false;
+};
+
+// Quantized linear layer with row parallelism for 4-bit gptq and awq
+// checkpoints on cpu.
+class RowParallelQLinearCpuImpl : public RowParallelQLinearImpl {
+ public:
+  RowParallelQLinearCpuImpl(int64_t in_features,
+                            int64_t out_features,
+                            bool bias,
+                            const QuantArgs& quant_args,
+                            bool input_is_parallelized,
+                            const ParallelArgs& parallel_args,
+                            const torch::TensorOptions& options);
+
+  torch::Tensor quant_matmul(const torch::Tensor& input,
+                             const torch::Tensor& qweight,
+                             const torch::Tensor& qzeros,
+                             const torch::Tensor& scales) const override;
+
+  // load the weight from the checkpoint
+  void load_state_dict(const StateDict& state_dict) override;
+
+ private:
+  void register_packed_buffers();
+
+  // repack the weights once qweight, qzeros and scales are all loaded
+  void repack_weights_if_loaded();
+
+  // buffers for the blocked layout
+  torch::Tensor packed_qweight_;
+  torch::Tensor packed_scales_;
+  torch::Tensor packed_scaled_zeros_;
+
+  int64_t out_features_ = 0;
+  int64_t group_size_ = 0;
+
+  // true for awq checkpoints that pack qweight along the output dim
+  bool awq_format_ = false;
+
+  // whether the weights are repacked into the buffers
+  bool repacked_ = false;
+};
+
+}  // namespace llm
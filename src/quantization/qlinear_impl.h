@@ -82,7 +82,7 @@ class ColumnParallelQLinearImpl : public ParallelLinearImpl {
            << " device=" << qweight_.device();
   }
 
- private:
+ protected:
   // parameter members, must be registered
   DEFINE_FUSED_WEIGHT(qweight);
   DEFINE_FUSED_WEIGHT(qzeros);
@@ -154,7 +154,7 @@ class RowParallelQLinearImpl : public ParallelLinearImpl {
            << " device=" << qweight_.device();
   }
 
- private:
+ protected:
   // parameter members, must be registered
   DEFINE_WEIGHT(qweight);
   DEFINE_WEIGHT(qzeros);
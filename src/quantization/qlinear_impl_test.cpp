@@ -3,9 +3,22 @@
 #include <torch/torch.h>
 
 #include "model_loader/state_dict.h"
+#include "pack_utils.h"
+#include "qlinear_cpu_impl.h"
 #include "qlinear_gptq_impl.h"
 
 namespace llm {
+namespace {
+// awq packs 4-bit values in the order of [0, 2, 4, 6, 1, 3, 5, 7]
+torch::Tensor awq_pack_cols(const torch::Tensor& unpacked) {
+  const auto interleaving = torch::tensor({0, 2, 4, 6, 1, 3, 5, 7});
+  const auto interleaved = unpacked.reshape({-1, 8})
+                               .index_select(/*dim=*/1, interleaving)
+                               .reshape(unpacked.sizes())
+                               .contiguous();
+  return pack_utils::pack_cols(interleaved, /*num_bits=*/4);
+}
+}  // namespace
 
 TEST(QlinearTest, Basic) {
   auto state_dict = StateDict::load_safetensors("data/gptq_small.safetensors");
@@ -95,4 +108,136 @@ TEST(QlinearTest, RowParallelQuantLinear) {
                               /*atol=*/1e-02));
 }
 
+TEST(QlinearTest, ColumnParallelQuantLinearCpu) {
+  const int64_t in_features = 4096;
+  const int64_t out_features = 4096;
+  QuantArgs quant_args;
+  quant_args.quant_method("gptq").bits(4).group_size(128);
+  auto state_dict = StateDict::load_safetensors("data/gptq.safetensors");
+  const auto weights =
+      detail::construct_weights(state_dict->get_tensor("qweight"),
+                                state_dict->get_tensor("qzeros"),
+                                state_dict->get_tensor("scales"),
+                                /*bits=*/4)
+          .to(torch::kFloat);
+
+  for (const auto dtype : {torch::kFloat, torch::kBFloat16}) {
+    const auto options = torch::dtype(dtype).device(torch::kCPU);
+    ColumnParallelQLinearCpuImpl qlinear(in_features,
+                                         out_features,
+                                         /*bias=*/false,
+                                         quant_args,
+                                         /*gather_output=*/false,
+                                         ParallelArgs(0, 1, nullptr),
+                                         options);
+    qlinear.load_state_dict(*state_dict);
+    qlinear.verify_loaded_weights();
+
+    const auto input = torch::rand({7, in_features});
+    const auto output = qlinear.forward(input.to(dtype));
+    EXPECT_EQ(output.scalar_type(), dtype);
+    const auto desired_output = torch::matmul(input.to(dtype).to(torch::kFloat),
+                                              weights);
+    const double rtol = dtype == torch::kFloat ? 1e-4 : 1e-2;
+    EXPECT_TRUE(torch::allclose(output.to(torch::kFloat),
+                                desired_output,
+                                rtol,
+                                /*atol=*/1e-2));
+  }
+}
+
+TEST(QlinearTest, RowParallelQuantLinearCpu) {
+  // odd number of output blocks to cover the padding
+  const int64_t in_features = 256;
+  const int64_t out_features = 72;
+  const int64_t group_size = 64;
+  const int64_t n_groups = in_features / group_size;
+
+  // gptq checkpoint with zeros stored as z - 1
+  const auto q =
+      torch::randint(0, 16, {in_features, out_features}, torch::kInt);
+  const auto z = torch::randint(1, 16, {n_groups, out_features}, torch::kInt);
+  const auto scales = torch::rand({n_groups, out_features}) / 16;
+  StateDict state_dict(
+      {{"qweight",
+        pack_utils::pack_cols(q.t().contiguous(), /*num_bits=*/4)
+            .t()
+            .contiguous()},
+       {"qzeros", pack_utils::pack_cols(z - 1, /*num_bits=*/4)},
+       {"scales", scales}});
+  const auto weights =
+      detail::construct_weights(state_dict.get_tensor("qweight"),
+                                state_dict.get_tensor("qzeros"),
+                                state_dict.get_tensor("scales"),
+                                /*bits=*/4);
+
+  QuantArgs quant_args;
+  quant_args.quant_method("gptq").bits(4).group_size(group_size);
+  RowParallelQLinearCpuImpl qlinear(in_features,
+                                    out_features,
+                                    /*bias=*/false,
+                                    quant_args,
+                                    /*input_is_parallelized=*/true,
+                                    ParallelArgs(0, 1, nullptr),
+                                    torch::dtype(torch::kFloat));
+  qlinear.load_state_dict(state_dict);
+  qlinear.verify_loaded_weights();
+
+  const auto input = torch::randn({5, in_features});
+  const auto output = qlinear.forward(input);
+  EXPECT_TRUE(torch::allclose(output,
+                              torch::matmul(input, weights),
+                              /*rtol=*/1e-4,
+                              /*atol=*/1e-4));
+}
+
+TEST(QlinearTest, AWQQuantLinearCpu) {
+  const int64_t in_features = 256;
+  const int64_t out_features = 128;
+  const int64_t group_size = 128;
+  const int64_t n_groups = in_features / group_size;
+
+  const auto q =
+      torch::randint(0, 16, {in_features, out_features}, torch::kInt);
+  const auto z = torch::randint(0, 16, {n_groups, out_features}, torch::kInt);
+  const auto scales = torch::rand({n_groups, out_features}) / 16;
+  // awq: w = s * (q - z)
+  const auto weights =
+      (scales.unsqueeze(1) *
+       (q.reshape({n_groups, group_size, out_features}) - z.unsqueeze(1)))
+          .reshape({in_features, out_features});
+
+  // the fused weights are split on the output dim
+  const auto q_chunks = q.chunk(/*chunks=*/2, /*dim=*/1);
+  const auto z_chunks = z.chunk(/*chunks=*/2, /*dim=*/1);
+  const auto s_chunks = scales.chunk(/*chunks=*/2, /*dim=*/1);
+  std::unordered_map<std::string, torch::Tensor> dict;
+  for (int i = 0; i < 2; ++i) {
+    const std::string prefix = i == 0 ? "gate_proj." : "up_proj.";
+    dict[prefix + "qweight"] = awq_pack_cols(q_chunks[i].contiguous());
+    dict[prefix + "qzeros"] = awq_pack_cols(z_chunks[i].contiguous());
+    dict[prefix + "scales"] = s_chunks[i].contiguous();
+  }
+  StateDict state_dict(dict);
+
+  QuantArgs quant_args;
+  quant_args.quant_method("awq").bits(4).group_size(group_size);
+  ColumnParallelQLinearCpuImpl qlinear(in_features,
+                                       out_features,
+                                       /*bias=*/false,
+                                       quant_args,
+                                       /*gather_output=*/false,
+                                       ParallelArgs(0, 1, nullptr),
+                                       torch::dtype(torch::kFloat));
+  qlinear.load_state_dict(state_dict, {"gate_proj.", "up_proj."});
+  qlinear.verify_loaded_weights();
+
+  const auto input = torch::randn({3, in_features});
+  const auto output = qlinear.forward(input);
+  EXPECT_TRUE(torch::allclose(output,
+                              torch::matmul(input, weights),
+                              /*rtol=*/1e-4,
+                              /*atol=*/1e-4));
+}
+
 }  // namespace llm
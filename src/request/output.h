@@ -33,6 +33,32 @@ struct Usage {
 
   // the total number of tokens used in the request (prompt + completion).
   size_t num_total_tokens = 0;
+
+  // the number of prompt tokens served from the prefix cache.
+  size_t num_cached_tokens = 0;
+};
+
+// Where the time of a finished request went, in seconds. The phases are
+// back-to-back wall clock times, so they add up to the end to end latency.
+struct LatencyBreakdown {
+  // waiting in the queue before being scheduled for the first time.
+  double queue_seconds = 0;
+
+  // waiting to be rescheduled after being preempted.
+  double preempted_seconds = 0;
+
+  // from being scheduled until the prompt is processed, including the
+  // recomputation of the prompt after preemption.
+  double prefill_seconds = 0;
+
+  // from the end of the prefill until the last token is generated.
+  double decode_seconds = 0;
+
+  // from the last token until the response is dispatched.
+  double response_seconds = 0;
+
+  // the number of steps the prompt was processed in with chunked prefill.
+  size_t num_prefill_chunks = 0;
 };
 
 struct LogProbData {
@@ -86,6 +112,9 @@ struct RequestOutput {
   // the statistics for the request.
   std::optional<Usage> usage;
 
+  // the latency breakdown for finished requests.
+  std::optional<LatencyBreakdown> latency;
+
   // whether the request is finished.
   bool finished = false;
 };
@@ -4,6 +4,7 @@
 #include <absl/time/time.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -35,6 +36,7 @@ void Request::add_sequence() {
   options.stopping_criteria = this->stopping_criteria;
   options.echo = this->echo;
   options.logprobs = this->logprobs;
+  options.lora_adapter = this->lora_adapter;
 
   const size_t index = sequences.size();
   sequences.emplace_back(index,
@@ -73,6 +75,64 @@ void Request::expand_sequences() {
   }
 }
 
+void Request::on_scheduled(const absl::Time& now) {
+  if (phase_ == RequestPhase::WAITING || phase_ == RequestPhase::PREEMPTED) {
+    // the prompt is recomputed after preemption
+    transition_to(RequestPhase::PREFILL, now);
+  }
+  if (phase_ == RequestPhase::PREFILL) {
+    ++num_prefill_chunks_;
+  }
+}
+
+void Request::on_preempted(const absl::Time& now) {
+  // a waiting request may be preempted from blocks allocated ahead of time,
+  // which is still counted as queueing.
+  if (phase_ == RequestPhase::PREFILL || phase_ == RequestPhase::DECODE) {
+    transition_to(RequestPhase::PREEMPTED, now);
+  }
+}
+
+void Request::on_step_finished(const absl::Time& now) {
+  if (phase_ != RequestPhase::PREFILL) {
+    return;
+  }
+  const bool in_prefill =
+      std::any_of(sequences.begin(), sequences.end(), [](const Sequence& seq) {
+        return !seq.is_finished() && seq.is_prefill_stage();
+      });
+  if (!in_prefill) {
+    transition_to(RequestPhase::DECODE, now);
+  }
+}
+
+void Request::on_finished(const absl::Time& now) {
+  transition_to(RequestPhase::FINISHED, now);
+}
+
+void Request::transition_to(RequestPhase phase, const absl::Time& now) {
+  phase_durations_[static_cast<size_t>(phase_)] += now - phase_start_time_;
+  phase_ = phase;
+  phase_start_time_ = now;
+}
+
+LatencyBreakdown Request::latency_breakdown(const absl::Time& now) const {
+  auto durations = phase_durations_;
+  durations[static_cast<size_t>(phase_)] += now - phase_start_time_;
+  const auto seconds = [&durations](RequestPhase phase) {
+    return absl::ToDoubleSeconds(durations[static_cast<size_t>(phase)]);
+  };
+
+  LatencyBreakdown latency;
+  latency.queue_seconds = seconds(RequestPhase::WAITING);
+  latency.preempted_seconds = seconds(RequestPhase::PREEMPTED);
+  latency.prefill_seconds = seconds(RequestPhase::PREFILL);
+  latency.decode_seconds = seconds(RequestPhase::DECODE);
+  latency.response_seconds = seconds(RequestPhase::FINISHED);
+  latency.num_prefill_chunks = num_prefill_chunks_;
+  return latency;
+}
+
 RequestOutput Request::build_output(const Tokenizer& tokenizer) {
   // summarize statistics for all sequences
   Usage usage;
@@ -81,9 +141,16 @@ RequestOutput Request::build_output(const Tokenizer& tokenizer) {
     usage.num_generated_tokens += seq.num_generated_tokens();
   }
   usage.num_total_tokens = usage.num_prompt_tokens + usage.num_generated_tokens;
+  // all sequences share the same prompt, count the first one
+  if (!sequences.empty()) {
+    usage.num_cached_tokens = sequences.front().num_cached_tokens();
+  }
 
   RequestOutput output;
   output.usage = usage;
+  if (phase_ == RequestPhase::FINISHED) {
+    output.latency = latency_breakdown(absl::Now());
+  }
   output.status = Status(StatusCode::OK);
   output.finished = is_finished();
 
@@ -3,8 +3,10 @@
 #include <absl/time/clock.h>
 #include <absl/time/time.h>
 
+#include <array>
 #include <cstdint>
 #include <deque>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -15,6 +17,15 @@
 
 namespace llm {
 
+// The phases of a request, used to break down its latency.
+enum class RequestPhase : uint8_t {
+  WAITING = 0,
+  PREFILL,
+  DECODE,
+  PREEMPTED,
+  FINISHED,
+};
+
 // Function to call when an output is generated.
 using OnOutput = std::function<bool(const RequestOutput& output)>;
 
@@ -51,6 +62,13 @@ struct Request final {
     return is_cancelled_.load(std::memory_order_relaxed);
   }
 
+  // returns true if the request has run out of its deadline, or has been
+  // waiting in the queue for too long before being scheduled.
+  bool is_expired(const absl::Time& now) const {
+    return now > deadline ||
+           (!scheduled_time.has_value() && now > queue_deadline);
+  }
+
   // Get the elapsed time since the request was created.
   double elapsed_seconds() const {
     return absl::ToDoubleSeconds(absl::Now() - created_time);
@@ -58,6 +76,20 @@ struct Request final {
 
   RequestOutput build_output(const Tokenizer& tokenizer);
 
+  // record the transitions between phases for the latency breakdown. called
+  // by the scheduler when the request is scheduled for a step, preempted,
+  // after each step and when it is finished.
+  void on_scheduled(const absl::Time& now);
+  void on_preempted(const absl::Time& now);
+  void on_step_finished(const absl::Time& now);
+  void on_finished(const absl::Time& now);
+
+  RequestPhase phase() const { return phase_; }
+
+  // the latency breakdown of the request so far, the current phase is
+  // accounted until now.
+  LatencyBreakdown latency_breakdown(const absl::Time& now) const;
+
   // Scheduled time of the request.
   // NOLINTNEXTLINE
   const absl::Time created_time;
@@ -97,9 +129,30 @@ struct Request final {
   // Whether to echo back the prompt in the output.
   bool echo = false;
 
+  // the name of the lora adapter to serve the request, empty for the base
+  // model.
+  std::string lora_adapter;
+
   // the priority of the request.
   Priority priority = Priority::NORMAL;
 
+  // the tenant (end-user) that issued the request, used for fair-share
+  // scheduling. empty for anonymous requests.
+  std::string tenant;
+
+  // the request is aborted with DEADLINE_EXCEEDED once the deadline has
+  // passed. no deadline by default.
+  absl::Time deadline = absl::InfiniteFuture();
+
+  // the latest time for the request to be scheduled for the first time. the
+  // request is aborted with DEADLINE_EXCEEDED if it is still waiting in the
+  // queue after that.
+  absl::Time queue_deadline = absl::InfiniteFuture();
+
+  // the time the request was scheduled for the first time, nullopt if the
+  // request is still waiting in the queue.
+  std::optional<absl::Time> scheduled_time;
+
   // list of sequences to generate completions for the prompt
   // use deque instead of vector to avoid no-copy move for Sequence
   std::deque<Sequence> sequences;
@@ -108,8 +161,21 @@ struct Request final {
   OnOutput on_output;
 
  private:
+  // move to a new phase, accounting the time spent in the current one
+  void transition_to(RequestPhase phase, const absl::Time& now);
+
   // is the sequence cancelled
   std::atomic_bool is_cancelled_{false};
+
+  // the current phase and the time it started
+  RequestPhase phase_ = RequestPhase::WAITING;
+  absl::Time phase_start_time_ = created_time;
+
+  // the time spent in each phase, indexed by RequestPhase
+  std::array<absl::Duration, 5> phase_durations_{};
+
+  // the number of steps with prompt tokens
+  size_t num_prefill_chunks_ = 0;
 };
 
 // Compare two request contexts based on priority then scheduled time.
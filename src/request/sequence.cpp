@@ -4,6 +4,7 @@
 #include <absl/time/clock.h>
 #include <absl/time/time.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -284,6 +285,14 @@ void Sequence::set_shared_blocks(std::vector<Block>&& shared_blocks) {
             num_shared_tokens);
 }
 
+bool Sequence::record_cached_tokens(size_t num_tokens) {
+  if (num_cached_tokens_.has_value()) {
+    return false;
+  }
+  num_cached_tokens_ = std::min(num_tokens, num_prompt_tokens_);
+  return true;
+}
+
 // release all cache blocks
 void Sequence::release_blocks() {
   // reset the kv cache position to 0
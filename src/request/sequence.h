@@ -3,6 +3,8 @@
 #include <absl/time/time.h>
 
 #include <cstdint>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "common/slice.h"
@@ -10,6 +12,7 @@
 #include "memory/block.h"
 #include "output.h"
 #include "sampling/parameters.h"
+#include "status.h"
 #include "stopping_criteria.h"
 #include "tokenizer/tokenizer.h"
 
@@ -57,6 +60,9 @@ class Sequence final {
 
     // whether to output log probabilities for output tokens
     bool logprobs = false;
+
+    // the name of the lora adapter, empty for the base model
+    std::string lora_adapter;
   };
 
   Sequence(size_t index,
@@ -163,6 +169,13 @@ class Sequence final {
   // set shared cache blocks from prefix cache
   void set_shared_blocks(std::vector<Block>&& shared_blocks);
 
+  // the number of prompt tokens matched in the prefix cache on the first
+  // allocation. only the first match is recorded since a preempted sequence
+  // is matched again with its own cached blocks.
+  // returns false if the match has already been recorded.
+  bool record_cached_tokens(size_t num_tokens);
+  size_t num_cached_tokens() const { return num_cached_tokens_.value_or(0); }
+
   // release all cache blocks
   void release_blocks();
 
@@ -172,6 +185,24 @@ class Sequence final {
   // get the number of blocks
   size_t num_blocks() const { return blocks_.size(); }
 
+  // the prefix cache epoch when the first blocks were allocated, the kv cache
+  // computed with stale model weights is not inserted into the prefix cache.
+  uint64_t cache_epoch() const { return cache_epoch_; }
+  void set_cache_epoch(uint64_t epoch) { cache_epoch_ = epoch; }
+
+  // the name of the lora adapter, empty for the base model
+  const std::string& lora_adapter() const { return options_.lora_adapter; }
+
+  // the slot holding the weights of the lora adapter for the current step,
+  // 0 for the base model
+  int32_t lora_slot() const { return lora_slot_; }
+  void set_lora_slot(int32_t slot) { lora_slot_ = slot; }
+
+  // the error that stopped the sequence before a step, e.g. its lora adapter
+  // failed to load. the request is aborted with it.
+  const std::optional<Status>& error() const { return error_; }
+  void set_error(Status status) { error_ = std::move(status); }
+
   // get the reason why the sequence is finished
   FinishReason finish_reason() const { return finish_reason_; }
 
@@ -276,6 +307,18 @@ class Sequence final {
   // physical blocks that hold the kv cache.
   std::vector<Block> blocks_;
 
+  // the prefix cache epoch of the blocks
+  uint64_t cache_epoch_ = 0;
+
+  // the number of prompt tokens matched in the prefix cache
+  std::optional<size_t> num_cached_tokens_;
+
+  // the slot of the lora adapter
+  int32_t lora_slot_ = 0;
+
+  // the error that stopped the sequence
+  std::optional<Status> error_;
+
   // is the sequence finished
   mutable bool is_finished_ = false;
 
@@ -3,6 +3,7 @@
 #include <absl/strings/match.h>
 #include <gflags/gflags_declare.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <unordered_set>
 #include <vector>
@@ -57,4 +58,21 @@ FinishReason StoppingCriteria::check_finished(const Slice<int32_t>& token_ids,
   return FinishReason::NONE;
 }
 
+size_t StoppingCriteria::max_remaining_tokens(size_t num_tokens,
+                                              size_t num_prompt_tokens) const {
+  size_t remaining = SIZE_MAX;
+  if (max_tokens > 0) {
+    const size_t num_generated_tokens = num_tokens - num_prompt_tokens;
+    remaining = max_tokens > num_generated_tokens
+                    ? max_tokens - num_generated_tokens
+                    : 0;
+  }
+  if (max_context_len > 0) {
+    remaining = std::min(
+        remaining,
+        max_context_len > num_tokens ? max_context_len - num_tokens : 0);
+  }
+  return remaining;
+}
+
 }  // namespace llm
@@ -16,6 +16,11 @@ struct StoppingCriteria {
   FinishReason check_finished(const Slice<int32_t>& token_ids,
                               size_t num_prompt_tokens) const;
 
+  // the number of tokens that can still be generated before reaching the max
+  // tokens or the max context length, SIZE_MAX if neither is set.
+  size_t max_remaining_tokens(size_t num_tokens,
+                              size_t num_prompt_tokens) const;
+
   // private:
 
   // maximum number of generated tokens
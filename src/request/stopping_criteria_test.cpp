@@ -2,6 +2,8 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdint>
+
 namespace llm {
 
 TEST(StoppingCriteriaTest, MaxTokens) {
@@ -89,4 +91,21 @@ TEST(StoppingCriteriaTest, StopSequences) {
             FinishReason::STOP);
 }
 
+TEST(StoppingCriteriaTest, MaxRemainingTokens) {
+  StoppingCriteria stopping_criteria;
+  stopping_criteria.max_tokens = 0;
+  EXPECT_EQ(stopping_criteria.max_remaining_tokens(/*num_tokens=*/10,
+                                                   /*num_prompt_tokens=*/8),
+            SIZE_MAX);
+
+  // 2 tokens generated out of 5
+  stopping_criteria.max_tokens = 5;
+  EXPECT_EQ(stopping_criteria.max_remaining_tokens(10, 8), 3u);
+
+  // the context length is reached first
+  stopping_criteria.max_context_len = 12;
+  EXPECT_EQ(stopping_criteria.max_remaining_tokens(10, 8), 2u);
+  EXPECT_EQ(stopping_criteria.max_remaining_tokens(12, 8), 0u);
+}
+
 }  // namespace llm
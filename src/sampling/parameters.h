@@ -40,32 +40,57 @@ struct SamplingParameters {
             const std::vector<int32_t>& unique_token_lens_vec);
 
   SamplingParameters to(const torch::Device& device,
-                        torch::ScalarType dtype) const {
+                        torch::ScalarType dtype,
+                        bool non_blocking = false) const {
     SamplingParameters params;
 
     // all tensors should be on the same device
-    params.selected_token_idxes = safe_to(selected_token_idxes, device);
+    params.selected_token_idxes =
+        safe_to(selected_token_idxes, device, non_blocking);
 
     auto options = torch::device(device).dtype(dtype);
-    params.frequency_penalties = safe_to(frequency_penalties, options);
-    params.presence_penalties = safe_to(presence_penalties, options);
-    params.repetition_penalties = safe_to(repetition_penalties, options);
-    params.temperatures = safe_to(temperatures, options);
-    params.top_p = safe_to(top_p, options);
-    params.top_k = safe_to(top_k, device);
-
-    params.unique_token_ids = safe_to(unique_token_ids, device);
-    params.unique_token_counts = safe_to(unique_token_counts, device);
-    params.unique_token_ids_lens = safe_to(unique_token_ids_lens, device);
-
-    params.sample_idxes = safe_to(sample_idxes, device);
-    params.do_sample = safe_to(do_sample, device);
+    params.frequency_penalties =
+        safe_to(frequency_penalties, options, non_blocking);
+    params.presence_penalties =
+        safe_to(presence_penalties, options, non_blocking);
+    params.repetition_penalties =
+        safe_to(repetition_penalties, options, non_blocking);
+    params.temperatures = safe_to(temperatures, options, non_blocking);
+    params.top_p = safe_to(top_p, options, non_blocking);
+    params.top_k = safe_to(top_k, device, non_blocking);
+
+    params.unique_token_ids = safe_to(unique_token_ids, device, non_blocking);
+    params.unique_token_counts =
+        safe_to(unique_token_counts, device, non_blocking);
+    params.unique_token_ids_lens =
+        safe_to(unique_token_ids_lens, device, non_blocking);
+
+    params.sample_idxes = safe_to(sample_idxes, device, non_blocking);
+    params.do_sample = safe_to(do_sample, device, non_blocking);
     params.logprobs = logprobs;
     params.max_top_logprobs = max_top_logprobs;
 
     return params;
   }
 
+  // copy all host tensors into page-locked memory
+  SamplingParameters pin_memory() const {
+    SamplingParameters params = *this;
+    params.selected_token_idxes = safe_pin_memory(selected_token_idxes);
+    params.frequency_penalties = safe_pin_memory(frequency_penalties);
+    params.presence_penalties = safe_pin_memory(presence_penalties);
+    params.repetition_penalties = safe_pin_memory(repetition_penalties);
+    params.temperatures = safe_pin_memory(temperatures);
+    params.top_p = safe_pin_memory(top_p);
+    params.top_k = safe_pin_memory(top_k);
+    params.unique_token_ids = safe_pin_memory(unique_token_ids);
+    params.unique_token_counts = safe_pin_memory(unique_token_counts);
+    params.unique_token_ids_lens = safe_pin_memory(unique_token_ids_lens);
+    params.sample_idxes = safe_pin_memory(sample_idxes);
+    params.do_sample = safe_pin_memory(do_sample);
+    return params;
+  }
+
   // ########### following parameters are used for logit processing ########
   // selected tokens are tokens for sampling the next token,
   // including the generated tokens and the last prompt token
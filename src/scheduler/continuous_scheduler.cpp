@@ -3,17 +3,23 @@
 #include <absl/time/clock.h>
 #include <absl/time/time.h>
 #include <folly/MPMCQueue.h>
+#include <folly/futures/Future.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "common/metrics.h"
 #include "common/timer.h"
+#include "common/tracer.h"
 #include "engine/engine.h"
 #include "request/request.h"
 #include "request/sequence.h"
+#include "request/status.h"
 
 // metrics
 DEFINE_GAUGE(num_pending_requests, "Number of pending requests in scheduler");
@@ -32,6 +38,12 @@ DEFINE_GAUGE(num_free_blocks, "Number of free blocks in the block allocator");
 DEFINE_GAUGE(num_blocks_in_use, "Effective number of blocks in use");
 
 DEFINE_COUNTER(scheduling_latency_seconds, "Latency of scheduling in seconds");
+DEFINE_COUNTER(overlap_planning_latency_seconds,
+               "Latency of planning the next step while the model is running");
+DEFINE_COUNTER(num_overlap_planned_requests_total,
+               "Total number of requests planned while the model is running");
+DEFINE_COUNTER(num_multi_step_batches_total,
+               "Total number of batches running multiple decode iterations");
 
 DEFINE_COUNTER_FAMILY(num_processing_tokens_total,
                       "Total number of processing tokens");
@@ -42,6 +54,21 @@ DEFINE_COUNTER_INSTANCE(num_generated_tokens_total,
                         num_processing_tokens_total,
                         {{"type", "generated"}});
 
+DEFINE_COUNTER_FAMILY(num_shed_requests_total,
+                      "Total number of requests shed by the scheduler");
+DEFINE_COUNTER_INSTANCE(num_rejected_requests_total,
+                        num_shed_requests_total,
+                        {{"reason", "admission"}});
+DEFINE_COUNTER_INSTANCE(num_queue_timeout_requests_total,
+                        num_shed_requests_total,
+                        {{"reason", "queue_timeout"}});
+DEFINE_COUNTER_INSTANCE(num_deadline_exceeded_requests_total,
+                        num_shed_requests_total,
+                        {{"reason", "deadline"}});
+
+DEFINE_GAUGE(predicted_queue_time_seconds,
+             "Predicted queueing time for new requests in seconds");
+
 // ttft latency histogram
 DEFINE_HISTOGRAM(
     time_to_first_token_latency_seconds,
@@ -57,6 +84,9 @@ namespace llm {
 
 constexpr size_t kRequestQueueSize = 100000;
 
+// weight of the latest step for the moving average of throughput
+constexpr double kThroughputEmaAlpha = 0.1;
+
 ContinuousScheduler::ContinuousScheduler(Engine* engine, const Options& options)
     : options_(options), engine_(engine), request_queue_(kRequestQueueSize) {
   CHECK(engine_ != nullptr);
@@ -65,7 +95,32 @@ ContinuousScheduler::ContinuousScheduler(Engine* engine, const Options& options)
 
   enable_prefix_cache_ = block_manager_->options().enable_prefix_cache();
 
+  SchedulerPolicy::Options policy_options;
+  policy_options.name(options_.scheduler_policy())
+      .priority_aging_interval(options_.priority_aging_interval())
+      .fair_share_half_life(options_.fair_share_half_life())
+      .block_manager(block_manager_)
+      .cache_aware_max_wait(options_.cache_aware_max_wait());
+  priority_queue_ = SchedulerPolicy::create(policy_options);
+  CHECK(priority_queue_ != nullptr)
+      << "Failed to create scheduler policy: " << options_.scheduler_policy();
+
   response_handler_ = std::make_unique<ResponseHandler>(engine_->tokenizer());
+
+  // at least one sequence per batch
+  max_seqs_per_batch_ = std::max(options_.max_seqs_per_batch(), 1);
+  // average number of token budget for each sequence.
+  avg_sequence_token_budget_ =
+      std::max<size_t>(options_.max_tokens_per_batch() / max_seqs_per_batch_,
+                       1 + options_.num_speculative_tokens());
+  // at least avg_sequence_token_budget_ token per sequence
+  max_tokens_per_batch_ =
+      std::max<size_t>(options_.max_tokens_per_batch(),
+                       max_seqs_per_batch_ * avg_sequence_token_budget_);
+
+  if (options_.enable_overlap_scheduling()) {
+    engine_threadpool_ = std::make_unique<ThreadPool>(1);
+  }
 }
 
 ContinuousScheduler::~ContinuousScheduler() {
@@ -77,9 +132,9 @@ ContinuousScheduler::~ContinuousScheduler() {
   }
 
   // release all requests in the priority queue
-  while (!priority_queue_.empty()) {
-    Request* request = priority_queue_.top();
-    priority_queue_.pop();
+  while (!priority_queue_->empty()) {
+    Request* request = priority_queue_->top();
+    priority_queue_->pop();
     std::unique_ptr<Request> request_ptr(request);
   }
 
@@ -94,23 +149,62 @@ bool ContinuousScheduler::schedule(std::unique_ptr<Request>& request) {
   CHECK(request != nullptr);
   CHECK(!request->sequences.empty());
 
+  // apply the server-wide limit on queueing time
+  request->queue_deadline =
+      std::min(request->queue_deadline,
+               request->created_time + options_.max_queue_time());
+
+  const auto now = absl::Now();
+  const size_t num_prompt_tokens = request->prompt_tokens.size();
+  // shed the request up front if it can't be scheduled before its deadline
+  if (request->is_expired(now)) {
+    if (now > request->deadline) {
+      COUNTER_INC(num_deadline_exceeded_requests_total);
+    } else {
+      COUNTER_INC(num_queue_timeout_requests_total);
+    }
+    response_handler_->on_request_error(
+        std::move(request),
+        Status(StatusCode::DEADLINE_EXCEEDED, "Deadline exceeded"));
+    return true;
+  }
+  if (options_.enable_admission_control()) {
+    const auto deadline = std::min(request->deadline, request->queue_deadline);
+    if (deadline != absl::InfiniteFuture() &&
+        now + predict_queue_time(num_prompt_tokens) > deadline) {
+      COUNTER_INC(num_rejected_requests_total);
+      response_handler_->on_request_error(
+          std::move(request),
+          Status(StatusCode::DEADLINE_EXCEEDED,
+                 "Request can't be scheduled before its deadline"));
+      return true;
+    }
+  }
+
+  num_waiting_prompt_tokens_.fetch_add(num_prompt_tokens,
+                                       std::memory_order_relaxed);
   if (request_queue_.write(request.get())) {
     // take over the ownership of the request
     request.release();
+    // wake up the scheduler loop if it is idle
+    event_count_.notify_all();
     return true;
   }
+  num_waiting_prompt_tokens_.fetch_sub(num_prompt_tokens,
+                                       std::memory_order_relaxed);
   // queue is full
   return false;
 }
 
-Batch ContinuousScheduler::build_sequence_batch() {
-  Timer timer;
-
+void ContinuousScheduler::handle_new_requests(const absl::Time& now) {
   // propogate new requests to priority_queue_
   Request* request = nullptr;
   // read from request queue then push to priority queue
   while (request_queue_.read(request)) {
     CHECK(request != nullptr);
+    if (abort_if_expired(request, now)) {
+      continue;
+    }
 
     // expand sequences to the target number if prefix cache is disabled.
     if (!enable_prefix_cache_) {
@@ -118,8 +212,35 @@ Batch ContinuousScheduler::build_sequence_batch() {
       request->expand_sequences();
     }
 
-    priority_queue_.push(request);
+    priority_queue_->push(request);
+  }
+}
+
+bool ContinuousScheduler::drop_expired_waiting_request(const absl::Time& now) {
+  Request* request = priority_queue_->top();
+  if (!request->is_expired(now)) {
+    return false;
   }
+  priority_queue_->pop();
+  // the request may still hold blocks from previous steps
+  auto it = std::find(
+      preemptable_requests_.begin(), preemptable_requests_.end(), request);
+  if (it != preemptable_requests_.end()) {
+    preemptable_requests_.erase(it);
+  }
+  return abort_if_expired(request, now);
+}
+
+Batch ContinuousScheduler::build_sequence_batch() {
+  // no step is running, the engine can update the state shared with the
+  // scheduler, e.g. the prefix cache
+  engine_->on_step_boundary();
+
+  TraceSpan span("scheduler.build_batch");
+  Timer timer;
+  const auto now = absl::Now();
+
+  handle_new_requests(now);
 
   // insert running requests back to the priority queue, iterating from the
   // lowest priority to the highest
@@ -133,6 +254,11 @@ Batch ContinuousScheduler::build_sequence_batch() {
       continue;
     }
 
+    // drop expired requests before spending any budget on them
+    if (abort_if_expired(request, now) || abort_if_failed(request)) {
+      continue;
+    }
+
     // check if the request can be expanded
     if (request->should_expand_sequences()) {
       // cache the blocks to share among the sequences
@@ -151,39 +277,52 @@ Batch ContinuousScheduler::build_sequence_batch() {
     // put it to the front of the preemptable queue as it has higher priority
     preemptable_requests_.push_front(request);
     // push the request back to the priority queue
-    priority_queue_.push(request);
+    priority_queue_->push(request);
   }
   running_requests_.clear();
 
+  // re-evaluate the order of waiting requests for time dependent policies
+  priority_queue_->refresh(now);
+
   // clear previous batch
   running_sequences_.clear();
   running_sequences_budgets_.clear();
 
-  // at least one sequence per batch
-  const size_t max_seqs_per_batch = std::max(options_.max_seqs_per_batch(), 1);
-
-  // average number of token budget for each sequence.
-  const size_t avg_sequence_token_budget =
-      std::max<size_t>(options_.max_tokens_per_batch() / max_seqs_per_batch,
-                       1 + options_.num_speculative_tokens());
-
   // remaining budget for the current batch
-  // at least avg_sequence_token_budget token per sequence
-  size_t remaining_token_budget =
-      std::max<size_t>(options_.max_tokens_per_batch(),
-                       max_seqs_per_batch * avg_sequence_token_budget);
-  size_t remaining_seq_budget = max_seqs_per_batch;
+  size_t remaining_token_budget = max_tokens_per_batch_;
+  size_t remaining_seq_budget = max_seqs_per_batch_;
 
   size_t num_preempted_requests = 0;
 
   std::vector<Sequence*> candidate_sequences;
   std::vector<size_t> candidate_token_budgets;
+  // the lora adapters used by the batch
+  std::vector<std::string> lora_adapters;
+  // the requests set aside for this step, pushed back after scheduling
+  std::vector<Request*> skipped_requests;
   // schedule the requests in the priority queue until budgets are exhausted
-  while (!priority_queue_.empty() &&
+  while (!priority_queue_->empty() &&
          remaining_token_budget > options_.num_speculative_tokens() &&
          remaining_seq_budget > 0) {
-    Request* request = priority_queue_.top();
-    // TODO: check if request is timeout
+    // drop expired requests before spending any budget on them
+    if (drop_expired_waiting_request(now)) {
+      continue;
+    }
+    Request* request = priority_queue_->top();
+
+    // the adapters of the batch must fit in the lora slots
+    const auto& lora_adapter = request->lora_adapter;
+    const bool new_lora_adapter =
+        !lora_adapter.empty() &&
+        std::find(lora_adapters.begin(), lora_adapters.end(), lora_adapter) ==
+            lora_adapters.end();
+    if (new_lora_adapter && options_.max_loras() > 0 &&
+        lora_adapters.size() >= static_cast<size_t>(options_.max_loras())) {
+      // set it aside so that the requests behind it can still be scheduled
+      priority_queue_->pop();
+      skipped_requests.push_back(request);
+      continue;
+    }
 
     const size_t num_sequences = request->sequences.size();
     candidate_sequences.clear();
@@ -206,8 +345,9 @@ Batch ContinuousScheduler::build_sequence_batch() {
         break;
       }
 
-      const size_t token_budget = std::min(
-          avg_sequence_token_budget, remaining_token_budget - allocated_tokens);
+      const size_t token_budget =
+          std::min(avg_sequence_token_budget_,
+                   remaining_token_budget - allocated_tokens);
       size_t actual_tokens = 0;
       // no blocks left
       if (!allocate_blocks_for(&sequence, token_budget, &actual_tokens)) {
@@ -227,7 +367,7 @@ Batch ContinuousScheduler::build_sequence_batch() {
     // schedule candidates in the request if there are enough blocks
     if (has_enough_blocks) {
       // remove the request from the priority queue
-      priority_queue_.pop();
+      priority_queue_->pop();
       // add the request to the batch
       running_requests_.push_back(request);
       running_sequences_.insert(running_sequences_.end(),
@@ -238,11 +378,19 @@ Batch ContinuousScheduler::build_sequence_batch() {
                                         candidate_token_budgets.end());
       remaining_token_budget -= allocated_tokens;
       remaining_seq_budget -= allocated_seqs;
+      on_request_scheduled(request, allocated_tokens, now);
+      if (new_lora_adapter) {
+        lora_adapters.push_back(lora_adapter);
+      }
 
-      // the request has been scheduled and can't be preempted
-      if (!preemptable_requests_.empty() &&
-          request == preemptable_requests_.front()) {
-        preemptable_requests_.pop_front();
+      // the request has been scheduled and can't be preempted. it is usually
+      // at the front, but policies other than fcfs may pick requests in a
+      // different order than the one they were running in.
+      auto it = std::find(preemptable_requests_.begin(),
+                          preemptable_requests_.end(),
+                          request);
+      if (it != preemptable_requests_.end()) {
+        preemptable_requests_.erase(it);
       }
       continue;
     }
@@ -256,13 +404,14 @@ Batch ContinuousScheduler::build_sequence_batch() {
       if (request_to_preempt != request) {
         ++num_preempted_requests;
         block_manager_->release_blocks_for(request_to_preempt);
+        request_to_preempt->on_preempted(now);
       }
       continue;
     }
 
     // no requests left to preempt, partially schedule the request
     if (!candidate_sequences.empty()) {
-      priority_queue_.pop();
+      priority_queue_->pop();
       running_requests_.push_back(request);
       running_sequences_.insert(running_sequences_.end(),
                                 candidate_sequences.begin(),
@@ -272,9 +421,13 @@ Batch ContinuousScheduler::build_sequence_batch() {
                                         candidate_token_budgets.end());
       remaining_token_budget -= allocated_tokens;
       remaining_seq_budget -= allocated_seqs;
+      on_request_scheduled(request, allocated_tokens, now);
     }
     break;
   }
+  for (Request* request : skipped_requests) {
+    priority_queue_->push(request);
+  }
 
   // adjust the token number for each sequence if still have token budget left
   if (remaining_token_budget > 0) {
@@ -302,11 +455,15 @@ Batch ContinuousScheduler::build_sequence_batch() {
     }
   }
 
-  if (running_sequences_.empty() && !priority_queue_.empty()) {
+  if (running_sequences_.empty() && !priority_queue_->empty()) {
     LOG(ERROR) << "No enough memory to schedule single sequence";
     // no enough memory to schedule single sequence, just finish the request
-    Request* request = priority_queue_.top();
-    priority_queue_.pop();
+    Request* request = priority_queue_->top();
+    priority_queue_->pop();
+    if (!request->scheduled_time.has_value()) {
+      num_waiting_prompt_tokens_.fetch_sub(request->prompt_tokens.size(),
+                                           std::memory_order_relaxed);
+    }
     block_manager_->release_blocks_for(request);
     // release the ownership of the request
     response_handler_->on_request_finish(std::unique_ptr<Request>(request));
@@ -315,6 +472,8 @@ Batch ContinuousScheduler::build_sequence_batch() {
   // update the batch
   size_t num_prompt_tokens = 0;
   size_t num_generated_tokens = 0;
+  size_t num_prefill_seqs = 0;
+  next_step_num_tokens_ = 0;
   Batch batch;
   for (size_t i = 0; i < running_sequences_.size(); ++i) {
     auto* sequence = running_sequences_[i];
@@ -329,10 +488,37 @@ Batch ContinuousScheduler::build_sequence_batch() {
     const size_t generated_tokens = token_budget - prompt_tokens;
     num_prompt_tokens += prompt_tokens;
     num_generated_tokens += generated_tokens;
+    if (prompt_tokens > 0) {
+      ++num_prefill_seqs;
+    }
+
+    // assume the sequence either continues prefilling or decodes one token in
+    // the next step
+    const size_t next_prompt_tokens = remaining_prompt_tokens - prompt_tokens;
+    next_step_num_tokens_ +=
+        next_prompt_tokens > 0
+            ? std::min(next_prompt_tokens, avg_sequence_token_budget_)
+            : 1 + options_.num_speculative_tokens();
 
     batch.add(sequence, token_budget);
   }
 
+  const uint32_t num_decode_steps = num_decode_steps_for_batch();
+  if (num_decode_steps > 1) {
+    batch.set_num_decode_steps(num_decode_steps);
+    // an upper bound, sequences may finish before the last iteration
+    num_generated_tokens *= num_decode_steps;
+    COUNTER_INC(num_multi_step_batches_total);
+  }
+  num_batch_tokens_ = num_prompt_tokens + num_generated_tokens;
+  next_step_num_seqs_ = running_sequences_.size();
+  span.arg("num_prefill_seqs", num_prefill_seqs)
+      .arg("num_decode_seqs", running_sequences_.size() - num_prefill_seqs)
+      .arg("num_prompt_tokens", num_prompt_tokens)
+      .arg("num_generated_tokens", num_generated_tokens)
+      .arg("num_decode_steps", num_decode_steps)
+      .arg("num_preempted_requests", num_preempted_requests);
+
   // update metrics before returning
   if (!batch.empty()) {
     // only update the scheduling latency when there are requests to process
@@ -345,8 +531,10 @@ Batch ContinuousScheduler::build_sequence_batch() {
   GAUGE_SET(num_pending_requests,
             pending_requests_.load(std::memory_order_relaxed));
   GAUGE_SET(num_running_requests, running_requests_.size());
-  GAUGE_SET(num_waiting_requests, priority_queue_.size());
+  GAUGE_SET(num_waiting_requests, priority_queue_->size());
   GAUGE_SET(num_preempted_requests, num_preempted_requests);
+  GAUGE_SET(predicted_queue_time_seconds,
+            absl::ToDoubleSeconds(predict_queue_time(/*num_prompt_tokens=*/0)));
 
   GAUGE_SET(num_running_sequences, running_sequences_.size());
 
@@ -361,19 +549,20 @@ Batch ContinuousScheduler::build_sequence_batch() {
 Batch ContinuousScheduler::wait_for_batch(const absl::Duration& timeout) {
   const auto deadline = absl::Now() + timeout;
   while (true) {
+    // register as a waiter before building the batch to not miss requests
+    // arriving in between
+    const auto key = event_count_.prepare_wait();
     Batch batch = build_sequence_batch();
     if (!batch.empty()) {
+      event_count_.cancel_wait();
       return batch;
     }
-    const auto now = absl::Now();
-    if (now > deadline) {
+    if (absl::Now() > deadline) {
+      event_count_.cancel_wait();
       break;
     }
-    // wait for new requests to arrive
-    constexpr uint64_t kStepSleepTimeMs = 10;
-    const auto time_to_sleep =
-        std::min(absl::Milliseconds(kStepSleepTimeMs), deadline - now);
-    absl::SleepFor(time_to_sleep);
+    // block until new requests arrive
+    event_count_.wait_until(key, deadline);
   }
   // return an empty batch
   return {};
@@ -388,7 +577,7 @@ void ContinuousScheduler::step(const absl::Duration& timeout) {
     return;
   }
 
-  engine_->execute_model(batch);
+  execute_batch(batch);
 
   // process request output in batch
   process_batch_output();
@@ -396,20 +585,24 @@ void ContinuousScheduler::step(const absl::Duration& timeout) {
 
 void ContinuousScheduler::run_until_complete() {
   while (true) {
+    const auto key = event_count_.prepare_wait();
     // build a batch of requests/sequences
     auto batch = build_sequence_batch();
     if (batch.empty()) {
       if (pending_requests_.load(std::memory_order_relaxed) > 0) {
         // wait for new requests to arrive
+        event_count_.wait(key);
         continue;
       }
 
       // no more requests to process
+      event_count_.cancel_wait();
       break;
     }
+    event_count_.cancel_wait();
 
     // run inference for the batch
-    engine_->execute_model(batch);
+    execute_batch(batch);
 
     // process request output in batch
     process_batch_output();
@@ -419,7 +612,120 @@ void ContinuousScheduler::run_until_complete() {
   response_handler_->wait_for_complete();
 }
 
+void ContinuousScheduler::execute_batch(Batch& batch) {
+  TraceSpan span("scheduler.execute_batch");
+  span.arg("num_seqs", batch.size())
+      .arg("num_decode_steps", batch.num_decode_steps());
+  Timer timer;
+  if (engine_threadpool_ == nullptr) {
+    engine_->execute_model(batch);
+  } else {
+    // run the whole step on the engine thread, the outputs are applied to the
+    // batch there once the model is done
+    std::atomic<bool> done{false};
+    engine_threadpool_->schedule([this, &batch, &done]() {
+      engine_->execute_model_async(batch).get();
+      done.store(true, std::memory_order_release);
+      event_count_.notify_all();
+    });
+    // plan the next step while the model is running, and again whenever new
+    // requests arrive before it is done. the inputs of the next batch are
+    // still prepared by Batch::prepare_model_input after this step.
+    while (true) {
+      const auto key = event_count_.prepare_wait();
+      // requests scheduled before the step is done are seen by this plan
+      const bool step_done = done.load(std::memory_order_acquire);
+      plan_next_step();
+      if (step_done) {
+        event_count_.cancel_wait();
+        break;
+      }
+      event_count_.wait(key);
+    }
+  }
+  update_throughput(timer.elapsed_seconds());
+}
+
+void ContinuousScheduler::plan_next_step() {
+  AUTO_COUNTER(overlap_planning_latency_seconds);
+  TraceSpan span("scheduler.plan_next_step");
+  const auto now = absl::Now();
+  handle_new_requests(now);
+  priority_queue_->refresh(now);
+
+  // the budget left after running sequences take their share in the next step
+  size_t remaining_token_budget =
+      max_tokens_per_batch_ -
+      std::min(next_step_num_tokens_, max_tokens_per_batch_);
+  size_t remaining_seq_budget =
+      max_seqs_per_batch_ - std::min(next_step_num_seqs_, max_seqs_per_batch_);
+
+  // waiting requests are disjoint from the running batch, so it is safe to
+  // allocate blocks for them while the model is running.
+  std::vector<Request*> planned_requests;
+  size_t num_newly_planned_requests = 0;
+  while (!priority_queue_->empty() &&
+         remaining_token_budget > options_.num_speculative_tokens() &&
+         remaining_seq_budget > 0) {
+    if (drop_expired_waiting_request(now)) {
+      continue;
+    }
+    Request* request = priority_queue_->top();
+
+    bool has_enough_blocks = true;
+    size_t allocated_tokens = 0;
+    size_t allocated_seqs = 0;
+    for (Sequence& sequence : request->sequences) {
+      if (sequence.is_finished()) {
+        continue;
+      }
+      if (allocated_tokens + options_.num_speculative_tokens() >=
+              remaining_token_budget ||
+          allocated_seqs >= remaining_seq_budget) {
+        break;
+      }
+      const size_t token_budget =
+          std::min(avg_sequence_token_budget_,
+                   remaining_token_budget - allocated_tokens);
+      size_t actual_tokens = 0;
+      if (!allocate_blocks_for(&sequence, token_budget, &actual_tokens)) {
+        has_enough_blocks = false;
+        break;
+      }
+      allocated_tokens += actual_tokens;
+      allocated_seqs += 1;
+    }
+
+    // the allocated blocks can be reclaimed by preemption if the request
+    // doesn't make it into the next batch, requests planned before keep them
+    if (allocated_seqs > 0 &&
+        std::find(preemptable_requests_.begin(),
+                  preemptable_requests_.end(),
+                  request) == preemptable_requests_.end()) {
+      preemptable_requests_.push_back(request);
+      ++num_newly_planned_requests;
+    }
+    // no preemption while planning, leave it to the next step
+    if (!has_enough_blocks) {
+      break;
+    }
+
+    priority_queue_->pop();
+    planned_requests.push_back(request);
+    remaining_token_budget -= allocated_tokens;
+    remaining_seq_budget -= allocated_seqs;
+  }
+
+  // put planned requests back, the next step picks them up with blocks already
+  // allocated and patches the plan with the actual results of current step.
+  for (Request* request : planned_requests) {
+    priority_queue_->push(request);
+  }
+  COUNTER_ADD(num_overlap_planned_requests_total, num_newly_planned_requests);
+}
+
 void ContinuousScheduler::process_batch_output() {
+  TraceSpan span("scheduler.process_output");
   // update token latency metrics
   const auto now = absl::Now();
   for (Sequence* sequence : running_sequences_) {
@@ -434,12 +740,55 @@ void ContinuousScheduler::process_batch_output() {
 
   // process request output in batch
   for (Request* request : running_requests_) {
+    request->on_step_finished(now);
     if (request->is_streaming()) {
       response_handler_->on_request_stream(request);
     }
   }
 }
 
+uint32_t ContinuousScheduler::num_decode_steps_for_batch() {
+  uint32_t num_decode_steps =
+      static_cast<uint32_t>(std::max(options_.num_decode_steps(), 1));
+  // go back to the scheduler every step if new requests are waiting
+  if (num_decode_steps == 1 || options_.num_speculative_tokens() > 0 ||
+      running_sequences_.empty() || !priority_queue_->empty()) {
+    return 1;
+  }
+
+  for (size_t i = 0; i < running_sequences_.size(); ++i) {
+    const Sequence* sequence = running_sequences_[i];
+    if (sequence->is_prefill_stage() || running_sequences_budgets_[i] != 1) {
+      return 1;
+    }
+  }
+
+  // stop at the first sequence reaching its max tokens or max context length,
+  // which would otherwise keep running on the device past its limits, e.g.
+  // beyond the max position embeddings.
+  size_t max_decode_steps = num_decode_steps;
+  for (const Sequence* sequence : running_sequences_) {
+    max_decode_steps = std::min(
+        max_decode_steps,
+        sequence->stopping_criteria()->max_remaining_tokens(
+            sequence->num_tokens(), sequence->num_prompt_tokens()));
+  }
+  if (max_decode_steps <= 1) {
+    return 1;
+  }
+  num_decode_steps = static_cast<uint32_t>(max_decode_steps);
+
+  // allocate blocks for all the iterations up front. the blocks allocated
+  // before running out are used by the following steps anyway.
+  for (Sequence* sequence : running_sequences_) {
+    const size_t num_tokens = sequence->num_tokens() + num_decode_steps - 1;
+    if (!block_manager_->allocate_blocks_for(sequence, num_tokens)) {
+      return 1;
+    }
+  }
+  return num_decode_steps;
+}
+
 bool ContinuousScheduler::allocate_blocks_for(Sequence* sequence,
                                               size_t token_budget,
                                               size_t* actual_tokens) {
@@ -484,4 +833,86 @@ bool ContinuousScheduler::allocate_blocks_for(Sequence* sequence,
   return block_manager_->allocate_blocks_for(sequence, num_tokens);
 }
 
+void ContinuousScheduler::on_request_scheduled(Request* request,
+                                               size_t num_tokens,
+                                               const absl::Time& now) {
+  if (!request->scheduled_time.has_value()) {
+    request->scheduled_time = now;
+    num_waiting_prompt_tokens_.fetch_sub(request->prompt_tokens.size(),
+                                         std::memory_order_relaxed);
+  }
+  request->on_scheduled(now);
+  priority_queue_->on_scheduled(request, num_tokens);
+}
+
+bool ContinuousScheduler::abort_if_expired(Request* request,
+                                           const absl::Time& now) {
+  if (!request->is_expired(now)) {
+    return false;
+  }
+
+  if (now > request->deadline) {
+    COUNTER_INC(num_deadline_exceeded_requests_total);
+  } else {
+    COUNTER_INC(num_queue_timeout_requests_total);
+  }
+  if (!request->scheduled_time.has_value()) {
+    num_waiting_prompt_tokens_.fetch_sub(request->prompt_tokens.size(),
+                                         std::memory_order_relaxed);
+  }
+  block_manager_->release_blocks_for(request);
+  // release the ownership of the request
+  response_handler_->on_request_error(
+      std::unique_ptr<Request>(request),
+      Status(StatusCode::DEADLINE_EXCEEDED, "Deadline exceeded"));
+  return true;
+}
+
+bool ContinuousScheduler::abort_if_failed(Request* request) {
+  for (const Sequence& sequence : request->sequences) {
+    if (!sequence.error().has_value()) {
+      continue;
+    }
+    block_manager_->release_blocks_for(request);
+    // release the ownership of the request
+    response_handler_->on_request_error(std::unique_ptr<Request>(request),
+                                        sequence.error().value());
+    return true;
+  }
+  return false;
+}
+
+absl::Duration ContinuousScheduler::predict_queue_time(
+    size_t num_prompt_tokens) const {
+  const double tokens_per_second =
+      tokens_per_second_.load(std::memory_order_relaxed);
+  if (tokens_per_second <= 0) {
+    // no estimation yet
+    return absl::ZeroDuration();
+  }
+  // all waiting prompt tokens ahead, plus the request's own prompt, need to be
+  // processed before the request produces its first token. this is a rough
+  // estimation which ignores priorities and the decoding load.
+  const int64_t num_waiting_tokens =
+      std::max<int64_t>(
+          num_waiting_prompt_tokens_.load(std::memory_order_relaxed), 0) +
+      static_cast<int64_t>(num_prompt_tokens);
+  return absl::Seconds(static_cast<double>(num_waiting_tokens) /
+                       tokens_per_second);
+}
+
+void ContinuousScheduler::update_throughput(double step_seconds) {
+  if (step_seconds <= 0 || num_batch_tokens_ == 0) {
+    return;
+  }
+  const double tokens_per_second =
+      static_cast<double>(num_batch_tokens_) / step_seconds;
+  const double prev = tokens_per_second_.load(std::memory_order_relaxed);
+  // exponential moving average of the throughput
+  const double ema = prev <= 0 ? tokens_per_second
+                               : kThroughputEmaAlpha * tokens_per_second +
+                                     (1 - kThroughputEmaAlpha) * prev;
+  tokens_per_second_.store(ema, std::memory_order_relaxed);
+}
+
 }  // namespace llm
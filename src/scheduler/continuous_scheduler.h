@@ -3,16 +3,21 @@
 #include <absl/time/time.h>
 #include <folly/MPMCQueue.h>
 
+#include <atomic>
 #include <memory>
 #include <queue>
+#include <string>
 
+#include "common/event_count.h"
 #include "common/macros.h"
+#include "common/threadpool.h"
 #include "engine/batch.h"
 #include "memory/block_manager.h"
 #include "request/request.h"
 #include "request/sequence.h"
 #include "response_handler.h"
 #include "scheduler.h"
+#include "scheduler_policy.h"
 
 namespace llm {
 class Engine;
@@ -30,6 +35,50 @@ class ContinuousScheduler final : public Scheduler {
 
     // the number of speculative tokens per step
     DEFINE_ARG(int32_t, num_speculative_tokens) = 0;
+
+    // the policy to order waiting requests, one of: fcfs, spf, priority_aging,
+    // fair_share and cache_aware. see scheduler_policy.h for details.
+    DEFINE_ARG(std::string, scheduler_policy) = "fcfs";
+
+    // the waiting time to promote a request by one priority level, only used
+    // by the priority_aging policy
+    DEFINE_ARG(absl::Duration, priority_aging_interval) = absl::Seconds(5);
+
+    // the half life of the per-tenant usage, only used by the fair_share
+    // policy
+    DEFINE_ARG(absl::Duration, fair_share_half_life) = absl::Seconds(60);
+
+    // the waiting time after which a request is scheduled in arrival order
+    // instead of by its cost, only used by the cache_aware policy
+    DEFINE_ARG(absl::Duration, cache_aware_max_wait) = absl::Seconds(2);
+
+    // the maximum time a request can wait in the queue before being scheduled
+    // for the first time. requests waiting longer are aborted with
+    // DEADLINE_EXCEEDED. no limit by default.
+    DEFINE_ARG(absl::Duration, max_queue_time) = absl::InfiniteDuration();
+
+    // reject requests up front if their predicted queueing time, estimated
+    // from the number of waiting prompt tokens and the recent throughput,
+    // exceeds their deadline. only applies to requests with a deadline.
+    DEFINE_ARG(bool, enable_admission_control) = true;
+
+    // run the model on a separate thread and plan the next step while the
+    // current step is running, assuming every running sequence decodes one
+    // token. the plan is corrected once the results arrive. only admitting
+    // requests and allocating their blocks are overlapped, the inputs of the
+    // next batch are still prepared after the current step.
+    DEFINE_ARG(bool, enable_overlap_scheduling) = false;
+
+    // the maximum number of distinct lora adapters per batch, which is the
+    // number of lora slots of the engine. 0 means no limit.
+    DEFINE_ARG(int32_t, max_loras) = 0;
+
+    // the number of decode iterations to run per step when all running
+    // sequences are decoding and no request is waiting. blocks for all the
+    // iterations are allocated up front, and new requests wait for at most
+    // that many iterations. the iterations stop once a sequence reaches its
+    // max tokens or max context length. not used with speculative decoding.
+    DEFINE_ARG(int32_t, num_decode_steps) = 1;
   };
 
   ContinuousScheduler(Engine* engine, const Options& options);
@@ -37,7 +86,8 @@ class ContinuousScheduler final : public Scheduler {
   ~ContinuousScheduler();
 
   // schedule a request, thread safe and non-blocking
-  // may return false if the queue is full
+  // may return false if the queue is full. requests that can't meet their
+  // deadline are taken over and aborted with DEADLINE_EXCEEDED.
   bool schedule(std::unique_ptr<Request>& request) override;
 
   // step the scheduler forward by one step
@@ -55,17 +105,43 @@ class ContinuousScheduler final : public Scheduler {
     const auto old_value =
         pending_requests_.fetch_sub(1, std::memory_order_relaxed);
     CHECK_GT(old_value, 0) << "pending requests underflow";
+    // wake up run_until_complete() waiting for pending requests
+    event_count_.notify_all();
   }
 
  private:
   Batch wait_for_batch(const absl::Duration& timeout);
 
-  // build a batch of requests from the priority queue
+  // build a batch of requests from the priority queue, after calling the
+  // step boundary hook of the engine
   Batch build_sequence_batch();
 
+  // move new requests from the request queue into the priority queue
+  void handle_new_requests(const absl::Time& now);
+
+  // drop the request on the top of the priority queue if it has expired.
+  // returns true if the request is dropped.
+  bool drop_expired_waiting_request(const absl::Time& now);
+
+  // run the model for the batch, overlapped with planning the next step if
+  // enabled: the step runs on the engine thread while the next step is
+  // planned again for each new request arriving before it is done.
+  void execute_batch(Batch& batch);
+
+  // plan the next step while the current step is running: take in new
+  // requests and allocate blocks for waiting requests expected to fit into the
+  // next batch. only touches requests that are not in the running batch.
+  void plan_next_step();
+
   // process the batch output
   void process_batch_output();
 
+  // the number of decode iterations for the running sequences: the
+  // configured number if all of them are decoding one token, no request is
+  // waiting and blocks can be allocated for all the iterations, otherwise 1.
+  // capped by the first sequence to reach its max tokens or max context length.
+  uint32_t num_decode_steps_for_batch();
+
   // allocate blocks for a sequence, honoring the tokens budget.
   // * for prefill sequence, the allocated_tokens will be within
   // [1, num_prompt_tokens - num_tokens_in_kv_cache].
@@ -76,8 +152,38 @@ class ContinuousScheduler final : public Scheduler {
                            size_t token_budget,
                            size_t* actual_tokens);
 
+  // update states after num_tokens tokens of the request have been scheduled
+  void on_request_scheduled(Request* request,
+                            size_t num_tokens,
+                            const absl::Time& now);
+
+  // abort the request with DEADLINE_EXCEEDED if it has expired.
+  // returns true if the request is aborted and its ownership is released.
+  bool abort_if_expired(Request* request, const absl::Time& now);
+
+  // abort the request with the error of its first failed sequence, e.g. its
+  // lora adapter failed to load. returns true if the request is aborted and
+  // its ownership is released.
+  bool abort_if_failed(Request* request);
+
+  // predict the queueing time for a request with num_prompt_tokens tokens
+  absl::Duration predict_queue_time(size_t num_prompt_tokens) const;
+
+  // update the throughput estimation after running a batch
+  void update_throughput(double step_seconds);
+
   const Options options_;
 
+  // the maximum number of sequences per batch, at least one
+  size_t max_seqs_per_batch_ = 1;
+
+  // the average token budget for each sequence
+  size_t avg_sequence_token_budget_ = 1;
+
+  // the maximum number of tokens per batch, at least avg_sequence_token_budget_
+  // per sequence
+  size_t max_tokens_per_batch_ = 1;
+
   // the engine to run the batch
   Engine* engine_;
 
@@ -91,12 +197,15 @@ class ContinuousScheduler final : public Scheduler {
   // the schedule owns the requests and manages their lifetimes.
   folly::MPMCQueue<Request*> request_queue_;
 
+  // signaled when new requests arrive, the scheduler loop blocks on it when
+  // there is nothing to run instead of polling the request queue.
+  EventCount event_count_;
+
   // Requests with HIGH priority are processed first, followed by MEDIUM
   // priority requests, and finally LOW priority requests. Within each priority
-  // level, requests are handled on First-Come-First-Served (FCFS) basis.
-  using MinHeap =
-      std::priority_queue<Request*, std::vector<Request*>, RequestPtrGreater>;
-  MinHeap priority_queue_;
+  // level, requests are ordered by the scheduler policy, First-Come-First-
+  // Served (FCFS) by default.
+  std::unique_ptr<SchedulerPolicy> priority_queue_;
 
   // a batch of requests in running state, sorted by priority from high to low.
   std::vector<Request*> running_requests_;
@@ -117,6 +226,24 @@ class ContinuousScheduler final : public Scheduler {
 
   // the number of requests that are waiting to be scheduled
   std::atomic<size_t> pending_requests_{0};
+
+  // the number of prompt tokens of requests that haven't been scheduled yet
+  std::atomic<int64_t> num_waiting_prompt_tokens_{0};
+
+  // moving average of the number of tokens processed per second, 0 means no
+  // estimation yet.
+  std::atomic<double> tokens_per_second_{0};
+
+  // the number of tokens in the last batch
+  size_t num_batch_tokens_ = 0;
+
+  // the expected number of tokens and sequences for running sequences of the
+  // last batch in the next step, used to plan the next step in advance.
+  size_t next_step_num_tokens_ = 0;
+  size_t next_step_num_seqs_ = 0;
+
+  // the thread to dispatch the model when overlap scheduling is enabled
+  std::unique_ptr<ThreadPool> engine_threadpool_;
 };
 
 }  // namespace llm
@@ -7,6 +7,7 @@
 #include <memory>
 
 #include "common/metrics.h"
+#include "common/tracer.h"
 #include "request/request.h"
 #include "request/sequence.h"
 
@@ -26,21 +27,65 @@ DEFINE_HISTOGRAM(
     "Histogram of end to end latency in seconds",
     std::vector<double>{0.2, 0.5, 1.0, 2.0, 5.0, 10.0, 15.0, 20.0, 30.0, 60.0});
 
+DEFINE_HISTOGRAM_FAMILY(request_phase_latency_seconds,
+                        "Histogram of the time requests spent in each phase");
+DEFINE_HISTOGRAM_INSTANCE(
+    queue_latency_seconds,
+    request_phase_latency_seconds,
+    {{"phase", "queue"}},
+    std::vector<double>{0.01, 0.05, 0.1, 0.5, 1.0, 2.0, 5.0, 10.0, 30.0});
+DEFINE_HISTOGRAM_INSTANCE(
+    preempted_latency_seconds,
+    request_phase_latency_seconds,
+    {{"phase", "preempted"}},
+    std::vector<double>{0.01, 0.05, 0.1, 0.5, 1.0, 2.0, 5.0, 10.0, 30.0});
+DEFINE_HISTOGRAM_INSTANCE(
+    prefill_latency_seconds,
+    request_phase_latency_seconds,
+    {{"phase", "prefill"}},
+    std::vector<double>{0.01, 0.05, 0.1, 0.5, 1.0, 2.0, 5.0, 10.0, 30.0});
+DEFINE_HISTOGRAM_INSTANCE(
+    decode_latency_seconds,
+    request_phase_latency_seconds,
+    {{"phase", "decode"}},
+    std::vector<double>{0.2, 0.5, 1.0, 2.0, 5.0, 10.0, 20.0, 30.0, 60.0});
+DEFINE_HISTOGRAM_INSTANCE(
+    response_latency_seconds,
+    request_phase_latency_seconds,
+    {{"phase", "response"}},
+    std::vector<double>{0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0});
+
+DEFINE_HISTOGRAM(num_prefill_chunks,
+                 "Histogram of the number of steps to process a prompt",
+                 std::vector<double>{1, 2, 4, 8, 16, 32, 64});
+
 namespace llm {
 
 ResponseHandler::ResponseHandler(const Tokenizer* tokenizer)
     : tokenizer_(tokenizer->clone()) {}
 
 void ResponseHandler::on_request_finish(std::unique_ptr<Request> request) {
+  request->on_finished(absl::Now());
   // schedule the response handling
   response_threadpool_.schedule([tokenizer = tokenizer_.get(),
                                  request = std::move(request)]() {
     AUTO_COUNTER(non_stream_responsing_latency_seconds);
+    TraceSpan span("response_handler.finish");
 
     // update the metrics for the request
     HISTOGRAM_OBSERVE(end_2_end_latency_seconds, request->elapsed_seconds());
 
-    request->on_output(request->build_output(*tokenizer));
+    RequestOutput output = request->build_output(*tokenizer);
+    if (output.latency.has_value()) {
+      const auto& latency = output.latency.value();
+      HISTOGRAM_OBSERVE(queue_latency_seconds, latency.queue_seconds);
+      HISTOGRAM_OBSERVE(preempted_latency_seconds, latency.preempted_seconds);
+      HISTOGRAM_OBSERVE(prefill_latency_seconds, latency.prefill_seconds);
+      HISTOGRAM_OBSERVE(decode_latency_seconds, latency.decode_seconds);
+      HISTOGRAM_OBSERVE(response_latency_seconds, latency.response_seconds);
+      HISTOGRAM_OBSERVE(num_prefill_chunks, latency.num_prefill_chunks);
+    }
+    request->on_output(output);
   });
 }
 
@@ -74,6 +119,8 @@ void ResponseHandler::on_request_stream(Request* request) {
                                  num_tokens = std::move(num_tokens),
                                  tokenizer = tokenizer_.get()]() {
     AUTO_COUNTER(stream_responsing_latency_seconds);
+    TraceSpan span("response_handler.stream");
+    span.arg("num_seqs", indexes.size());
 
     RequestOutput req_output;
     for (size_t i = 0; i < indexes.size(); ++i) {
@@ -94,6 +141,16 @@ void ResponseHandler::on_request_stream(Request* request) {
   });
 }
 
+void ResponseHandler::on_request_error(std::unique_ptr<Request> request,
+                                       Status status) {
+  response_threadpool_.schedule(
+      [request = std::move(request), status = std::move(status)]() mutable {
+        RequestOutput output(std::move(status));
+        output.finished = true;
+        request->on_output(output);
+      });
+}
+
 void ResponseHandler::wait_for_complete() {
   // add a task to the end of the pool to wait for it to finish
   absl::Notification done;
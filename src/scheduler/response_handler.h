@@ -3,6 +3,9 @@
 #include <common/threadpool.h>
 
 #include <cstdint>
+#include <memory>
+
+#include "request/status.h"
 
 namespace llm {
 
@@ -19,6 +22,9 @@ class ResponseHandler final {
 
   void on_request_stream(Request* request);
 
+  // take over the ownership of the request and respond with an error status
+  void on_request_error(std::unique_ptr<Request> request, Status status);
+
   // wait for all responses in queue to be handled
   void wait_for_complete();
 
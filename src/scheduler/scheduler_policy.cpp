@@ -4,113 +4,264 @@
 #include <absl/time/time.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
 #include "memory/block_manager.h"
 #include "request/request.h"
 #include "request/sequence.h"
-#include "scheduler/response_handler.h"
 
 namespace llm {
-constexpr size_t kRequestQueueSize = 100000;
-constexpr size_t kMaxBatchSize = 100;
-
-FCFSSchedulerPolicy::FCFSSchedulerPolicy(ResponseHandler* response_handler,
-                                         BlockManager* block_manager)
-    : response_handler_(response_handler),
-      block_manager_(block_manager),
-      waiting_queue_(kRequestQueueSize) {}
-
-FCFSSchedulerPolicy::~FCFSSchedulerPolicy() {
-  // release all requests in the queue
-  while (!waiting_queue_.isEmpty()) {
-    Request* request = nullptr;
-    waiting_queue_.read(request);
-    std::unique_ptr<Request> request_ptr(request);
-  }
+namespace {
+// usage below this threshold is dropped to bound the size of the usage map
+constexpr double kMinTenantUsage = 1e-3;
+}  // namespace
+
+namespace {
+using PolicyFactory =
+    std::unique_ptr<SchedulerPolicy> (*)(const SchedulerPolicy::Options&);
 
-  // release all requests in the ready queue
-  for (Request* request : blocking_queue_) {
-    std::unique_ptr<Request> request_ptr(request);
+struct PolicyEntry {
+  const char* name;
+  PolicyFactory create;
+};
+
+// the supported policies by name, an empty name selects the first one
+const PolicyEntry kPolicies[] = {
+    {"fcfs",
+     [](const SchedulerPolicy::Options& /*options*/)
+         -> std::unique_ptr<SchedulerPolicy> {
+       return std::make_unique<FCFSSchedulerPolicy>();
+     }},
+    {"spf",
+     [](const SchedulerPolicy::Options& /*options*/)
+         -> std::unique_ptr<SchedulerPolicy> {
+       return std::make_unique<ShortestPromptFirstSchedulerPolicy>();
+     }},
+    {"priority_aging",
+     [](const SchedulerPolicy::Options& options)
+         -> std::unique_ptr<SchedulerPolicy> {
+       return std::make_unique<PriorityAgingSchedulerPolicy>(
+           options.priority_aging_interval());
+     }},
+    {"fair_share",
+     [](const SchedulerPolicy::Options& options)
+         -> std::unique_ptr<SchedulerPolicy> {
+       return std::make_unique<FairShareSchedulerPolicy>(
+           options.fair_share_half_life());
+     }},
+    {"cache_aware",
+     [](const SchedulerPolicy::Options& options)
+         -> std::unique_ptr<SchedulerPolicy> {
+       return std::make_unique<CacheAwareSchedulerPolicy>(
+           options.block_manager(), options.cache_aware_max_wait());
+     }},
+};
+
+const PolicyEntry* find_policy(const std::string& name) {
+  if (name.empty()) {
+    return &kPolicies[0];
   }
+  for (const auto& policy : kPolicies) {
+    if (name == policy.name) {
+      return &policy;
+    }
+  }
+  return nullptr;
+}
+}  // namespace
 
-  // release all requests in the running queue
-  for (Request* request : running_queue_) {
-    std::unique_ptr<Request> request_ptr(request);
+std::unique_ptr<SchedulerPolicy> SchedulerPolicy::create(
+    const Options& options) {
+  const auto* policy = find_policy(options.name());
+  if (policy == nullptr) {
+    LOG(ERROR) << "Unknown scheduler policy: " << options.name()
+               << ", expected one of: " << joined_names();
+    return nullptr;
   }
+  return policy->create(options);
+}
 
-  running_queue_.clear();
-  blocking_queue_.clear();
+bool SchedulerPolicy::is_supported(const std::string& name) {
+  return find_policy(name) != nullptr;
 }
 
-bool FCFSSchedulerPolicy::schedule(std::unique_ptr<Request>& request) {
-  CHECK(request != nullptr);
-  if (waiting_queue_.write(request.get())) {
-    // take over the ownership of the request
-    request.release();
-    return true;
-  }
-  // queue is full
-  return false;
+const std::vector<std::string>& SchedulerPolicy::names() {
+  static const auto* names = [] {
+    auto* names = new std::vector<std::string>();
+    for (const auto& policy : kPolicies) {
+      names->emplace_back(policy.name);
+    }
+    return names;
+  }();
+  return *names;
 }
 
-std::vector<Sequence*> FCFSSchedulerPolicy::build_batch() {
-  std::vector<Request*> ready_queue;
-  for (Request* request : running_queue_) {
-    if (request->is_finished()) {
-      response_handler_->on_request_finish(std::unique_ptr<Request>(request));
-      continue;
+std::string SchedulerPolicy::joined_names() {
+  std::string joined;
+  for (const auto& name : names()) {
+    if (!joined.empty()) {
+      joined += ", ";
     }
-    ready_queue.emplace_back(request);
+    joined += name;
   }
-  running_queue_.clear();
+  return joined;
+}
 
-  for (Request* request : blocking_queue_) {
-    ready_queue.emplace_back(request);
-  }
-  blocking_queue_.clear();
+void SchedulerPolicy::push(Request* request) {
+  CHECK(request != nullptr);
+  heap_.push_back({key(request, absl::Now()), request});
+  std::push_heap(heap_.begin(), heap_.end(), EntryGreater());
+}
 
-  while (!waiting_queue_.isEmpty()) {
-    Request* request = nullptr;
-    waiting_queue_.read(request);
-    CHECK(request != nullptr);
-    ready_queue.emplace_back(request);
+void SchedulerPolicy::pop() {
+  CHECK(!heap_.empty());
+  std::pop_heap(heap_.begin(), heap_.end(), EntryGreater());
+  heap_.pop_back();
+}
+
+void SchedulerPolicy::refresh(const absl::Time& now) {
+  if (!is_dynamic()) {
+    return;
+  }
+  on_refresh(now);
+  // re-evaluate keys for all waiting requests then rebuild the heap
+  for (auto& entry : heap_) {
+    entry.key = key(entry.request, now);
   }
+  std::make_heap(heap_.begin(), heap_.end(), EntryGreater());
+}
 
-  std::vector<Sequence*> running_batch;
-  running_batch.reserve(kMaxBatchSize);
-  for (Request* request : ready_queue) {
-    if (request->sequences.empty() || request->is_finished()) {
-      continue;
-    }
+SchedulerPolicy::Key FCFSSchedulerPolicy::key(const Request* request,
+                                              const absl::Time& /*now*/) const {
+  return {static_cast<int32_t>(request->priority), 0, request->created_time};
+}
 
-    std::vector<Sequence*> sequences;
-    sequences.reserve(request->sequences.size());
+SchedulerPolicy::Key ShortestPromptFirstSchedulerPolicy::key(
+    const Request* request,
+    const absl::Time& /*now*/) const {
+  // use the first sequence as the representative, all sequences in a request
+  // share the same prompt.
+  const auto& sequence = request->sequences.front();
+  const size_t num_prompt_tokens = sequence.num_prompt_tokens();
+  const size_t num_kv_cache_tokens = sequence.num_kv_cache_tokens();
+  const size_t remaining_prompt_tokens =
+      num_prompt_tokens > num_kv_cache_tokens
+          ? num_prompt_tokens - num_kv_cache_tokens
+          : 0;
+  return {static_cast<int32_t>(request->priority),
+          static_cast<double>(remaining_prompt_tokens),
+          request->created_time};
+}
 
-    for (Sequence& sequence : request->sequences) {
-      if (sequence.is_finished()) {
-        continue;
-      }
-      if (block_manager_->allocate_blocks_for(&sequence)) {
-        sequences.emplace_back(&sequence);
-      }
-    }
-    if (sequences.empty()) {
-      blocking_queue_.emplace_back(request);
+PriorityAgingSchedulerPolicy::PriorityAgingSchedulerPolicy(
+    absl::Duration aging_interval)
+    : aging_interval_(aging_interval) {
+  CHECK(aging_interval_ > absl::ZeroDuration())
+      << "aging interval should be positive";
+}
+
+SchedulerPolicy::Key PriorityAgingSchedulerPolicy::key(
+    const Request* request,
+    const absl::Time& now) const {
+  const auto waiting_time =
+      std::max(now - request->created_time, absl::ZeroDuration());
+  const int64_t promotions =
+      absl::IDivDuration(waiting_time, aging_interval_, nullptr);
+  // promote the request by one level for each aging interval, up to HIGH
+  const int64_t priority =
+      static_cast<int64_t>(request->priority) - promotions;
+  const auto highest = static_cast<int64_t>(Priority::HIGH);
+  return {static_cast<int32_t>(std::max(priority, highest)),
+          0,
+          request->created_time};
+}
+
+FairShareSchedulerPolicy::FairShareSchedulerPolicy(absl::Duration half_life)
+    : half_life_(half_life) {
+  CHECK(half_life_ > absl::ZeroDuration()) << "half life should be positive";
+}
+
+void FairShareSchedulerPolicy::on_scheduled(const Request* request,
+                                            size_t num_tokens) {
+  usages_[request->tenant] += static_cast<double>(num_tokens);
+}
+
+double FairShareSchedulerPolicy::usage(const std::string& tenant) const {
+  const auto it = usages_.find(tenant);
+  return it == usages_.end() ? 0 : it->second;
+}
+
+void FairShareSchedulerPolicy::on_refresh(const absl::Time& now) {
+  if (last_decay_time_ == absl::InfinitePast()) {
+    last_decay_time_ = now;
+    return;
+  }
+  const double elapsed = absl::FDivDuration(now - last_decay_time_, half_life_);
+  if (elapsed <= 0) {
+    return;
+  }
+  last_decay_time_ = now;
+
+  // decay usage exponentially: usage * 0.5^(elapsed / half_life)
+  const double factor = std::exp2(-elapsed);
+  for (auto it = usages_.begin(); it != usages_.end();) {
+    it->second *= factor;
+    if (it->second < kMinTenantUsage) {
+      usages_.erase(it++);
     } else {
-      running_queue_.emplace_back(request);
-      running_batch.insert(
-          running_batch.end(), sequences.begin(), sequences.end());
+      ++it;
     }
   }
+}
 
-  if (running_batch.empty() && !blocking_queue_.empty()) {
-    LOG(ERROR) << "Not enough memory to schedule one sequence";
+SchedulerPolicy::Key FairShareSchedulerPolicy::key(
+    const Request* request,
+    const absl::Time& /*now*/) const {
+  return {static_cast<int32_t>(request->priority),
+          usage(request->tenant),
+          request->created_time};
+}
 
-    Request* request = blocking_queue_.back();
-    blocking_queue_.pop_back();
+CacheAwareSchedulerPolicy::CacheAwareSchedulerPolicy(
+    const BlockManager* block_manager,
+    absl::Duration max_wait)
+    : block_manager_(block_manager), max_wait_(max_wait) {
+  CHECK(max_wait_ >= absl::ZeroDuration())
+      << "max waiting time should be non-negative";
+}
+
+SchedulerPolicy::Key CacheAwareSchedulerPolicy::key(
+    const Request* request,
+    const absl::Time& now) const {
+  const auto priority = static_cast<int32_t>(request->priority);
+  // starved requests go first, ordered by arrival time
+  if (now - request->created_time >= max_wait_) {
+    return {priority, -1, request->created_time};
+  }
 
-    // TODO: optimize the logic to only release blocks for sequences one by one
-    response_handler_->on_request_finish(std::unique_ptr<Request>(request));
+  // use the first sequence as the representative, all sequences in a request
+  // share the same prompt.
+  const auto& sequence = request->sequences.front();
+  const size_t num_prompt_tokens = sequence.num_prompt_tokens();
+  size_t num_cached_tokens = sequence.num_kv_cache_tokens();
+  if (block_manager_ != nullptr) {
+    num_cached_tokens = std::max(num_cached_tokens,
+                                 block_manager_->num_cached_tokens(&sequence));
   }
-  return running_batch;
+  const size_t num_new_tokens = num_prompt_tokens > num_cached_tokens
+                                    ? num_prompt_tokens - num_cached_tokens
+                                    : 0;
+  // the number of new blocks to allocate for the prompt
+  size_t num_new_blocks = num_new_tokens;
+  if (block_manager_ != nullptr) {
+    const size_t block_size = block_manager_->options().block_size();
+    num_new_blocks = (num_new_tokens + block_size - 1) / block_size;
+  }
+  return {priority,
+          static_cast<double>(num_new_blocks),
+          request->created_time};
 }
+
 }  // namespace llm
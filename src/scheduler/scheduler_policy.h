@@ -1,53 +1,224 @@
 #pragma once
 
-#include <folly/MPMCQueue.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/time/time.h>
 
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
-#include "scheduler/scheduler_config.h"
+#include "common/macros.h"
 
 namespace llm {
 
-class Request;
-class Sequence; 
+class BlockManager;
+struct Request;
+
+// A scheduler policy decides the order in which waiting requests are picked up
+// by the scheduler. The batch building logic, including token/sequence budgets,
+// block allocation and preemption, is shared by all policies and lives in the
+// scheduler itself, the policy only answers "which request goes next".
+//
+// Requests with higher priority (Priority::HIGH) are always considered before
+// requests with lower priority unless the policy explicitly promotes them (for
+// example by aging). Not thread safe.
 class SchedulerPolicy {
  public:
+  struct Options {
+    // the name of the policy, one of names()
+    DEFINE_ARG(std::string, name) = "fcfs";
+
+    // priority_aging: the waiting time to promote a request by one priority
+    // level.
+    DEFINE_ARG(absl::Duration, priority_aging_interval) = absl::Seconds(5);
+
+    // fair_share: the half life of the per-tenant usage, older usage decays
+    // exponentially.
+    DEFINE_ARG(absl::Duration, fair_share_half_life) = absl::Seconds(60);
+
+    // cache_aware: the block manager to look up the prefix cache.
+    DEFINE_ARG(const BlockManager*, block_manager) = nullptr;
+
+    // cache_aware: the waiting time after which a request is no longer
+    // reordered by its cost and goes first in arrival order.
+    DEFINE_ARG(absl::Duration, cache_aware_max_wait) = absl::Seconds(2);
+  };
+
+  // create a policy with the given options, returns nullptr for unknown policy
+  static std::unique_ptr<SchedulerPolicy> create(const Options& options);
+
+  // whether the name is a supported policy, empty for fcfs
+  static bool is_supported(const std::string& name);
+
+  // the names of the supported policies
+  static const std::vector<std::string>& names();
+
+  // the names of the supported policies separated by ", " for messages
+  static std::string joined_names();
+
   virtual ~SchedulerPolicy() = default;
 
-  virtual bool schedule(std::unique_ptr<Request>& request) = 0;
-  virtual std::vector<Sequence*> build_batch() = 0;
+  // add a request into the waiting queue
+  void push(Request* request);
+
+  // get the request that should be scheduled next
+  Request* top() const { return heap_.front().request; }
+
+  // remove the request returned by top()
+  void pop();
+
+  // returns true if there is no waiting request
+  bool empty() const { return heap_.empty(); }
+
+  // get the number of waiting requests
+  size_t size() const { return heap_.size(); }
+
+  // called once per step before building the batch. policies whose ordering
+  // changes over time (aging, usage decay) re-evaluate all waiting requests.
+  void refresh(const absl::Time& now);
+
+  // notify the policy that num_tokens tokens of the request have been
+  // scheduled in current step.
+  virtual void on_scheduled(const Request* request, size_t num_tokens) {}
+
+ protected:
+  // The ordering key for a request, the request with the smallest key is
+  // scheduled first. keys are compared lexicographically.
+  struct Key {
+    // the (effective) priority level of the request
+    int32_t priority = 0;
+    // the policy specific score within the same priority level
+    double score = 0;
+    // the arrival time of the request, used as tie breaker
+    absl::Time arrival_time;
+
+    bool operator<(const Key& other) const {
+      if (priority != other.priority) {
+        return priority < other.priority;
+      }
+      if (score != other.score) {
+        return score < other.score;
+      }
+      return arrival_time < other.arrival_time;
+    }
+  };
+
+  // compute the ordering key for the request
+  virtual Key key(const Request* request, const absl::Time& now) const = 0;
+
+  // whether the key of a waiting request changes over time
+  virtual bool is_dynamic() const { return false; }
+
+  // hook to update internal state in refresh() before keys are recomputed
+  virtual void on_refresh(const absl::Time& now) {}
+
+ private:
+  struct Entry {
+    Key key;
+    Request* request = nullptr;
+  };
+
+  // std heap is a max-heap, invert the comparison to get the smallest key on
+  // the top.
+  struct EntryGreater {
+    bool operator()(const Entry& a, const Entry& b) const {
+      return b.key < a.key;
+    }
+  };
+
+  // waiting requests, organized as a binary heap
+  std::vector<Entry> heap_;
 };
 
-class BlockManager;
-class ResponseHandler;
+// First-Come-First-Served within each priority level.
 class FCFSSchedulerPolicy final : public SchedulerPolicy {
+ protected:
+  Key key(const Request* request, const absl::Time& now) const override;
+};
+
+// Shortest-Prompt-First within each priority level: requests with fewer
+// prompt tokens left to prefill go first, which favors decoding requests and
+// short prompts and minimizes the average time to first token.
+class ShortestPromptFirstSchedulerPolicy final : public SchedulerPolicy {
+ protected:
+  Key key(const Request* request, const absl::Time& now) const override;
+
+  // the number of tokens to prefill changes after preemption
+  bool is_dynamic() const override { return true; }
+};
+
+// Priority scheduling with aging: a waiting request is promoted by one
+// priority level for every `priority_aging_interval` it has been waiting, so
+// low priority requests can't be starved forever by a stream of high priority
+// ones.
+class PriorityAgingSchedulerPolicy final : public SchedulerPolicy {
+ public:
+  explicit PriorityAgingSchedulerPolicy(absl::Duration aging_interval);
+
+ protected:
+  Key key(const Request* request, const absl::Time& now) const override;
+
+  bool is_dynamic() const override { return true; }
+
+ private:
+  absl::Duration aging_interval_;
+};
+
+// Fair share across tenants: within each priority level, requests from the
+// tenant that consumed the fewest (exponentially decayed) tokens go first.
+// Requests without a tenant share one anonymous tenant.
+class FairShareSchedulerPolicy final : public SchedulerPolicy {
  public:
-  explicit FCFSSchedulerPolicy(ResponseHandler* response_handler,
-                               BlockManager* block_manager);
-  ~FCFSSchedulerPolicy() override;
+  explicit FairShareSchedulerPolicy(absl::Duration half_life);
+
+  void on_scheduled(const Request* request, size_t num_tokens) override;
+
+  // get the decayed usage of the tenant, mainly for testing
+  double usage(const std::string& tenant) const;
+
+ protected:
+  Key key(const Request* request, const absl::Time& now) const override;
+
+  bool is_dynamic() const override { return true; }
 
-  bool schedule(std::unique_ptr<Request>& request) override;
-  std::vector<Sequence*> build_batch() override;
+  void on_refresh(const absl::Time& now) override;
 
  private:
-  ResponseHandler* response_handler_;
-  BlockManager* block_manager_;
+  absl::Duration half_life_;
 
-  folly::MPMCQueue<Request*> waiting_queue_;
-  std::vector<Request*> blocking_queue_;
-  std::vector<Request*> running_queue_;
+  // the last time usages were decayed
+  absl::Time last_decay_time_ = absl::InfinitePast();
+
+  // decayed number of scheduled tokens for each tenant
+  absl::flat_hash_map<std::string, double> usages_;
 };
 
-class SchedulerPolicyFactory {
+// Cache-aware ordering within each priority level: requests needing fewer new
+// blocks go first, counting the prompt tokens already in the prefix cache as
+// free. A request whose prompt is mostly resident costs little memory and
+// compute, so admitting it first raises throughput and lowers time to first
+// token under bursty traffic sharing long prefixes, e.g. RAG.
+//
+// The prefix cache is probed without touching its LRU order. Requests that
+// have waited longer than `max_wait` go ahead of the others in arrival order,
+// so cold requests can't be starved by a stream of warm ones.
+class CacheAwareSchedulerPolicy final : public SchedulerPolicy {
  public:
-  static SchedulerPolicy* Create(const SchedulerPolicyType& type,
-                                 ResponseHandler* response_handler,
-                                 BlockManager* block_manager) {
-    static FCFSSchedulerPolicy policy(response_handler,
-                                      block_manager);
-    return &policy;
-  }
+  // the block manager may be null, then no prompt token counts as cached
+  CacheAwareSchedulerPolicy(const BlockManager* block_manager,
+                            absl::Duration max_wait);
+
+ protected:
+  Key key(const Request* request, const absl::Time& now) const override;
+
+  // the prefix cache and waiting time change every step
+  bool is_dynamic() const override { return true; }
+
+ private:
+  const BlockManager* block_manager_;
+
+  absl::Duration max_wait_;
 };
 
 }  // namespace llm
@@ -1,455 +1,777 @@
-#include "scheduler/scheduler.h"
-
-#include <absl/strings/str_split.h>
-#include <c10/core/Device.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
 #include <gtest/gtest.h>
-#include <torch/torch.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
 
-#include "scheduler/speculative_scheduler.h"
+#include "continuous_scheduler.h"
+#include "engine/simulated_engine.h"
+#include "scheduler_policy.h"
 
 namespace llm {
 
-class FakeTokenizer : public Tokenizer {
- public:
-  FakeTokenizer() {
-    register_id_token(1058, "who");
-    register_id_token(338, "is");
-    register_id_token(4473, "messi");
-    register_id_token(29973, "?");
-  }
-  virtual ~FakeTokenizer() {}
-
-  bool encode(const std::string_view& text,
-              std::vector<int32_t>* ids) const override {
-    LOG(FATAL) << "FakeTokenizer::encode shouldn't be called";
-    return true;
-  }
+namespace {
 
-  std::string decode(const Slice<int32_t>& tokens) const override {
-    std::stringstream ss;
-    for (auto token : tokens) {
-      auto it = id_to_token_.find(token);
-      ss << it->second << " ";
-    }
+SimulatedEngine::Options engine_options(
+    absl::Duration step_latency = absl::ZeroDuration()) {
+  SimulatedEngine::Options options;
+  options.num_blocks(1024).block_size(16);
+  // sleep for the step latency so that deadlines and latencies see it
+  options.step_latency(step_latency).real_time(true);
+  return options;
+}
 
-    auto str = ss.str();
-    str.erase(str.find_last_not_of(' ') + 1);
-    return str;
+// records the step at which each request finished from the steps of a
+// simulated engine.
+class StepRecorder {
+ public:
+  explicit StepRecorder(SimulatedEngine* engine) : engine_(engine) {
+    engine_->set_step_callback([this](Batch& batch) { on_step(batch); });
   }
 
-  size_t vocab_size() const override { return id_to_token_.size(); }
+  // the time when the last step finished
+  absl::Time last_step_time() const { return last_step_time_; }
+
+  // the maximum number of distinct lora adapters in one step
+  size_t max_loras_per_step() const { return max_loras_per_step_; }
 
-  std::unique_ptr<Tokenizer> clone() const override {
-    return std::make_unique<FakeTokenizer>();
+  // request id => the step when the request finished
+  const std::map<int32_t, size_t>& finish_steps() const {
+    return finish_steps_;
   }
 
  private:
-  void register_id_token(int32_t id, std::string token) {
-    id_to_token_.emplace(id, token);
-    token_to_id_.emplace(token, id);
+  void on_step(Batch& batch) {
+    last_step_time_ = absl::Now();
+    std::set<std::string> lora_adapters;
+    for (size_t i = 0; i < batch.size(); ++i) {
+      Sequence* sequence = batch[i];
+      if (!sequence->lora_adapter().empty()) {
+        lora_adapters.insert(sequence->lora_adapter());
+      }
+      if (sequence->is_finished()) {
+        // the first prompt token is used as the request id
+        finish_steps_.emplace(sequence->token_ids()[0], engine_->num_steps());
+      }
+    }
+    max_loras_per_step_ = std::max(max_loras_per_step_, lora_adapters.size());
   }
 
- private:
-  std::unordered_map<int32_t, std::string> id_to_token_;
-  std::unordered_map<std::string, int32_t> token_to_id_;
+  SimulatedEngine* engine_;
+  absl::Time last_step_time_;
+  std::map<int32_t, size_t> finish_steps_;
+  size_t max_loras_per_step_ = 0;
 };
 
-class FakeSSMEngine : public Engine {
+// forwards to a simulated engine and counts the step boundaries, which must
+// not fall in the middle of a step
+class StepBoundaryEngine : public Engine {
  public:
-  FakeSSMEngine(const std::vector<torch::Device>& devices) : Engine(devices) {}
-  virtual ~FakeSSMEngine() {}
+  explicit StepBoundaryEngine(SimulatedEngine* engine) : engine_(engine) {}
 
-  bool init(const std::string&) override {
-    fake_tokenizer_ = std::make_unique<FakeTokenizer>();
-    fake_block_manager_ = std::make_unique<BlockManager>(128, 16);
-    return true;
+  ModelOutput execute_model(Batch& batch) override {
+    in_step_ = true;
+    auto output = engine_->execute_model(batch);
+    in_step_ = false;
+    return output;
   }
 
-  std::unique_ptr<Tokenizer> tokenizer() const override {
-    return fake_tokenizer_->clone();
+  void on_step_boundary() override {
+    EXPECT_FALSE(in_step_.load());
+    ++num_step_boundaries_;
   }
 
+  const Tokenizer* tokenizer() const override { return engine_->tokenizer(); }
+
   BlockManager* block_manager() const override {
-    return fake_block_manager_.get();
+    return engine_->block_manager();
   }
 
-  void execute_model(Batch&) override {
-    if (spec_tokens_idx_ >= spec_token_ids_.size()) {
-      LOG(FATAL) << "Out of Range, you should setup FakeSSMEngine correctly.";
-    }
-    ++execute_model_calls_;
-    // ModelOutput output;
-    // std::vector<int64_t> val;
-    // val.emplace_back(spec_token_ids_[spec_tokens_idx_++]);
-
-    // output.next_tokens = torch::unsqueeze(torch::tensor(val, torch::kInt64),
-    // 0);
+  const ModelArgs& model_args() const override {
+    return engine_->model_args();
   }
 
-  void validate(Batch&) override { ++validate_calls_; }
-
-  void set_spec_token_ids(const std::vector<int64_t>& spec_token_ids) {
-    spec_token_ids_ = spec_token_ids;
+  const TokenizerArgs& tokenizer_args() const override {
+    return engine_->tokenizer_args();
   }
 
-  int get_execute_model_calls() { return execute_model_calls_; }
-
-  int get_validate_calls() { return validate_calls_; }
+  size_t num_step_boundaries() const { return num_step_boundaries_; }
 
  private:
-  std::vector<int64_t> spec_token_ids_;
-  int spec_tokens_idx_ = 0;
-  int execute_model_calls_ = 0;
-  int validate_calls_ = 0;
-
-  std::unique_ptr<Tokenizer> fake_tokenizer_;
-  std::unique_ptr<BlockManager> fake_block_manager_;
+  SimulatedEngine* engine_;
+  std::atomic<bool> in_step_{false};
+  size_t num_step_boundaries_ = 0;
 };
 
-class FakeLLMEngine : public Engine {
+// forwards to a simulated engine, failing the sequences of a lora adapter
+// like an adapter that can't be loaded
+class FailedLoraEngine : public Engine {
  public:
-  FakeLLMEngine(const std::vector<torch::Device>& devices) : Engine(devices) {}
-  virtual ~FakeLLMEngine() {}
-
-  bool init(const std::string&) override {
-    fake_tokenizer_ = std::make_unique<FakeTokenizer>();
-    fake_block_manager_ = std::make_unique<BlockManager>(128, 16);
-    return true;
+  FailedLoraEngine(SimulatedEngine* engine, std::string failed_adapter)
+      : engine_(engine), failed_adapter_(std::move(failed_adapter)) {}
+
+  ModelOutput execute_model(Batch& batch) override {
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (batch[i]->lora_adapter() == failed_adapter_) {
+        batch[i]->set_error(Status(StatusCode::UNAVAILABLE, "failed"));
+      }
+    }
+    if (!batch.drop_failed_sequences()) {
+      return {};
+    }
+    return engine_->execute_model(batch);
   }
 
-  std::unique_ptr<Tokenizer> tokenizer() const override {
-    return fake_tokenizer_->clone();
-  }
+  const Tokenizer* tokenizer() const override { return engine_->tokenizer(); }
 
   BlockManager* block_manager() const override {
-    return fake_block_manager_.get();
+    return engine_->block_manager();
   }
 
-  void execute_model(Batch&) override { ++execute_model_calls_; }
-
-  void validate(Batch&) override {
-    if (valid_tokens_idx_ >= valid_token_ids_.size()) {
-      LOG(FATAL) << "Out of Range, you should setup FakeLLMEngine correctly.";
-    }
-
-    ++validate_calls_;
-    // TODO: fix the unittest
-    // ModelOutput output;
-    // output.next_tokens =
-    //     torch::unsqueeze(torch::tensor(valid_token_ids_, torch::kInt64), 0);
-    // return output;
+  const ModelArgs& model_args() const override {
+    return engine_->model_args();
   }
 
-  void set_valid_token_id(const std::vector<int64_t>& valid_token_ids) {
-    valid_token_ids_ = valid_token_ids;
+  const TokenizerArgs& tokenizer_args() const override {
+    return engine_->tokenizer_args();
   }
 
-  int get_execute_model_calls() { return execute_model_calls_; }
+ private:
+  SimulatedEngine* engine_;
+  std::string failed_adapter_;
+};
+
+// records the final status of each request
+class StatusRecorder {
+ public:
+  OnOutput callback(int32_t id) {
+    return [this, id](const RequestOutput& output) {
+      if (output.finished && output.status.has_value()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        statuses_[id] = output.status.value().code();
+      }
+      return true;
+    };
+  }
 
-  int get_validate_calls() { return validate_calls_; }
+  std::optional<StatusCode> status(int32_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = statuses_.find(id);
+    if (it == statuses_.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
 
  private:
-  std::vector<int64_t> valid_token_ids_;
-  int valid_tokens_idx_ = 0;
-  int execute_model_calls_ = 0;
-  int validate_calls_ = 0;
-  std::unique_ptr<Tokenizer> fake_tokenizer_;
-  std::unique_ptr<BlockManager> fake_block_manager_;
+  std::mutex mutex_;
+  std::map<int32_t, StatusCode> statuses_;
 };
 
-class TestableSpeculativeScheduler {
- public:
-  TestableSpeculativeScheduler(const std::vector<int64_t>& spec_token_ids,
-                               const std::vector<int64_t>& valid_token_id,
-                               uint64_t spec_steps) {
-    create_scheduler_config(spec_steps);
-    create_engine(spec_token_ids, valid_token_id);
-    create_scheduler();
+// create a request with the given id as the first prompt token
+std::unique_ptr<Request> create_request(int32_t id,
+                                        size_t num_prompt_tokens,
+                                        size_t max_tokens,
+                                        Priority priority = Priority::NORMAL,
+                                        const std::string& tenant = "",
+                                        const std::string& lora_adapter = "") {
+  std::vector<int32_t> prompt_tokens(num_prompt_tokens, 1);
+  prompt_tokens[0] = id;
+  const size_t capacity = num_prompt_tokens + max_tokens + 1;
+  auto request = std::make_unique<Request>("",
+                                           std::move(prompt_tokens),
+                                           capacity,
+                                           /*n=*/1,
+                                           /*best_of=*/1,
+                                           /*logprobs=*/false);
+  request->stopping_criteria.max_tokens = max_tokens;
+  request->stopping_criteria.ignore_eos = true;
+  request->priority = priority;
+  request->tenant = tenant;
+  request->lora_adapter = lora_adapter;
+  request->on_output = [](const RequestOutput& /*output*/) { return true; };
+  request->add_sequence();
+  // make sure created_time is strictly increasing among requests
+  absl::SleepFor(absl::Microseconds(10));
+  return request;
+}
+
+// pop all requests from the policy and return their ids in order
+std::vector<int32_t> drain(SchedulerPolicy* policy) {
+  std::vector<int32_t> ids;
+  while (!policy->empty()) {
+    ids.push_back(policy->top()->prompt_tokens[0]);
+    policy->pop();
   }
+  return ids;
+}
 
-  bool schedule(std::unique_ptr<Request>& request) {
-    return scheduler_->schedule(request);
+// run the workload until complete and return the average finish step
+double run_workload(const std::string& policy,
+                    const std::vector<size_t>& prompt_lens,
+                    size_t max_tokens,
+                    bool enable_overlap_scheduling = false) {
+  SimulatedEngine engine(engine_options());
+  StepRecorder recorder(&engine);
+  ContinuousScheduler::Options options;
+  options.max_tokens_per_batch(64)
+      .max_seqs_per_batch(4)
+      .scheduler_policy(policy)
+      .enable_overlap_scheduling(enable_overlap_scheduling);
+  ContinuousScheduler scheduler(&engine, options);
+
+  for (size_t i = 0; i < prompt_lens.size(); ++i) {
+    const int32_t id = static_cast<int32_t>(i + 1);
+    auto request = create_request(id, prompt_lens[i], max_tokens);
+    EXPECT_TRUE(scheduler.schedule(request));
   }
+  scheduler.run_until_complete();
 
-  void step(const absl::Duration& timeout) { scheduler_->step(timeout); }
+  const auto& finish_steps = recorder.finish_steps();
+  EXPECT_EQ(finish_steps.size(), prompt_lens.size());
+  double total_steps = 0;
+  for (const auto& [id, step] : finish_steps) {
+    total_steps += static_cast<double>(step);
+  }
+  LOG(INFO) << "policy: " << policy << ", total steps: " << engine.num_steps()
+            << ", average finish step: " << total_steps / finish_steps.size();
+  return total_steps / finish_steps.size();
+}
 
-  Tokenizer* tokenizer() { return tokenizer_.get(); }
+}  // namespace
 
-  int get_ssm_execute_model_calls() {
-    return ssm_engine_->get_execute_model_calls();
+TEST(SchedulerPolicyTest, Create) {
+  SchedulerPolicy::Options options;
+  for (const auto& name : SchedulerPolicy::names()) {
+    options.name(name);
+    EXPECT_NE(SchedulerPolicy::create(options), nullptr) << name;
+    EXPECT_TRUE(SchedulerPolicy::is_supported(name)) << name;
   }
+  options.name("unknown");
+  EXPECT_EQ(SchedulerPolicy::create(options), nullptr);
+  EXPECT_FALSE(SchedulerPolicy::is_supported("unknown"));
+}
 
-  int get_llm_execute_model_calls() {
-    return llm_engine_->get_execute_model_calls();
+TEST(SchedulerPolicyTest, FCFS) {
+  FCFSSchedulerPolicy policy;
+  auto r1 = create_request(1, 8, 4, Priority::NORMAL);
+  auto r2 = create_request(2, 8, 4, Priority::LOW);
+  auto r3 = create_request(3, 8, 4, Priority::NORMAL);
+  auto r4 = create_request(4, 8, 4, Priority::HIGH);
+  policy.push(r3.get());
+  policy.push(r2.get());
+  policy.push(r1.get());
+  policy.push(r4.get());
+  EXPECT_EQ(policy.size(), 4);
+
+  // priority first, then arrival time
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({4, 1, 3, 2}));
+}
+
+TEST(SchedulerPolicyTest, ShortestPromptFirst) {
+  ShortestPromptFirstSchedulerPolicy policy;
+  auto r1 = create_request(1, 64, 4);
+  auto r2 = create_request(2, 8, 4);
+  auto r3 = create_request(3, 32, 4);
+  auto r4 = create_request(4, 8, 4);
+  auto r5 = create_request(5, 128, 4, Priority::HIGH);
+  for (auto* r : {r1.get(), r2.get(), r3.get(), r4.get(), r5.get()}) {
+    policy.push(r);
   }
+  policy.refresh(absl::Now());
+
+  // priority first, then shortest prompt, then arrival time
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({5, 2, 4, 3, 1}));
+}
 
-  int get_ssm_validate_calls() {
-    return ssm_engine_->get_validate_calls();
-    ;
+TEST(SchedulerPolicyTest, PriorityAging) {
+  PriorityAgingSchedulerPolicy policy(absl::Seconds(10));
+  auto low = create_request(1, 8, 4, Priority::LOW);
+  auto normal = create_request(2, 8, 4, Priority::NORMAL);
+  auto high = create_request(3, 8, 4, Priority::HIGH);
+
+  policy.push(high.get());
+  policy.push(normal.get());
+  policy.push(low.get());
+  policy.refresh(absl::Now());
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({3, 2, 1}));
+
+  // after 10 seconds, low => normal and normal => high
+  for (auto* r : {high.get(), normal.get(), low.get()}) {
+    policy.push(r);
   }
+  policy.refresh(absl::Now() + absl::Seconds(10));
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({2, 3, 1}));
 
-  int get_llm_validate_calls() {
-    return llm_engine_->get_validate_calls();
-    ;
+  // after 20 seconds, all requests are promoted to high, ordered by arrival
+  for (auto* r : {high.get(), normal.get(), low.get()}) {
+    policy.push(r);
   }
+  policy.refresh(absl::Now() + absl::Seconds(20));
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({1, 2, 3}));
+}
 
- private:
-  void create_engine(const std::vector<int64_t>& spec_token_ids,
-                     const std::vector<int64_t>& valid_token_id) {
-    std::vector<torch::Device> devices;
-    devices.emplace_back(torch::kCUDA, 0);
-    llm_engine_ = std::make_unique<FakeLLMEngine>(devices);
-    llm_engine_->init("");
-    llm_engine_->set_valid_token_id(valid_token_id);
-    tokenizer_ = llm_engine_->tokenizer();
-    ssm_engine_ = std::make_unique<FakeSSMEngine>(devices);
-    ssm_engine_->init("");
-    ssm_engine_->set_spec_token_ids(spec_token_ids);
+TEST(SchedulerPolicyTest, FairShare) {
+  FairShareSchedulerPolicy policy(absl::Seconds(60));
+  auto a1 = create_request(1, 8, 4, Priority::NORMAL, "a");
+  auto a2 = create_request(2, 8, 4, Priority::NORMAL, "a");
+  auto b1 = create_request(3, 8, 4, Priority::NORMAL, "b");
+  auto c1 = create_request(4, 8, 4, Priority::NORMAL, "c");
+
+  // tenant a consumed most tokens, then tenant b
+  policy.on_scheduled(a1.get(), 100);
+  policy.on_scheduled(b1.get(), 10);
+  EXPECT_DOUBLE_EQ(policy.usage("a"), 100);
+  EXPECT_DOUBLE_EQ(policy.usage("b"), 10);
+
+  for (auto* r : {a1.get(), a2.get(), b1.get(), c1.get()}) {
+    policy.push(r);
   }
+  const auto now = absl::Now();
+  policy.refresh(now);
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({4, 3, 1, 2}));
+
+  // usage decays by half after one half life
+  policy.refresh(now + absl::Seconds(60));
+  EXPECT_NEAR(policy.usage("a"), 50, 1e-6);
+  EXPECT_NEAR(policy.usage("b"), 5, 1e-6);
+}
 
-  void create_scheduler_config(uint64_t spec_steps) {
-    config_ = std::make_unique<SchedulerConfig>(
-        SchedulerType::SPECULATIVE, SchedulerPolicyType::FCFS, spec_steps);
+TEST(SchedulerPolicyTest, CacheAware) {
+  BlockManager::Options options;
+  options.num_blocks(32).block_size(16);
+  BlockManager block_manager(options);
+  CacheAwareSchedulerPolicy policy(&block_manager, absl::Seconds(5));
+
+  auto cold = create_request(1, 64, 4);
+  auto warm = create_request(2, 64, 4);
+  auto short_cold = create_request(3, 16, 4);
+  auto high = create_request(4, 64, 4, Priority::HIGH);
+  // the first 48 tokens of the warm request are in the prefix cache
+  const auto& warm_tokens = warm->prompt_tokens;
+  block_manager.restore_prefix_cache(
+      {{"",
+        std::vector<int32_t>(warm_tokens.begin(), warm_tokens.begin() + 48),
+        {1, 2, 3}}});
+  const size_t num_free_blocks = block_manager.num_free_blocks();
+
+  for (auto* r : {cold.get(), warm.get(), short_cold.get(), high.get()}) {
+    policy.push(r);
+  }
+  const auto now = absl::Now();
+  policy.refresh(now);
+  // priority first, then the number of new blocks, then arrival time
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({4, 2, 3, 1}));
+  // probing doesn't allocate or share any block
+  EXPECT_EQ(block_manager.num_free_blocks(), num_free_blocks);
+  EXPECT_EQ(warm->sequences.front().num_kv_cache_tokens(), 0);
+
+  // starved requests go first in arrival order, still after higher priority
+  for (auto* r : {cold.get(), warm.get(), short_cold.get(), high.get()}) {
+    policy.push(r);
   }
+  policy.refresh(now + absl::Seconds(5));
+  EXPECT_EQ(drain(&policy), std::vector<int32_t>({4, 1, 2, 3}));
+}
 
-  void create_scheduler() {
-    scheduler_ = std::make_unique<SpeculativeScheduler>(
-        *config_.get(), llm_engine_.get(), ssm_engine_.get());
+TEST(ContinuousSchedulerTest, AllPoliciesCompleteWorkload) {
+  const std::vector<size_t> prompt_lens = {200, 8, 16, 8, 32, 8, 64, 8};
+  for (const auto& policy : SchedulerPolicy::names()) {
+    run_workload(policy, prompt_lens, /*max_tokens=*/4);
   }
+}
 
- private:
-  std::unique_ptr<SpeculativeScheduler> scheduler_;
-  std::unique_ptr<FakeLLMEngine> llm_engine_;
-  std::unique_ptr<FakeSSMEngine> ssm_engine_;
-  std::unique_ptr<SchedulerConfig> config_;
-  std::unique_ptr<Tokenizer> tokenizer_;
-};
+TEST(ContinuousSchedulerTest, ShortestPromptFirstReducesAverageLatency) {
+  // one long prompt followed by a burst of short ones
+  const std::vector<size_t> prompt_lens = {256, 8, 8, 8, 8, 8, 8, 8, 8};
+  const double fcfs = run_workload("fcfs", prompt_lens, /*max_tokens=*/4);
+  const double spf = run_workload("spf", prompt_lens, /*max_tokens=*/4);
+  EXPECT_LT(spf, fcfs);
+}
 
-class RequestWrapper {
- public:
-  RequestWrapper(Tokenizer* tokenizer) : tokenizer_(tokenizer) {
-    sampling_param_.temperature = 0;
-    sampling_param_.top_p = 1.0;
-    sampling_param_.top_k = 0;
-    sampling_param_.repetition_penalty = 1.0;
-    sampling_param_.frequency_penalty = 0.0;
-    sampling_param_.presence_penalty = 0.0;
+TEST(ContinuousSchedulerTest, OverlapSchedulingCompletesWorkload) {
+  const std::vector<size_t> prompt_lens = {200, 8, 16, 8, 32, 8, 64, 8};
+  for (const auto* policy : {"fcfs", "spf"}) {
+    const double sequential =
+        run_workload(policy, prompt_lens, /*max_tokens=*/4);
+    const double overlapped = run_workload(policy,
+                                           prompt_lens,
+                                           /*max_tokens=*/4,
+                                           /*enable_overlap_scheduling=*/true);
+    // all requests are submitted up front, the plan always matches
+    EXPECT_EQ(sequential, overlapped);
+  }
+}
 
-    stopping_criteria_.max_tokens = 100;
-    stopping_criteria_.ignore_eos = false;
-    stopping_criteria_.eos_token_id = 2;
+TEST(ContinuousSchedulerTest, OverlapSchedulingPlansArrivingRequests) {
+  for (const bool enable_overlap_scheduling : {false, true}) {
+    SimulatedEngine engine(engine_options(absl::Milliseconds(20)));
+    ContinuousScheduler::Options options;
+    options.max_tokens_per_batch(64)
+        .max_seqs_per_batch(4)
+        .enable_overlap_scheduling(enable_overlap_scheduling);
+    ContinuousScheduler scheduler(&engine, options);
+    auto first = create_request(1, /*num_prompt_tokens=*/8, /*max_tokens=*/4);
+    EXPECT_TRUE(scheduler.schedule(first));
+
+    // the second request arrives while the first step is running
+    auto second = create_request(2, /*num_prompt_tokens=*/8, /*max_tokens=*/4);
+    const Sequence* arrived = &second->sequences[0];
+    engine.set_step_callback([&](Batch& /*batch*/) {
+      if (second != nullptr) {
+        EXPECT_TRUE(scheduler.schedule(second));
+      }
+    });
+    scheduler.step(absl::Seconds(10));
+    EXPECT_EQ(engine.num_steps(), 1);
+    // the planned request already holds its blocks when the next step starts
+    EXPECT_EQ(arrived->num_blocks() > 0, enable_overlap_scheduling);
+    EXPECT_EQ(arrived->num_kv_cache_tokens(), 0);
+
+    // the first request decodes its last token in the fourth step
+    scheduler.run_until_complete();
+    EXPECT_EQ(engine.num_steps(), 5);
   }
+}
 
-  std::unique_ptr<Request> create_request(
-      const std::vector<int> prompt_tokens) {
-    return create_request_impl(prompt_tokens);
+TEST(ContinuousSchedulerTest, StepBoundaryHook) {
+  for (const bool enable_overlap_scheduling : {false, true}) {
+    SimulatedEngine simulated_engine(engine_options());
+    StepBoundaryEngine engine(&simulated_engine);
+    ContinuousScheduler::Options options;
+    options.max_tokens_per_batch(64)
+        .max_seqs_per_batch(4)
+        .enable_overlap_scheduling(enable_overlap_scheduling);
+    ContinuousScheduler scheduler(&engine, options);
+    for (int32_t id = 1; id <= 8; ++id) {
+      auto request =
+          create_request(id, /*num_prompt_tokens=*/8, /*max_tokens=*/4);
+      EXPECT_TRUE(scheduler.schedule(request));
+    }
+    scheduler.run_until_complete();
+    // called before building each batch, and the empty ones
+    EXPECT_GT(engine.num_step_boundaries(), simulated_engine.num_batches());
   }
+}
 
-  std::unique_ptr<Request> create_request(const std::string& prompt) {
-    std::vector<int> prompt_tokens;
-    tokenizer_->encode(prompt, &prompt_tokens);
-    return create_request_impl(prompt_tokens);
+TEST(ContinuousSchedulerTest, MultiStepDecode) {
+  const std::vector<size_t> max_tokens = {3, 10, 17, 32};
+  std::map<int32_t, size_t> expected_finish_steps;
+  for (const int32_t num_decode_steps : {1, 4, 8}) {
+    SimulatedEngine engine(engine_options());
+    StepRecorder recorder(&engine);
+    ContinuousScheduler::Options options;
+    options.max_tokens_per_batch(64).max_seqs_per_batch(8).num_decode_steps(
+        num_decode_steps);
+    ContinuousScheduler scheduler(&engine, options);
+    for (size_t i = 0; i < max_tokens.size(); ++i) {
+      const int32_t id = static_cast<int32_t>(i + 1);
+      auto request = create_request(id, /*num_prompt_tokens=*/8, max_tokens[i]);
+      EXPECT_TRUE(scheduler.schedule(request));
+    }
+    scheduler.run_until_complete();
+
+    // sequences stop at their own max_tokens in the middle of a batch
+    if (num_decode_steps == 1) {
+      expected_finish_steps = recorder.finish_steps();
+      EXPECT_EQ(engine.num_batches(), engine.num_steps());
+    } else {
+      EXPECT_EQ(recorder.finish_steps(), expected_finish_steps);
+      EXPECT_LT(engine.num_batches(), engine.num_steps());
+    }
+    EXPECT_EQ(recorder.finish_steps().size(), max_tokens.size());
+    EXPECT_EQ(engine.block_manager()->num_blocks_in_use(), 0);
   }
+}
 
-  SequenceResult sequence_output() { return outputs_["req_001"]; }
+TEST(ContinuousSchedulerTest, MultiStepDecodeStopsAtLengthLimits) {
+  SimulatedEngine engine(engine_options());
+  // the decode iteration of the running batch, from 1
+  size_t num_batches = 0;
+  size_t batch_step = 0;
+  // request id => the number of tokens when the request finished
+  std::map<int32_t, size_t> num_tokens;
+  engine.set_step_callback([&](Batch& batch) {
+    if (engine.num_batches() != num_batches) {
+      num_batches = engine.num_batches();
+      batch_step = 0;
+    }
+    ++batch_step;
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const Sequence* sequence = batch[i];
+      if (sequence->is_finished()) {
+        // no sequence runs past its limits till the end of a batch
+        EXPECT_EQ(batch_step, batch.num_decode_steps());
+        num_tokens.emplace(sequence->token_ids()[0], sequence->num_tokens());
+      }
+    }
+  });
+  ContinuousScheduler::Options options;
+  options.max_tokens_per_batch(64).max_seqs_per_batch(8).num_decode_steps(8);
+  ContinuousScheduler scheduler(&engine, options);
+
+  // request 1 reaches its max tokens and request 2 its max context length in
+  // the middle of the first 8 decode iterations, request 3 runs till the end
+  auto request = create_request(1, /*num_prompt_tokens=*/8, /*max_tokens=*/5);
+  EXPECT_TRUE(scheduler.schedule(request));
+  request = create_request(2, /*num_prompt_tokens=*/8, /*max_tokens=*/32);
+  request->sequences.clear();
+  request->stopping_criteria.max_context_len = 8 + 11;
+  request->add_sequence();
+  EXPECT_TRUE(scheduler.schedule(request));
+  request = create_request(3, /*num_prompt_tokens=*/8, /*max_tokens=*/32);
+  EXPECT_TRUE(scheduler.schedule(request));
+  scheduler.run_until_complete();
+
+  const std::map<int32_t, size_t> expected = {
+      {1, 8 + 5}, {2, 8 + 11}, {3, 8 + 32}};
+  EXPECT_EQ(num_tokens, expected);
+  EXPECT_LT(engine.num_batches(), engine.num_steps());
+  EXPECT_EQ(engine.block_manager()->num_blocks_in_use(), 0);
+}
 
- private:
-  std::unique_ptr<Request> create_request_impl(
-      const std::vector<int> prompt_tokens) {
-    const std::string request_id("req_001");
-    auto request = std::make_unique<Request>(request_id, prompt_tokens);
-    request->echo = true;
-    request->sampling_param = sampling_param_;
-    request->stopping_criteria = stopping_criteria_;
-    request->on_finish = [this, &request_id](
-                             const std::vector<SequenceResult>& seq_results,
-                             const Status& status,
-                             const Usage& stats) -> bool {
-      this->outputs_.emplace(request_id, seq_results[0]);
+TEST(ContinuousSchedulerTest, LatencyBreakdown) {
+  const auto step_latency = absl::Milliseconds(2);
+  SimulatedEngine engine(engine_options(step_latency));
+  ContinuousScheduler::Options options;
+  // one sequence per step, prompts are processed in chunks of 64 tokens
+  options.max_tokens_per_batch(64).max_seqs_per_batch(1);
+  ContinuousScheduler scheduler(&engine, options);
+
+  std::mutex mutex;
+  std::map<int32_t, LatencyBreakdown> latencies;
+  for (const int32_t id : {1, 2}) {
+    auto request = create_request(id, /*num_prompt_tokens=*/200, 4);
+    request->on_output = [&, id](const RequestOutput& output) {
+      if (output.finished && output.latency.has_value()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies[id] = output.latency.value();
+      }
       return true;
     };
-    request->add_sequence([this, request_id](const std::string& delta,
-                                             FinishReason reason) -> bool {
-      SequenceResult output;
-      output.output_text = delta;
-      output.finish_reason = reason;
-      this->outputs_.emplace(request_id, output);
-      return true;
-    });
-    return request;
+    EXPECT_TRUE(scheduler.schedule(request));
   }
+  scheduler.run_until_complete();
+
+  ASSERT_EQ(latencies.size(), 2);
+  const double step_seconds = absl::ToDoubleSeconds(step_latency);
+  for (const auto& [id, latency] : latencies) {
+    // 4 chunks for the prompt, the last one generates the first token
+    EXPECT_EQ(latency.num_prefill_chunks, 4);
+    EXPECT_GE(latency.prefill_seconds, 4 * step_seconds);
+    EXPECT_GE(latency.decode_seconds, 3 * step_seconds);
+    EXPECT_EQ(latency.preempted_seconds, 0);
+    EXPECT_GE(latency.response_seconds, 0);
+  }
+  // the second request waits for the first one to finish
+  EXPECT_GE(latencies[2].queue_seconds, 7 * step_seconds);
+  EXPECT_LT(latencies[1].queue_seconds, latencies[2].queue_seconds);
+}
 
- private:
-  SamplingParameter sampling_param_;
-  StoppingCriteria stopping_criteria_;
-  Tokenizer* tokenizer_;
-
-  std::map<std::string, SequenceResult> outputs_;
-  bool is_finished = false;
-};
+// the deadlines are set in the past or left in the far future instead of
+// racing the wall clock. the scheduler only runs on the test thread, so the
+// deadlines of the scheduled requests are moved between the steps.
+TEST(ContinuousSchedulerTest, ShedExpiredRequests) {
+  SimulatedEngine engine(engine_options());
+  ContinuousScheduler::Options options;
+  options.max_tokens_per_batch(64).max_seqs_per_batch(4);
+  ContinuousScheduler scheduler(&engine, options);
+  StatusRecorder recorder;
+
+  // already expired when scheduled
+  auto expired = create_request(1, 8, 4);
+  expired->on_output = recorder.callback(1);
+  expired->deadline = absl::Now() - absl::Milliseconds(1);
+  EXPECT_TRUE(scheduler.schedule(expired));
+
+  // expires while waiting in the queue
+  auto waiting = create_request(2, 8, 4);
+  waiting->on_output = recorder.callback(2);
+  Request* waiting_ptr = waiting.get();
+  EXPECT_TRUE(scheduler.schedule(waiting));
+  waiting_ptr->queue_deadline = absl::InfinitePast();
+  scheduler.run_until_complete();
+  EXPECT_EQ(recorder.status(1), StatusCode::DEADLINE_EXCEEDED);
+  EXPECT_EQ(recorder.status(2), StatusCode::DEADLINE_EXCEEDED);
+  // no budget spent on expired requests
+  EXPECT_EQ(engine.num_steps(), 0);
+
+  // expires while running, the other request is not affected
+  auto running = create_request(3, 8, /*max_tokens=*/1000);
+  running->on_output = recorder.callback(3);
+  Request* running_ptr = running.get();
+  auto normal = create_request(4, 8, /*max_tokens=*/4);
+  normal->on_output = recorder.callback(4);
+  Request* normal_ptr = normal.get();
+  EXPECT_TRUE(scheduler.schedule(running));
+  EXPECT_TRUE(scheduler.schedule(normal));
+  // both requests are running after the first step
+  scheduler.step(absl::Seconds(10));
+  EXPECT_EQ(engine.num_steps(), 1);
+  running_ptr->deadline = absl::InfinitePast();
+  // queue deadline doesn't apply once the request has been scheduled
+  normal_ptr->queue_deadline = absl::InfinitePast();
+  scheduler.run_until_complete();
+  EXPECT_EQ(recorder.status(3), StatusCode::DEADLINE_EXCEEDED);
+  EXPECT_EQ(recorder.status(4), StatusCode::OK);
+  EXPECT_LT(engine.num_steps(), 1000);
+}
 
-TEST(DISABLED_SpeculativeSchedulerTest, Speculative4StepsPartiallyMatchTest) {
-  // who[1058] is[338] messi[4473] ?[29973]
-  const std::vector<int64_t> spec_token_ids = {1058, 338, 4473, 29973};
-  const std::vector<int64_t> valid_token_ids = {
-      1058, 338, 4473, 1058, 338, 4473};
-  const uint64_t spec_steps = 4;
-
-  TestableSpeculativeScheduler scheduler(
-      spec_token_ids, valid_token_ids, spec_steps);
-  RequestWrapper request_wrapper(scheduler.tokenizer());
-
-  std::vector<int> input_tokens = {1058};
-  // expect output tokens: [1058] + [1058, 338, 4473, 1058]
-  // expect output string: who who is messi who
-  const std::string expect_output("who who is messi who");
-  auto request = request_wrapper.create_request(input_tokens);
-  scheduler.schedule(request);
-  scheduler.step(absl::Seconds(1));
-  absl::SleepFor(absl::Seconds(2));
-  auto sequence_result = request_wrapper.sequence_output();
-
-  EXPECT_EQ(spec_steps, scheduler.get_ssm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_llm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_ssm_validate_calls());
-  EXPECT_EQ(1, scheduler.get_llm_validate_calls());
-
-  EXPECT_EQ(sequence_result.finish_reason, FinishReason::NONE);
-  EXPECT_EQ(sequence_result.output_text, expect_output);
+TEST(ContinuousSchedulerTest, MaxLorasPerBatch) {
+  SimulatedEngine engine(engine_options());
+  StepRecorder recorder(&engine);
+  ContinuousScheduler::Options options;
+  options.max_tokens_per_batch(64).max_seqs_per_batch(8).max_loras(2);
+  ContinuousScheduler scheduler(&engine, options);
+
+  const std::vector<std::string> lora_adapters = {"a", "b", "", "c", "a", "d"};
+  for (size_t i = 0; i < lora_adapters.size(); ++i) {
+    const int32_t id = static_cast<int32_t>(i + 1);
+    auto request = create_request(id,
+                                  /*num_prompt_tokens=*/8,
+                                  /*max_tokens=*/4,
+                                  Priority::NORMAL,
+                                  /*tenant=*/"",
+                                  lora_adapters[i]);
+    EXPECT_TRUE(scheduler.schedule(request));
+  }
+  scheduler.run_until_complete();
+  EXPECT_EQ(recorder.finish_steps().size(), lora_adapters.size());
+  EXPECT_EQ(recorder.max_loras_per_step(), 2);
+  // the requests behind an adapter that doesn't fit are not blocked by it
+  const auto& finish_steps = recorder.finish_steps();
+  EXPECT_LT(finish_steps.at(5), finish_steps.at(4));
 }
 
-TEST(DISABLED_SpeculativeSchedulerTest, Speculative3StepsFullyMatchTest) {
-  // who[1058] is[338] messi[4473] ?[29973]
-  const std::vector<int64_t> spec_token_ids = {1058, 338, 4473};
-  const std::vector<int64_t> valid_token_ids = {1058, 338, 4473, 1058};
-  const uint64_t spec_steps = 3;
-
-  TestableSpeculativeScheduler scheduler(
-      spec_token_ids, valid_token_ids, spec_steps);
-  RequestWrapper request_wrapper(scheduler.tokenizer());
-
-  std::vector<int> input_tokens = {1058};
-  // expect output tokens: [1058] + [1058, 338, 4473, 1058]
-  // expect output string: who who is messi who
-  const std::string expect_output("who who is messi who");
-  auto request = request_wrapper.create_request(input_tokens);
-  scheduler.schedule(request);
-  scheduler.step(absl::Seconds(1));
-  absl::SleepFor(absl::Seconds(2));
-  auto sequence_result = request_wrapper.sequence_output();
-
-  EXPECT_EQ(spec_steps, scheduler.get_ssm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_llm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_ssm_validate_calls());
-  EXPECT_EQ(1, scheduler.get_llm_validate_calls());
-
-  EXPECT_EQ(sequence_result.finish_reason, FinishReason::NONE);
-  EXPECT_EQ(sequence_result.output_text, expect_output);
+TEST(ContinuousSchedulerTest, FailedLoraAdapter) {
+  SimulatedEngine simulated_engine(engine_options());
+  FailedLoraEngine engine(&simulated_engine, "bad");
+  ContinuousScheduler::Options options;
+  options.max_tokens_per_batch(64).max_seqs_per_batch(8).max_loras(2);
+  ContinuousScheduler scheduler(&engine, options);
+  StatusRecorder recorder;
+
+  // only the requests of the failed adapter are aborted
+  const std::vector<std::string> lora_adapters = {"a", "bad", "", "bad"};
+  for (size_t i = 0; i < lora_adapters.size(); ++i) {
+    const int32_t id = static_cast<int32_t>(i + 1);
+    auto request = create_request(id,
+                                  /*num_prompt_tokens=*/8,
+                                  /*max_tokens=*/4,
+                                  Priority::NORMAL,
+                                  /*tenant=*/"",
+                                  lora_adapters[i]);
+    request->on_output = recorder.callback(id);
+    EXPECT_TRUE(scheduler.schedule(request));
+  }
+  scheduler.run_until_complete();
+  EXPECT_EQ(recorder.status(1), StatusCode::OK);
+  EXPECT_EQ(recorder.status(2), StatusCode::UNAVAILABLE);
+  EXPECT_EQ(recorder.status(3), StatusCode::OK);
+  EXPECT_EQ(recorder.status(4), StatusCode::UNAVAILABLE);
+  EXPECT_EQ(engine.block_manager()->num_blocks_in_use(), 0);
 }
 
-TEST(DISABLED_SpeculativeSchedulerTest, Speculative4StepsNoMatchTest) {
-  // who[1058] is[338] messi[4473] ?[29973]
-  const std::vector<int64_t> spec_token_ids = {1058, 338, 4473, 29973};
-  const std::vector<int64_t> valid_token_ids = {338, 4473, 29973, 1058, 338};
-  const uint64_t spec_steps = 4;
-
-  TestableSpeculativeScheduler scheduler(
-      spec_token_ids, valid_token_ids, spec_steps);
-  RequestWrapper request_wrapper(scheduler.tokenizer());
-
-  std::vector<int> input_tokens = {1058};
-  // expect output tokens: [1058] + [338]
-  // expect output string: who is
-  const std::string expect_output("who is");
-  auto request = request_wrapper.create_request(input_tokens);
-  scheduler.schedule(request);
-  scheduler.step(absl::Seconds(1));
-  absl::SleepFor(absl::Seconds(2));
-  auto sequence_result = request_wrapper.sequence_output();
-
-  EXPECT_EQ(spec_steps, scheduler.get_ssm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_llm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_ssm_validate_calls());
-  EXPECT_EQ(1, scheduler.get_llm_validate_calls());
-
-  EXPECT_EQ(sequence_result.finish_reason, FinishReason::NONE);
-  EXPECT_EQ(sequence_result.output_text, expect_output);
+TEST(ContinuousSchedulerTest, AdmissionControl) {
+  for (const bool enable_admission_control : {true, false}) {
+    SimulatedEngine engine(engine_options(absl::Milliseconds(10)));
+    ContinuousScheduler::Options options;
+    options.max_tokens_per_batch(64)
+        .max_seqs_per_batch(4)
+        .enable_admission_control(enable_admission_control);
+    ContinuousScheduler scheduler(&engine, options);
+    StatusRecorder recorder;
+
+    // warm up to estimate the throughput: at most ~6400 tokens per second
+    auto warmup = create_request(1, 64, 4);
+    warmup->on_output = recorder.callback(1);
+    EXPECT_TRUE(scheduler.schedule(warmup));
+    scheduler.run_until_complete();
+    EXPECT_EQ(recorder.status(1), StatusCode::OK);
+    const size_t num_warmup_steps = engine.num_steps();
+
+    // a long prompt that needs ~1 second to prefill
+    auto request = create_request(2, 6400, 1);
+    request->on_output = recorder.callback(2);
+    if (enable_admission_control) {
+      // rejected up front without running any step. it is rejected even if
+      // a slow run lets the deadline pass before the request is scheduled.
+      request->deadline = absl::Now() + absl::Milliseconds(100);
+      EXPECT_TRUE(scheduler.schedule(request));
+      scheduler.run_until_complete();
+      EXPECT_EQ(engine.num_steps(), num_warmup_steps);
+    } else {
+      // admitted and dropped only when the deadline passes, which is moved
+      // past after the first step since the scheduler runs on this thread
+      Request* request_ptr = request.get();
+      EXPECT_TRUE(scheduler.schedule(request));
+      scheduler.step(absl::Seconds(10));
+      request_ptr->deadline = absl::InfinitePast();
+      scheduler.run_until_complete();
+      EXPECT_GT(engine.num_steps(), num_warmup_steps);
+    }
+    EXPECT_EQ(recorder.status(2), StatusCode::DEADLINE_EXCEEDED);
+  }
 }
 
-TEST(DISABLED_SpeculativeSchedulerTest,
-     Speculative4StepsPartialMatchWithEndTest) {
-  // who[1058] is[338] messi[4473] ?[29973]
-  const std::vector<int64_t> spec_token_ids = {1058, 338, 4473, 29973};
-  const std::vector<int64_t> valid_token_ids = {1058, 338, 4473, 2};
-  const uint64_t spec_steps = 4;
-
-  TestableSpeculativeScheduler scheduler(
-      spec_token_ids, valid_token_ids, spec_steps);
-  RequestWrapper request_wrapper(scheduler.tokenizer());
-
-  std::vector<int> input_tokens = {1058};
-  // expect output tokens: [1058] + [1058, 338, 4473, 2]
-  // expect output string: who who is messi
-  const std::string expect_output("who who is messi");
-  auto request = request_wrapper.create_request(input_tokens);
-  scheduler.schedule(request);
-  scheduler.step(absl::Seconds(1));
-  absl::SleepFor(absl::Seconds(2));
-  auto sequence_result = request_wrapper.sequence_output();
-
-  EXPECT_EQ(spec_steps, scheduler.get_ssm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_llm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_ssm_validate_calls());
-  EXPECT_EQ(1, scheduler.get_llm_validate_calls());
-
-  EXPECT_EQ(sequence_result.output_text, expect_output);
-  EXPECT_EQ(sequence_result.finish_reason, FinishReason::STOP);
+TEST(ContinuousSchedulerTest, IdleWakeupLatency) {
+  SimulatedEngine engine(engine_options());
+  StepRecorder recorder(&engine);
+  ContinuousScheduler scheduler(&engine, ContinuousScheduler::Options());
+
+  for (int32_t i = 0; i < 10; ++i) {
+    // the scheduler loop blocks on an idle engine
+    std::thread loop([&scheduler]() { scheduler.step(absl::Seconds(10)); });
+    absl::SleepFor(absl::Milliseconds(20));
+
+    const int32_t id = i + 1;
+    auto request = create_request(id, 8, /*max_tokens=*/1);
+    const auto schedule_time = absl::Now();
+    EXPECT_TRUE(scheduler.schedule(request));
+    loop.join();
+    // the new request wakes up the loop instead of the step timeout, see
+    // BM_idle_wakeup in scheduler_benchmark for the latency
+    EXPECT_EQ(recorder.finish_steps().count(id), 1);
+    EXPECT_LT(recorder.last_step_time() - schedule_time, absl::Seconds(5));
+  }
 }
 
-TEST(DISABLED_SpeculativeSchedulerTest, Speculative15StepsPartialMatchTest) {
-  // who[1058] is[338] messi[4473] ?[29973]
-  const std::vector<int64_t> spec_token_ids = {1058,
-                                               338,
-                                               4473,
-                                               1058,
-                                               338,
-                                               4473,
-                                               1058,
-                                               338,
-                                               4473,
-                                               1058,
-                                               338,
-                                               4473,
-                                               1058,
-                                               338,
-                                               4473};
-  const std::vector<int64_t> valid_token_ids = {
-      1058, 338, 4473, 1058, 338, 4473, 2};
-  const uint64_t spec_steps = 15;
-
-  TestableSpeculativeScheduler scheduler(
-      spec_token_ids, valid_token_ids, spec_steps);
-  RequestWrapper request_wrapper(scheduler.tokenizer());
-
-  std::vector<int> input_tokens = {1058};
-  // expect output tokens: [1058] +
-  //   [1058, 338, 4473, 1058, 338, 4473, 2]
-  // expect output string: who who is messi who is messi
-  const std::string expect_output("who who is messi who is messi");
-  auto request = request_wrapper.create_request(input_tokens);
-  scheduler.schedule(request);
-  scheduler.step(absl::Seconds(1));
-  absl::SleepFor(absl::Seconds(2));
-  auto sequence_result = request_wrapper.sequence_output();
-
-  EXPECT_EQ(spec_steps, scheduler.get_ssm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_llm_execute_model_calls());
-  EXPECT_EQ(0, scheduler.get_ssm_validate_calls());
-  EXPECT_EQ(1, scheduler.get_llm_validate_calls());
-
-  EXPECT_EQ(sequence_result.output_text, expect_output);
-  EXPECT_EQ(sequence_result.finish_reason, FinishReason::STOP);
+TEST(SimulatedEngineTest, LatencyModel) {
+  SimulatedEngine::Options simulated_options;
+  simulated_options.num_blocks(1024)
+      .block_size(16)
+      .step_latency(absl::Milliseconds(1))
+      .prefill_token_latency(absl::Microseconds(10))
+      .decode_token_latency(absl::Microseconds(100))
+      .context_token_latency(absl::Microseconds(1));
+  SimulatedEngine engine(simulated_options);
+  ContinuousScheduler::Options options;
+  options.max_tokens_per_batch(64).max_seqs_per_batch(4);
+  ContinuousScheduler scheduler(&engine, options);
+
+  auto request = create_request(1, /*num_prompt_tokens=*/64, /*max_tokens=*/3);
+  EXPECT_TRUE(scheduler.schedule(request));
+  scheduler.run_until_complete();
+
+  // one prefill step generating the first token, then two decode steps
+  EXPECT_EQ(engine.num_steps(), 3);
+  EXPECT_EQ(engine.num_prefill_tokens(), 64);
+  EXPECT_EQ(engine.num_decode_tokens(), 2);
+  EXPECT_EQ(engine.num_generated_tokens(), 3);
+  // the decode steps attend to 65 and 66 tokens
+  const auto expected = absl::Milliseconds(3) + absl::Microseconds(64 * 10) +
+                        absl::Microseconds(2 * 100) +
+                        absl::Microseconds(64 + 65 + 66);
+  EXPECT_EQ(engine.simulated_time(), expected);
+  EXPECT_EQ(engine.block_manager()->num_blocks_in_use(), 0);
 }
+
 }  // namespace llm
@@ -0,0 +1,59 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <filesystem>
+#include <string>
+
+#include "engine/llm_engine.h"
+#include "engine/utils.h"
+
+using namespace llm;
+
+// Loads a huggingface checkpoint once and writes the final in-memory layout of
+// each rank into the weights cache, so that servers started with the same
+// --weights_cache_dir, devices, dtype and linear flags restore it directly.
+
+DEFINE_string(model_path, "", "hf model path to the model file.");
+
+DEFINE_string(device,
+              "auto",
+              "Device to run the model on, e.g. cpu, cuda:0, cuda:0,cuda:1, or "
+              "auto to use all available gpus.");
+
+DEFINE_string(cpu_dtype,
+              "float32",
+              "dtype for weights and activations on cpu: float32 or bfloat16");
+
+DEFINE_string(weights_cache_dir, "", "directory to write the weights cache.");
+
+DEFINE_int64(max_prefetch_files,
+             2,
+             "maximum number of model weights files to load ahead of workers");
+
+int main(int argc, char* argv[]) {
+  // initialize glog and gflags
+  google::InitGoogleLogging(argv[0]);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  CHECK(!FLAGS_model_path.empty()) << "model_path is empty.";
+  CHECK(std::filesystem::exists(FLAGS_model_path))
+      << "model path " << FLAGS_model_path << " does not exist.";
+  CHECK(!FLAGS_weights_cache_dir.empty()) << "weights_cache_dir is empty.";
+
+  const auto devices = parse_devices(FLAGS_device);
+  LOG(INFO) << "Using devices: " << to_string(devices);
+
+  LLMEngine::Options options;
+  options.devices(devices)
+      .cpu_dtype(FLAGS_cpu_dtype)
+      .max_prefetch_files(FLAGS_max_prefetch_files)
+      .weights_cache_dir(FLAGS_weights_cache_dir);
+
+  // loading the model writes the cache if it doesn't exist yet
+  LLMEngine engine(options);
+  CHECK(engine.init_model(FLAGS_model_path))
+      << "Failed to load model from " << FLAGS_model_path;
+  LOG(INFO) << "Weights cache for " << FLAGS_model_path << " is ready in "
+            << FLAGS_weights_cache_dir;
+  return 0;
+}
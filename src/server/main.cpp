@@ -12,12 +12,14 @@
 #include <optional>
 
 #include "common/metrics.h"
+#include "common/tracer.h"
 #include "grpc_server.h"
 #include "handlers/chat_handler.h"
 #include "handlers/completion_handler.h"
 #include "handlers/llm_handler.h"
 #include "handlers/models_handler.h"
 #include "http_server.h"
+#include "scheduler/scheduler_policy.h"
 using namespace llm;
 
 DEFINE_int32(http_port, 9999, "Port for http server.");
@@ -54,6 +56,10 @@ DEFINE_bool(enable_prefix_cache,
             true,
             "enable the prefix cache for the block manager");
 
+DEFINE_string(prefix_cache_eviction_policy,
+              "lru",
+              "eviction policy of the prefix cache, one of: lru, lfu, gdsf");
+
 DEFINE_bool(enable_cuda_graph,
             true,
             "Enable CUDA Graph to optimize model execution.");
@@ -77,12 +83,101 @@ DEFINE_int32(max_seqs_per_batch, 128, "max number of sequences per batch");
 
 DEFINE_int32(num_speculative_tokens, 0, "number of speculative tokens");
 
+DEFINE_int32(num_decode_steps,
+             1,
+             "number of decode iterations per step when no request is "
+             "waiting, not used with speculative decoding");
+
+DEFINE_string(scheduler_policy,
+              "fcfs",
+              "policy to order waiting requests, an unknown policy lists "
+              "the supported ones");
+
+DEFINE_double(priority_aging_interval,
+              5,
+              "priority_aging policy: waiting time in seconds to promote a "
+              "request by one priority level");
+
+DEFINE_double(fair_share_half_life,
+              60,
+              "fair_share policy: half life in seconds of the per-tenant "
+              "usage");
+
+DEFINE_double(cache_aware_max_wait,
+              2,
+              "cache_aware policy: waiting time in seconds after which a "
+              "request is no longer reordered by its cost");
+
+DEFINE_double(max_queue_time,
+              0,
+              "max time in seconds a request can wait in the queue before "
+              "being scheduled, 0 means no limit");
+
+DEFINE_bool(enable_admission_control,
+            true,
+            "reject requests up front if they are predicted to miss their "
+            "deadline");
+
+DEFINE_bool(enable_overlap_scheduling,
+            false,
+            "plan the next step while the current step is running on the "
+            "device");
+
+DEFINE_string(cpu_dtype,
+              "float32",
+              "dtype for weights and activations on cpu: float32 or bfloat16");
+
+DEFINE_int64(max_prefetch_files,
+             2,
+             "maximum number of model weights files to load ahead of workers");
+
+DEFINE_string(weights_cache_dir,
+              "",
+              "directory to cache the loaded weights for fast restarts, empty "
+              "to disable the cache");
+
+DEFINE_string(lora_modules,
+              "",
+              "lora adapters to serve as models, comma separated list of "
+              "name=path, e.g. sql=/path/to/sql_lora,chat=/path/to/chat_lora");
+
+DEFINE_int64(max_loras,
+             4,
+             "maximum number of lora adapters per batch, which are kept on "
+             "the device");
+
+DEFINE_int64(max_lora_rank, 16, "maximum rank of the lora adapters");
+
+DEFINE_string(prefix_cache_snapshot_dir,
+              "",
+              "directory to save the prefix cache on shutdown and restore it "
+              "on startup, empty to disable the snapshot");
+
+DEFINE_int64(prefix_cache_snapshot_interval,
+             0,
+             "interval in seconds to save the prefix cache snapshot while "
+             "serving, 0 to only save it on shutdown");
+
+DEFINE_double(prefix_cache_summary_interval,
+              0,
+              "interval in seconds to refresh the summary of the resident "
+              "prefixes served at /prefix_cache/summary for the gateway to "
+              "route requests, 0 to disable the summary");
+
+DEFINE_int64(trace_buffer_size,
+             0,
+             "number of the latest spans of the inference loop to keep for "
+             "the chrome trace served at /trace, 0 to disable tracing");
+
 // NOLINTNEXTLINE
 static std::atomic<uint32_t> signal_received{0};
 void shutdown_handler(int signal) {
-  // TODO: gracefully shutdown the server
+  // stop the servers and the handler in main, exit on the second signal
+  if (signal_received.fetch_add(1, std::memory_order_relaxed) > 0) {
+    LOG(WARNING) << "Received signal " << signal << " again, exiting...";
+    exit(1);
+  }
   LOG(WARNING) << "Received signal " << signal << ", stopping server...";
-  exit(1);
 }
 
 std::optional<std::vector<uint32_t>> parse_batch_sizes(
@@ -110,6 +205,23 @@ std::optional<std::vector<uint32_t>> parse_batch_sizes(
   return std::vector<uint32_t>{sizes_set.begin(), sizes_set.end()};
 }
 
+LoraAdapterPaths parse_lora_modules(const std::string& lora_modules_str) {
+  LoraAdapterPaths lora_adapters;
+  if (lora_modules_str.empty()) {
+    return lora_adapters;
+  }
+  const std::vector<std::string> modules =
+      absl::StrSplit(lora_modules_str, ',');
+  for (const auto& module : modules) {
+    const std::vector<std::string> parts = absl::StrSplit(module, '=');
+    if (parts.size() != 2 || parts[0].empty() || parts[1].empty()) {
+      LOG(FATAL) << "Invalid lora module: " << module << ", expected name=path";
+    }
+    lora_adapters[parts[0]] = parts[1];
+  }
+  return lora_adapters;
+}
+
 int main(int argc, char** argv) {
   // glog and glfag will be initialized in folly::init
   folly::Init init(&argc, &argv);
@@ -120,6 +232,18 @@ int main(int argc, char** argv) {
     LOG(FATAL) << "Model path " << FLAGS_model_path << " does not exist.";
   }
 
+  if (!SchedulerPolicy::is_supported(FLAGS_scheduler_policy)) {
+    LOG(ERROR) << "Invalid --scheduler_policy: " << FLAGS_scheduler_policy
+               << ", expected one of: " << SchedulerPolicy::joined_names();
+    return -1;
+  }
+  if (FLAGS_priority_aging_interval <= 0 || FLAGS_fair_share_half_life <= 0 ||
+      FLAGS_cache_aware_max_wait < 0) {
+    LOG(ERROR) << "--priority_aging_interval and --fair_share_half_life must "
+                  "be positive, --cache_aware_max_wait must be non-negative";
+    return -1;
+  }
+
   if (FLAGS_model_id.empty()) {
     // use last part of the path as model id
     FLAGS_model_id = std::filesystem::path(FLAGS_model_path).filename();
@@ -152,6 +276,20 @@ int main(int argc, char** argv) {
                              return transport.send_string("OK\n");
                            });
 
+  // the latest steps of the inference loop in chrome trace format, to be
+  // loaded into chrome://tracing or perfetto
+  if (FLAGS_trace_buffer_size > 0) {
+    Tracer::Instance().enable(FLAGS_trace_buffer_size);
+  }
+  http_server.register_uri(
+      "/trace", [](HttpServer::Transport& transport) -> bool {
+        if (!Tracer::Instance().enabled()) {
+          return transport.send_status(404);
+        }
+        return transport.send_string(Tracer::Instance().to_chrome_trace(),
+                                     "application/json");
+      });
+
   // Create LLMHandler
   LLMHandler::Options options;
   options.model_path(FLAGS_model_path)
@@ -162,6 +300,7 @@ int main(int argc, char** argv) {
       .max_cache_size(FLAGS_max_cache_size)
       .max_memory_utilization(FLAGS_max_memory_utilization)
       .enable_prefix_cache(FLAGS_enable_prefix_cache)
+      .prefix_cache_eviction_policy(FLAGS_prefix_cache_eviction_policy)
       .enable_cuda_graph(FLAGS_enable_cuda_graph)
       .cuda_graph_max_seq_len(FLAGS_cuda_graph_max_seq_len)
       .cuda_graph_batch_sizes(parse_batch_sizes(FLAGS_cuda_graph_batch_sizes))
@@ -169,13 +308,44 @@ int main(int argc, char** argv) {
           parse_batch_sizes(FLAGS_draft_cuda_graph_batch_sizes))
       .max_tokens_per_batch(FLAGS_max_tokens_per_batch)
       .max_seqs_per_batch(FLAGS_max_seqs_per_batch)
-      .num_speculative_tokens(FLAGS_num_speculative_tokens);
+      .num_speculative_tokens(FLAGS_num_speculative_tokens)
+      .num_decode_steps(FLAGS_num_decode_steps)
+      .scheduler_policy(FLAGS_scheduler_policy)
+      .priority_aging_interval(FLAGS_priority_aging_interval)
+      .fair_share_half_life(FLAGS_fair_share_half_life)
+      .cache_aware_max_wait(FLAGS_cache_aware_max_wait)
+      .max_queue_time(FLAGS_max_queue_time)
+      .enable_admission_control(FLAGS_enable_admission_control)
+      .enable_overlap_scheduling(FLAGS_enable_overlap_scheduling)
+      .cpu_dtype(FLAGS_cpu_dtype)
+      .max_prefetch_files(FLAGS_max_prefetch_files)
+      .weights_cache_dir(FLAGS_weights_cache_dir)
+      .lora_adapters(parse_lora_modules(FLAGS_lora_modules))
+      .max_loras(FLAGS_max_loras)
+      .max_lora_rank(FLAGS_max_lora_rank)
+      .prefix_cache_snapshot_dir(FLAGS_prefix_cache_snapshot_dir)
+      .prefix_cache_snapshot_interval(FLAGS_prefix_cache_snapshot_interval)
+      .prefix_cache_summary_interval(FLAGS_prefix_cache_summary_interval);
 
   auto llm_handler = std::make_unique<LLMHandler>(options);
   llm_handler->start();
 
+  // the http server is stopped before the handler is released
+  http_server.register_uri(
+      "/prefix_cache/summary",
+      [handler = llm_handler.get()](HttpServer::Transport& transport) -> bool {
+        const auto summary = handler->prefix_cache_summary();
+        if (!summary.has_value()) {
+          return transport.send_status(404);
+        }
+        return transport.send_string(summary.value(), "application/json");
+      });
+
   // supported models
   std::vector<std::string> models = {FLAGS_model_id};
+  for (const auto& [name, path] : options.lora_adapters()) {
+    models.push_back(name);
+  }
   auto completion_handler =
       std::make_unique<CompletionHandler>(llm_handler.get(), models);
   auto chat_handler = std::make_unique<ChatHandler>(llm_handler.get(), models);
@@ -210,6 +380,7 @@ int main(int argc, char** argv) {
   // stop grpc server and http server
   grpc_server.stop();
   http_server.stop();
-  llm_handler->stop();
+  // saves the prefix cache snapshot if enabled
+  llm_handler.reset();
   return 0;
 }
@@ -36,8 +36,12 @@ SpeculativeEngine::SpeculativeEngine(const Options& options)
       .max_cache_size(options.max_cache_size())
       .max_memory_utilization(options.max_memory_utilization())
       .enable_prefix_cache(options.enable_prefix_cache())
+      .prefix_cache_eviction_policy(options.prefix_cache_eviction_policy())
       .enable_cuda_graph(options.enable_cuda_graph())
-      .cuda_graph_max_seq_len(options.cuda_graph_max_seq_len());
+      .cuda_graph_max_seq_len(options.cuda_graph_max_seq_len())
+      .cpu_dtype(options.cpu_dtype())
+      .max_prefetch_files(options.max_prefetch_files())
+      .weights_cache_dir(options.weights_cache_dir());
 
   // target engine
   engine_options.devices(options.devices())
@@ -30,6 +30,9 @@ class SpeculativeEngine : public Engine {
     // enable prefix cache
     DEFINE_ARG(bool, enable_prefix_cache) = true;
 
+    // the eviction policy of the prefix cache: lru, lfu or gdsf
+    DEFINE_ARG(std::string, prefix_cache_eviction_policy) = "lru";
+
     // the number of speculative tokens per step
     DEFINE_ARG(int32_t, num_speculative_tokens) = 0;
 
@@ -45,6 +48,16 @@ class SpeculativeEngine : public Engine {
     // batch sizes to capture cuda graphs for draft model
     DEFINE_ARG(std::optional<std::vector<uint32_t>>,
                draft_cuda_graph_batch_sizes);
+
+    // dtype for weights and activations on cpu: float32 or bfloat16
+    DEFINE_ARG(std::string, cpu_dtype) = "float32";
+
+    // the maximum number of model weights files to load ahead of the workers
+    DEFINE_ARG(int64_t, max_prefetch_files) = 2;
+
+    // directory to cache the loaded weights for fast restarts, empty to
+    // disable the cache
+    DEFINE_ARG(std::string, weights_cache_dir);
   };
 
   // create an engine with the given devices
@@ -59,6 +72,11 @@ class SpeculativeEngine : public Engine {
   // N.B. the model output is the output of the target model.
   ModelOutput execute_model(Batch& batch) override;
 
+  void on_step_boundary() override {
+    engine_->on_step_boundary();
+    draft_engine_->on_step_boundary();
+  }
+
   const Tokenizer* tokenizer() const override { return engine_->tokenizer(); }
 
   BlockManager* block_manager() const override {